@@ -36,6 +36,7 @@ add_subdirectory(udpDevice)
 add_subdirectory(MetadataSample)
 add_subdirectory(MetadataXML)
 add_subdirectory(XmlGeometryCacheDesc)
+add_subdirectory(binaryGeometryCache)
 
 # The list from SuperConductor, used in standalone devkit
 if (NOT INSIDE_MAYA)
@@ -0,0 +1,195 @@
+#include "associationsSerializerBinary.h"
+#include "channelSerializerBinary.h"
+#include "metadataXML.h"
+#include "metadataXMLPluginStrings.h"
+#include <sstream>
+#include <string>
+#include <maya/MString.h>
+#include <maya/MStringResource.h>
+#include <maya/adskDataAssociations.h>
+#include <maya/adskDataChannel.h>
+#include <maya/adskDataAssociationsSerializer.h>
+#include <maya/adskDataChannelSerializer.h>
+
+using namespace adsk;
+using namespace adsk::Data;
+using namespace adsk::Data::Binary;
+
+ImplementSerializerFormat(AssociationsSerializerBinary,AssociationsSerializer,binaryFormatType);
+
+//----------------------------------------------------------------------
+//
+//! \brief Default constructor, does nothing
+//
+AssociationsSerializerBinary::AssociationsSerializerBinary()
+{
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Default destructor, does nothing
+//
+AssociationsSerializerBinary::~AssociationsSerializerBinary	()
+{
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Create Associations based on the binary data in the input stream.
+//
+//! \param[in] cSrc Stream containing the binary format data to be read
+//! \param[out] errors Description of problems found when reading the data
+//
+//! \return The created Associations, NULL if there was an error creating it
+//
+adsk::Data::Associations*
+AssociationsSerializerBinary::read(
+	std::istream&	cSrc,
+	std::string&	errors )	const
+{
+	unsigned int errorCount = 0;
+	errors = "";
+
+	std::string contents;
+	if( ! Util::slurp( cSrc, contents ) )
+	{
+		REPORT_ERROR_AT_LINE(kBinaryTruncated, 0.0);
+		return NULL;
+	}
+
+	Reader reader( contents.data(), contents.size() );
+	return parse( reader, errorCount, errors );
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Create Associations from the binary data at the reader position
+//
+//! \param[in] reader Binary data, left after the Associations when successful
+//! \param[out] errorCount Number of errors found in parsing
+//! \param[out] errors Description of problems found when parsing the data
+//
+//! \return The created Associations, NULL if there were errors
+//
+adsk::Data::Associations*
+AssociationsSerializerBinary::parse(
+	Reader&			reader,
+	unsigned int&	errorCount,
+	std::string&	errors )	const
+{
+	// Get the Channel serializer to handle the Channel sections.
+	// If it can't be found then no data can be created.
+	const ChannelSerializerBinary* binaryChannelSerializer = dynamic_cast<const ChannelSerializerBinary*>( adsk::Data::ChannelSerializer::formatByName( binaryFormatType ) );
+	if( ! binaryChannelSerializer )
+	{
+		REPORT_ERROR(kAssociationsBinaryChannelSerializerMissing);
+		return NULL;
+	}
+
+	size_t start = reader.offset();
+	uint32_t channelCount = 0;
+	if( ! reader.readTag( binaryTagAssociations ) )
+	{
+		REPORT_ERROR_AT_LINE1(kBinaryHeaderInvalid, MString(binaryTagAssociations), (double)start);
+		return NULL;
+	}
+	if( ! reader.readUInt32( channelCount ) )
+	{
+		REPORT_ERROR_AT_LINE(kBinaryTruncated, (double)reader.offset());
+		return NULL;
+	}
+
+	adsk::Data::Associations* newAssociations = adsk::Data::Associations::create();
+	for( uint32_t c=0; (c<channelCount) && (errorCount == 0); ++c )
+	{
+		adsk::Data::Channel* newChannel =
+			binaryChannelSerializer->parse( reader, errorCount, errors );
+
+		if( newChannel && (errorCount == 0) )
+		{
+			newAssociations->setChannel( *newChannel );
+		}
+
+		// The parser allocated this object but it's no longer needed so
+		// release it.
+		delete newChannel;
+	}
+
+	// If there were errors any Associations created will be incorrect so pass
+	// back nothing rather than bad data.
+	if( errorCount > 0 )
+	{
+		delete newAssociations;
+		newAssociations = NULL;
+	}
+
+	return newAssociations;
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Output the Associations object in binary format into the stream
+//
+//! \param[in] dataToWrite Associations to be formatted
+//! \param[out] cDst Stream to which the binary format of the Associations is written
+//! \param[out] errors Description of problems found when writing the Associations
+//
+//! \return number of errors found during write, 0 means success
+//
+int
+AssociationsSerializerBinary::write(
+	const adsk::Data::Associations&	dataToWrite,
+	std::ostream&					cDst,
+	std::string&					errors )	const
+{
+	unsigned int errorCount = 0;
+	// Get the Channel serializer to handle the Channel sections.
+	// If it can't be found then no data can be created.
+	const ChannelSerializerBinary* binaryChannelSerializer = dynamic_cast<const ChannelSerializerBinary*>( adsk::Data::ChannelSerializer::formatByName( binaryFormatType ) );
+	if( ! binaryChannelSerializer )
+	{
+		REPORT_ERROR_AT_LINE(kAssociationsBinaryChannelSerializerMissing, 0.0);
+		return 1;
+	}
+
+	Writer header;
+	header.writeTag( binaryTagAssociations );
+	header.writeUInt32( dataToWrite.channelCount() );
+	cDst.write( header.buffer().data(), header.buffer().size() );
+
+	// Write out the Associations/Channel data
+	for( unsigned int s=0; s<dataToWrite.channelCount(); ++s )
+	{
+		const adsk::Data::Channel theChannel = dataToWrite.channelAt( s );
+		errorCount += binaryChannelSerializer->write( theChannel, cDst, errors );
+	}
+
+	return errorCount;
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Get a description of the binary Associations format
+//
+//! \param[out] info Stream to which the binary format description is output
+//
+void
+AssociationsSerializerBinary::getFormatDescription(
+	std::ostream&	info ) const
+{
+	MStatus status;
+	MString description = MStringResource::getString(kBinaryInfo, status);
+	info << description.asChar();
+}
+
+//-
+// ==================================================================
+// Copyright 2015 Autodesk, Inc.  All rights reserved.
+// 
+// This computer source code  and related  instructions and comments are
+// the unpublished confidential and proprietary information of Autodesk,
+// Inc. and are  protected  under applicable  copyright and trade secret
+// law. They may not  be disclosed to, copied or used by any third party
+// without the prior written consent of Autodesk, Inc.
+// ==================================================================
+//+
@@ -0,0 +1,63 @@
+#ifndef associationsSerializerBinary_h
+#define associationsSerializerBinary_h
+
+#include <maya/adskDataAssociationsSerializer.h>	// for base class
+#include <maya/adskCommon.h>
+#include "metadataBinary.h"
+
+namespace adsk {
+  namespace Data {
+	class Associations;
+  }
+}
+
+// ****************************************************************************
+/*!
+	\class adsk::Data::Plugin::AssociationsSerializerBinary
+ 	\brief Class handling the data Associations format type "binary"
+
+	Binary counterpart of the XML Associations format. This is the format
+	selected when a scene stores its metadata as "binary".
+
+		  "MDBA" VERSION
+		  CHANNEL_COUNT
+		  CHANNEL...   <!-- Parsed by ChannelSerializerBinary -->
+*/
+using namespace adsk::Data;
+class AssociationsSerializerBinary : public AssociationsSerializer
+{
+	DeclareSerializerFormat(AssociationsSerializerBinary, AssociationsSerializer);
+public:
+	~AssociationsSerializerBinary() override;
+
+	// Mandatory implementation overrides
+	adsk::Data::Associations*
+						read		(std::istream&		 cSrc,
+									 std::string&		 errors)	const override;
+	int			write		(const Associations& dataToWrite,
+									 std::ostream&		 cDst,
+									 std::string&		 errors)	const override;
+	void		getFormatDescription(std::ostream& info)	const override;
+
+	// Partial interface to allow passing off parsing of a subsection of
+	// the binary data to the Associations subsection
+	adsk::Data::Associations* parse	(adsk::Data::Binary::Reader&	reader,
+									 unsigned int&	errorCount,
+									 std::string&	errors )	const;
+
+private:
+	AssociationsSerializerBinary();		//! Use theFormat() to create.
+};
+
+//-
+// ==================================================================
+// Copyright 2015 Autodesk, Inc.  All rights reserved.
+// 
+// This computer source code  and related  instructions and comments are
+// the unpublished confidential and proprietary information of Autodesk,
+// Inc. and are  protected  under applicable  copyright and trade secret
+// law. They may not  be disclosed to, copied or used by any third party
+// without the prior written consent of Autodesk, Inc.
+// ==================================================================
+//+
+#endif // associationsSerializerBinary_h
@@ -0,0 +1,229 @@
+#include "channelSerializerBinary.h"
+#include "streamSerializerBinary.h"
+#include "metadataXML.h"
+#include "metadataXMLPluginStrings.h"
+#include <sstream>
+#include <string>
+#include <maya/MString.h>
+#include <maya/MStringResource.h>
+#include <maya/adskDataChannel.h>
+#include <maya/adskDataChannelSerializer.h>
+#include <maya/adskDataStream.h>
+#include <maya/adskDataStreamSerializer.h>
+
+using namespace adsk;
+using namespace adsk::Data;
+using namespace adsk::Data::Binary;
+
+ImplementSerializerFormat(ChannelSerializerBinary,ChannelSerializer,binaryFormatType);
+
+//----------------------------------------------------------------------
+//
+//! \brief Default constructor, does nothing
+//
+ChannelSerializerBinary::ChannelSerializerBinary()
+{
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Default destructor, does nothing
+//
+ChannelSerializerBinary::~ChannelSerializerBinary	()
+{
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Create a Channel based on the binary data in the input stream.
+//
+//	This is not normally called directly as a Channel cannot float freely
+//	without an Associations parent defining how it is attached to an object.
+//	The Associations reader will call the parse() method below on its data.
+//
+//! \param[in] cSrc Stream containing the binary format data to be read
+//! \param[out] errors Description of problems found when reading the data
+//
+//! \return The created Channel, NULL if there was an error creating it
+//
+adsk::Data::Channel*
+ChannelSerializerBinary::read(
+	std::istream&	cSrc,
+	std::string&	errors )	const
+{
+	unsigned int errorCount = 0;
+	errors = "";
+
+	std::string contents;
+	if( ! Util::slurp( cSrc, contents ) )
+	{
+		REPORT_ERROR_AT_LINE(kBinaryTruncated, 0.0);
+		return NULL;
+	}
+
+	Reader reader( contents.data(), contents.size() );
+	adsk::Data::Channel* newChannel = parse( reader, errorCount, errors );
+
+	// If there were errors any Channel created will be incorrect so pass
+	// back nothing rather than bad data.
+	if( errorCount > 0 )
+	{
+		delete newChannel;
+		newChannel = NULL;
+	}
+	return newChannel;
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Create a Channel from the binary data at the reader position
+//
+//! \param[in] reader Binary data, left after the Channel when successful
+//! \param[out] errorCount Number of errors found in parsing
+//! \param[out] errors Description of problems found when parsing the data
+//
+//! \return The created Channel, NULL if there were errors
+//
+adsk::Data::Channel*
+ChannelSerializerBinary::parse(
+	Reader&			reader,
+	unsigned int&	errorCount,
+	std::string&	errors )	const
+{
+	// Get the Stream serializer to handle the Stream sections.
+	// If it can't be found then no data can be created.
+	const StreamSerializerBinary* binaryStreamSerializer = dynamic_cast<const StreamSerializerBinary*>( adsk::Data::StreamSerializer::formatByName( binaryFormatType ) );
+	if( ! binaryStreamSerializer )
+	{
+		REPORT_ERROR_AT_LINE(kChannelBinaryStreamSerializerMissing, (double)reader.offset());
+		return NULL;
+	}
+
+	size_t start = reader.offset();
+	if( ! reader.readTag( binaryTagChannel ) )
+	{
+		REPORT_ERROR_AT_LINE1(kBinaryHeaderInvalid, MString(binaryTagChannel), (double)start);
+		return NULL;
+	}
+
+	std::string channelName;
+	uint32_t streamCount = 0;
+	if( ! reader.readString( channelName )
+	||  ! reader.readUInt32( streamCount ) )
+	{
+		REPORT_ERROR_AT_LINE(kBinaryTruncated, (double)reader.offset());
+		return NULL;
+	}
+
+	adsk::Data::Channel newChannel( channelName );
+	for( uint32_t s=0; (s<streamCount) && (errorCount == 0); ++s )
+	{
+		adsk::Data::Stream* newStream =
+			binaryStreamSerializer->parse( reader, errorCount, errors );
+
+		if( newStream && (errorCount == 0) )
+		{
+			newChannel.setDataStream( *newStream );
+		}
+
+		// The parser allocated this object but the Channel keeps its own
+		// reference to the data so release it.
+		delete newStream;
+	}
+
+	// If there were errors any Stream created will be incorrect so pass
+	// back nothing rather than bad data.
+	if( errorCount > 0 )
+	{
+		return NULL;
+	}
+	return new adsk::Data::Channel( newChannel );
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Output the Channel object in binary format into the stream
+//
+//! \param[in] dataToWrite Channel to be formatted
+//! \param[out] cDst stream to which the binary format of the Channel is written
+//! \param[out] errors Description of problems found when writing the Channel
+//
+//! \return number of errors found during write, 0 means success
+//
+int
+ChannelSerializerBinary::write(
+	const adsk::Data::Channel&	dataToWrite,
+	std::ostream&				cDst,
+	std::string&				errors )	const
+{
+	unsigned int errorCount = 0;
+	// Get the Stream serializer to handle the Stream sections.
+	// If it can't be found then no data can be created.
+	const StreamSerializerBinary* binaryStreamSerializer = dynamic_cast<const StreamSerializerBinary*>( adsk::Data::StreamSerializer::formatByName( binaryFormatType ) );
+	if( ! binaryStreamSerializer )
+	{
+		REPORT_ERROR_AT_LINE(kChannelBinaryStreamSerializerMissing, 0.0);
+		return 1;
+	}
+
+	// Empty Streams are skipped so count the real ones first
+	uint32_t streamCount = 0;
+	for( unsigned int s=0; s<dataToWrite.dataStreamCount(); ++s )
+	{
+		if( dataToWrite.dataStream( s ) ) ++streamCount;
+	}
+
+	Writer header;
+	header.writeTag( binaryTagChannel );
+	header.writeString( dataToWrite.name() );
+	header.writeUInt32( streamCount );
+	cDst.write( header.buffer().data(), header.buffer().size() );
+
+	// Write out the Stream data
+	for( unsigned int s=0; s<dataToWrite.dataStreamCount(); ++s )
+	{
+		const adsk::Data::Stream* theStream = dataToWrite.dataStream( s );
+		if( ! theStream ) continue;
+
+		std::string streamErrors;
+		int streamErrorCount = binaryStreamSerializer->write( *theStream, cDst, streamErrors );
+		if( streamErrorCount > 0 )
+		{
+			if( errorCount > 0 ) errors += '\n';
+			errors += streamErrors;
+			errorCount += streamErrorCount;
+		}
+	}
+
+	return errorCount;
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Get a description of the binary Channel format
+//
+//	This actually describes the entire binary metadata format, only a
+//	subset of which is the Channel data.
+//
+//! \param[out] info stream to which the binary format description is output
+//
+void
+ChannelSerializerBinary::getFormatDescription(
+	std::ostream&	info ) const
+{
+	MStatus status;
+	MString description = MStringResource::getString(kBinaryInfo, status);
+	info << description.asChar();
+}
+
+//-
+// ==================================================================
+// Copyright 2015 Autodesk, Inc.  All rights reserved.
+// 
+// This computer source code  and related  instructions and comments are
+// the unpublished confidential and proprietary information of Autodesk,
+// Inc. and are  protected  under applicable  copyright and trade secret
+// law. They may not  be disclosed to, copied or used by any third party
+// without the prior written consent of Autodesk, Inc.
+// ==================================================================
+//+
@@ -0,0 +1,64 @@
+#ifndef channelSerializerBinary_h
+#define channelSerializerBinary_h
+
+#include <maya/adskDataChannelSerializer.h>	// for base class
+#include <maya/adskCommon.h>
+#include "metadataBinary.h"
+
+namespace adsk {
+  namespace Data {
+	class Channel;
+  }
+}
+
+// ****************************************************************************
+/*!
+	\class adsk::Data::Plugin::ChannelSerializerBinary
+ 	\brief Class handling the data Channel format type "binary"
+
+	Binary counterpart of the XML Channel format, see StreamSerializerBinary
+	for the layout of the Streams it contains.
+
+		  "MDBC" VERSION
+		  CHANNEL_NAME
+		  STREAM_COUNT
+		  STREAM...   <!-- Parsed by StreamSerializerBinary -->
+*/
+using namespace adsk::Data;
+class ChannelSerializerBinary : public ChannelSerializer
+{
+	DeclareSerializerFormat(ChannelSerializerBinary, ChannelSerializer);
+public:
+	~ChannelSerializerBinary() override;
+
+	// Mandatory implementation overrides
+	adsk::Data::Channel*
+						read		(std::istream&		cSrc,
+									 std::string&		errors)		const override;
+	int			write		(const adsk::Data::Channel&	dataToWrite,
+									 std::ostream&		cDst,
+									 std::string&		errors)		const override;
+	void		getFormatDescription(std::ostream& info)	const override;
+
+	// Partial interface to allow passing off parsing of a subsection of
+	// the binary data to the Channel subsection
+	adsk::Data::Channel* parse		(adsk::Data::Binary::Reader&	reader,
+									 unsigned int&	errorCount,
+									 std::string&	errors )	const;
+
+private:
+	ChannelSerializerBinary();		//! Use theFormat() to create.
+};
+
+//-
+// ==================================================================
+// Copyright 2015 Autodesk, Inc.  All rights reserved.
+// 
+// This computer source code  and related  instructions and comments are
+// the unpublished confidential and proprietary information of Autodesk,
+// Inc. and are  protected  under applicable  copyright and trade secret
+// law. They may not  be disclosed to, copied or used by any third party
+// without the prior written consent of Autodesk, Inc.
+// ==================================================================
+//+
+#endif // channelSerializerBinary_h
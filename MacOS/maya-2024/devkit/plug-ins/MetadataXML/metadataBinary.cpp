@@ -0,0 +1,309 @@
+#include "metadataBinary.h"
+#include <istream>
+#include <ostream>
+#include <string.h>
+#include <maya/MGlobal.h>
+#include <maya/MString.h>
+#ifdef METADATA_BINARY_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace adsk;
+using namespace adsk::Data;
+using namespace adsk::Data::Binary;
+
+//----------------------------------------------------------------------
+//
+//! \brief Append raw bytes to the buffer
+//
+void
+Writer::writeBytes(
+	const void*	data,
+	size_t		size )
+{
+	fBuffer.append( (const char*)data, size );
+}
+
+void Writer::writeUInt8	( uint8_t value )	{ writeBytes( &value, sizeof(value) ); }
+void Writer::writeUInt32( uint32_t value )	{ writeBytes( &value, sizeof(value) ); }
+void Writer::writeUInt64( uint64_t value )	{ writeBytes( &value, sizeof(value) ); }
+
+//----------------------------------------------------------------------
+//
+//! \brief Append a length prefixed string
+//
+void
+Writer::writeString(
+	const std::string&	value )
+{
+	writeUInt32( (uint32_t) value.size() );
+	writeBytes( value.data(), value.size() );
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Append a section tag and the format version
+//
+void
+Writer::writeTag(
+	const char*	tag )
+{
+	writeBytes( tag, 4 );
+	writeUInt8( binaryVersion );
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Reader constructor
+//
+//! \param[in] data Start of the buffer to read, not owned
+//! \param[in] size Number of bytes in the buffer
+//
+Reader::Reader(
+	const char*	data,
+	size_t		size )
+: fData( data )
+, fSize( size )
+, fOffset( 0 )
+{
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Return a pointer to the next size bytes and move past them
+//
+//! \return NULL if the buffer has fewer than size bytes left
+//
+const char*
+Reader::skip(
+	size_t	size )
+{
+	if( size > remaining() )
+	{
+		fOffset = fSize;
+		return NULL;
+	}
+	const char* data = fData + fOffset;
+	fOffset += size;
+	return data;
+}
+
+bool
+Reader::readBytes(
+	void*	data,
+	size_t	size )
+{
+	const char* src = skip( size );
+	if( ! src ) return false;
+	memcpy( data, src, size );
+	return true;
+}
+
+bool Reader::readUInt8	( uint8_t& value )	{ return readBytes( &value, sizeof(value) ); }
+bool Reader::readUInt32	( uint32_t& value )	{ return readBytes( &value, sizeof(value) ); }
+bool Reader::readUInt64	( uint64_t& value )	{ return readBytes( &value, sizeof(value) ); }
+
+bool
+Reader::readString(
+	std::string&	value )
+{
+	uint32_t size = 0;
+	if( ! readUInt32( size ) ) return false;
+	const char* data = skip( size );
+	if( ! data ) return false;
+	value.assign( data, size );
+	return true;
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Check for a section tag of a version this code understands
+//
+bool
+Reader::readTag(
+	const char*	tag )
+{
+	const char* data = skip( 4 );
+	uint8_t version = 0;
+	return data && (0 == memcmp( data, tag, 4 ))
+		&& readUInt8( version ) && (version == binaryVersion);
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief zlib level to write with, taken from an option variable so
+//!        that it can be changed without a new format
+//
+int
+Util::compressionLevel()
+{
+	if( ! compressionAvailable() ) return 0;
+	bool exists = false;
+	int level = MGlobal::optionVarIntValue( binaryCompressionOptionVar, &exists );
+	if( ! exists || level < 0 ) return 0;
+	return level > 9 ? 9 : level;
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Was the plug-in built with zlib?
+//
+bool
+Util::compressionAvailable()
+{
+#ifdef METADATA_BINARY_ZLIB
+	return true;
+#else
+	return false;
+#endif
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Write a block of data, compressed if that is enabled and helps
+//
+//	The block is a flags byte followed by the stored size, and for
+//	compressed blocks the uncompressed size, then the stored bytes.
+//
+//! \param[in] block Data to write
+//! \param[out] cDst Stream to write to
+//
+void
+Util::writeBlock(
+	const std::string&	block,
+	std::ostream&		cDst )
+{
+	Writer header;
+#ifdef METADATA_BINARY_ZLIB
+	int level = compressionLevel();
+	if( level > 0 && block.size() > 0 )
+	{
+		uLongf packedSize = compressBound( (uLong) block.size() );
+		std::string packed( packedSize, '\0' );
+		if( Z_OK == compress2( (Bytef*) &packed[0], &packedSize,
+							   (const Bytef*) block.data(), (uLong) block.size(), level )
+			&& packedSize < block.size() )
+		{
+			header.writeUInt8( binaryFlagCompressed );
+			header.writeUInt64( (uint64_t) packedSize );
+			header.writeUInt64( (uint64_t) block.size() );
+			cDst.write( header.buffer().data(), header.buffer().size() );
+			cDst.write( packed.data(), packedSize );
+			return;
+		}
+	}
+#endif
+	header.writeUInt8( 0 );
+	header.writeUInt64( (uint64_t) block.size() );
+	cDst.write( header.buffer().data(), header.buffer().size() );
+	cDst.write( block.data(), block.size() );
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Read a block written by writeBlock()
+//
+//! \param[in] reader Source of the block
+//! \param[out] data Start of the block contents
+//! \param[out] size Size of the block contents
+//! \param[out] storage Holds the contents of compressed blocks, data
+//!             points into the reader for the others
+//! \param[out] unsupported Set if the block is compressed and this
+//!             plug-in was built without zlib
+//
+//! \return false if the block could not be read
+//
+bool
+Util::readBlock(
+	Reader&			reader,
+	const char*&	data,
+	size_t&			size,
+	std::string&	storage,
+	bool&			unsupported )
+{
+	unsupported = false;
+	uint8_t flags = 0;
+	uint64_t storedSize = 0;
+	if( ! reader.readUInt8( flags ) || ! reader.readUInt64( storedSize ) )
+	{
+		return false;
+	}
+
+	if( 0 == (flags & binaryFlagCompressed) )
+	{
+		data = reader.skip( (size_t) storedSize );
+		size = (size_t) storedSize;
+		return data != NULL;
+	}
+
+	uint64_t rawSize = 0;
+	if( ! reader.readUInt64( rawSize ) )
+	{
+		return false;
+	}
+	const char* packed = reader.skip( (size_t) storedSize );
+	if( ! packed )
+	{
+		return false;
+	}
+#ifdef METADATA_BINARY_ZLIB
+	// zlib cannot expand data by more than about 1032:1, so a larger size
+	// comes from a corrupt header and is not worth allocating for
+	if( rawSize / 1032 > storedSize )
+	{
+		return false;
+	}
+	storage.resize( (size_t) rawSize );
+	uLongf unpackedSize = (uLongf) rawSize;
+	if( Z_OK != uncompress( (Bytef*) &storage[0], &unpackedSize,
+							(const Bytef*) packed, (uLong) storedSize )
+		|| unpackedSize != rawSize )
+	{
+		return false;
+	}
+	data = storage.data();
+	size = storage.size();
+	return true;
+#else
+	(void)storage;
+	unsupported = true;
+	return false;
+#endif
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Read the rest of an input stream into memory
+//
+bool
+Util::slurp(
+	std::istream&	cSrc,
+	std::string&	contents )
+{
+	std::streampos start = cSrc.tellg();
+	cSrc.seekg( 0, std::ios::end );
+	std::streampos end = cSrc.tellg();
+	if( start < 0 || end < start )
+	{
+		return false;
+	}
+	cSrc.seekg( start );
+	contents.resize( (size_t)(end - start) );
+	if( contents.size() > 0 )
+	{
+		cSrc.read( &contents[0], contents.size() );
+	}
+	return ! cSrc.fail();
+}
+
+//-
+// ==================================================================
+// Copyright 2015 Autodesk, Inc.  All rights reserved.
+//
+// This computer source code  and related  instructions and comments are
+// the unpublished confidential and proprietary information of Autodesk,
+// Inc. and are  protected  under applicable  copyright and trade secret
+// law. They may not  be disclosed to, copied or used by any third party
+// without the prior written consent of Autodesk, Inc.
+// ==================================================================
+//+
@@ -0,0 +1,114 @@
+#ifndef _metadataBinary_h_
+#define _metadataBinary_h_
+
+#include <iosfwd>
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Contains shared information for the binary serializers
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Name under which the binary format is registered for Streams, Channels
+// and Associations.
+//
+#define binaryFormatType				"binary"
+//
+// Every section starts with a four character tag followed by a version byte
+//
+#define binaryTagStream					"MDBS"
+#define binaryTagChannel				"MDBC"
+#define binaryTagAssociations			"MDBA"
+#define binaryVersion					1
+//
+// Payload flags
+//
+#define binaryFlagCompressed			0x01
+//
+// Option variable holding the zlib level used when writing, 0 or unset
+// writes uncompressed data
+//
+#define binaryCompressionOptionVar		"metadataBinaryCompression"
+
+//----------------------------------------------------------------------
+//
+//! Helper classes for reading and writing the binary format. All values
+//! are written in the byte order of the machine, which is little endian
+//! on every platform Maya runs on.
+//
+namespace adsk {
+	namespace Data {
+		namespace Binary {
+
+//! Appends values to a memory buffer
+class Writer
+{
+public:
+	void		writeBytes	( const void* data, size_t size );
+	void		writeUInt8	( uint8_t value );
+	void		writeUInt32	( uint32_t value );
+	void		writeUInt64	( uint64_t value );
+	void		writeString	( const std::string& value );
+	void		writeTag	( const char* tag );
+
+	std::string&	buffer	()			{ return fBuffer; }
+
+private:
+	std::string	fBuffer;
+};
+
+//! Reads values back from a memory buffer, every method returns false
+//! once the buffer is exhausted
+class Reader
+{
+public:
+	Reader( const char* data, size_t size );
+
+	bool		readBytes	( void* data, size_t size );
+	bool		readUInt8	( uint8_t& value );
+	bool		readUInt32	( uint32_t& value );
+	bool		readUInt64	( uint64_t& value );
+	bool		readString	( std::string& value );
+	bool		readTag		( const char* tag );
+	const char*	skip		( size_t size );
+
+	size_t		offset		()	const	{ return fOffset; }
+	size_t		remaining	()	const	{ return fSize - fOffset; }
+
+private:
+	const char*	fData;
+	size_t		fSize;
+	size_t		fOffset;
+};
+
+class Util
+{
+public:
+	static int	compressionLevel	();
+	static bool	compressionAvailable();
+	static void	writeBlock			( const std::string& block, std::ostream& cDst );
+	static bool	readBlock			( Reader& reader, const char*& data, size_t& size,
+									  std::string& storage, bool& unsupported );
+	static bool	slurp				( std::istream& cSrc, std::string& contents );
+};
+
+		} // namespace Binary
+	} // namespace Data
+} // namespace adsk
+
+//-
+// ==================================================================
+// Copyright 2015 Autodesk, Inc.  All rights reserved.
+//
+// This computer source code  and related  instructions and comments are
+// the unpublished confidential and proprietary information of Autodesk,
+// Inc. and are  protected  under applicable  copyright and trade secret
+// law. They may not  be disclosed to, copied or used by any third party
+// without the prior written consent of Autodesk, Inc.
+// ==================================================================
+//+
+
+#endif // _metadataBinary_h_
@@ -0,0 +1,157 @@
+#include "metadataSerializerBenchmark.h"
+#include "metadataXML.h"
+#include "metadataBinary.h"
+#include <sstream>
+#include <string>
+#include <maya/MArgList.h>
+#include <maya/MGlobal.h>
+#include <maya/MString.h>
+#include <maya/MTimer.h>
+#include <maya/adskDataHandle.h>
+#include <maya/adskDataIndex.h>
+#include <maya/adskDataMember.h>
+#include <maya/adskDataStream.h>
+#include <maya/adskDataStreamSerializer.h>
+#include <maya/adskDataStructure.h>
+
+using namespace adsk::Data;
+
+// Structure used for the benchmark Stream, registered on first use and
+// left registered for later runs.
+static const char* benchmarkStructureName = "metadataSerializerBenchmark";
+
+//----------------------------------------------------------------------
+//
+//! \brief Write and read back the Stream with one format, reporting the
+//!        timings and the size of the data.
+//
+//! \return false if the format is not available or the data did not
+//!         survive the round trip
+//
+static bool
+timeFormat(
+	MPxCommand&		cmd,
+	const char*		label,
+	const char*		formatName,
+	const Stream&	stream )
+{
+	const StreamSerializer* serializer = StreamSerializer::formatByName( formatName );
+	if( ! serializer )
+	{
+		MString msg;
+		msg.format( "metadataSerializerBenchmark: the ^1s format is not registered", formatName );
+		MGlobal::displayError( msg );
+		return false;
+	}
+
+	MTimer timer;
+	std::string errors;
+	std::stringstream data;
+	timer.beginTimer();
+	serializer->write( stream, data, errors );
+	timer.endTimer();
+	double writeTime = timer.elapsedTime();
+	std::string::size_type dataSize = data.str().size();
+
+	timer.beginTimer();
+	Stream* readStream = serializer->read( data, errors );
+	timer.endTimer();
+	double readTime = timer.elapsedTime();
+
+	bool matches = readStream && (*readStream == stream);
+	delete readStream;
+
+	MString msg;
+	msg.format( "metadataSerializerBenchmark: ^1s write ^2s s, read ^3s s, ^4s bytes",
+		label, MString() + writeTime, MString() + readTime, MString() + (double) dataSize );
+	MGlobal::displayInfo( msg );
+	if( ! matches )
+	{
+		msg.format( "metadataSerializerBenchmark: ^1s data read back does not match ^2s", label, errors.c_str() );
+		MGlobal::displayError( msg );
+	}
+	cmd.appendToResult( writeTime );
+	cmd.appendToResult( readTime );
+	return matches;
+}
+
+//----------------------------------------------------------------------
+//
+void*
+MetadataSerializerBenchmark::creator()
+{
+	return new MetadataSerializerBenchmark;
+}
+
+//----------------------------------------------------------------------
+//
+MStatus
+MetadataSerializerBenchmark::doIt( const MArgList& args )
+{
+	int elementCount = 1000000;
+	for( unsigned int i = 0; i + 1 < args.length(); i += 2 )
+	{
+		MString flag = args.asString( i );
+		if( flag == "-elements" || flag == "-e" )
+			elementCount = args.asInt( i + 1 );
+	}
+	if( elementCount < 1 )
+	{
+		displayError( "metadataSerializerBenchmark: -elements must be positive." );
+		return MS::kInvalidParameter;
+	}
+
+	Structure* structure = Structure::structureByName( benchmarkStructureName );
+	if( ! structure )
+	{
+		structure = Structure::create();
+		structure->setName( benchmarkStructureName );
+		structure->addMember( Member::kFloat, 3, "position" );
+		structure->addMember( Member::kInt32, 1, "id" );
+		Structure::registerStructure( *structure );
+	}
+
+	Stream stream( *structure, "benchmark" );
+	Handle element( *structure );
+	for( int e = 0; e < elementCount; ++e )
+	{
+		element.setPositionByMemberIndex( 0 );
+		float* position = element.asFloat();
+		position[0] = (float) e;
+		position[1] = (float) (e % 1000) * 0.5f;
+		position[2] = (float) (e / 1000) * 0.25f;
+		element.setPositionByMemberIndex( 1 );
+		element.asInt32()[0] = e;
+		stream.setElement( Index( (IndexCount) e ), element );
+	}
+
+	bool ok = timeFormat( *this, "XML", xmlFormatType, stream );
+	ok = timeFormat( *this, "binary", binaryFormatType, stream ) && ok;
+
+	// The compressed run temporarily overrides the user's compression level
+	if( Binary::Util::compressionAvailable() )
+	{
+		bool exists = false;
+		int level = MGlobal::optionVarIntValue( binaryCompressionOptionVar, &exists );
+		MGlobal::setOptionVarValue( binaryCompressionOptionVar, 6 );
+		ok = timeFormat( *this, "compressed binary", binaryFormatType, stream ) && ok;
+		if( exists )
+			MGlobal::setOptionVarValue( binaryCompressionOptionVar, level );
+		else
+			MGlobal::removeOptionVar( binaryCompressionOptionVar );
+	}
+
+	return ok ? MS::kSuccess : MS::kFailure;
+}
+
+//-
+// ==================================================================
+// Copyright 2015 Autodesk, Inc.  All rights reserved.
+// 
+// This computer source code  and related  instructions and comments are
+// the unpublished confidential and proprietary information of Autodesk,
+// Inc. and are  protected  under applicable  copyright and trade secret
+// law. They may not  be disclosed to, copied or used by any third party
+// without the prior written consent of Autodesk, Inc.
+// ==================================================================
+//+
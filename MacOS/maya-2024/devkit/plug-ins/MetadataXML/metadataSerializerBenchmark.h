@@ -0,0 +1,37 @@
+#ifndef metadataSerializerBenchmark_h
+#define metadataSerializerBenchmark_h
+
+#include <maya/MPxCommand.h>
+
+// ****************************************************************************
+/*!
+	\class MetadataSerializerBenchmark
+ 	\brief Command timing the Stream serializers against each other
+
+		metadataSerializerBenchmark [-elements n]
+
+	Fills a Stream of n elements (1000000 by default) holding a float[3]
+	position and an int32 id, then writes and reads it back with the XML
+	format, the binary format and, when the plug-in was built with zlib,
+	the compressed binary format. The write and read times in seconds are
+	returned in that order and the data sizes are displayed with them.
+*/
+class MetadataSerializerBenchmark : public MPxCommand
+{
+public:
+	MStatus		doIt	( const MArgList& args ) override;
+	static void*	creator	();
+};
+
+//-
+// ==================================================================
+// Copyright 2015 Autodesk, Inc.  All rights reserved.
+// 
+// This computer source code  and related  instructions and comments are
+// the unpublished confidential and proprietary information of Autodesk,
+// Inc. and are  protected  under applicable  copyright and trade secret
+// law. They may not  be disclosed to, copied or used by any third party
+// without the prior written consent of Autodesk, Inc.
+// ==================================================================
+//+
+#endif // metadataSerializerBenchmark_h
@@ -8,6 +8,10 @@
 #include "channelSerializerXML.h"
 #include <maya/adskDataStreamSerializer.h>
 #include "streamSerializerXML.h"
+#include "associationsSerializerBinary.h"
+#include "channelSerializerBinary.h"
+#include "streamSerializerBinary.h"
+#include "metadataSerializerBenchmark.h"
 #include <libxml/globals.h>
 #include <libxml/xmlreader.h>
 #include <libxml/parser.h>
@@ -17,12 +21,14 @@
 //
 // This is what looks like an empty plug-in. The work happens outside
 // the normal plug-in mechanism, enabling an XML serializer for metadata
-// Structures and Streams. Since they are not part of the M* class
+// Structures and Streams and a binary one for Streams, Channels and
+// Associations. Since they are not part of the M* class
 // mechanism they don't get registered like commands or nodes would.
 //
 // Since the serializers are all used on demand all the plug-in has to do
 // is register and deregister it by creating and destroying the
-// initializers to handle the serializer lifetime.
+// initializers to handle the serializer lifetime. The only command,
+// metadataSerializerBenchmark, compares the speed of the two formats.
 //
 // In order to build this plug-in you will need libxml2. On Linux and Mac
 // this is a standard library. On Windows you will need a local copy.
@@ -63,6 +69,9 @@ static SerializerInitializer<StructureSerializer>*		_structureXMLInitializer	= N
 static SerializerInitializer<AssociationsSerializer>*	_associationsXMLInitializer	= NULL;
 static SerializerInitializer<ChannelSerializer>*		_channelXMLInitializer		= NULL;
 static SerializerInitializer<StreamSerializer>*			_streamXMLInitializer		= NULL;
+static SerializerInitializer<AssociationsSerializer>*	_associationsBinaryInitializer	= NULL;
+static SerializerInitializer<ChannelSerializer>*		_channelBinaryInitializer	= NULL;
+static SerializerInitializer<StreamSerializer>*			_streamBinaryInitializer	= NULL;
 
 MStatus initializePlugin( MObject obj )
 { 
@@ -73,6 +82,16 @@ MStatus initializePlugin( MObject obj )
 	_associationsXMLInitializer = new SerializerInitializer<AssociationsSerializer>( AssociationsSerializerXML::theFormat() );
 	_channelXMLInitializer = new SerializerInitializer<ChannelSerializer>( ChannelSerializerXML::theFormat() );
 	_streamXMLInitializer = new SerializerInitializer<StreamSerializer>( StreamSerializerXML::theFormat() );
+	_associationsBinaryInitializer = new SerializerInitializer<AssociationsSerializer>( AssociationsSerializerBinary::theFormat() );
+	_channelBinaryInitializer = new SerializerInitializer<ChannelSerializer>( ChannelSerializerBinary::theFormat() );
+	_streamBinaryInitializer = new SerializerInitializer<StreamSerializer>( StreamSerializerBinary::theFormat() );
+
+	MStatus status = plugin.registerCommand( "metadataSerializerBenchmark", MetadataSerializerBenchmark::creator );
+	if( ! status )
+	{
+		cerr << "Failed to register command : metadataSerializerBenchmark\n";
+		return status;
+	}
 	return MS::kSuccess;
 }
 
@@ -80,6 +99,13 @@ MStatus initializePlugin( MObject obj )
 //
 MStatus uninitializePlugin( MObject obj )
 {
+	MFnPlugin plugin( obj );
+	MStatus status = plugin.deregisterCommand( "metadataSerializerBenchmark" );
+	if( ! status )
+	{
+		cerr << "Failed to deregister command : metadataSerializerBenchmark\n";
+	}
+
 	// Destructors of the initializers will deregister the format types
 	if( _structureXMLInitializer )
 	{
@@ -101,7 +127,22 @@ MStatus uninitializePlugin( MObject obj )
 		delete _streamXMLInitializer;
 		_streamXMLInitializer = NULL;
 	}
-	return MS::kSuccess;
+	if( _associationsBinaryInitializer )
+	{
+		delete _associationsBinaryInitializer;
+		_associationsBinaryInitializer = NULL;
+	}
+	if( _channelBinaryInitializer )
+	{
+		delete _channelBinaryInitializer;
+		_channelBinaryInitializer = NULL;
+	}
+	if( _streamBinaryInitializer )
+	{
+		delete _streamBinaryInitializer;
+		_streamBinaryInitializer = NULL;
+	}
+	return status;
 }
 
 //-
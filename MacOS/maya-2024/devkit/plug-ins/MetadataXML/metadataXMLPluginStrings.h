@@ -206,6 +206,37 @@
 //
 //######################################################################
 
+//######################################################################
+//
+// Binary strings
+//
+#define kBinaryHeaderInvalid			MStringResourceId(kPluginId, "kBinaryHeaderInvalid",			"Binary metadata '^1s' section not found at byte ^2s")
+#define kBinaryTruncated				MStringResourceId(kPluginId, "kBinaryTruncated",				"Binary metadata ends early at byte ^1s")
+#define kBinaryCompressionUnsupported	MStringResourceId(kPluginId, "kBinaryCompressionUnsupported",	"Compressed binary metadata at byte ^1s cannot be read, the plug-in was built without zlib")
+#define kAssociationsBinaryChannelSerializerMissing	MStringResourceId(kPluginId, "kAssociationsBinaryChannelSerializerMissing",	"Cannot find binary serializer for Channel data")
+#define kChannelBinaryStreamSerializerMissing	MStringResourceId(kPluginId, "kChannelBinaryStreamSerializerMissing",	"Cannot find binary serializer for Stream data")
+#define kStreamBinaryIndexTypeInvalid	MStringResourceId(kPluginId, "kStreamBinaryIndexTypeInvalid",	"Index type '^1s' not recognized at byte ^2s")
+#define kStreamBinaryMembersMismatch	MStringResourceId(kPluginId, "kStreamBinaryMembersMismatch",	"Members of Structure '^1s' do not match the data at byte ^2s")
+#define kStreamBinarySetValueFailed		MStringResourceId(kPluginId, "kStreamBinarySetValueFailed",		"Failed to set new metadata value at byte ^1s")
+#define kStreamBinaryStructureNotFound	MStringResourceId(kPluginId, "kStreamBinaryStructureNotFound",	"Structure '^1s' not found at byte ^2s")
+#define kBinaryInfo						MStringResourceId(kPluginId, "kBinaryInfo",\
+	"\nThe binary metadata format stores the same Associations,"\
+	"\nChannels and Streams as the XML format in a compact form"\
+	"\nthat is read without any text conversion."\
+	"\n"\
+	"\nEach section starts with a four character tag (MDBA for"\
+	"\nAssociations, MDBC for Channels, MDBS for Streams) and a"\
+	"\nversion number. Streams store their name, Structure name,"\
+	"\nindex type and Structure member layout followed by the"\
+	"\nelement indexes and then one array per member holding"\
+	"\nthat member's value for every element."\
+	"\n"\
+	"\nSet the option variable metadataBinaryCompression to a"\
+	"\nzlib level from 1 to 9 to compress the Stream data when"\
+	"\nwriting. Compressed data is read back automatically.")
+//
+//######################################################################
+
 //-
 //**************************************************************************/
 // Copyright (c) 2012 Autodesk, Inc.
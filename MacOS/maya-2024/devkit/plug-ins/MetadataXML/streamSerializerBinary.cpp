@@ -0,0 +1,449 @@
+#include "streamSerializerBinary.h"
+#include "metadataXML.h"
+#include "metadataXMLPluginStrings.h"
+#include <sstream>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <maya/MString.h>
+#include <maya/MStringResource.h>
+#include <maya/adskDataHandle.h>
+#include <maya/adskDataIndex.h>
+#include <maya/adskDataMember.h>
+#include <maya/adskDataStream.h>
+#include <maya/adskDataStructure.h>
+#include <maya/adskDataStreamSerializer.h>
+
+using namespace adsk;
+using namespace adsk::Data;
+using namespace adsk::Data::Binary;
+
+ImplementSerializerFormat(StreamSerializerBinary,StreamSerializer,binaryFormatType);
+
+//----------------------------------------------------------------------
+//
+//! \brief Default constructor, does nothing
+//
+StreamSerializerBinary::StreamSerializerBinary()
+{
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Default destructor, does nothing
+//
+StreamSerializerBinary::~StreamSerializerBinary	()
+{
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Create a Stream based on the binary data in the input stream.
+//
+//	This is not normally called directly as a Stream cannot float freely
+//	without a Channel parent to connect it with an object. The Channel
+//	reader will call the parse() method below on its own data.
+//
+//! \param[in] cSrc Stream containing the binary format data to be read
+//! \param[out] errors Description of problems found when reading the data
+//
+//! \return The created Stream, NULL if there was an error creating it
+//
+adsk::Data::Stream*
+StreamSerializerBinary::read(
+	std::istream&	cSrc,
+	std::string&	errors )	const
+{
+	unsigned int errorCount = 0;
+	errors = "";
+
+	std::string contents;
+	if( ! Util::slurp( cSrc, contents ) )
+	{
+		REPORT_ERROR_AT_LINE(kBinaryTruncated, 0.0);
+		return NULL;
+	}
+
+	Reader reader( contents.data(), contents.size() );
+	adsk::Data::Stream* newStream = parse( reader, errorCount, errors );
+
+	// If there were errors any Stream created will be incorrect so pass
+	// back nothing rather than bad data.
+	if( errorCount > 0 )
+	{
+		delete newStream;
+		newStream = NULL;
+	}
+	return newStream;
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Create a Stream from the binary data at the reader position
+//
+//! \param[in] reader Binary data, left after the Stream when successful
+//! \param[out] errorCount Number of errors found in parsing
+//! \param[out] errors Description of problems found when parsing the data
+//
+//! \return The created Stream, even if partially complete
+//
+adsk::Data::Stream*
+StreamSerializerBinary::parse(
+	Reader&			reader,
+	unsigned int&	errorCount,
+	std::string&	errors )	const
+{
+	size_t start = reader.offset();
+	if( ! reader.readTag( binaryTagStream ) )
+	{
+		REPORT_ERROR_AT_LINE1(kBinaryHeaderInvalid, MString(binaryTagStream), (double)start);
+		return NULL;
+	}
+
+	std::string streamName;
+	std::string structureName;
+	std::string indexTypeName;
+	uint32_t memberCount = 0;
+	if( ! reader.readString( streamName )
+	||  ! reader.readString( structureName )
+	||  ! reader.readString( indexTypeName )
+	||  ! reader.readUInt32( memberCount ) )
+	{
+		REPORT_ERROR_AT_LINE(kBinaryTruncated, (double)reader.offset());
+		return NULL;
+	}
+
+	Structure* structure = Structure::structureByName( structureName.c_str() );
+	if( ! structure )
+	{
+		REPORT_ERROR_AT_LINE1(kStreamBinaryStructureNotFound, MString(structureName.c_str()), (double)start);
+		return NULL;
+	}
+
+	// Values are copied straight into the Handles so the member layout
+	// has to be exactly the one they were written with.
+	bool membersMatch = (memberCount == structure->memberCount());
+	std::vector<Member::eDataType> memberTypes;
+	std::vector<unsigned int> memberDims;
+	Structure::iterator structIt = structure->begin();
+	for( uint32_t m=0; m<memberCount; ++m )
+	{
+		std::string memberName;
+		uint8_t memberType = 0;
+		uint32_t memberDim = 0;
+		if( ! reader.readString( memberName )
+		||  ! reader.readUInt8( memberType )
+		||  ! reader.readUInt32( memberDim ) )
+		{
+			REPORT_ERROR_AT_LINE(kBinaryTruncated, (double)reader.offset());
+			return NULL;
+		}
+		if( membersMatch )
+		{
+			membersMatch = (structIt != structure->end())
+						&& (memberName == structIt->name())
+						&& (memberType == (uint8_t) structIt->type())
+						&& (memberDim == structIt->length());
+		}
+		if( membersMatch )
+		{
+			memberTypes.push_back( structIt->type() );
+			memberDims.push_back( structIt->length() );
+			++structIt;
+		}
+	}
+	if( ! membersMatch )
+	{
+		REPORT_ERROR_AT_LINE1(kStreamBinaryMembersMismatch, MString(structureName.c_str()), (double)start);
+		return NULL;
+	}
+
+	// Okay allocate this here inside the DLL since it will be deleted before
+	// parsing is complete. The allocated object is just a wrapper around the
+	// real data, which will be allocated properly inside the main app.
+	adsk::Data::Stream* newStream = new adsk::Data::Stream( *structure, streamName );
+	if( ! newStream->setIndexType( indexTypeName ) )
+	{
+		REPORT_ERROR_AT_LINE1(kStreamBinaryIndexTypeInvalid, MString(indexTypeName.c_str()), (double)start);
+		delete newStream;
+		return NULL;
+	}
+	bool numericIndex = (newStream->indexType() == adsk::Data::Index::theTypeName());
+	adsk::Data::Index::IndexCreator indexCreator = adsk::Data::Index::creator( newStream->indexType() );
+	if( ! numericIndex && ! indexCreator )
+	{
+		REPORT_ERROR_AT_LINE1(kStreamBinaryIndexTypeInvalid, MString(indexTypeName.c_str()), (double)start);
+		delete newStream;
+		return NULL;
+	}
+
+	// The element data, compressed or not
+	size_t blockStart = reader.offset();
+	const char* blockData = NULL;
+	size_t blockSize = 0;
+	std::string blockStorage;
+	bool unsupported = false;
+	if( ! Util::readBlock( reader, blockData, blockSize, blockStorage, unsupported ) )
+	{
+		if( unsupported )
+		{
+			REPORT_ERROR_AT_LINE(kBinaryCompressionUnsupported, (double)blockStart);
+		}
+		else
+		{
+			REPORT_ERROR_AT_LINE(kBinaryTruncated, (double)reader.offset());
+		}
+		return newStream;
+	}
+	Reader block( blockData, blockSize );
+
+	uint64_t elementCount = 0;
+	if( ! block.readUInt64( elementCount ) )
+	{
+		REPORT_ERROR_AT_LINE(kBinaryTruncated, (double)blockStart);
+		return newStream;
+	}
+
+	// Find where every array starts. Fixed size values are read in place,
+	// variable length ones get a reader of their own. Counts are checked
+	// against what is left in the block before they are multiplied, so a
+	// corrupt count cannot wrap the column size around.
+	Reader indexReader( NULL, 0 );
+	const char* numericIndexes = NULL;
+	if( numericIndex )
+	{
+		if( elementCount > block.remaining() / sizeof(uint32_t) )
+		{
+			REPORT_ERROR_AT_LINE(kBinaryTruncated, (double)blockStart);
+			return newStream;
+		}
+		numericIndexes = block.skip( (size_t) elementCount * sizeof(uint32_t) );
+	}
+	else
+	{
+		size_t indexStart = block.offset();
+		std::string indexValue;
+		uint64_t indexesRead = 0;
+		while( indexesRead < elementCount && block.readString( indexValue ) ) { ++indexesRead; }
+		if( indexesRead != elementCount )
+		{
+			REPORT_ERROR_AT_LINE(kBinaryTruncated, (double)blockStart);
+			return newStream;
+		}
+		indexReader = Reader( blockData + indexStart, block.offset() - indexStart );
+	}
+
+	std::vector<const char*> columns( memberCount, (const char*) NULL );
+	std::vector<Reader> stringColumns( memberCount, Reader( NULL, 0 ) );
+	for( uint32_t m=0; m<memberCount; ++m )
+	{
+		if( memberTypes[m] == Member::kString )
+		{
+			// Every string takes at least its 4 byte length
+			if( memberDims[m] > 0 &&
+				elementCount > block.remaining() / ((size_t) memberDims[m] * sizeof(uint32_t)) )
+			{
+				REPORT_ERROR_AT_LINE(kBinaryTruncated, (double)blockStart);
+				return newStream;
+			}
+			const uint64_t valueCount = elementCount * memberDims[m];
+			size_t columnStart = block.offset();
+			std::string value;
+			uint64_t valuesRead = 0;
+			while( valuesRead < valueCount && block.readString( value ) ) { ++valuesRead; }
+			if( valuesRead != valueCount )
+			{
+				REPORT_ERROR_AT_LINE(kBinaryTruncated, (double)blockStart);
+				return newStream;
+			}
+			stringColumns[m] = Reader( blockData + columnStart, block.offset() - columnStart );
+		}
+		else
+		{
+			size_t valueSize = (size_t) memberDims[m] * Member::typeSize( memberTypes[m] );
+			if( valueSize > 0 && elementCount > block.remaining() / valueSize )
+			{
+				REPORT_ERROR_AT_LINE(kBinaryTruncated, (double)blockStart);
+				return newStream;
+			}
+			columns[m] = block.skip( (size_t) elementCount * valueSize );
+		}
+	}
+	if( block.remaining() != 0 || (numericIndex && elementCount > 0 && ! numericIndexes) )
+	{
+		REPORT_ERROR_AT_LINE(kBinaryTruncated, (double)blockStart);
+		return newStream;
+	}
+	for( uint32_t m=0; m<memberCount; ++m )
+	{
+		if( memberTypes[m] != Member::kString && elementCount > 0 && ! columns[m] )
+		{
+			REPORT_ERROR_AT_LINE(kBinaryTruncated, (double)blockStart);
+			return newStream;
+		}
+	}
+
+	// Build the elements
+	for( uint64_t e=0; e<elementCount; ++e )
+	{
+		adsk::Data::Handle newValue( *structure );
+		for( uint32_t m=0; m<memberCount; ++m )
+		{
+			newValue.setPositionByMemberIndex( m );
+			if( memberTypes[m] == Member::kString )
+			{
+				std::string value;
+				for( unsigned int dim=0; dim<memberDims[m]; ++dim )
+				{
+					stringColumns[m].readString( value );
+					newValue.fromStr( value, dim, errors );
+				}
+			}
+			else
+			{
+				size_t valueSize = memberDims[m] * Member::typeSize( memberTypes[m] );
+				memcpy( newValue.asType( memberTypes[m] ), columns[m] + e * valueSize, valueSize );
+			}
+		}
+
+		adsk::Data::Index dataIndex;
+		if( numericIndex )
+		{
+			uint32_t indexValue = 0;
+			memcpy( &indexValue, numericIndexes + e * sizeof(uint32_t), sizeof(uint32_t) );
+			dataIndex = (adsk::Data::IndexCount) indexValue;
+		}
+		else
+		{
+			std::string indexValue;
+			indexReader.readString( indexValue );
+			dataIndex = indexCreator( indexValue );
+		}
+
+		if( ! newStream->setElement( dataIndex, newValue ) )
+		{
+			REPORT_ERROR_AT_LINE(kStreamBinarySetValueFailed, (double)blockStart);
+		}
+	}
+
+	return newStream;
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Write the Stream object in binary format into the output stream
+//
+//! \param[in] dataToWrite Stream to be formatted
+//! \param[out] cDst Output stream to which the binary format of the Stream is written
+//! \param[out] errors Description of problems found when writing the Stream
+//
+//! \return number of errors found during write, 0 means success
+//
+int
+StreamSerializerBinary::write(
+	const adsk::Data::Stream&	dataToWrite,
+	std::ostream&				cDst,
+	std::string&				errors )	const
+{
+	errors = "";
+
+	const Structure& structure = dataToWrite.structure();
+	bool numericIndex = (dataToWrite.indexType() == adsk::Data::Index::theTypeName());
+
+	// Header with the member layout, so that the reader can check it
+	Writer header;
+	header.writeTag( binaryTagStream );
+	header.writeString( dataToWrite.name() );
+	header.writeString( structure.name() );
+	header.writeString( dataToWrite.indexType() );
+	header.writeUInt32( structure.memberCount() );
+	std::vector<Member::eDataType> memberTypes;
+	std::vector<unsigned int> memberDims;
+	for( adsk::Data::Structure::iterator structIt = structure.begin();
+		 structIt != structure.end(); ++structIt )
+	{
+		header.writeString( structIt->name() );
+		header.writeUInt8( (uint8_t) structIt->type() );
+		header.writeUInt32( structIt->length() );
+		memberTypes.push_back( structIt->type() );
+		memberDims.push_back( structIt->length() );
+	}
+	cDst.write( header.buffer().data(), header.buffer().size() );
+
+	// Gather the indexes and one array per member in a single pass
+	Writer indexes;
+	std::vector<Writer> columns( memberTypes.size() );
+	uint64_t elementCount = 0;
+	for( adsk::Data::Stream::iterator sIter = dataToWrite.cbegin();
+		 sIter != dataToWrite.cend(); ++sIter )
+	{
+		adsk::Data::Handle& idHandle = (*sIter);
+		if( numericIndex )
+		{
+			indexes.writeUInt32( (uint32_t) sIter.index().index() );
+		}
+		else
+		{
+			indexes.writeString( sIter.index().asString() );
+		}
+
+		for( unsigned int m=0; m<memberTypes.size(); ++m )
+		{
+			idHandle.setPositionByMemberIndex( m );
+			if( memberTypes[m] == Member::kString )
+			{
+				char** values = idHandle.asString();
+				for( unsigned int dim=0; dim<memberDims[m]; ++dim )
+				{
+					columns[m].writeString( (values && values[dim]) ? values[dim] : "" );
+				}
+			}
+			else
+			{
+				columns[m].writeBytes( idHandle.asType( memberTypes[m] ),
+									   memberDims[m] * Member::typeSize( memberTypes[m] ) );
+			}
+		}
+		++elementCount;
+	}
+
+	Writer block;
+	block.writeUInt64( elementCount );
+	std::string& blockData = block.buffer();
+	blockData += indexes.buffer();
+	for( unsigned int m=0; m<columns.size(); ++m )
+	{
+		blockData += columns[m].buffer();
+		std::string().swap( columns[m].buffer() );
+	}
+	Util::writeBlock( blockData, cDst );
+
+	return cDst.fail() ? 1 : 0;
+}
+
+//----------------------------------------------------------------------
+//
+//! \brief Get a description of the binary format
+//
+//! \param[out] info Stream to which the binary format description is output
+//
+void
+StreamSerializerBinary::getFormatDescription(
+	std::ostream&	info ) const
+{
+	MStatus status;
+	MString description = MStringResource::getString(kBinaryInfo, status);
+	info << description.asChar();
+}
+
+//-
+// ==================================================================
+// Copyright 2015 Autodesk, Inc.  All rights reserved.
+// 
+// This computer source code  and related  instructions and comments are
+// the unpublished confidential and proprietary information of Autodesk,
+// Inc. and are  protected  under applicable  copyright and trade secret
+// law. They may not  be disclosed to, copied or used by any third party
+// without the prior written consent of Autodesk, Inc.
+// ==================================================================
+//+
@@ -0,0 +1,77 @@
+#ifndef streamSerializerBinary_h
+#define streamSerializerBinary_h
+
+#include <maya/adskDataStreamSerializer.h>	// for base class
+#include <maya/adskCommon.h>
+#include "metadataBinary.h"
+
+namespace adsk {
+  namespace Data {
+	class Stream;
+  }
+}
+
+// ****************************************************************************
+/*!
+	\class adsk::Data::Plugin::StreamSerializerBinary
+ 	\brief Class handling the data Stream format type "binary"
+
+	The binary format holds the same information as the XML format but
+	stores values in their native representation, one array per Structure
+	member, so that large Streams can be read and written without any
+	text conversion.
+
+		  "MDBS" VERSION
+		  STREAM_NAME STREAM_STRUCTURE STREAM_INDEX_TYPE
+		  MEMBER_COUNT { MEMBER_NAME MEMBER_TYPE MEMBER_DIM }...
+		  BLOCK
+
+	The member layout is checked against the Structure of the same name
+	when reading. BLOCK is optionally compressed and contains
+
+		  ELEMENT_COUNT
+		  INDEX_VALUE...
+		  FIELD1_VALUE...
+		  FIELD2_VALUE_DIM[0] FIELD2_VALUE_DIM[1] FIELD2_VALUE_DIM[2]...
+
+	Numeric indexes are stored as 32 bit integers, other index types and
+	string values as length prefixed strings.
+*/
+using namespace adsk::Data;
+class StreamSerializerBinary : public adsk::Data::StreamSerializer
+{
+	DeclareSerializerFormat(StreamSerializerBinary, adsk::Data::StreamSerializer);
+public:
+	~StreamSerializerBinary() override;
+
+	// Mandatory implementation overrides
+	adsk::Data::Stream*
+						read		(std::istream&		cSrc,
+									 std::string&		errors)		const override;
+	int			write		(const adsk::Data::Stream&	dataToWrite,
+									 std::ostream&		cDst,
+									 std::string&		errors)		const override;
+	void		getFormatDescription(std::ostream& info)	const override;
+
+	// Partial interface to allow passing off parsing of a subsection of
+	// the binary data to the Stream subsection
+	adsk::Data::Stream* parse		(adsk::Data::Binary::Reader&	reader,
+									 unsigned int&	errorCount,
+									 std::string&	errors )	const;
+
+private:
+	StreamSerializerBinary();		//! Use theFormat() to create.
+};
+
+//-
+// ==================================================================
+// Copyright 2015 Autodesk, Inc.  All rights reserved.
+// 
+// This computer source code  and related  instructions and comments are
+// the unpublished confidential and proprietary information of Autodesk,
+// Inc. and are  protected  under applicable  copyright and trade secret
+// law. They may not  be disclosed to, copied or used by any third party
+// without the prior written consent of Autodesk, Inc.
+// ==================================================================
+//+
+#endif // streamSerializerBinary_h
@@ -15,11 +15,38 @@
 //
 //	In this example, the cache files are written in xml format.
 //
+//	When a cache file is opened for reading, the byte offset of every
+//	chunk is recorded in a time index so that findTime() and
+//	readNextTime() can seek directly to a frame. The index is saved next
+//	to the cache file (with an ".idx" suffix) when it is written or first
+//	scanned, and reused as long as the cache file size and modification
+//	time still match.
+//
+//	Reading goes through a buffered tokenizer that parses numbers straight
+//	into the output arrays. "xmlCacheMapFiles 1" makes it memory map whole
+//	cache files instead, and "xmlCacheReadBenchmark <file>" compares the
+//	read throughput of both modes with plain ifstream token extraction,
+//	and times seeking to the frames in random order.
+//
 
 #include <string>
 #include <stack>
 #include <fstream>
 #include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 #include <assert.h>
 #include <stdlib.h>
@@ -33,9 +60,270 @@
 #include <maya/MFloatArray.h>
 #include <maya/MIntArray.h>
 #include <maya/MVectorArray.h>
+#include <maya/MStringArray.h>
+#include <maya/MPxCommand.h>
+#include <maya/MArgList.h>
+#include <maya/MTimer.h>
 
 using namespace std;
 
+// ****************************************
+//
+//  XmlTokenReader
+//
+//	Whitespace-delimited tokenizer used for reading cache files. Tokens
+//	are returned as views into a read buffer (or into the mapped file),
+//	and numbers are parsed in place, so reading an array does not
+//	allocate per value.
+//
+
+class XmlTokenReader
+{
+public:
+	XmlTokenReader();
+	~XmlTokenReader();
+
+	bool		open( const char* fileName, bool mapFile );
+	void		close();
+	bool		isOpen() const { return fOpen; }
+	bool		isMapped() const { return fMapped != NULL; }
+
+	// Offset of the read position, as tellg() would report it
+	streamoff	offset() const { return fBufferOffset + ( fCur - fBegin ); }
+	bool		seek( streamoff offset );
+
+	// The returned token stays valid until the next call
+	bool		nextToken( const char*& token, size_t& length );
+	bool		nextToken( string& token );
+	double		parseDouble( const char* token, size_t length ) const;
+
+	static bool	tokenIs( const char* token, size_t length, const string& value )
+	{
+		return length == value.size() && memcmp( token, value.data(), length ) == 0;
+	}
+
+private:
+	bool		refill();
+
+	static const size_t	kBufferSize = 1 << 20;
+
+	bool		fOpen;
+	filebuf		fFileBuf;
+	vector<char> fBuffer;
+	char*		fMapped;
+	size_t		fMappedSize;
+
+	const char*	fBegin;			// start of the buffered data
+	const char*	fCur;			// read position
+	const char*	fEnd;			// end of the buffered data
+	const char*	fTokenStart;	// kept across refills
+	streamoff	fBufferOffset;	// file offset of fBegin
+};
+
+XmlTokenReader::XmlTokenReader()
+:	fOpen( false )
+,	fMapped( NULL )
+,	fMappedSize( 0 )
+,	fBegin( NULL )
+,	fCur( NULL )
+,	fEnd( NULL )
+,	fTokenStart( NULL )
+,	fBufferOffset( 0 )
+{
+}
+
+XmlTokenReader::~XmlTokenReader()
+{
+	close();
+}
+
+bool XmlTokenReader::open( const char* fileName, bool mapFile )
+{
+	close();
+
+#if !defined(_WIN32)
+	if( mapFile )
+	{
+		int fd = ::open( fileName, O_RDONLY );
+		if( fd >= 0 )
+		{
+			struct stat info;
+			if( fstat( fd, &info ) == 0 && info.st_size > 0 )
+			{
+				void* data = mmap( NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+				if( data != MAP_FAILED )
+				{
+					madvise( data, (size_t)info.st_size, MADV_SEQUENTIAL );
+					fMapped = (char*)data;
+					fMappedSize = (size_t)info.st_size;
+				}
+			}
+			::close( fd );
+		}
+		if( fMapped )
+		{
+			fBegin = fCur = fTokenStart = fMapped;
+			fEnd = fMapped + fMappedSize;
+			fBufferOffset = 0;
+			fOpen = true;
+			return true;
+		}
+		// Fall back to buffered reads
+	}
+#else
+	(void)mapFile;
+#endif
+
+	if( !fFileBuf.open( fileName, ios::in | ios::binary ) ) {
+		return false;
+	}
+	// One extra byte keeps the data NUL terminated for strtod
+	fBuffer.resize( kBufferSize + 1 );
+	fBegin = fCur = fEnd = fTokenStart = &fBuffer[0];
+	fBuffer[0] = '\0';
+	fBufferOffset = 0;
+	fOpen = true;
+	return true;
+}
+
+void XmlTokenReader::close()
+{
+#if !defined(_WIN32)
+	if( fMapped ) {
+		munmap( fMapped, fMappedSize );
+	}
+#endif
+	fMapped = NULL;
+	fMappedSize = 0;
+	if( fFileBuf.is_open() ) {
+		fFileBuf.close();
+	}
+	fBegin = fCur = fEnd = fTokenStart = NULL;
+	fBufferOffset = 0;
+	fOpen = false;
+}
+
+bool XmlTokenReader::seek( streamoff offset )
+{
+	if( !fOpen || offset < 0 ) {
+		return false;
+	}
+	if( offset >= fBufferOffset && offset <= fBufferOffset + ( fEnd - fBegin ) )
+	{
+		fCur = fTokenStart = fBegin + ( offset - fBufferOffset );
+		return true;
+	}
+	if( fMapped ) {
+		return false;
+	}
+	if( fFileBuf.pubseekpos( offset, ios::in ) != streampos( offset ) ) {
+		return false;
+	}
+	fBegin = fCur = fEnd = fTokenStart = &fBuffer[0];
+	fBuffer[0] = '\0';
+	fBufferOffset = offset;
+	return true;
+}
+
+bool XmlTokenReader::refill()
+//
+// Read more data, keeping everything from fTokenStart on. Returns false
+// at end of file.
+//
+{
+	if( fMapped || !fFileBuf.is_open() ) {
+		return false;
+	}
+
+	size_t kept = fEnd - fTokenStart;
+	size_t cur = fCur - fTokenStart;
+	fBufferOffset += fTokenStart - fBegin;
+	if( kept + 1 >= fBuffer.size() ) {
+		// A single token larger than the buffer
+		vector<char> larger( fBuffer.size() * 2 );
+		memcpy( &larger[0], fTokenStart, kept );
+		fBuffer.swap( larger );
+	} else if( kept > 0 ) {
+		memmove( &fBuffer[0], fTokenStart, kept );
+	}
+
+	char* data = &fBuffer[0];
+	streamsize count = fFileBuf.sgetn( data + kept, (streamsize)( fBuffer.size() - 1 - kept ) );
+	if( count < 0 ) {
+		count = 0;
+	}
+
+	fBegin = fTokenStart = data;
+	fCur = data + cur;
+	fEnd = data + kept + count;
+	data[kept + count] = '\0';
+	return count > 0;
+}
+
+bool XmlTokenReader::nextToken( const char*& token, size_t& length )
+{
+	if( !fOpen ) {
+		return false;
+	}
+
+	// Skip whitespace
+	for(;;)
+	{
+		while( fCur < fEnd && isspace( (unsigned char)*fCur ) ) {
+			++fCur;
+		}
+		fTokenStart = fCur;
+		if( fCur < fEnd ) {
+			break;
+		}
+		if( !refill() ) {
+			return false;
+		}
+	}
+
+	// Token, which may straddle the end of the buffer
+	for(;;)
+	{
+		while( fCur < fEnd && !isspace( (unsigned char)*fCur ) ) {
+			++fCur;
+		}
+		if( fCur < fEnd || !refill() ) {
+			break;
+		}
+	}
+
+	token = fTokenStart;
+	length = fCur - fTokenStart;
+	return true;
+}
+
+bool XmlTokenReader::nextToken( string& token )
+{
+	const char* t;
+	size_t length;
+	if( !nextToken( t, length ) ) {
+		token.clear();
+		return false;
+	}
+	token.assign( t, length );
+	return true;
+}
+
+double XmlTokenReader::parseDouble( const char* token, size_t length ) const
+{
+	// Buffered data is always followed by whitespace or a NUL, so the
+	// token can be parsed where it is. Only a token ending exactly at
+	// the end of a mapped file needs a terminated copy.
+	if( token + length < fEnd || !fMapped ) {
+		return strtod( token, NULL );
+	}
+	char copy[64];
+	length = min( length, sizeof(copy) - 1 );
+	memcpy( copy, token, length );
+	copy[length] = '\0';
+	return strtod( copy, NULL );
+}
+
 class XmlCacheFormat : public MPxCacheFormat
 {
 public:
@@ -46,6 +334,9 @@ public:
 	static void		setPluginName( const MString& name );
 	static MString	translatorName();
 
+	static bool		mapFiles() { return fMapFiles; }
+	static void		setMapFiles( bool map ) { fMapFiles = map; }
+
 	MStatus			isValid() override;
 
     MStatus			open( const MString& fileName, FileAccessMode mode ) override;
@@ -92,6 +383,7 @@ protected:
 
 	static MString	fExtension;
 	static MString	fCacheFormatName;
+	static bool		fMapFiles;
 
 private:
 	void			startXmlBlock( string& t );
@@ -100,6 +392,9 @@ private:
 	void			writeXmlTagValue( string& tag, int value );
 	bool			readXmlTagValue( string tag, MStringArray& value );
 	bool			readXmlTagValueInChunk( string tag, MStringArray& values );
+	void			readXmlValues( const string& endTag, MStringArray& values );
+	template <class Store>
+	unsigned		readXmlTagNumbers( string& tag, unsigned count, Store store );
 	void			readXmlTag( string& value );
 	bool			findXmlStartTag( string& tag );
 	bool			findXmlStartTagInChunk( string& tag );
@@ -108,16 +403,38 @@ private:
 	void			writeXmlValue( double value );
 	void			writeXmlValue( float value );
 	void			writeXmlValue( int value );
-		
+
+	// Time index: for every chunk, its time and the file offset just
+	// past its time tag, sorted by time.
+	struct TimeIndexEntry
+	{
+		MTime		time;
+		streamoff	offset;
+		bool operator<( const TimeIndexEntry& other ) const { return time < other.time; }
+	};
+	MString			indexFileName() const;
+	bool			dataFileStamp( long long& size, long long& modified ) const;
+	bool			loadTimeIndex();
+	void			buildTimeIndex();
+	void			saveTimeIndex() const;
+	void			sortIndexByOffset();
+	bool			seekToIndexEntry( size_t entry, MTime& foundTime );
+
 	MString			fFileName;
-	fstream			fFile;
+	fstream			fFile;		// writing
+	XmlTokenReader	fReader;	// reading
 	stack<string>	fXmlStack;
 	FileAccessMode	fMode;
 
+	vector<TimeIndexEntry>	fTimeIndex;
+	vector<size_t>	fIndexByOffset;	// fTimeIndex entries in file order
+	bool			fTimeIndexValid;
+	streamoff		fDataStart;		// first byte after the header
 };
 
 MString XmlCacheFormat::fExtension = "mc";			// For files on disk
 MString XmlCacheFormat::fCacheFormatName = "xml";	// For presentation in GUI
+bool XmlCacheFormat::fMapFiles = false;
 
 inline MString XmlCacheFormat::translatorName()
 {
@@ -159,6 +476,9 @@ string channelTag("channel");
 string chunkTag("chunk");			
 
 XmlCacheFormat::XmlCacheFormat()
+:	fMode( kRead )
+,	fTimeIndexValid( false )
+,	fDataStart( 0 )
 {
 }
 
@@ -175,21 +495,36 @@ XmlCacheFormat::open( const MString& fileName, FileAccessMode mode )
 	assert((fileName.length() > 0));
 
 	fFileName = fileName;
+	fMode = mode;
+	fTimeIndex.clear();
+	fTimeIndexValid = false;
 	
 	if( mode == kWrite ) {
 		fFile.open(fFileName.asChar(), ios::out);
+		// Offsets are recorded as chunks are written
+		fTimeIndexValid = true;
 	}
 	else if (mode == kReadWrite) {
+		// Appended chunks are not tracked, drop any saved index so the
+		// next read rebuilds it.
+		remove( indexFileName().asChar() );
 		fFile.open(fFileName.asChar(), ios::app);
 	} else {
-		fFile.open(fFileName.asChar(), ios::in);
+		fReader.open(fFileName.asChar(), fMapFiles);
 	}
 
-	if (!fFile.is_open()) {
+	if (!fFile.is_open() && !fReader.isOpen()) {
 		rtn = false;
 	} else {
 		if (mode == kRead) {
 			rtn = readHeader();
+			if( rtn ) {
+				fDataStart = fReader.offset();
+				if( !loadTimeIndex() ) {
+					buildTimeIndex();
+					saveTimeIndex();
+				}
+			}
 		}
 	}
 
@@ -200,7 +535,7 @@ XmlCacheFormat::open( const MString& fileName, FileAccessMode mode )
 MStatus
 XmlCacheFormat::isValid()
 {
-	bool rtn = fFile.is_open();
+	bool rtn = fFile.is_open() || fReader.isOpen();
 	return rtn ? MS::kSuccess : MS::kFailure ;
 }
 
@@ -209,7 +544,7 @@ XmlCacheFormat::readHeader()
 {
 	bool rtn = false;
 	if (kWrite != fMode) {
-		if( fFile.is_open() ) {
+		if( fReader.isOpen() ) {
 			string tag;
 			readXmlTag( tag );
 
@@ -239,7 +574,12 @@ XmlCacheFormat::readHeader()
 MStatus
 XmlCacheFormat::rewind()
 {
-   	if( fFile.is_open() ) 
+	if( fReader.isOpen() && fTimeIndexValid )
+	{
+		// No need to reopen and re-read the header (or the index)
+		return fReader.seek( fDataStart ) ? MS::kSuccess : MS::kFailure;
+	}
+   	if( fFile.is_open() || fReader.isOpen() ) 
    	{
 		close();
         	if(!open(fFileName, kRead ))
@@ -258,7 +598,15 @@ void XmlCacheFormat::close()
 {
     if( fFile.is_open() ) {
 	fFile.close();
+	if( fMode == kWrite && fTimeIndexValid ) {
+		sort( fTimeIndex.begin(), fTimeIndex.end() );
+		saveTimeIndex();
+	}
     }
+    fReader.close();
+    fTimeIndex.clear();
+    fIndexByOffset.clear();
+    fTimeIndexValid = false;
 }
 
 MStatus XmlCacheFormat::writeInt32( int i ) 
@@ -314,6 +662,13 @@ XmlCacheFormat::writeTime( MTime& time )
 	stringstream oss;
 	oss << time;
 	writeXmlTagValue(timeTag, oss.str() );
+
+	if( fMode == kWrite && fTimeIndexValid ) {
+		TimeIndexEntry entry;
+		entry.time = time;
+		entry.offset = fFile.tellp();
+		fTimeIndex.push_back( entry );
+	}
 	return MS::kSuccess;
 }
 
@@ -365,6 +720,16 @@ XmlCacheFormat::readNextTime( MTime& foundTime )
 // Read the next time based on the current read position.
 //
 {	
+	if( fTimeIndexValid && fMode == kRead )
+	{
+		// The first chunk whose time tag lies after the read position
+		streamoff pos = fReader.offset();
+		vector<size_t>::const_iterator it = upper_bound( fIndexByOffset.begin(), fIndexByOffset.end(), pos,
+			[this]( streamoff p, size_t entry ) { return p < fTimeIndex[entry].offset; } );
+		size_t next = ( it == fIndexByOffset.end() ) ? fTimeIndex.size() : *it;
+		return seekToIndexEntry( next, foundTime ) ? MS::kSuccess : MS::kFailure;
+	}
+
 	MTime readAwTime(0.0, MTime::k6000FPS);
 	bool ret = readTime(readAwTime);
 	foundTime = readAwTime;
@@ -384,6 +749,21 @@ XmlCacheFormat::findTime( MTime& time, MTime& foundTime )
 	MTime preTime( seekTime - timeTolerance );
 	MTime postTime( seekTime + timeTolerance );
 
+	if( fTimeIndexValid && fMode == kRead )
+	{
+		TimeIndexEntry key;
+		key.time = preTime;
+		vector<TimeIndexEntry>::const_iterator it =
+			lower_bound( fTimeIndex.begin(), fTimeIndex.end(), key );
+		if( it == fTimeIndex.end() || it->time > postTime )
+		{
+			// Time could not be found
+			//
+			return MS::kFailure;
+		}
+		return seekToIndexEntry( it - fTimeIndex.begin(), foundTime ) ? MS::kSuccess : MS::kFailure;
+	}
+
 	bool fileRewound = false;
 	while (1)
 	{
@@ -565,15 +945,12 @@ XmlCacheFormat::readArraySize()
 MStatus
 XmlCacheFormat::readDoubleArray( MDoubleArray& array, unsigned arraySize )
 {
-	MStringArray value;
-	readXmlTagValue(doubleArrayTag, value);
-
-	assert( value.length() == arraySize );
 	array.setLength( arraySize );
-	for ( unsigned int i = 0; i < value.length(); i++ )
-	{
-		array[i] = strtod( value[i].asChar(), NULL );
-	}
+	unsigned count = readXmlTagNumbers( doubleArrayTag, arraySize,
+		[&array]( unsigned i, double v ) { array[i] = v; } );
+
+	assert( count == arraySize );
+	(void)count;
 	
 	return MS::kSuccess;
 }
@@ -581,15 +958,12 @@ XmlCacheFormat::readDoubleArray( MDoubleArray& array, unsigned arraySize )
 MStatus
 XmlCacheFormat::readFloatArray( MFloatArray& array, unsigned arraySize )
 {
-	MStringArray value;
-	readXmlTagValue(floatArrayTag, value);
-
-	assert( value.length() == arraySize );
 	array.setLength( arraySize );
-	for ( unsigned int i = 0; i < value.length(); i++ )
-	{
-		array[i] = (float)strtod( value[i].asChar(), NULL );
-	}
+	unsigned count = readXmlTagNumbers( floatArrayTag, arraySize,
+		[&array]( unsigned i, double v ) { array[i] = (float)v; } );
+
+	assert( count == arraySize );
+	(void)count;
 	
 	return MS::kSuccess;
 }
@@ -597,23 +971,15 @@ XmlCacheFormat::readFloatArray( MFloatArray& array, unsigned arraySize )
 MStatus
 XmlCacheFormat::readDoubleVectorArray( MVectorArray& array, unsigned arraySize )
 {
-	MStringArray value;
-	if( !readXmlTagValue(doubleVectorArrayTag, value) )
+	array.setLength( arraySize );
+	unsigned count = readXmlTagNumbers( doubleVectorArrayTag, arraySize * 3,
+		[&array]( unsigned i, double v ) { array[i / 3][i % 3] = v; } );
+	if( count == (unsigned)-1 )
 	{
 		return MS::kFailure;
 	}
 
-	assert( value.length() == arraySize * 3 );
-	array.setLength( arraySize );
-	for (unsigned i = 0; i < arraySize; i++ )
-	{
-		double v[3];
-		v[0] = strtod( value[i*3].asChar(), NULL );
-		v[1] = strtod( value[i*3+1].asChar(), NULL );
-		v[2] = strtod( value[i*3+2].asChar(), NULL );
-
-		array.set( v, i );
-	}
+	assert( count == arraySize * 3 );
 	
 	return MS::kSuccess;
 }
@@ -621,22 +987,13 @@ XmlCacheFormat::readDoubleVectorArray( MVectorArray& array, unsigned arraySize )
 MStatus 
 XmlCacheFormat::readFloatVectorArray( MFloatVectorArray& array, unsigned arraySize )
 {
-	MStringArray value;
-	readXmlTagValue(floatVectorArrayTag, value);
-
-	assert( value.length() == arraySize * 3 );
-
 	array.clear();
 	array.setLength( arraySize );
-	for (unsigned i = 0; i < arraySize; i++ )
-	{
-		float v[3];
-		v[0] = (float)strtod( value[i*3].asChar(), NULL );
-		v[1] = (float)strtod( value[i*3+1].asChar(), NULL );
-		v[2] = (float)strtod( value[i*3+2].asChar(), NULL );
+	unsigned count = readXmlTagNumbers( floatVectorArrayTag, arraySize * 3,
+		[&array]( unsigned i, double v ) { array[i / 3][i % 3] = (float)v; } );
 
-		array.set(v,i);
-	}
+	assert( count == arraySize * 3 );
+	(void)count;
 
 	return MS::kSuccess;
 }
@@ -647,6 +1004,139 @@ XmlCacheFormat::extension()
 	return fExtension;
 }
 
+// ****************************************
+//
+//  Time index
+//
+
+MString XmlCacheFormat::indexFileName() const
+{
+	return fFileName + ".idx";
+}
+
+bool XmlCacheFormat::dataFileStamp( long long& size, long long& modified ) const
+//
+// Size and modification time of the cache file, which the saved index
+// has to match. The size alone misses a file rewritten in place with
+// chunks of other lengths adding up to the same total.
+//
+{
+	struct stat info;
+	if( stat( fFileName.asChar(), &info ) != 0 ) {
+		return false;
+	}
+	size = (long long)info.st_size;
+	modified = (long long)info.st_mtime;
+	return true;
+}
+
+bool XmlCacheFormat::loadTimeIndex()
+//
+// Read the index saved next to the cache file. It is only used if it was
+// written for a file of the current size and modification time.
+//
+{
+	long long dataSize = 0, dataModified = 0;
+	if( !dataFileStamp( dataSize, dataModified ) ) {
+		return false;
+	}
+
+	ifstream file( indexFileName().asChar(), ios::in );
+	if( !file.is_open() ) {
+		return false;
+	}
+
+	string magic;
+	int version = 0;
+	long long fileSize = -1, fileModified = -1;
+	size_t count = 0;
+	file >> magic >> version >> fileSize >> fileModified >> count;
+	if( !file || magic != "xmlCacheTimeIndex" || version != 2 ||
+		fileSize != dataSize || fileModified != dataModified ) {
+		return false;
+	}
+
+	fTimeIndex.resize( count );
+	for( size_t i = 0; i < count; i++ ) {
+		double ticks = 0.0;
+		file >> ticks >> fTimeIndex[i].offset;
+		fTimeIndex[i].time = MTime( ticks, MTime::k6000FPS );
+	}
+	if( !file ) {
+		fTimeIndex.clear();
+		return false;
+	}
+
+	sortIndexByOffset();
+	fTimeIndexValid = true;
+	return true;
+}
+
+void XmlCacheFormat::buildTimeIndex()
+//
+// Scan the whole file once, recording the offset after each chunk's
+// time tag.
+//
+{
+	fTimeIndex.clear();
+	while( beginReadChunk() )
+	{
+		TimeIndexEntry entry;
+		entry.time = MTime( 0.0, MTime::k6000FPS );
+		readTime( entry.time );
+		entry.offset = fReader.offset();
+		fTimeIndex.push_back( entry );
+	}
+	stable_sort( fTimeIndex.begin(), fTimeIndex.end() );
+	sortIndexByOffset();
+
+	fReader.seek( fDataStart );
+	fTimeIndexValid = true;
+}
+
+void XmlCacheFormat::saveTimeIndex() const
+{
+	long long dataSize = 0, dataModified = 0;
+	if( !dataFileStamp( dataSize, dataModified ) ) {
+		return;
+	}
+
+	ofstream file( indexFileName().asChar(), ios::out );
+	if( !file.is_open() ) {
+		// Read-only location, the index will be rebuilt on next open
+		return;
+	}
+
+	file << "xmlCacheTimeIndex 2 " << dataSize << " " << dataModified << " " << fTimeIndex.size() << "\n";
+	file.precision( 17 );
+	for( size_t i = 0; i < fTimeIndex.size(); i++ ) {
+		file << fTimeIndex[i].time.as( MTime::k6000FPS ) << " " << fTimeIndex[i].offset << "\n";
+	}
+}
+
+void XmlCacheFormat::sortIndexByOffset()
+{
+	fIndexByOffset.resize( fTimeIndex.size() );
+	for( size_t i = 0; i < fIndexByOffset.size(); i++ ) {
+		fIndexByOffset[i] = i;
+	}
+	sort( fIndexByOffset.begin(), fIndexByOffset.end(),
+		[this]( size_t a, size_t b ) { return fTimeIndex[a].offset < fTimeIndex[b].offset; } );
+}
+
+bool XmlCacheFormat::seekToIndexEntry( size_t entry, MTime& foundTime )
+//
+// Position the file as if the chunk's start tag and time had just been
+// read.
+//
+{
+	if( entry >= fTimeIndex.size() ) {
+		return false;
+	}
+	foundTime = fTimeIndex[entry].time;
+	return fReader.seek( fTimeIndex[entry].offset );
+}
+
 // ****************************************
 //
 //  Helper functions
@@ -690,21 +1180,13 @@ void XmlCacheFormat::writeXmlTagValue( string& tag, int value )
 
 bool XmlCacheFormat::readXmlTagValue( string tag, MStringArray& values )
 {
-	string endTag = XMLENDTAG(tag);
 	bool status = true;
 
 	values.clear();
 
-	// Yes this could be much much smarter
 	if( findXmlStartTag(tag) )
 	{
-		string token;
-		fFile >> token;
-		while ( !fFile.eof() && token != endTag )
-		{
-			values.append( token.data() );
-			fFile >> token;
-		} 
+		readXmlValues( XMLENDTAG(tag), values );
 	}
 	else
 	{
@@ -717,7 +1199,6 @@ bool XmlCacheFormat::readXmlTagValue( string tag, MStringArray& values )
 
 bool XmlCacheFormat::readXmlTagValueInChunk( string tag, MStringArray& values )
 {
-	string endTag = XMLENDTAG(tag);
 	bool status = true;
 
 	values.clear();
@@ -725,14 +1206,8 @@ bool XmlCacheFormat::readXmlTagValueInChunk( string tag, MStringArray& values )
     // Find the tag in the currently read chunk.
 	if( findXmlStartTagInChunk(tag) )
 	{
-		string token;
-		fFile >> token;
         // Look for the values within the bounds of the tag.
-		while ( !fFile.eof() && token != endTag )
-		{
-			values.append( token.data() );
-			fFile >> token;
-		} 
+		readXmlValues( XMLENDTAG(tag), values );
 	}
 	else
 	{
@@ -742,28 +1217,66 @@ bool XmlCacheFormat::readXmlTagValueInChunk( string tag, MStringArray& values )
 	return status;
 }
 
+void XmlCacheFormat::readXmlValues( const string& endTag, MStringArray& values )
+{
+	const char* token;
+	size_t length;
+	while ( fReader.nextToken( token, length ) && !XmlTokenReader::tokenIs( token, length, endTag ) )
+	{
+		values.append( MString( token, (int)length ) );
+	}
+}
+
+template <class Store>
+unsigned XmlCacheFormat::readXmlTagNumbers( string& tag, unsigned count, Store store )
+//
+// Parse the values of the given tag directly into the caller's storage,
+// store( index, value ) being called for each of the first count values.
+// Returns the number of values found, or (unsigned)-1 if there is no
+// such tag.
+//
+{
+	if( !findXmlStartTag( tag ) )
+	{
+		return (unsigned)-1;
+	}
+
+	string endTag = XMLENDTAG(tag);
+	unsigned found = 0;
+	const char* token;
+	size_t length;
+	while ( fReader.nextToken( token, length ) && !XmlTokenReader::tokenIs( token, length, endTag ) )
+	{
+		if( found < count )
+		{
+			store( found, fReader.parseDouble( token, length ) );
+		}
+		found++;
+	}
+	return found;
+}
+
 void XmlCacheFormat::readXmlTag( string& value )
 {
-	value.clear();
-        fFile >> value;
+	fReader.nextToken( value );
 }
 
 bool XmlCacheFormat::findXmlStartTag( string& tag )
 {
-	string tagRead;
 	string tagExpected = XMLSTARTTAG(tag);
+	const char* token;
+	size_t length;
 
-	fFile >> tagRead;
 	// Keep looking all the way to EOF
-	while(!fFile.eof() && tagRead != tagExpected) 
-	{
-		fFile >> tagRead;
-	}
-	if( tagRead != tagExpected )
+	while( fReader.nextToken( token, length ) )
 	{
+		if( XmlTokenReader::tokenIs( token, length, tagExpected ) )
+		{
+			return true;
+		}
 	}
 
-	return ( tagRead == tagExpected );
+	return false;
 }
 
 bool XmlCacheFormat::findXmlStartTagInChunk( string& tag )
@@ -771,35 +1284,34 @@ bool XmlCacheFormat::findXmlStartTagInChunk( string& tag )
 // Look for the given tag within the currently read chunk.
 //
 {
-	string tagRead;
 	string tagExpected = XMLSTARTTAG(tag);
 	string tagEndChunk("</"+chunkTag+">");
-
-    fFile >> tagRead;
+	const char* token;
+	size_t length;
 
     // Keep looking all the way to EOF
-    while((!fFile.eof()) && (tagRead != tagExpected) && (tagRead != tagEndChunk)) 
-    {
-		fFile >> tagRead;
-    }
-	if( (tagRead != tagExpected) && (tagRead != tagEndChunk) )
+	while( fReader.nextToken( token, length ) )
 	{
+		if( XmlTokenReader::tokenIs( token, length, tagExpected ) )
+		{
+			return true;
+		}
+		if( XmlTokenReader::tokenIs( token, length, tagEndChunk ) )
+		{
+			break;
+		}
 	}
 
-	return ( tagRead == tagExpected );
+	return false;
 }
 
 bool XmlCacheFormat::findXmlEndTag(string& tag)
 {
-	string tagRead;
 	string tagExpected("</"+tag+">");
+	const char* token;
+	size_t length;
 
-	fFile >> tagRead;
-	if( tagRead != tagExpected )
-	{
-	}
-
-	return ( tagRead == tagExpected );
+	return fReader.nextToken( token, length ) && XmlTokenReader::tokenIs( token, length, tagExpected );
 }
 
 void XmlCacheFormat::writeXmlValue( string& value )
@@ -824,6 +1336,204 @@ void XmlCacheFormat::writeXmlValue( int value )
 
 
 
+// ****************************************
+//
+// xmlCacheMapFiles [on]
+//
+// Sets whether cache files opened for reading from now on are memory
+// mapped rather than read through a buffer. Returns the current setting.
+//
+class xmlCacheMapFiles : public MPxCommand
+{
+public:
+	MStatus		doIt( const MArgList& args ) override;
+	static void* creator() { return new xmlCacheMapFiles(); }
+};
+
+MStatus xmlCacheMapFiles::doIt( const MArgList& args )
+{
+	MStatus status;
+	if( args.length() > 0 ) {
+		bool map = args.asBool( 0, &status );
+		if( !status ) {
+			displayError( "xmlCacheMapFiles: expected a boolean argument" );
+			return status;
+		}
+		XmlCacheFormat::setMapFiles( map );
+	}
+	setResult( XmlCacheFormat::mapFiles() );
+	return MS::kSuccess;
+}
+
+// ****************************************
+//
+// xmlCacheReadBenchmark fileName [iterations]
+//
+// Tokenizes the whole file and parses every token as a number, first the
+// way the reader used to (std::ifstream extraction into strings, then an
+// MStringArray), then with the buffered and mapped token reader, and
+// reports the throughput of each in MB/s.
+//
+// Then opens the file as a cache and visits every frame in a shuffled
+// order, the way scrubbing does: findTime() followed by reading the first
+// channel's name and array size. Reported in frames per second, with the
+// current xmlCacheMapFiles setting.
+//
+class xmlCacheReadBenchmark : public MPxCommand
+{
+public:
+	MStatus		doIt( const MArgList& args ) override;
+	static void* creator() { return new xmlCacheReadBenchmark(); }
+};
+
+static double benchmarkStreamRead( const char* fileName )
+{
+	ifstream file( fileName, ios::in );
+	string token;
+	MStringArray values;
+	double sum = 0.0;
+	while( file >> token )
+	{
+		values.append( token.data() );
+		if( values.length() == 4096 ) {
+			for( unsigned i = 0; i < values.length(); i++ ) {
+				sum += strtod( values[i].asChar(), NULL );
+			}
+			values.clear();
+		}
+	}
+	for( unsigned i = 0; i < values.length(); i++ ) {
+		sum += strtod( values[i].asChar(), NULL );
+	}
+	return sum;
+}
+
+static double benchmarkTokenRead( const char* fileName, bool mapFile )
+{
+	XmlTokenReader reader;
+	reader.open( fileName, mapFile );
+	const char* token;
+	size_t length;
+	double sum = 0.0;
+	while( reader.nextToken( token, length ) )
+	{
+		sum += reader.parseDouble( token, length );
+	}
+	return sum;
+}
+
+static unsigned benchmarkSeekRead( XmlCacheFormat& cache, const vector<MTime>& times )
+{
+	unsigned found = 0;
+	for( size_t i = 0; i < times.size(); i++ )
+	{
+		MTime seekTime( times[i] );
+		MTime foundTime;
+		MString channel;
+		if( cache.findTime( seekTime, foundTime ) && cache.readChannelName( channel ) ) {
+			cache.readArraySize();
+			found++;
+		}
+	}
+	return found;
+}
+
+MStatus xmlCacheReadBenchmark::doIt( const MArgList& args )
+{
+	MStatus status;
+	if( args.length() < 1 ) {
+		displayError( "xmlCacheReadBenchmark: a cache file name is required" );
+		return MS::kInvalidParameter;
+	}
+	MString fileName = args.asString( 0, &status );
+	int iterations = 3;
+	if( args.length() > 1 ) {
+		iterations = args.asInt( 1, &status );
+	}
+	if( !status || iterations <= 0 ) {
+		displayError( "xmlCacheReadBenchmark: iterations must be a positive integer" );
+		return MS::kInvalidParameter;
+	}
+
+	ifstream sizeCheck( fileName.asChar(), ios::in | ios::binary | ios::ate );
+	if( !sizeCheck.is_open() ) {
+		displayError( "xmlCacheReadBenchmark: cannot open " + fileName );
+		return MS::kFailure;
+	}
+	const double megaBytes = (double)(streamoff)sizeCheck.tellg() / ( 1024.0 * 1024.0 );
+	sizeCheck.close();
+
+	const char* modes[] = { "ifstream", "buffered", "mapped" };
+	clearResult();
+	for( int m = 0; m < 3; m++ )
+	{
+		double elapsed = 0.0;
+		for( int it = 0; it < iterations; it++ )
+		{
+			MTimer timer; timer.beginTimer();
+			if( m == 0 ) {
+				benchmarkStreamRead( fileName.asChar() );
+			} else {
+				benchmarkTokenRead( fileName.asChar(), m == 2 );
+			}
+			timer.endTimer();
+			elapsed += timer.elapsedTime();
+		}
+
+		const double mbPerSecond = ( elapsed > 0.0 ) ? megaBytes * iterations / elapsed : 0.0;
+		MString msg;
+		msg.format( "xmlCacheReadBenchmark: ^1s reader, ^2s MB/s", MString( modes[m] ), MString() + mbPerSecond );
+		MGlobal::displayInfo( msg );
+		appendToResult( MString( modes[m] ) );
+		appendToResult( mbPerSecond );
+	}
+
+	// Random access. Opening reads or builds the time index, which is
+	// not timed.
+	XmlCacheFormat cache;
+	if( !cache.open( fileName, MPxCacheFormat::kRead ) ) {
+		displayError( "xmlCacheReadBenchmark: " + fileName + " is not an xml cache file" );
+		return MS::kFailure;
+	}
+	vector<MTime> times;
+	MTime time;
+	while( cache.readNextTime( time ) ) {
+		times.push_back( time );
+	}
+
+	// Same order on every run so that results can be compared
+	unsigned seed = 1;
+	for( size_t i = times.size(); i > 1; i-- )
+	{
+		seed = seed * 1103515245u + 12345u;
+		swap( times[i - 1], times[( seed >> 8 ) % i] );
+	}
+
+	double elapsed = 0.0;
+	for( int it = 0; it < iterations; it++ )
+	{
+		MTimer timer; timer.beginTimer();
+		unsigned found = benchmarkSeekRead( cache, times );
+		timer.endTimer();
+		elapsed += timer.elapsedTime();
+		if( found != times.size() ) {
+			displayError( "xmlCacheReadBenchmark: could not seek to every frame of " + fileName );
+			return MS::kFailure;
+		}
+	}
+	cache.close();
+
+	const double framesPerSecond = ( elapsed > 0.0 ) ? (double)times.size() * iterations / elapsed : 0.0;
+	MString msg;
+	msg.format( "xmlCacheReadBenchmark: ^1s frames in random order, ^2s frames/s",
+		MString() + (int)times.size(), MString() + framesPerSecond );
+	MGlobal::displayInfo( msg );
+	appendToResult( MString( "seek" ) );
+	appendToResult( framesPerSecond );
+
+	return MS::kSuccess;
+}
+
 // ****************************************
 
 MStatus initializePlugin( MObject obj )
@@ -834,6 +1544,8 @@ MStatus initializePlugin( MObject obj )
 		XmlCacheFormat::translatorName(),
 		XmlCacheFormat::creator
 	);
+	plugin.registerCommand( "xmlCacheMapFiles", xmlCacheMapFiles::creator );
+	plugin.registerCommand( "xmlCacheReadBenchmark", xmlCacheReadBenchmark::creator );
 
 	return MS::kSuccess;
 }
@@ -844,6 +1556,8 @@ MStatus uninitializePlugin( MObject obj )
 	MFnPlugin plugin( obj );
 
 	plugin.deregisterCacheFormat( XmlCacheFormat::translatorName() );
+	plugin.deregisterCommand( "xmlCacheMapFiles" );
+	plugin.deregisterCommand( "xmlCacheReadBenchmark" );
 
 	return MS::kSuccess;
 }
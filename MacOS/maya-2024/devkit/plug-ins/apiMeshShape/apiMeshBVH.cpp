@@ -0,0 +1,358 @@
+//-
+// ==========================================================================
+// Copyright 2015 Autodesk, Inc.  All rights reserved.
+//
+// Use of this software is subject to the terms of the Autodesk
+// license agreement provided at the time of installation or download,
+// or which otherwise accompanies this software in either electronic
+// or hard copy form.
+// ==========================================================================
+//+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// apiMeshBVH.cpp
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "apiMeshBVH.h"
+
+#include <algorithm>
+#include <float.h>
+
+// Triangles per leaf
+static const int kLeafSize = 4;
+
+apiMeshBVH::apiMeshBVH()
+: fVertexCount( 0 ), fConnectCount( 0 ), fFaceCount( 0 )
+{}
+
+apiMeshBVH::~apiMeshBVH() {}
+
+void apiMeshBVH::clear()
+{
+	fNodes.clear();
+	fTriangles.clear();
+	fVertexCount = 0;
+	fConnectCount = 0;
+	fFaceCount = 0;
+	fFaceCounts.clear();
+	fFaceConnects.clear();
+}
+
+bool apiMeshBVH::matches( const apiMeshGeom& geom ) const
+{
+	// Equal counts are not enough, faces can be rewired without changing
+	// any of them.
+	return fVertexCount == geom.vertices.length() &&
+		   fFaceCount == geom.faceCount &&
+		   fFaceCounts.sharesWith( geom.face_counts ) &&
+		   fFaceConnects.sharesWith( geom.face_connects );
+}
+
+void apiMeshBVH::build( const apiMeshGeom& geom )
+//
+// Description
+//
+//    Triangulate the faces and build the tree top down, splitting the
+//    triangles at the median centroid along the longest axis.
+//
+{
+	clear();
+
+	fVertexCount = geom.vertices.length();
+	fConnectCount = geom.face_connects.length();
+	fFaceCount = geom.faceCount;
+	fFaceCounts = geom.face_counts;
+	fFaceConnects = geom.face_connects;
+
+	int base = 0;
+	for ( int i=0; i<geom.faceCount; i++ )
+	{
+		int numVerts = geom.face_counts[i];
+		if ( base + numVerts > (int)fConnectCount )
+			break;
+		for ( int v=1; v<numVerts-1; v++ )
+		{
+			Triangle tri;
+			tri.corner[0] = base;
+			tri.corner[1] = base + v;
+			tri.corner[2] = base + v + 1;
+			bool valid = true;
+			for ( int c=0; c<3; c++ )
+			{
+				int vertexId = geom.face_connects[tri.corner[c]];
+				valid = valid && vertexId >= 0 && vertexId < (int)fVertexCount;
+			}
+			if ( valid )
+				fTriangles.push_back( tri );
+		}
+		base += numVerts;
+	}
+
+	if ( fTriangles.empty() )
+		return;
+
+	std::vector<double> centroids( fTriangles.size() * 3 );
+	for ( size_t t=0; t<fTriangles.size(); t++ )
+	{
+		for ( int c=0; c<3; c++ )
+		{
+			const MPoint& p = geom.vertices[ geom.face_connects[fTriangles[t].corner[c]] ];
+			for ( int axis=0; axis<3; axis++ )
+				centroids[t*3 + axis] += p[axis] / 3.0;
+		}
+	}
+
+	fNodes.reserve( 2 * fTriangles.size() / kLeafSize + 1 );
+	buildNode( geom, centroids, 0, (int)fTriangles.size() );
+}
+
+int apiMeshBVH::buildNode( const apiMeshGeom& geom,
+						   std::vector<double>& centroids,
+						   int first, int count )
+{
+	int index = (int)fNodes.size();
+	fNodes.push_back( Node() );
+
+	if ( count <= kLeafSize )
+	{
+		fNodes[index].first = first;
+		fNodes[index].count = count;
+		boundTriangles( geom, fNodes[index] );
+		return index;
+	}
+
+	// Split along the longest axis of the centroid bounds
+	double cmin[3] = {  DBL_MAX,  DBL_MAX,  DBL_MAX };
+	double cmax[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+	for ( int t=first; t<first+count; t++ )
+	{
+		for ( int axis=0; axis<3; axis++ )
+		{
+			cmin[axis] = std::min( cmin[axis], centroids[t*3 + axis] );
+			cmax[axis] = std::max( cmax[axis], centroids[t*3 + axis] );
+		}
+	}
+	int axis = 0;
+	if ( cmax[1] - cmin[1] > cmax[axis] - cmin[axis] ) axis = 1;
+	if ( cmax[2] - cmin[2] > cmax[axis] - cmin[axis] ) axis = 2;
+
+	// Order the triangles by centroid around the median. The centroids
+	// are sorted through an index and then both arrays are permuted.
+	int half = count / 2;
+	std::vector<int> order( count );
+	for ( int i=0; i<count; i++ )
+		order[i] = first + i;
+	std::nth_element( order.begin(), order.begin() + half, order.end(),
+		[&centroids, axis]( int a, int b ) {
+			return centroids[a*3 + axis] < centroids[b*3 + axis];
+		} );
+
+	std::vector<Triangle> triangles( count );
+	std::vector<double> sorted( count * 3 );
+	for ( int i=0; i<count; i++ )
+	{
+		triangles[i] = fTriangles[order[i]];
+		for ( int c=0; c<3; c++ )
+			sorted[i*3 + c] = centroids[order[i]*3 + c];
+	}
+	std::copy( triangles.begin(), triangles.end(), fTriangles.begin() + first );
+	std::copy( sorted.begin(), sorted.end(), centroids.begin() + first*3 );
+
+	buildNode( geom, centroids, first, half );
+	int right = buildNode( geom, centroids, first + half, count - half );
+
+	Node& node = fNodes[index];
+	const Node& leftNode = fNodes[index + 1];
+	const Node& rightNode = fNodes[right];
+	for ( int c=0; c<3; c++ )
+	{
+		node.bboxMin[c] = std::min( leftNode.bboxMin[c], rightNode.bboxMin[c] );
+		node.bboxMax[c] = std::max( leftNode.bboxMax[c], rightNode.bboxMax[c] );
+	}
+	node.first = right;
+	node.count = 0;
+	return index;
+}
+
+void apiMeshBVH::boundTriangles( const apiMeshGeom& geom, Node& node ) const
+{
+	for ( int c=0; c<3; c++ )
+	{
+		node.bboxMin[c] =  DBL_MAX;
+		node.bboxMax[c] = -DBL_MAX;
+	}
+	for ( int t=node.first; t<node.first+node.count; t++ )
+	{
+		for ( int corner=0; corner<3; corner++ )
+		{
+			const MPoint& p = geom.vertices[ geom.face_connects[fTriangles[t].corner[corner]] ];
+			for ( int c=0; c<3; c++ )
+			{
+				node.bboxMin[c] = std::min( node.bboxMin[c], p[c] );
+				node.bboxMax[c] = std::max( node.bboxMax[c], p[c] );
+			}
+		}
+	}
+}
+
+void apiMeshBVH::refit( const apiMeshGeom& geom )
+//
+// Description
+//
+//    Recompute the node bounds for moved vertices, keeping the tree
+//    layout. Children come after their parent, so walking the nodes
+//    backwards visits them bottom up.
+//
+{
+	for ( int i=(int)fNodes.size()-1; i>=0; i-- )
+	{
+		Node& node = fNodes[i];
+		if ( node.count > 0 )
+		{
+			boundTriangles( geom, node );
+			continue;
+		}
+		const Node& leftNode = fNodes[i + 1];
+		const Node& rightNode = fNodes[node.first];
+		for ( int c=0; c<3; c++ )
+		{
+			node.bboxMin[c] = std::min( leftNode.bboxMin[c], rightNode.bboxMin[c] );
+			node.bboxMax[c] = std::max( leftNode.bboxMax[c], rightNode.bboxMax[c] );
+		}
+	}
+}
+
+// Squared distance from a point to a node's box
+static inline double boxDistance2( const double p[3], const double bmin[3], const double bmax[3] )
+{
+	double d2 = 0.0;
+	for ( int c=0; c<3; c++ )
+	{
+		double d = 0.0;
+		if ( p[c] < bmin[c] )
+			d = bmin[c] - p[c];
+		else if ( p[c] > bmax[c] )
+			d = p[c] - bmax[c];
+		d2 += d * d;
+	}
+	return d2;
+}
+
+// Closest point on triangle abc to p, by Voronoi regions
+// (Ericson, Real-Time Collision Detection, 5.1.5)
+static MPoint closestPointOnTriangle( const MPoint& p, const MPoint& a,
+									  const MPoint& b, const MPoint& c )
+{
+	MVector ab = b - a;
+	MVector ac = c - a;
+	MVector ap = p - a;
+	double d1 = ab * ap;
+	double d2 = ac * ap;
+	if ( d1 <= 0.0 && d2 <= 0.0 )
+		return a;
+
+	MVector bp = p - b;
+	double d3 = ab * bp;
+	double d4 = ac * bp;
+	if ( d3 >= 0.0 && d4 <= d3 )
+		return b;
+
+	double vc = d1*d4 - d3*d2;
+	if ( vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0 )
+		return a + ab * ( d1 / (d1 - d3) );
+
+	MVector cp = p - c;
+	double d5 = ab * cp;
+	double d6 = ac * cp;
+	if ( d6 >= 0.0 && d5 <= d6 )
+		return c;
+
+	double vb = d5*d2 - d1*d6;
+	if ( vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0 )
+		return a + ac * ( d2 / (d2 - d6) );
+
+	double va = d3*d6 - d5*d4;
+	if ( va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0 )
+		return b + (c - b) * ( (d4 - d3) / ((d4 - d3) + (d5 - d6)) );
+
+	double denom = va + vb + vc;
+	if ( denom == 0.0 )
+	{
+		// Degenerate triangle, all the edge tests failed on round off
+		return a;
+	}
+	double v = vb / denom;
+	double w = vc / denom;
+	return a + ab * v + ac * w;
+}
+
+bool apiMeshBVH::closestPoint( const apiMeshGeom& geom,
+							   const MPoint& toThisPoint,
+							   MPoint& theClosestPoint,
+							   double tolerance ) const
+//
+// Description
+//
+//    Depth first search, visiting the nearer child first and skipping
+//    nodes farther away than the best point found so far.
+//
+{
+	if ( fNodes.empty() )
+		return false;
+
+	const double p[3] = { toThisPoint.x, toThisPoint.y, toThisPoint.z };
+	const double tolerance2 = tolerance > 0.0 ? tolerance * tolerance : 0.0;
+	double best = DBL_MAX;
+
+	int stack[64];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while ( stackSize > 0 )
+	{
+		const Node& node = fNodes[ stack[--stackSize] ];
+		if ( boxDistance2( p, node.bboxMin, node.bboxMax ) >= best )
+			continue;
+
+		if ( node.count > 0 )
+		{
+			for ( int t=node.first; t<node.first+node.count; t++ )
+			{
+				const Triangle& tri = fTriangles[t];
+				MPoint candidate = closestPointOnTriangle( toThisPoint,
+					geom.vertices[ geom.face_connects[tri.corner[0]] ],
+					geom.vertices[ geom.face_connects[tri.corner[1]] ],
+					geom.vertices[ geom.face_connects[tri.corner[2]] ] );
+				double d2 = (candidate - toThisPoint) * (candidate - toThisPoint);
+				if ( d2 < best )
+				{
+					best = d2;
+					theClosestPoint = candidate;
+					if ( best <= tolerance2 )
+						return true;
+				}
+			}
+			continue;
+		}
+
+		// Median splits keep the tree balanced, so the stack holds
+		// at most one pending node per level.
+		int left = (int)(&node - &fNodes[0]) + 1;
+		int right = node.first;
+		double leftDist = boxDistance2( p, fNodes[left].bboxMin, fNodes[left].bboxMax );
+		double rightDist = boxDistance2( p, fNodes[right].bboxMin, fNodes[right].bboxMax );
+		if ( leftDist < rightDist )
+		{
+			stack[stackSize++] = right;
+			stack[stackSize++] = left;
+		}
+		else
+		{
+			stack[stackSize++] = left;
+			stack[stackSize++] = right;
+		}
+	}
+
+	return best < DBL_MAX;
+}
@@ -0,0 +1,83 @@
+//-
+// ==========================================================================
+// Copyright 2015 Autodesk, Inc.  All rights reserved.
+//
+// Use of this software is subject to the terms of the Autodesk
+// license agreement provided at the time of installation or download,
+// or which otherwise accompanies this software in either electronic
+// or hard copy form.
+// ==========================================================================
+//+
+
+#ifndef _apiMeshBVH
+#define _apiMeshBVH
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Bounding volume hierarchy over the triangles of an apiMeshGeom
+//
+// Used by apiMesh::closestPoint. Faces are fan triangulated the same way
+// the draw overrides triangulate them. Triangles refer to their corners
+// through face_connects, so when only the vertices move (deformation,
+// tweaks) the tree is refit in place instead of being rebuilt.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <maya/MPoint.h>
+#include "apiMeshGeom.h"
+
+class apiMeshBVH
+{
+public:
+	apiMeshBVH();
+	~apiMeshBVH();
+
+	void			build( const apiMeshGeom& geom );
+	void			refit( const apiMeshGeom& geom );
+	void			clear();
+
+	// True when the tree was built for geometry with this topology: the
+	// same vertex count and the very face_counts and face_connects arrays,
+	// which are shared between copies of the geometry until modified.
+	bool			matches( const apiMeshGeom& geom ) const;
+	bool			isEmpty() const { return fNodes.empty(); }
+
+	// Closest point on the surface to the given point. The search stops
+	// early once a point within tolerance has been found.
+	bool			closestPoint( const apiMeshGeom& geom,
+								  const MPoint& toThisPoint,
+								  MPoint& theClosestPoint,
+								  double tolerance ) const;
+
+private:
+	// Corners of a triangle, as indices into face_connects
+	struct Triangle {
+		int		corner[3];
+	};
+
+	// Nodes are stored depth first: the left child of an inner node
+	// directly follows it, so children always come after their parent.
+	struct Node {
+		double	bboxMin[3];
+		double	bboxMax[3];
+		int		first;		// leaf: first triangle, inner: right child
+		int		count;		// leaf: number of triangles, inner: 0
+	};
+
+	int				buildNode( const apiMeshGeom& geom,
+							   std::vector<double>& centroids,
+							   int first, int count );
+	void			boundTriangles( const apiMeshGeom& geom, Node& node ) const;
+
+	std::vector<Node>		fNodes;
+	std::vector<Triangle>	fTriangles;
+
+	unsigned int	fVertexCount;
+	unsigned int	fConnectCount;
+	int				fFaceCount;
+	apiMeshSharedArray<MIntArray>	fFaceCounts;
+	apiMeshSharedArray<MIntArray>	fFaceConnects;
+};
+
+#endif /* _apiMeshBVH */
@@ -87,10 +87,10 @@ MStatus apiMeshCreator::compute( const MPlug& plug, MDataBlock& datablock )
 		// and construct some apiMeshGeom for it.
 		//
 		bool hasHistory = computeInputMesh( plug, datablock,
-											geomPtr->vertices,
-											geomPtr->face_counts,
-											geomPtr->face_connects,
-											geomPtr->normals, 
+											geomPtr->vertices.write(),
+											geomPtr->face_counts.write(),
+											geomPtr->face_connects.write(),
+											geomPtr->normals.write(), 
 											geomPtr->uvcoords
 			);
 											
@@ -107,10 +107,10 @@ MStatus apiMeshCreator::compute( const MPlug& plug, MDataBlock& datablock )
 			{
 				case 0 : // build a cube
 					buildCube( shape_size,
-							   geomPtr->vertices,
-							   geomPtr->face_counts,
-							   geomPtr->face_connects,
-							   geomPtr->normals, 
+							   geomPtr->vertices.write(),
+							   geomPtr->face_counts.write(),
+							   geomPtr->face_connects.write(),
+							   geomPtr->normals.write(), 
 							   geomPtr->uvcoords
 						);
 					break;
@@ -118,10 +118,10 @@ MStatus apiMeshCreator::compute( const MPlug& plug, MDataBlock& datablock )
 				case 1 : // buld a sphere
 					buildSphere( shape_size,
 								 32,
-								 geomPtr->vertices,
-								 geomPtr->face_counts,
-								 geomPtr->face_connects,
-								 geomPtr->normals, 
+								 geomPtr->vertices.write(),
+								 geomPtr->face_counts.write(),
+								 geomPtr->face_connects.write(),
+								 geomPtr->normals.write(), 
 								 geomPtr->uvcoords
 						);
 					break;
@@ -377,7 +377,7 @@ MStatus apiMeshCreator::computeInputMesh(
 	// Check to see if we have UVs to copy. 
 	//
 	bool hasUVs = surfFn.numUVs() > 0; 	
-	surfFn.getUVs( uvs.ucoord, uvs.vcoord ); 
+	surfFn.getUVs( uvs.ucoord.write(), uvs.vcoord.write() ); 
 
 	for ( int i=0; i<surfFn.numPolygons(); i++ )
 	{
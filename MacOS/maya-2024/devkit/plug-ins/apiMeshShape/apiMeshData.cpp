@@ -22,6 +22,11 @@
 
 #include <maya/MFnSingleIndexedComponent.h>
 #include <maya/MArgList.h>
+#include <maya/MGlobal.h>
+#include <maya/MTimer.h>
+
+#include <vector>
+#include <sstream>
 
 //////////////////////////////////////////////////////////////////////
 
@@ -36,10 +41,25 @@
 #define kFaceKeyword			"face"
 #define kUVKeyword				"uv" 
 
+// Binary file layout. Values are in the byte order of the host that
+// wrote them, which the magic number identifies.
+//
+//     uint32   magic, kBinaryMagic
+//     uint32   version
+//     uint32   vertex count,  then x, y, z doubles per vertex
+//     uint32   normal count,  then x, y, z doubles per normal
+//     uint32   face count,    then an int32 vertex count per face
+//     uint32   connect count, then an int32 vertex id per face vertex
+//     uint32   uv count,      then all u floats, then all v floats
+//     uint32   uv index count, then an int32 uv id per face vertex
+//
+#define kBinaryMagic			0x6d497061		// "apIm" read as little endian
+
 //////////////////////////////////////////////////////////////////////
 
 const MTypeId apiMeshData::id( 0x80777 );
 const MString apiMeshData::typeName( "apiMeshData" );
+const unsigned int apiMeshData::kBinaryVersion = 1;
 
 apiMeshData::apiMeshData() : fGeometry( NULL )
 {
@@ -78,13 +98,149 @@ MStatus apiMeshData::readASCII( const MArgList& argList, unsigned& index )
 	return MS::kSuccess;
 }
 
+//////////////////////////////////////////////////////////////////////
+//
+// Binary IO helpers. Arrays are moved with one stream call each.
+//
+
+// Reads what writeBinary wrote, checking every count against the bytes
+// left so that a damaged file fails instead of allocating wildly.
+//
+class apiMeshBinaryReader
+{
+public:
+	apiMeshBinaryReader( istream& in, unsigned length )
+		: fIn( in ), fRemaining( length ) {}
+
+	bool read( void* dst, size_t bytes )
+	{
+		if ( bytes > fRemaining )
+			return false;
+		fIn.read( (char*)dst, bytes );
+		fRemaining -= (unsigned)bytes;
+		return fIn.good();
+	}
+
+	bool readCount( unsigned int& count, size_t elementSize )
+	{
+		return read( &count, sizeof(count) ) &&
+			   (size_t)count * elementSize <= fRemaining;
+	}
+
+	template <class T>
+	bool readArray( std::vector<T>& values, size_t elementsPerItem, unsigned int& count )
+	{
+		if ( ! readCount( count, elementsPerItem * sizeof(T) ) )
+			return false;
+		values.resize( (size_t)count * elementsPerItem );
+		return values.empty() || read( &values[0], values.size() * sizeof(T) );
+	}
+
+private:
+	istream&	fIn;
+	unsigned	fRemaining;
+};
+
+static void writeUInt( ostream& out, unsigned int value )
+{
+	out.write( (const char*)&value, sizeof(value) );
+}
+
+template <class T>
+static void writeArray( ostream& out, const std::vector<T>& values )
+{
+	if ( ! values.empty() )
+		out.write( (const char*)&values[0], values.size() * sizeof(T) );
+}
+
+static void writeIntArray( ostream& out, const MIntArray& array )
+{
+	std::vector<int> values( array.length() );
+	if ( ! values.empty() )
+		array.get( &values[0] );
+	writeUInt( out, array.length() );
+	writeArray( out, values );
+}
+
+static bool readIntArray( apiMeshBinaryReader& reader, apiMeshSharedArray<MIntArray>& array )
+{
+	std::vector<int> values;
+	unsigned int count;
+	if ( ! reader.readArray( values, 1, count ) )
+		return false;
+	array = count ? MIntArray( &values[0], count ) : MIntArray();
+	return true;
+}
+
 /* override */
-MStatus apiMeshData::readBinary( istream& /*in*/, unsigned /*length*/ )
+MStatus apiMeshData::readBinary( istream& in, unsigned length )
 //
 // Description
-//     NOT IMPLEMENTED
+//     Binary file input method, see the layout above.
 //
 {
+	apiMeshBinaryReader reader( in, length );
+	apiMeshGeom geom;
+
+	unsigned int magic = 0, version = 0;
+	if ( ! reader.read( &magic, sizeof(magic) ) ||
+		 ! reader.read( &version, sizeof(version) ) ) {
+		return MS::kFailure;
+	}
+	if ( magic != kBinaryMagic ) {
+		cerr << "apiMeshData: binary data has the wrong byte order or is not apiMeshData\n";
+		return MS::kFailure;
+	}
+	if ( version > kBinaryVersion ) {
+		cerr << "apiMeshData: binary data version " << version << " is newer than this plug-in\n";
+		return MS::kFailure;
+	}
+
+	// Vertices are stored as x, y, z and expanded to homogeneous points
+	//
+	std::vector<double> xyz;
+	unsigned int count;
+	if ( ! reader.readArray( xyz, 3, count ) ) {
+		return MS::kFailure;
+	}
+	if ( count > 0 ) {
+		std::vector<double> xyzw( (size_t)count * 4 );
+		for ( unsigned int i=0; i<count; i++ ) {
+			xyzw[i*4]   = xyz[i*3];
+			xyzw[i*4+1] = xyz[i*3+1];
+			xyzw[i*4+2] = xyz[i*3+2];
+			xyzw[i*4+3] = 1.0;
+		}
+		geom.vertices = MPointArray( (const double (*)[4])&xyzw[0], count );
+	}
+
+	std::vector<double> normals;
+	if ( ! reader.readArray( normals, 3, count ) ) {
+		return MS::kFailure;
+	}
+	if ( count > 0 ) {
+		geom.normals = MVectorArray( (const double (*)[3])&normals[0], count );
+	}
+
+	if ( ! readIntArray( reader, geom.face_counts ) ||
+		 ! readIntArray( reader, geom.face_connects ) ) {
+		return MS::kFailure;
+	}
+	geom.faceCount = geom.face_counts.length();
+
+	std::vector<float> uv;
+	if ( ! reader.readArray( uv, 2, count ) ) {
+		return MS::kFailure;
+	}
+	if ( count > 0 ) {
+		geom.uvcoords.ucoord = MFloatArray( &uv[0], count );
+		geom.uvcoords.vcoord = MFloatArray( &uv[count], count );
+	}
+	if ( ! readIntArray( reader, geom.uvcoords.faceVertexIndex ) ) {
+		return MS::kFailure;
+	}
+
+	*fGeometry = geom;
 	return MS::kSuccess;
 }
 
@@ -110,13 +266,49 @@ MStatus apiMeshData::writeASCII( ostream& out )
 }
 
 /* override */
-MStatus apiMeshData::writeBinary( ostream& /*out*/ )
+MStatus apiMeshData::writeBinary( ostream& out )
 //
 // Description
-//    NOT IMPLEMENTED
+//    Binary file output method, see the layout above.
 //
 {
-	return MS::kSuccess;
+	writeUInt( out, kBinaryMagic );
+	writeUInt( out, kBinaryVersion );
+
+	unsigned int vertexCount = fGeometry->vertices.length();
+	std::vector<double> xyz( (size_t)vertexCount * 3 );
+	for ( unsigned int i=0; i<vertexCount; i++ ) {
+		const MPoint& vertex = fGeometry->vertices[i];
+		xyz[i*3]   = vertex.x;
+		xyz[i*3+1] = vertex.y;
+		xyz[i*3+2] = vertex.z;
+	}
+	writeUInt( out, vertexCount );
+	writeArray( out, xyz );
+
+	unsigned int normalCount = fGeometry->normals.length();
+	std::vector<double> normals( (size_t)normalCount * 3 );
+	if ( normalCount > 0 ) {
+		fGeometry->normals.read().get( (double (*)[3])&normals[0] );
+	}
+	writeUInt( out, normalCount );
+	writeArray( out, normals );
+
+	writeIntArray( out, fGeometry->face_counts );
+	writeIntArray( out, fGeometry->face_connects );
+
+	unsigned int uvCount = fGeometry->uvcoords.uvcount();
+	std::vector<float> uv( (size_t)uvCount * 2 );
+	if ( uvCount > 0 ) {
+		fGeometry->uvcoords.ucoord.read().get( &uv[0] );
+		fGeometry->uvcoords.vcoord.read().get( &uv[uvCount] );
+	}
+	writeUInt( out, uvCount );
+	writeArray( out, uv );
+
+	writeIntArray( out, fGeometry->uvcoords.faceVertexIndex );
+
+	return out.good() ? MS::kSuccess : MS::kFailure;
 }
 
 /* override */
@@ -439,3 +631,197 @@ MStatus apiMeshData::readFacesASCII( const MArgList& argList,
 	fGeometry->faceCount = fGeometry->face_counts.length();
 	return result;
 }
+
+//////////////////////////////////////////////////////////////////////
+//
+// apiMeshDataBenchmark
+//
+
+void* apiMeshDataBenchmark::creator()
+{
+	return new apiMeshDataBenchmark;
+}
+
+// A square grid of quads with per vertex normals and uvs
+//
+static void makeGrid( apiMeshGeom& geom, int side )
+{
+	for ( int j=0; j<side; j++ ) {
+		for ( int i=0; i<side; i++ ) {
+			geom.vertices.append( MPoint( i * 0.1, 0.01 * ((i * 7 + j * 13) % 17), j * 0.1 ) );
+			geom.normals.append( MVector( 0.0, 1.0, 0.0 ) );
+			geom.uvcoords.append_uv( (float)i / side, (float)j / side );
+		}
+	}
+	for ( int j=0; j<side-1; j++ ) {
+		for ( int i=0; i<side-1; i++ ) {
+			int v = j * side + i;
+			int corners[4] = { v, v + 1, v + side + 1, v + side };
+			geom.face_counts.append( 4 );
+			for ( int c=0; c<4; c++ ) {
+				geom.face_connects.append( corners[c] );
+				geom.uvcoords.faceVertexIndex.append( corners[c] );
+			}
+		}
+	}
+	geom.faceCount = geom.face_counts.length();
+}
+
+static bool sameIntArray( const MIntArray& a, const MIntArray& b )
+{
+	if ( a.length() != b.length() )
+		return false;
+	for ( unsigned int i=0; i<a.length(); i++ ) {
+		if ( a[i] != b[i] )
+			return false;
+	}
+	return true;
+}
+
+static bool sameGeometry( const apiMeshGeom& a, const apiMeshGeom& b )
+{
+	if ( a.vertices.length() != b.vertices.length() ||
+		 a.normals.length() != b.normals.length() ||
+		 a.uvcoords.uvcount() != b.uvcoords.uvcount() ||
+		 a.faceCount != b.faceCount ) {
+		return false;
+	}
+	for ( unsigned int i=0; i<a.vertices.length(); i++ ) {
+		if ( a.vertices[i] != b.vertices[i] )
+			return false;
+	}
+	for ( unsigned int i=0; i<a.normals.length(); i++ ) {
+		if ( a.normals[i] != b.normals[i] )
+			return false;
+	}
+	for ( int i=0; i<a.uvcoords.uvcount(); i++ ) {
+		if ( a.uvcoords.u(i) != b.uvcoords.u(i) || a.uvcoords.v(i) != b.uvcoords.v(i) )
+			return false;
+	}
+	return sameIntArray( a.face_counts, b.face_counts ) &&
+		   sameIntArray( a.face_connects, b.face_connects ) &&
+		   sameIntArray( a.uvcoords.faceVertexIndex, b.uvcoords.faceVertexIndex );
+}
+
+MStatus apiMeshDataBenchmark::doIt( const MArgList& args )
+{
+	int vertexCount = 2000000;
+	if ( args.length() > 0 ) {
+		args.get( 0, vertexCount );
+	}
+	int side = 2;
+	while ( side * side < vertexCount )
+		side++;
+
+	apiMeshData source;
+	makeGrid( *source.fGeometry, side );
+
+	MTimer timer;
+	MString msg;
+
+	// ASCII. The file reader hands readASCII the tokens of the data
+	// statement, so the text is split into an argument list first; that
+	// step is timed separately.
+	//
+	std::ostringstream asciiOut;
+	timer.beginTimer();
+	source.writeASCII( asciiOut );
+	timer.endTimer();
+	double asciiWrite = timer.elapsedTime();
+
+	std::istringstream asciiIn( asciiOut.str() );
+	MArgList tokens;
+	std::string token;
+	timer.beginTimer();
+	while ( asciiIn >> token ) {
+		if ( token.size() >= 2 && token[0] == '"' )
+			token = token.substr( 1, token.size() - 2 );
+		tokens.addArg( MString( token.c_str() ) );
+	}
+	timer.endTimer();
+	double asciiTokenize = timer.elapsedTime();
+
+	apiMeshData asciiCopy;
+	unsigned index = 0;
+	timer.beginTimer();
+	MStatus asciiStat = asciiCopy.readASCII( tokens, index );
+	timer.endTimer();
+	double asciiRead = timer.elapsedTime();
+
+	// Binary
+	//
+	std::ostringstream binaryOut;
+	timer.beginTimer();
+	MStatus binaryStat = source.writeBinary( binaryOut );
+	timer.endTimer();
+	double binaryWrite = timer.elapsedTime();
+
+	std::string bytes = binaryOut.str();
+	std::istringstream binaryIn( bytes );
+	apiMeshData binaryCopy;
+	timer.beginTimer();
+	if ( binaryStat )
+		binaryStat = binaryCopy.readBinary( binaryIn, (unsigned)bytes.size() );
+	timer.endTimer();
+	double binaryRead = timer.elapsedTime();
+
+	bool roundTrip = binaryStat && sameGeometry( *source.fGeometry, *binaryCopy.fGeometry );
+
+	// Pass the data along inputSurface -> cachedSurface -> outputSurface
+	// -> worldSurface, then tweak a vertex of the last copy
+	//
+	const int kChainLength = 4;
+	apiMeshData chain[kChainLength];
+	timer.beginTimer();
+	chain[0].copy( source );
+	for ( int i=1; i<kChainLength; i++ )
+		chain[i].copy( chain[i-1] );
+	timer.endTimer();
+	double copyTime = timer.elapsedTime();
+
+	timer.beginTimer();
+	chain[kChainLength-1].fGeometry->vertices.write()[0] += MVector( 0.0, 1.0, 0.0 );
+	timer.endTimer();
+	double tweakTime = timer.elapsedTime();
+
+	bool shared = chain[kChainLength-1].fGeometry->face_connects.sharesWith( source.fGeometry->face_connects ) &&
+				  ! chain[kChainLength-1].fGeometry->vertices.sharesWith( source.fGeometry->vertices ) &&
+				  source.fGeometry->vertices.sharesWith( chain[0].fGeometry->vertices );
+
+	msg.format( "apiMeshData ^1s vertices, ^2s faces",
+				MString() + (int)source.fGeometry->vertices.length(),
+				MString() + source.fGeometry->faceCount );
+	MGlobal::displayInfo( msg );
+	msg.format( "  ASCII:  write ^1s s, tokenize ^2s s, read ^3s s, ^4s MB",
+				MString() + asciiWrite, MString() + asciiTokenize, MString() + asciiRead,
+				MString() + (double)asciiOut.str().size() / (1024.0 * 1024.0) );
+	MGlobal::displayInfo( msg );
+	msg.format( "  binary: write ^1s s, read ^2s s, ^3s MB",
+				MString() + binaryWrite, MString() + binaryRead,
+				MString() + (double)bytes.size() / (1024.0 * 1024.0) );
+	MGlobal::displayInfo( msg );
+
+	msg.format( "  copy along ^1s plugs: ^2s s, first tweak after: ^3s s, ^4s MB of vertices",
+				MString() + kChainLength, MString() + copyTime, MString() + tweakTime,
+				MString() + (double)source.fGeometry->vertices.length() * sizeof(MPoint) / (1024.0 * 1024.0) );
+	MGlobal::displayInfo( msg );
+
+	if ( ! shared ) {
+		MGlobal::displayWarning( "Copies did not share their arrays as expected" );
+	}
+	if ( ! asciiStat ) {
+		MGlobal::displayWarning( "ASCII read failed" );
+	}
+	if ( ! roundTrip ) {
+		displayError( "Binary round trip did not reproduce the geometry" );
+		return MS::kFailure;
+	}
+
+	appendToResult( asciiWrite );
+	appendToResult( asciiTokenize + asciiRead );
+	appendToResult( binaryWrite );
+	appendToResult( binaryRead );
+	appendToResult( copyTime );
+	appendToResult( tweakTime );
+	return MS::kSuccess;
+}
@@ -26,6 +26,7 @@
 #define _apiMeshData
 
 #include <maya/MPxGeometryData.h>
+#include <maya/MPxCommand.h>
 #include <maya/MTypeId.h>
 #include <maya/MString.h>
 #include "apiMeshGeom.h"
@@ -86,6 +87,10 @@ public:
 	MStatus					writeFacesASCII( std::ostream& out );
 	MStatus					writeUVASCII( std::ostream& out );
 
+	// Version of the binary layout written by writeBinary
+	//
+	static const unsigned int kBinaryVersion;
+
 	static void * creator();
 
 public:
@@ -97,4 +102,23 @@ public:
 	apiMeshGeom* fGeometry;
 };
 
+///////////////////////////////////////////////////////////////////////////////
+//
+// apiMeshDataBenchmark [vertexCount]
+//
+// Times the ASCII and binary write and read of an apiMeshData grid with
+// about vertexCount vertices (2 million by default) and checks that the
+// binary round trip gives back the same geometry. Also times passing the
+// data along a chain of plugs, which shares the arrays, and the first
+// tweak after it, which copies the vertices only.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+class apiMeshDataBenchmark : public MPxCommand
+{
+public:
+	MStatus			doIt( const MArgList& args ) override;
+	static void*	creator();
+};
+
 #endif /* apimeshData */
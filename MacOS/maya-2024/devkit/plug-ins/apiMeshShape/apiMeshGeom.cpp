@@ -25,7 +25,8 @@ apiMeshGeom::~apiMeshGeom() {}
 /* override */
 apiMeshGeom& apiMeshGeom::operator=( const apiMeshGeom& other )
 //
-// Copy the geometry
+// Copy the geometry. The arrays are shared with the other copy until
+// either side modifies them.
 //
 {
 	if ( &other != this ) {
@@ -17,6 +17,11 @@
 // This class holds the underlying geometry for the shape or data.
 // This is where geometry specific data and methods should go.
 //
+// The arrays are shared between copies of the geometry and only copied
+// when one of the copies modifies them (copy-on-write). Data passed
+// unchanged from plug to plug, e.g. inputSurface to outputSurface, then
+// costs a reference count update instead of a copy of every array.
+//
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <maya/MPointArray.h>
@@ -24,11 +29,68 @@
 #include <maya/MFloatArray.h> 
 #include <maya/MVectorArray.h>
 
+#include <memory>
+#include <utility>
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// A Maya array shared between copies until written.
+//
+// Reading goes through the const accessors. There is deliberately no
+// non-const operator[]: code that modifies the array asks for it with
+// write(), which makes a private copy first if the array is shared.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+template <class T>
+class apiMeshSharedArray
+{
+public:
+	apiMeshSharedArray() : fArray( std::make_shared<T>() ) {}
+	apiMeshSharedArray( const T& array ) : fArray( std::make_shared<T>( array ) ) {}
+
+	apiMeshSharedArray& operator=( const T& array )
+	{
+		fArray = std::make_shared<T>( array );
+		return *this;
+	}
+
+	const T&		read() const { return *fArray; }
+	operator		const T&() const { return *fArray; }
+	unsigned int	length() const { return fArray->length(); }
+	auto			operator[]( unsigned int index ) const
+						-> decltype( std::declval<const T&>()[index] )
+	{
+		return read()[index];
+	}
+
+	T& write()
+	{
+		if ( fArray.use_count() > 1 ) {
+			fArray = std::make_shared<T>( *fArray );
+		}
+		return *fArray;
+	}
+
+	template <class V>
+	void			append( const V& value ) { write().append( value ); }
+	void			clear() { fArray = std::make_shared<T>(); }
+
+	bool			isShared() const { return fArray.use_count() > 1; }
+	bool			sharesWith( const apiMeshSharedArray& other ) const
+	{
+		return fArray == other.fArray;
+	}
+
+private:
+	std::shared_ptr<T>	fArray;
+};
+
 class apiMeshGeomUV; 
 
 class apiMeshGeomUV { 
   public: 
-	apiMeshGeomUV() { reset(); } 
+	apiMeshGeomUV() {} 
 	~apiMeshGeomUV() {} 
 
 	int					uvId( int faceVertexIndex ) const;
@@ -39,9 +101,9 @@ class apiMeshGeomUV {
 	void				append_uv( float u, float v ); 
 	void				reset(); 
 	
-	MIntArray			faceVertexIndex; 
-	MFloatArray			ucoord; 
-	MFloatArray			vcoord; 
+	apiMeshSharedArray<MIntArray>	faceVertexIndex; 
+	apiMeshSharedArray<MFloatArray>	ucoord; 
+	apiMeshSharedArray<MFloatArray>	vcoord; 
 };
 
 inline void apiMeshGeomUV::reset()
@@ -90,10 +152,10 @@ public:
 	apiMeshGeom& operator=( const apiMeshGeom& );
 
 public:
-    MPointArray	  vertices;
-    MIntArray	  face_counts;
-    MIntArray	  face_connects;
-    MVectorArray  normals;
+    apiMeshSharedArray<MPointArray>	 vertices;
+    apiMeshSharedArray<MIntArray>	 face_counts;
+    apiMeshSharedArray<MIntArray>	 face_connects;
+    apiMeshSharedArray<MVectorArray> normals;
 	apiMeshGeomUV uvcoords; 
     int			  faceCount;
 };
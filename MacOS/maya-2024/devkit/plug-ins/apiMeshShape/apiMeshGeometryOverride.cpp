@@ -34,9 +34,11 @@
 #include <maya/MFnSingleIndexedComponent.h>
 #include <maya/MFnDagNode.h>
 #include <maya/MDrawRegistry.h>
+#include <maya/MArgList.h>
 #include <set>
 #include <vector>
 #include <memory>
+#include <algorithm>
 
 // Custom user data class to attach to render items
 class apiMeshUserData : public MUserData
@@ -453,10 +455,19 @@ const MString apiMeshGeometryOverride::sFaceSelectionItemName = "apiMeshFaceSele
 const MString apiMeshGeometryOverride::sActiveVertexStreamName = "apiMeshSharedVertexStream";
 const MString apiMeshGeometryOverride::sFaceCenterStreamName = "apiMeshFaceCenterStream";
 
+unsigned long long apiMeshGeometryOverride::sLastUpdateBytes = 0;
+unsigned long long apiMeshGeometryOverride::sTotalBytes = 0;
+unsigned long long apiMeshGeometryOverride::sUpdateCount = 0;
+unsigned long long apiMeshGeometryOverride::sPartialUpdateCount = 0;
+
 apiMeshGeometryOverride::apiMeshGeometryOverride(const MObject& obj)
 : MPxGeometryOverride(obj)
 , fMesh(NULL)
 , fMeshGeom(NULL)
+, fFullUpdate(true)
+, fFilledVertexCount(0)
+, fVertexSlotsValid(false)
+, fUpdateBytes(0)
 , fColorRemapTexture(NULL)
 , fLinearSampler(NULL)
 {
@@ -564,6 +575,22 @@ void apiMeshGeometryOverride::updateDG()
 	{
 		fMeshGeom = fMesh->meshGeomToUse();
 
+		// Collect the vertices moved since the buffers were last filled.
+		// They add up until populateGeometry has used them.
+		std::vector<int> dirtyVertices;
+		if (!fMesh->takeDirtyVertices(dirtyVertices) || !fMeshGeom || !sameTopology())
+		{
+			fFullUpdate = true;
+		}
+		if (fFullUpdate)
+		{
+			fDirtyVertices.clear();
+		}
+		else
+		{
+			fDirtyVertices.insert(fDirtyVertices.end(), dirtyVertices.begin(), dirtyVertices.end());
+		}
+
 		if (fMesh->hasActiveComponents())
 		{
 			MObjectArray activeComponents = fMesh->activeComponents();
@@ -598,6 +625,31 @@ void apiMeshGeometryOverride::updateDG()
 	}
 }
 
+bool apiMeshGeometryOverride::isStreamDirty(const MHWRender::MVertexBufferDescriptor& desc)
+{
+	// Streams reported clean keep their buffers in the geometry, and the
+	// ones the moved vertices affect are patched in place there (see
+	// patchKeptVertexBuffers). Active vertex positions follow the
+	// selection and are always refilled.
+	return fFullUpdate || desc.name() == sActiveVertexStreamName;
+}
+
+/*
+	Is the stream computed from the vertex positions: positions (also used
+	by the numeric display items), face centers and the fake color per
+	vertex.
+*/
+bool apiMeshGeometryOverride::dependsOnPositions(const MHWRender::MVertexBufferDescriptor& desc)
+{
+	static const MString numeric3Value("numeric3value");
+
+	return desc.semantic() == MHWRender::MGeometry::kPosition ||
+		desc.semantic() == MHWRender::MGeometry::kColor ||
+		(desc.semantic() == MHWRender::MGeometry::kTexture &&
+		 desc.semanticName().toLowerCase() == numeric3Value &&
+		 desc.name() == sVertexPositionItemName);
+}
+
 /*
 	Some example code to print out shader parameters
 */
@@ -1981,6 +2033,7 @@ void apiMeshGeometryOverride::updateRenderItems(
 */
 void apiMeshGeometryOverride::cloneVertexBuffer(
 		MHWRender::MVertexBuffer* srcBuffer,
+		const void* srcData,
 		MHWRender::MGeometry& data,
 		MHWRender::MVertexBufferDescriptor& desc,
 		unsigned int bufferSize,
@@ -1999,14 +2052,298 @@ void apiMeshGeometryOverride::cloneVertexBuffer(
 					MHWRender::MGeometry::semanticString(desc.semantic()).asChar() );
 		}
 		void* destDataBuffer = destBuffer->acquire(bufferSize, true /*writeOnly - we don't need the current buffer values*/);
-	 	void* srcDataBuffer = srcBuffer->map();
-	 	if (srcDataBuffer && destDataBuffer)
+
+		// Copy from the source data while it is still staged, rather
+		// than reading the committed buffer back.
+		const void* srcDataBuffer = srcData ? srcData : srcBuffer->map();
+		if (srcDataBuffer && destDataBuffer)
 			memcpy(destDataBuffer, srcDataBuffer, bufferSize * desc.dataTypeSize() * desc.dimension());
 
-	 	if (destDataBuffer)
-			destBuffer->commit(destDataBuffer);
+		if (destDataBuffer)
+			commitVertexBuffer(destBuffer, destDataBuffer, bufferSize);
+
+		if (!srcData)
+			srcBuffer->unmap();
+	}
+}
+
+/*
+	Commit a filled buffer, counting the bytes uploaded.
+*/
+void apiMeshGeometryOverride::commitVertexBuffer(
+		MHWRender::MVertexBuffer* buffer,
+		void* bufferData,
+		unsigned int bufferSize)
+{
+	if (!buffer || !bufferData)
+		return;
+
+	const MHWRender::MVertexBufferDescriptor& desc = buffer->descriptor();
+	fUpdateBytes += (unsigned long long)bufferSize * desc.dataTypeSize() * desc.dimension();
+	buffer->commit(bufferData);
+}
+
+/*
+	True when the geometry has the topology the vertex buffers were last
+	filled for. The topology arrays are shared between copies of the
+	geometry until one of them is modified (see apiMeshSharedArray).
+*/
+bool apiMeshGeometryOverride::sameTopology() const
+{
+	return fMeshGeom->face_counts.sharesWith(fFilledFaceCounts) &&
+		   fMeshGeom->face_connects.sharesWith(fFilledFaceConnects) &&
+		   fMeshGeom->vertices.length() == fFilledVertexCount;
+}
+
+/*
+	Map each vertex to the buffer slots and face centers it is used by.
+	Slots are numbered as in updateGeometryRequirements: one per face-vertex
+	of the non degenerate faces, in face order.
+*/
+void apiMeshGeometryOverride::buildVertexSlots()
+{
+	const unsigned int vertexCount = fMeshGeom->vertices.length();
+	const unsigned int connectCount = fMeshGeom->face_connects.length();
+
+	fSlotConnect.clear();
+	fCenterConnect.clear();
+	fCenterSize.clear();
+	fVertexSlotStart.assign(vertexCount + 1, 0);
+	fVertexCenterStart.assign(vertexCount + 1, 0);
+
+	int vid = 0;
+	for (int i=0; i<fMeshGeom->faceCount; i++)
+	{
+		int numVerts = fMeshGeom->face_counts[i];
+		if (numVerts > 2 && vid + numVerts <= (int)connectCount)
+		{
+			fCenterConnect.push_back(vid);
+			fCenterSize.push_back(numVerts);
+			for (int j=0; j<numVerts; j++)
+			{
+				fSlotConnect.push_back(vid + j);
+				unsigned int vertexId = (unsigned int)fMeshGeom->face_connects[vid + j];
+				if (vertexId < vertexCount)
+				{
+					fVertexSlotStart[vertexId + 1]++;
+					fVertexCenterStart[vertexId + 1]++;
+				}
+			}
+		}
+		if (numVerts > 0)
+			vid += numVerts;
+	}
+
+	for (unsigned int v=0; v<vertexCount; v++)
+	{
+		fVertexSlotStart[v + 1] += fVertexSlotStart[v];
+		fVertexCenterStart[v + 1] += fVertexCenterStart[v];
+	}
+
+	std::vector<int> slotCursor(fVertexSlotStart.begin(), fVertexSlotStart.end() - 1);
+	std::vector<int> centerCursor(fVertexCenterStart.begin(), fVertexCenterStart.end() - 1);
+	fVertexSlots.resize(fVertexSlotStart[vertexCount]);
+	fVertexCenters.resize(fVertexCenterStart[vertexCount]);
+	for (unsigned int slot=0; slot<fSlotConnect.size(); slot++)
+	{
+		unsigned int vertexId = (unsigned int)fMeshGeom->face_connects[fSlotConnect[slot]];
+		if (vertexId < vertexCount)
+			fVertexSlots[slotCursor[vertexId]++] = (int)slot;
+	}
+	for (unsigned int center=0; center<fCenterConnect.size(); center++)
+	{
+		for (int j=0; j<fCenterSize[center]; j++)
+		{
+			unsigned int vertexId = (unsigned int)fMeshGeom->face_connects[fCenterConnect[center] + j];
+			if (vertexId < vertexCount)
+				fVertexCenters[centerCursor[vertexId]++] = (int)center;
+		}
+	}
+	fVertexSlotsValid = true;
+}
+
+// Sorted indices to (first, count) runs. Short gaps are bridged, as
+// rewriting a few unchanged values is cheaper than another update call.
+static void indicesToRuns(std::vector<int>& indices,
+	std::vector< std::pair<unsigned int, unsigned int> >& runs)
+{
+	static const unsigned int kMaxGap = 16;
+
+	std::sort(indices.begin(), indices.end());
+	indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+	for (size_t i=0; i<indices.size(); i++)
+	{
+		unsigned int index = (unsigned int)indices[i];
+		if (!runs.empty() && index <= runs.back().first + runs.back().second + kMaxGap)
+			runs.back().second = index - runs.back().first + 1;
+		else
+			runs.push_back(std::make_pair(index, 1u));
+	}
+}
+
+/*
+	Turn the dirty vertices into the runs of buffer slots and face centers
+	to write again.
+*/
+void apiMeshGeometryOverride::prepareDirtyRuns()
+{
+	fDirtySlotRuns.clear();
+	fDirtyCenterRuns.clear();
+	if (fDirtyVertices.empty())
+		return;
+
+	if (!fVertexSlotsValid)
+		buildVertexSlots();
+
+	const unsigned int vertexCount = (unsigned int)fVertexSlotStart.size() - 1;
+	std::vector<int> slots;
+	std::vector<int> centers;
+	for (size_t i=0; i<fDirtyVertices.size(); i++)
+	{
+		unsigned int vertexId = (unsigned int)fDirtyVertices[i];
+		if (vertexId >= vertexCount)
+			continue;
+		slots.insert(slots.end(),
+			fVertexSlots.begin() + fVertexSlotStart[vertexId],
+			fVertexSlots.begin() + fVertexSlotStart[vertexId + 1]);
+		centers.insert(centers.end(),
+			fVertexCenters.begin() + fVertexCenterStart[vertexId],
+			fVertexCenters.begin() + fVertexCenterStart[vertexId + 1]);
+	}
+	indicesToRuns(slots, fDirtySlotRuns);
+	indicesToRuns(centers, fDirtyCenterRuns);
+}
 
-	 	srcBuffer->unmap();	
+/*
+	Look for the buffer kept from the last update for a requirement.
+*/
+MHWRender::MVertexBuffer* apiMeshGeometryOverride::findVertexBuffer(
+		MHWRender::MGeometry& data,
+		const MHWRender::MVertexBufferDescriptor& desc) const
+{
+	for (int i=0; i<data.vertexBufferCount(); i++)
+	{
+		MHWRender::MVertexBuffer* buffer = data.vertexBuffer(i);
+		if (!buffer)
+			continue;
+
+		const MHWRender::MVertexBufferDescriptor& bufferDesc = buffer->descriptor();
+		if (bufferDesc.name() == desc.name() &&
+			bufferDesc.semantic() == desc.semantic() &&
+			bufferDesc.semanticName() == desc.semanticName() &&
+			bufferDesc.dataType() == desc.dataType() &&
+			bufferDesc.dimension() == desc.dimension())
+		{
+			return buffer;
+		}
+	}
+	return NULL;
+}
+
+/*
+	Patch the buffers kept in the geometry from the last update. Streams
+	reported clean are not part of the requirements, so the buffers are
+	looked up in the geometry itself.
+*/
+void apiMeshGeometryOverride::patchKeptVertexBuffers(
+		MHWRender::MGeometry& data,
+		bool debugPopulateGeometry)
+{
+	if (fDirtySlotRuns.empty() && fDirtyCenterRuns.empty())
+		return;
+
+	for (int i=0; i<data.vertexBufferCount(); i++)
+	{
+		MHWRender::MVertexBuffer* buffer = data.vertexBuffer(i);
+		if (!buffer)
+			continue;
+
+		const MHWRender::MVertexBufferDescriptor& desc = buffer->descriptor();
+		if (desc.name() != sActiveVertexStreamName)
+			patchVertexBuffer(buffer, desc, debugPopulateGeometry);
+	}
+}
+
+/*
+	Write the dirty runs of a buffer kept from the last update. Only the
+	streams computed from vertex positions and the normals change:
+	positions (also used by the numeric display items), face centers, the
+	fake color per vertex and the per vertex normals, which the shape
+	updates along with the moved vertices. Uvs and vertex ids stay as they
+	were.
+*/
+void apiMeshGeometryOverride::patchVertexBuffer(
+		MHWRender::MVertexBuffer* buffer,
+		const MHWRender::MVertexBufferDescriptor& desc,
+		bool debugPopulateGeometry)
+{
+	bool normals = (desc.semantic() == MHWRender::MGeometry::kNormal);
+	if ((!normals && !dependsOnPositions(desc)) ||
+		desc.dataType() != MHWRender::MGeometry::kFloat)
+	{
+		return;
+	}
+
+	bool faceCenters = (desc.name() == sFaceCenterStreamName);
+	if (normals && faceCenters)
+		return;
+	const std::vector< std::pair<unsigned int, unsigned int> >& runs =
+		faceCenters ? fDirtyCenterRuns : fDirtySlotRuns;
+	if (debugPopulateGeometry && !runs.empty())
+	{
+		printf(">>> Patch %d runs of buffer with name %s. Semantic = %s\n",
+				(int)runs.size(), desc.name().asChar(),
+				MHWRender::MGeometry::semanticString(desc.semantic()).asChar() );
+	}
+
+	const int dimension = desc.dimension();
+	std::vector<float> values;
+	for (size_t r=0; r<runs.size(); r++)
+	{
+		const unsigned int first = runs[r].first;
+		const unsigned int count = runs[r].second;
+		values.resize((size_t)count * dimension);
+		for (unsigned int k=0; k<count; k++)
+		{
+			float position[3];
+			if (faceCenters)
+			{
+				// Same arithmetic as the full fill
+				const int base = fCenterConnect[first + k];
+				const int numVerts = fCenterSize[first + k];
+				double x = 0.0;
+				double y = 0.0;
+				double z = 0.0;
+				for (int v=0; v<numVerts; v++)
+				{
+					const MPoint& p = fMeshGeom->vertices[fMeshGeom->face_connects[base + v]];
+					x += p[0];
+					y += p[1];
+					z += p[2];
+				}
+				position[0] = (float)x/numVerts;
+				position[1] = (float)y/numVerts;
+				position[2] = (float)z/numVerts;
+			}
+			else if (normals)
+			{
+				const MVector& n = fMeshGeom->normals[fMeshGeom->face_connects[fSlotConnect[first + k]]];
+				position[0] = (float)n[0];
+				position[1] = (float)n[1];
+				position[2] = (float)n[2];
+			}
+			else
+			{
+				const MPoint& p = fMeshGeom->vertices[fMeshGeom->face_connects[fSlotConnect[first + k]]];
+				position[0] = (float)p[0];
+				position[1] = (float)p[1];
+				position[2] = (float)p[2];
+			}
+			for (int c=0; c<dimension; c++)
+				values[(size_t)k * dimension + c] = (c < 3) ? position[c] : 1.0f;
+		}
+		buffer->update(&values[0], first, count, false /*truncateIfSmaller*/);
+		fUpdateBytes += (unsigned long long)count * dimension * sizeof(float);
 	}
 }
 
@@ -2049,6 +2386,12 @@ void apiMeshGeometryOverride::updateGeometryRequirements(
 	float* uvs = NULL;
 	int numUVs = fMeshGeom->uvcoords.uvcount();
 
+	fUpdateBytes = 0;
+	if (!fFullUpdate)
+	{
+		prepareDirtyRuns();
+		patchKeptVertexBuffers(data, debugPopulateGeometry);
+	}
 
 	const MHWRender::MVertexBufferDescriptorList& descList =
 		requirements.vertexRequirements();
@@ -2063,6 +2406,14 @@ void apiMeshGeometryOverride::updateGeometryRequirements(
 			continue;
 		}
 
+		// Buffers kept from the last update have already been patched
+		//
+		if (!fFullUpdate && !isStreamDirty(desc) && findVertexBuffer(data, desc))
+		{
+			satisfiedRequirements[reqNum] = true;
+			continue;
+		}
+
 		// Fill in vertex data for drawing active vertex components (if drawSharedActiveVertices=true)
 		//
 		if (fDrawSharedActiveVertices && (desc.name() == sActiveVertexStreamName))
@@ -2381,42 +2732,6 @@ void apiMeshGeometryOverride::updateGeometryRequirements(
 		}
 	}
 
-	if (positions)
-	{
-		positionBuffer->commit(positions);
-	}
-
-	if (normals)
-	{
-		normalBuffer->commit(normals);
-	}
-
-	if (uvs)
-	{
-		uvBuffer->commit(uvs);
-	}
-	if (cpv)
-	{
-		cpvBuffer->commit(cpv);
-	}
-	
-	if (vertexNumericIds)
-	{
-		vertexNumericIdBuffer->commit(vertexNumericIds);
-	}
-	if (vertexNumericIdPositions)
-	{
-		vertexNumericIdPositionBuffer->commit(vertexNumericIdPositions);
-	}
-	if (vertexNumericLocations)
-	{
-		vertexNumericLocationBuffer->commit(vertexNumericLocations);
-	}
-	if (vertexNumericLocationPositions)
-	{
-		vertexNumericLocationPositionBuffer->commit(vertexNumericLocationPositions);
-	}
-
 	// Fill in active vertex data buffer (only when fDrawSharedActiveVertices=true
 	// which results in activeVertexPositions and activeVertexPositionBuffer being non-NULL)
 	//
@@ -2443,7 +2758,6 @@ void apiMeshGeometryOverride::updateGeometryRequirements(
 				activeVertexPositions[pid++] = (float)position[2];
 			}
 		}
-		activeVertexPositionBuffer->commit(activeVertexPositions);
 	}
 	if (activeVertexUVs && activeVertexUVBuffer)
 	{
@@ -2460,7 +2774,6 @@ void apiMeshGeometryOverride::updateGeometryRequirements(
 		{
 			activeVertexUVs[pid++] = (float)i/ (float)activeVertexCount;
 		}
-		activeVertexUVBuffer->commit(activeVertexUVs);
 	}
 
 	// Fill in face center data buffer (only when fDrawFaceCenter=true
@@ -2512,7 +2825,6 @@ void apiMeshGeometryOverride::updateGeometryRequirements(
 			}
 
 		}
-		faceCenterPositionBuffer->commit(faceCenterPositions);
 	}
 
 	// Run around a second time and handle duplicate buffers and unknown buffers
@@ -2530,13 +2842,13 @@ void apiMeshGeometryOverride::updateGeometryRequirements(
 			case MHWRender::MGeometry::kPosition:
 				{
 					satisfiedRequirements[reqNum] = true;
-					cloneVertexBuffer(activeVertexPositionBuffer, data, desc, activeVertexCount, debugPopulateGeometry);
+					cloneVertexBuffer(activeVertexPositionBuffer, activeVertexPositions, data, desc, activeVertexCount, debugPopulateGeometry);
 				}
 				break;
 			case MHWRender::MGeometry::kTexture:
 				{
 					satisfiedRequirements[reqNum] = true;
-					cloneVertexBuffer(activeVertexUVBuffer, data, desc, activeVertexCount, debugPopulateGeometry);
+					cloneVertexBuffer(activeVertexUVBuffer, activeVertexUVs, data, desc, activeVertexCount, debugPopulateGeometry);
 				}
 			default:
 				break;
@@ -2550,7 +2862,7 @@ void apiMeshGeometryOverride::updateGeometryRequirements(
 			case MHWRender::MGeometry::kPosition:
 				{
 					satisfiedRequirements[reqNum] = true;
-					cloneVertexBuffer(faceCenterPositionBuffer, data, desc, fMeshGeom->faceCount, debugPopulateGeometry);
+					cloneVertexBuffer(faceCenterPositionBuffer, faceCenterPositions, data, desc, fMeshGeom->faceCount, debugPopulateGeometry);
 				}
 				break;
 			default:
@@ -2566,17 +2878,17 @@ void apiMeshGeometryOverride::updateGeometryRequirements(
 					if (desc.name() == sVertexIdItemName)
 					{
 						satisfiedRequirements[reqNum] = true;
-						cloneVertexBuffer(vertexNumericIdPositionBuffer, data, desc, totalVerts, debugPopulateGeometry);
+						cloneVertexBuffer(vertexNumericIdPositionBuffer, vertexNumericIdPositions, data, desc, totalVerts, debugPopulateGeometry);
 					}
 					else if (desc.name() == sVertexPositionItemName)
 					{
 						satisfiedRequirements[reqNum] = true;
-						cloneVertexBuffer(vertexNumericLocationPositionBuffer, data, desc, totalVerts, debugPopulateGeometry);
+						cloneVertexBuffer(vertexNumericLocationPositionBuffer, vertexNumericLocationPositions, data, desc, totalVerts, debugPopulateGeometry);
 					}
 					else
 					{
 						satisfiedRequirements[reqNum] = true;
-						cloneVertexBuffer(positionBuffer, data, desc, totalVerts, debugPopulateGeometry);
+						cloneVertexBuffer(positionBuffer, positions, data, desc, totalVerts, debugPopulateGeometry);
 					}
 
 				}
@@ -2584,7 +2896,7 @@ void apiMeshGeometryOverride::updateGeometryRequirements(
 			case MHWRender::MGeometry::kNormal:
 				{
 					satisfiedRequirements[reqNum] = true;
-					cloneVertexBuffer(normalBuffer, data, desc, totalVerts, debugPopulateGeometry);
+					cloneVertexBuffer(normalBuffer, normals, data, desc, totalVerts, debugPopulateGeometry);
 				}
 				break;
 			case MHWRender::MGeometry::kTexture:
@@ -2595,25 +2907,25 @@ void apiMeshGeometryOverride::updateGeometryRequirements(
 					if ((desc.semanticName().toLowerCase() == numericValue) && (desc.name() == sVertexIdItemName))
 					{
 						satisfiedRequirements[reqNum] = true;
-						cloneVertexBuffer(vertexNumericIdBuffer, data, desc, totalVerts, debugPopulateGeometry);
+						cloneVertexBuffer(vertexNumericIdBuffer, vertexNumericIds, data, desc, totalVerts, debugPopulateGeometry);
 					}
 					else if ((desc.semanticName().toLowerCase() == numeric3Value) && (desc.name() == sVertexPositionItemName))
 					{
 						satisfiedRequirements[reqNum] = true;
-						cloneVertexBuffer(vertexNumericLocationBuffer, data, desc, totalVerts, debugPopulateGeometry);
+						cloneVertexBuffer(vertexNumericLocationBuffer, vertexNumericLocations, data, desc, totalVerts, debugPopulateGeometry);
 					}
 					else if (desc.name() != sVertexIdItemName &&
 							 desc.name() != sVertexPositionItemName)
 					{
 						satisfiedRequirements[reqNum] = true;
-						cloneVertexBuffer(uvBuffer, data, desc, totalVerts, debugPopulateGeometry);
+						cloneVertexBuffer(uvBuffer, uvs, data, desc, totalVerts, debugPopulateGeometry);
 					}
 				}
 				break;
 			case MHWRender::MGeometry::kColor:
 				{
 					satisfiedRequirements[reqNum] = true;
-					cloneVertexBuffer(cpvBuffer, data, desc, totalVerts, debugPopulateGeometry);
+					cloneVertexBuffer(cpvBuffer, cpv, data, desc, totalVerts, debugPopulateGeometry);
 				}
 				break;
 			default:
@@ -2638,12 +2950,47 @@ void apiMeshGeometryOverride::updateGeometryRequirements(
 				if (destDataBuffer)
 				{
 					memset(destDataBuffer, 0, totalVerts * desc.dataTypeSize() * desc.dimension());
-					destBuffer->commit(destDataBuffer);
+					commitVertexBuffer(destBuffer, destDataBuffer, totalVerts);
 				}
 			}
 		}
 	}
 	delete [] satisfiedRequirements;
+
+	// Commit the filled buffers. This is left until the duplicates have
+	// been cloned from them.
+	//
+	commitVertexBuffer(positionBuffer, positions, totalVerts);
+	commitVertexBuffer(normalBuffer, normals, totalVerts);
+	commitVertexBuffer(uvBuffer, uvs, totalVerts);
+	commitVertexBuffer(cpvBuffer, cpv, totalVerts);
+	commitVertexBuffer(vertexNumericIdBuffer, vertexNumericIds, totalVerts);
+	commitVertexBuffer(vertexNumericIdPositionBuffer, vertexNumericIdPositions, totalVerts);
+	commitVertexBuffer(vertexNumericLocationBuffer, vertexNumericLocations, totalVerts);
+	commitVertexBuffer(vertexNumericLocationPositionBuffer, vertexNumericLocationPositions, totalVerts);
+	commitVertexBuffer(activeVertexPositionBuffer, activeVertexPositions, activeVertexCount);
+	commitVertexBuffer(activeVertexUVBuffer, activeVertexUVs, activeVertexCount);
+	commitVertexBuffer(faceCenterPositionBuffer, faceCenterPositions, fMeshGeom->faceCount);
+
+	// The buffers now match the geometry
+	//
+	if (fFullUpdate)
+	{
+		fFilledFaceCounts = fMeshGeom->face_counts;
+		fFilledFaceConnects = fMeshGeom->face_connects;
+		fFilledVertexCount = fMeshGeom->vertices.length();
+		fVertexSlotsValid = false;
+	}
+	else if (!fDirtyVertices.empty())
+	{
+		sPartialUpdateCount++;
+	}
+	fFullUpdate = false;
+	fDirtyVertices.clear();
+
+	sLastUpdateBytes = fUpdateBytes;
+	sTotalBytes += fUpdateBytes;
+	sUpdateCount++;
 }
 
 /*
@@ -3536,3 +3883,54 @@ void apiMeshGeometryOverride::handleTraceMessage( const MString &message ) const
 
 
 
+
+/*
+	apiMeshUploadStats [-reset]
+
+	Prints the bytes written to vertex buffers by the last update of an
+	apiMesh geometry override and since the last reset, and returns
+	them with the number of updates and how many of those were partial.
+	Useful to check that tweaking a few vertices of a large mesh uploads
+	only those.
+*/
+void* apiMeshUploadStatsCmd::creator()
+{
+	return new apiMeshUploadStatsCmd;
+}
+
+MStatus apiMeshUploadStatsCmd::doIt( const MArgList& args )
+{
+	bool reset = false;
+	for ( unsigned int i=0; i<args.length(); i++ )
+	{
+		MString arg = args.asString( i );
+		if ( arg == "-r" || arg == "-reset" ) {
+			reset = true;
+		}
+		else {
+			displayError( "Usage: apiMeshUploadStats [-reset]" );
+			return MS::kInvalidParameter;
+		}
+	}
+
+	MString msg;
+	msg.format( "apiMesh vertex buffers: last update ^1s KB, ^2s KB in ^3s updates (^4s partial)",
+				MString() + (double)apiMeshGeometryOverride::sLastUpdateBytes / 1024.0,
+				MString() + (double)apiMeshGeometryOverride::sTotalBytes / 1024.0,
+				MString() + (double)apiMeshGeometryOverride::sUpdateCount,
+				MString() + (double)apiMeshGeometryOverride::sPartialUpdateCount );
+	MGlobal::displayInfo( msg );
+
+	appendToResult( (double)apiMeshGeometryOverride::sLastUpdateBytes );
+	appendToResult( (double)apiMeshGeometryOverride::sTotalBytes );
+	appendToResult( (double)apiMeshGeometryOverride::sUpdateCount );
+	appendToResult( (double)apiMeshGeometryOverride::sPartialUpdateCount );
+
+	if ( reset ) {
+		apiMeshGeometryOverride::sLastUpdateBytes = 0;
+		apiMeshGeometryOverride::sTotalBytes = 0;
+		apiMeshGeometryOverride::sUpdateCount = 0;
+		apiMeshGeometryOverride::sPartialUpdateCount = 0;
+	}
+	return MS::kSuccess;
+}
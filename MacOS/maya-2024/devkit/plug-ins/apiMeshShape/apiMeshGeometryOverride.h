@@ -22,10 +22,13 @@
 #include <maya/MIntArray.h>
 #include <maya/MStateManager.h>
 #include <maya/MTextureManager.h>
+#include <maya/MPxCommand.h>
 #include <set>
+#include <vector>
+#include <utility>
+#include "apiMeshGeom.h"
 
 class apiMesh;
-class apiMeshGeom;
 
 class apiMeshGeometryOverride : public MHWRender::MPxGeometryOverride
 {
@@ -40,6 +43,7 @@ public:
 	MHWRender::DrawAPI supportedDrawAPIs() const override;
 
 	void updateDG() override;
+	bool isStreamDirty(const MHWRender::MVertexBufferDescriptor& desc) override;
 	void updateRenderItems(
 		const MDagPath& path,
 		MHWRender::MRenderItemList& list) override;
@@ -59,6 +63,12 @@ public:
 	static MStatus registerComponentConverters();
 	static MStatus deregisterComponentConverters();
 
+	// Bytes written to vertex buffers, by all apiMesh geometry overrides
+	static unsigned long long sLastUpdateBytes;
+	static unsigned long long sTotalBytes;
+	static unsigned long long sUpdateCount;
+	static unsigned long long sPartialUpdateCount;
+
 protected:
 	void printShader(MHWRender::MShaderInstance* shader);
 	void setSolidColor(MHWRender::MShaderInstance* shaderInstance, const float *value);
@@ -87,11 +97,28 @@ protected:
 
 	void cloneVertexBuffer(
 		MHWRender::MVertexBuffer* srcBuffer,
+		const void* srcData,
 		MHWRender::MGeometry& data,
 		MHWRender::MVertexBufferDescriptor& desc,
 		unsigned int bufferSize,
 		bool debugPopulateGeometry);
 
+	// Partial vertex buffer updates
+	bool sameTopology() const;
+	void buildVertexSlots();
+	void prepareDirtyRuns();
+	MHWRender::MVertexBuffer* findVertexBuffer(MHWRender::MGeometry& data,
+		const MHWRender::MVertexBufferDescriptor& desc) const;
+	void commitVertexBuffer(MHWRender::MVertexBuffer* buffer,
+		void* bufferData,
+		unsigned int bufferSize);
+	void patchKeptVertexBuffers(MHWRender::MGeometry& data,
+		bool debugPopulateGeometry);
+	void patchVertexBuffer(MHWRender::MVertexBuffer* buffer,
+		const MHWRender::MVertexBufferDescriptor& desc,
+		bool debugPopulateGeometry);
+	static bool dependsOnPositions(const MHWRender::MVertexBufferDescriptor& desc);
+
 	// Indexing for render item handling methods
 	void updateIndexingForWireframeItems(MHWRender::MIndexBuffer* wireIndexBuffer,
 		const MHWRender::MRenderItem* item,
@@ -128,6 +155,37 @@ protected:
     bool fReceivesShadows;
     bool fEnableNumericDisplay;
 
+	// Vertex buffers are refilled completely only when the topology
+	// changed or the shape cannot tell which vertices moved. Otherwise
+	// isStreamDirty keeps the buffers from the last update and only the
+	// face-vertex slots of the moved vertices are written again, in the
+	// position derived and normal buffers.
+	//
+	bool fFullUpdate;
+	std::vector<int> fDirtyVertices;
+
+	// Topology the buffers were last filled for
+	apiMeshSharedArray<MIntArray> fFilledFaceCounts;
+	apiMeshSharedArray<MIntArray> fFilledFaceConnects;
+	unsigned int fFilledVertexCount;
+
+	// Built on the first partial update for a topology: the buffer slots
+	// (face-vertices of non degenerate faces) and face centers using each
+	// vertex, and the first face connect of each face center.
+	bool fVertexSlotsValid;
+	std::vector<int> fSlotConnect;
+	std::vector<int> fVertexSlotStart;
+	std::vector<int> fVertexSlots;
+	std::vector<int> fVertexCenterStart;
+	std::vector<int> fVertexCenters;
+	std::vector<int> fCenterConnect;
+	std::vector<int> fCenterSize;
+
+	// Dirty slots and face centers of the current update as (first, count)
+	std::vector< std::pair<unsigned int, unsigned int> > fDirtySlotRuns;
+	std::vector< std::pair<unsigned int, unsigned int> > fDirtyCenterRuns;
+	unsigned long long fUpdateBytes;
+
 	// Render item names
 	static const MString sWireframeItemName;
 	static const MString sShadedTemplateItemName;
@@ -177,3 +235,10 @@ protected:
 	bool fExternalItemsNonTri_NoPostEffects;
 };
 
+// Reports the vertex buffer upload statistics of the geometry override
+class apiMeshUploadStatsCmd : public MPxCommand
+{
+public:
+	MStatus			doIt( const MArgList& args ) override;
+	static void*	creator();
+};
@@ -83,7 +83,7 @@ void apiMeshGeomIterator::setPoint( const MPoint & pnt ) const
 	if ( NULL != geometry ) {
 		unsigned int idx = index();
 		if ( idx < geometry->vertices.length()) 
-			geometry->vertices.set( pnt, index() );
+			geometry->vertices.write().set( pnt, index() );
 	}
 }
 
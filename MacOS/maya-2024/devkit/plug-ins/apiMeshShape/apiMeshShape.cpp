@@ -106,7 +106,7 @@ MObject apiMesh::useWeightedTransformUsingFunction;
 MObject apiMesh::useWeightedTweakUsingFunction;
 MObject apiMesh::enableNumericDisplay;
 
-apiMesh::apiMesh() {}
+apiMesh::apiMesh() : fClosestPointTreeDirty( true ), fAllVerticesDirty( true ) {}
 
 apiMesh::~apiMesh()
 {
@@ -149,6 +149,8 @@ void apiMesh::postConstructor()
 	//
 	fShapeDirty = true;
 	fMaterialDirty = true;
+	fClosestPointTreeDirty = true;
+	fAllVerticesDirty = true;
 }
 
 /* override */
@@ -207,13 +209,24 @@ MStatus apiMesh::preEvaluation(const MDGContext& context, const MEvaluationNode&
 	if (context.isNormal())
 	{
 		MStatus status;
-		if ((evaluationNode.dirtyPlugExists(inputSurface, &status) && status) ||
-			(evaluationNode.dirtyPlugExists(mControlPoints, &status) && status) ||
+		bool inputDirty = evaluationNode.dirtyPlugExists(inputSurface, &status) && status;
+		bool tweaksDirty = evaluationNode.dirtyPlugExists(mControlPoints, &status) && status;
+		if (inputDirty ||
+			tweaksDirty ||
 			(evaluationNode.dirtyPlugExists(enableNumericDisplay, &status) && status)
 			)
 		{
 			setShapeDirty();
 		}
+
+		// The evaluation node does not say which control points changed.
+		// Tweaks made interactively have already recorded their vertices,
+		// anything else may have moved all of them.
+		//
+		if (inputDirty || (tweaksDirty && fDirtyVertices.empty()))
+		{
+			setAllVerticesDirty();
+		}
 	}
 
 	return MStatus::kSuccess;
@@ -274,6 +287,30 @@ MStatus apiMesh::setDependentsDirty( const MPlug& plug, MPlugArray& plugArray)
 	{
 		signalDirtyToViewport();
 	}
+
+	// Record which vertices the viewport has to update
+	//
+	if ( plug == inputSurface ) {
+		setAllVerticesDirty();
+	}
+	else if ( plug == mControlPoints ) {
+		if ( plug.isElement() ) {
+			addDirtyVertex( plug.logicalIndex() );
+		}
+		else if ( fDirtyVertices.empty() ) {
+			// Whole array, unless the tweak that set it already
+			// recorded the vertices it moved
+			setAllVerticesDirty();
+		}
+	}
+	else if ( plug == mControlValueX ||
+			  plug == mControlValueY ||
+			  plug == mControlValueZ ) {
+		MPlug point = plug.parent();
+		if ( point.isElement() ) {
+			addDirtyVertex( point.logicalIndex() );
+		}
+	}
 	return MS::kSuccess;
 }
 
@@ -938,23 +975,45 @@ void apiMesh:: closestPoint ( const MPoint & toThisPoint, \
 //
 // Description
 //
-//		Returns the closest point to the given point in space.
-//		Used for rigid bind of skin.  Currently returns wrong results;
-//		override it by implementing a closest point calculation.
+//		Returns the closest point on the surface to the given point in
+//		space. Used for rigid bind of skin and snapping.
+//
+//		The search runs on a bounding volume hierarchy over the triangles,
+//		built the first time it is needed. When the shape has been dirtied
+//		since, the tree is refit to the moved vertices, or rebuilt if the
+//		topology changed.
 {
-	// Iterate through the geometry to find the closest point within
-	// the given tolerance.
-	//
 	apiMeshGeom* geomPtr = ((apiMesh*)this)->meshGeomToUse();
-	int numVertices = geomPtr->vertices.length();
-	for (int ii=0; ii<numVertices; ii++)
-	{
-		MPoint tryThisOne = geomPtr->vertices[ii];
+	if ( NULL == geomPtr || 0 == geomPtr->vertices.length() ) {
+		theClosestPoint = toThisPoint;
+		return;
 	}
 
-	// Set the output point to the result (hardcode for debug just now)
-	//
-	theClosestPoint = geomPtr->vertices[0];
+	if ( fClosestPointTree.isEmpty() || !fClosestPointTree.matches( *geomPtr ) ) {
+		fClosestPointTree.build( *geomPtr );
+	}
+	else if ( fClosestPointTreeDirty ) {
+		fClosestPointTree.refit( *geomPtr );
+	}
+	fClosestPointTreeDirty = false;
+
+	if ( !fClosestPointTree.closestPoint( *geomPtr, toThisPoint,
+										  theClosestPoint, tolerance ) )
+	{
+		// No faces, fall back on the nearest vertex
+		//
+		int numVertices = geomPtr->vertices.length();
+		double best = toThisPoint.distanceTo( geomPtr->vertices[0] );
+		theClosestPoint = geomPtr->vertices[0];
+		for (int ii=1; ii<numVertices; ii++)
+		{
+			double distance = toThisPoint.distanceTo( geomPtr->vertices[ii] );
+			if ( distance < best ) {
+				best = distance;
+				theClosestPoint = geomPtr->vertices[ii];
+			}
+		}
+	}
 }
 
 /* override */
@@ -1028,7 +1087,7 @@ void apiMesh::transformUsing( const MMatrix & mat,
 				int elemCount = fnComp.elementCount();
 				for ( int idx=0; idx<elemCount && j < cacheLen; idx++, ++j ) {
 					int elemIndex = fnComp.element( idx );
-					geomPtr->vertices[elemIndex] = (*pointCache)[j];
+					geomPtr->vertices.write()[elemIndex] = (*pointCache)[j];
 				}
 			}
 		} else {
@@ -1037,7 +1096,7 @@ void apiMesh::transformUsing( const MMatrix & mat,
 			//
 			len = geomPtr->vertices.length();
 			for ( unsigned int idx = 0; idx < len && j < cacheLen; ++idx, ++j ) {
-				geomPtr->vertices[idx] = (*pointCache)[j];
+				geomPtr->vertices.write()[idx] = (*pointCache)[j];
 			}
 		}
 	} else {
@@ -1062,9 +1121,9 @@ void apiMesh::transformUsing( const MMatrix & mat,
 					if (savePoints) {
 						pointCache->append(geomPtr->vertices[elemIndex]);
 					}
-					geomPtr->vertices[elemIndex] *= mat;
-					geomPtr->normals[idx] =
-						geomPtr->normals[idx].transformAsNormal( mat );
+					geomPtr->vertices.write()[elemIndex] *= mat;
+					geomPtr->normals.write()[elemIndex] =
+						geomPtr->normals[elemIndex].transformAsNormal( mat );
 				}
 			}
 		} else {
@@ -1079,8 +1138,8 @@ void apiMesh::transformUsing( const MMatrix & mat,
 				if (savePoints) {
 					pointCache->append(geomPtr->vertices[idx]);
 				}
-				geomPtr->vertices[idx] *= mat;
-				geomPtr->normals[idx] =
+				geomPtr->vertices.write()[idx] *= mat;
+				geomPtr->normals.write()[idx] =
 					geomPtr->normals[idx].transformAsNormal( mat );
 
 			}
@@ -1162,6 +1221,11 @@ void apiMesh::updateCachedSurface( const apiMeshGeom* geomPtr, const MObjectArra
 		}
 	}
 
+	// Record the moved vertices before setting the control points below
+	// dirties them.
+	//
+	addDirtyVertices( componentList );
+
 	// Copy outputSurface to cachedSurface
 	//
 	if ( NULL == cached ) {
@@ -1340,6 +1404,7 @@ apiMesh::tweakUsing( const MMatrix & mat,
 	}
 	// Set the builder into the handle.
 	//
+	addDirtyVertices( componentList );
 	handle.set(builder);
 
 	// Tell maya the bounding box for this object has changed
@@ -1433,7 +1498,7 @@ void apiMesh::weightedTransformUsing(	const MTransformationMatrix& xform,
 			if (perc > almostZero) { // if the point has enough weight to be transformed
 				if (restorePoints) {
 					// restore the original point from the point cache
-					geomPtr->vertices[elemIndex] = MVector( (*pointCache)[pointCacheIndex] );
+					geomPtr->vertices.write()[elemIndex] = MVector( (*pointCache)[pointCacheIndex] );
 					pointCacheIndex++;
 				}
 				else { // perform point transformation
@@ -1442,7 +1507,7 @@ void apiMesh::weightedTransformUsing(	const MTransformationMatrix& xform,
 						pointCache->append( geomPtr->vertices[elemIndex] );
 					}
 					else if ( transformOrigPoints ) { // start by reverting points back to their original values stored in the pointCache for the transformation
-						geomPtr->vertices[elemIndex] = MVector( (*pointCache)[pointCacheIndex] );
+						geomPtr->vertices.write()[elemIndex] = MVector( (*pointCache)[pointCacheIndex] );
 					}
 					else if ( updatePoints ) { // update the pointCache with the current values
 						(*pointCache)[pointCacheIndex] = geomPtr->vertices[elemIndex];
@@ -1469,7 +1534,7 @@ void apiMesh::weightedTransformUsing(	const MTransformationMatrix& xform,
 					}
 
 					// Update the geomPtr with the new point
-					geomPtr->vertices[elemIndex] = MVector( newp );
+					geomPtr->vertices.write()[elemIndex] = MVector( newp );
 					pointCacheIndex++;
 				}
 			}
@@ -1609,7 +1674,7 @@ void apiMesh::weightedTweakUsing(
 					// the pointCache for the transformation
 					//
 					if ( transformOrigPoints ) {
-						geomPtr->vertices[elemIndex] = MVector( (*pointCache)[cacheIndex] );
+						geomPtr->vertices.write()[elemIndex] = MVector( (*pointCache)[cacheIndex] );
 					}
 
 					// Perform transformation of the point
@@ -1650,6 +1715,7 @@ void apiMesh::weightedTweakUsing(
 	}
 	// Set the builder into the handle.
 	//
+	addDirtyVertices( componentList );
 	handle.set(builder);
 
 	// Tell maya the bounding box for this object has changed
@@ -2251,7 +2317,7 @@ MStatus apiMesh::applyTweaks( MDataBlock& datablock, apiMeshGeom* geomPtr )
 		//
 		if (elemIndex < (int)geomPtr->vertices.length())
 		{
-			MPoint& oldPnt = geomPtr->vertices[elemIndex];
+			MPoint& oldPnt = geomPtr->vertices.write()[elemIndex];
 			oldPnt = oldPnt + offset;
 		}
 		cpHandle.next();
@@ -2315,13 +2381,14 @@ bool apiMesh::setValue( MDataBlock& datablock, int pntInd, int vlInd, double val
 	apiMesh* nonConstThis = (apiMesh*)this;
 	apiMeshGeom* geomPtr = nonConstThis->cachedGeom(datablock);
 	if ( NULL != geomPtr ) {
-		MPoint& point = geomPtr->vertices[ pntInd ];
+		MPoint& point = geomPtr->vertices.write()[ pntInd ];
 		point[ vlInd ] = val;
 		result = true;
 	}
 
 	if (datablock.context().isNormal())
 	{
+		addDirtyVertex( pntInd );
 		verticesUpdated();
 	}
 
@@ -2341,12 +2408,13 @@ bool apiMesh::setValue( MDataBlock& datablock, int pntInd, const MPoint & val )
 	apiMesh* nonConstThis = (apiMesh*)this;
 	apiMeshGeom* geomPtr = nonConstThis->cachedGeom(datablock);
 	if ( NULL != geomPtr ) {
-		geomPtr->vertices[ pntInd ] = val;
+		geomPtr->vertices.write()[ pntInd ] = val;
 		result = true;
 	}
 
 	if (datablock.context().isNormal())
 	{
+		addDirtyVertex( pntInd );
 		verticesUpdated();
 	}
 
@@ -2486,11 +2554,68 @@ void apiMesh::verticesUpdated()
 {
 	childChanged( MPxSurfaceShape::kBoundingBoxChanged );
 	childChanged( MPxSurfaceShape::kObjectChanged );
+	fClosestPointTreeDirty = true;
 }
 
 void apiMesh::setShapeDirty()
 {
 	fShapeDirty = true;
+	fClosestPointTreeDirty = true;
+}
+
+// Past this many ids a full update is cheaper than patching, and the list
+// stops growing for shapes drawn by an override that never takes it.
+static const size_t kMaxDirtyVertices = 1 << 16;
+
+void apiMesh::addDirtyVertex( int vertexId )
+{
+	if ( fAllVerticesDirty ) {
+		return;
+	}
+	if ( vertexId < 0 || fDirtyVertices.size() >= kMaxDirtyVertices ) {
+		setAllVerticesDirty();
+		return;
+	}
+	fDirtyVertices.push_back( vertexId );
+}
+
+void apiMesh::addDirtyVertices( const MObjectArray& componentList )
+//
+// Description
+//
+//    Record the vertices of the given components. An empty list means the
+//    whole surface.
+//
+{
+	unsigned int len = componentList.length();
+	if ( 0 == len ) {
+		setAllVerticesDirty();
+		return;
+	}
+	for ( unsigned int i=0; i<len && !fAllVerticesDirty; i++ )
+	{
+		MObject comp = convertToVertexComponent(componentList[i]);
+		MFnSingleIndexedComponent fnComp( comp );
+		int elemCount = fnComp.elementCount();
+		for ( int idx=0; idx<elemCount; idx++ ) {
+			addDirtyVertex( fnComp.element( idx ) );
+		}
+	}
+}
+
+void apiMesh::setAllVerticesDirty()
+{
+	fAllVerticesDirty = true;
+	fDirtyVertices.clear();
+}
+
+bool apiMesh::takeDirtyVertices( std::vector<int>& vertexIds )
+{
+	bool partial = !fAllVerticesDirty;
+	vertexIds.swap( fDirtyVertices );
+	fDirtyVertices.clear();
+	fAllVerticesDirty = false;
+	return partial;
 }
 
 void apiMesh::notifyViewport()
@@ -2721,6 +2846,21 @@ MStatus initializePlugin( MObject obj )
 		}
 	}
 
+	stat4 = plugin.registerCommand( "apiMeshDataBenchmark", apiMeshDataBenchmark::creator );
+	if ( ! stat4 ) {
+		cerr << "Failed to register command : apiMeshDataBenchmark\n";
+	}
+
+	stat4 = plugin.registerCommand( "apiMeshUploadStats", apiMeshUploadStatsCmd::creator );
+	if ( ! stat4 ) {
+		cerr << "Failed to register command : apiMeshUploadStats\n";
+	}
+
+	stat4 = plugin.registerCommand( "apiMeshSubSceneStats", apiMeshSubSceneStatsCmd::creator );
+	if ( ! stat4 ) {
+		cerr << "Failed to register command : apiMeshSubSceneStats\n";
+	}
+
 
 	stat4 = MHWRender::MDrawRegistry::registerGeometryOverrideCreator(
 				apiMeshGeometryShape::sDrawDbClassification,
@@ -2811,5 +2951,20 @@ MStatus uninitializePlugin( MObject obj)
 		cerr << "Failed to deregister node : apiMeshCreator \n";
 	}
 
+	stat = plugin.deregisterCommand( "apiMeshDataBenchmark" );
+	if ( ! stat ) {
+		cerr << "Failed to deregister command : apiMeshDataBenchmark \n";
+	}
+
+	stat = plugin.deregisterCommand( "apiMeshUploadStats" );
+	if ( ! stat ) {
+		cerr << "Failed to deregister command : apiMeshUploadStats \n";
+	}
+
+	stat = plugin.deregisterCommand( "apiMeshSubSceneStats" );
+	if ( ! stat ) {
+		cerr << "Failed to deregister command : apiMeshSubSceneStats \n";
+	}
+
 	return stat;
 }
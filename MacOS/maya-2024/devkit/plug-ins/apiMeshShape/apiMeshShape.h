@@ -35,6 +35,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include <maya/MPxSurfaceShape.h>
 #include <maya/MPxGeometryIterator.h>
@@ -49,6 +50,7 @@
 #include "apiMeshGeom.h"
 #include "apiMeshData.h"
 #include "apiMeshIterator.h"
+#include "apiMeshBVH.h"
 
 
 
@@ -189,6 +191,15 @@ public:
 	MStatus					buildControlPoints( MDataBlock&, int count );
 	void					verticesUpdated();
 
+	// Vertices moved since the viewport last took them, used by the
+	// geometry override to patch its vertex buffers instead of refilling
+	// them. takeDirtyVertices returns false when all of them may have
+	// changed, and resets the list either way.
+	//
+	void					addDirtyVertex( int vertexId );
+	void					setAllVerticesDirty();
+	bool					takeDirtyVertices( std::vector<int>& vertexIds );
+
 
 	static  MStatus         initialize();
 
@@ -234,6 +245,7 @@ private:
 	apiMeshGeom*			cachedGeom( MDataBlock& );
 
 	void					setShapeDirty();
+	void					addDirtyVertices( const MObjectArray& componentList );
 	void					notifyViewport();
 	void					signalDirtyToViewport();
 	MObject					convertToVertexComponent(const MObject& components);
@@ -241,7 +253,17 @@ private:
 	bool fHasHistoryOnCreate;
 	bool fShapeDirty;
 	bool fMaterialDirty;
+
+	// Used by closestPoint, built on first use. Set whenever the shape
+	// is dirtied or its vertices move; the tree is then refit, or rebuilt
+	// if the topology changed.
+	mutable apiMeshBVH fClosestPointTree;
+	mutable bool fClosestPointTreeDirty;
 	std::map<std::string, MCallbackId> fMaterialDirtyCbIds;
+
+	// See takeDirtyVertices
+	std::vector<int> fDirtyVertices;
+	bool fAllVerticesDirty;
 };
 
 class apiMeshGeometryShape : apiMesh {
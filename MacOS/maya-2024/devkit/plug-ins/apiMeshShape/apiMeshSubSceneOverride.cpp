@@ -56,10 +56,13 @@
 #include <maya/MUserData.h>
 #include <maya/MViewport2Renderer.h>
 #include <maya/MSharedPtr.h>
+#include <maya/MTimer.h>
+#include <maya/MArgList.h>
 
 #include <algorithm>
 #include <iterator>
 #include <memory>
+#include <unordered_map>
 
 #ifdef _WINDOWS
 #include <d3d11.h>
@@ -97,6 +100,46 @@ namespace apiMeshSubSceneOverrideHelpers
 		std::unique_ptr<bool[]> fFaceViewSelectedStates;
 	};
 
+	// Vertex and index buffers built from one apiMeshGeom. Shapes whose
+	// geometry shares its arrays, like duplicates fed by the same creator,
+	// draw with the same set instead of uploading a copy each.
+	class GeometryBuffers
+	{
+	public:
+		~GeometryBuffers();
+
+		static std::shared_ptr<GeometryBuffers> acquire(const apiMeshGeom& geom, const MBoundingBox& bounds);
+
+		bool builtFrom(const apiMeshGeom& geom) const;
+		bool build(const apiMeshGeom* meshGeom, const MBoundingBox& bounds);
+
+		std::unique_ptr<MHWRender::MVertexBuffer>
+			fPositionBuffer,
+			fNormalBuffer,
+			fBoxPositionBuffer;
+
+		std::unique_ptr<MHWRender::MIndexBuffer>
+			fWireIndexBuffer,
+			fBoxIndexBuffer,
+			fShadedIndexBuffer;
+
+		// Client buffers
+		unsigned int fBoxPositionBufferId = 0;
+		unsigned int fBoxIndexBufferId = 0;
+		ID3D11Buffer* fBoxPositionBufferDX = nullptr;
+		ID3D11Buffer* fBoxIndexBufferDX = nullptr;
+
+		// The arrays the buffers were built from
+		apiMeshSharedArray<MPointArray> fVertices;
+		apiMeshSharedArray<MVectorArray> fNormals;
+		apiMeshSharedArray<MIntArray> fFaceCounts;
+		apiMeshSharedArray<MIntArray> fFaceConnects;
+		const void* fKey = nullptr;
+
+		// Size of the buffers
+		size_t fBytes = 0;
+	};
+
 	using LinkLostUserDataPtr = MSharedPtr<LinkLostUserData>;
 	using ApiMeshHWSelectionUserDataPtr = MSharedPtr<apiMeshHWSelectionUserData>;
 
@@ -598,11 +641,11 @@ void apiMeshSubSceneOverride::manageRenderItems(
 	if (updateGeometry)
         rebuildGeometryBuffers();
 
-	if (!fPositionBuffer || !fNormalBuffer || !fBoxPositionBuffer ||
-		!fWireIndexBuffer || !fBoxIndexBuffer || !fShadedIndexBuffer)
+	if (!fGeometryBuffers)
 	{
 		return;
 	}
+	const GeometryBuffers& geometry = *fGeometryBuffers;
 
 	ViewSelectedFaceInfo vsfInfo;
 	bool isActiveViewFiltered = gatherViewSelectedFaceInfo(vsfInfo,
@@ -1150,35 +1193,35 @@ void apiMeshSubSceneOverride::manageRenderItems(
 		MBoundingBox bounds = fMesh->boundingBox();
 
 		MVertexBufferArray wireBuffers;
-		wireBuffers.addBuffer("positions", fPositionBuffer.get());
+		wireBuffers.addBuffer("positions", geometry.fPositionBuffer.get());
 
         if (wireItem)
-		    setGeometryForRenderItem(*wireItem, wireBuffers, *fWireIndexBuffer, &bounds);
+		    setGeometryForRenderItem(*wireItem, wireBuffers, *geometry.fWireIndexBuffer, &bounds);
         if (selectItem)
-		    setGeometryForRenderItem(*selectItem, wireBuffers, *fWireIndexBuffer, &bounds);
+		    setGeometryForRenderItem(*selectItem, wireBuffers, *geometry.fWireIndexBuffer, &bounds);
 
 		MVertexBufferArray boxBuffers;
-		boxBuffers.addBuffer("positions", fBoxPositionBuffer.get());
+		boxBuffers.addBuffer("positions", geometry.fBoxPositionBuffer.get());
 
         if (boxItem)
-		    setGeometryForRenderItem(*boxItem, boxBuffers, *fBoxIndexBuffer, &bounds);
+		    setGeometryForRenderItem(*boxItem, boxBuffers, *geometry.fBoxIndexBuffer, &bounds);
         if (selectedBoxItem)
-		    setGeometryForRenderItem(*selectedBoxItem, boxBuffers, *fBoxIndexBuffer, &bounds);
+		    setGeometryForRenderItem(*selectedBoxItem, boxBuffers, *geometry.fBoxIndexBuffer, &bounds);
 
 		MVertexBufferArray shadedBuffers;
-		shadedBuffers.addBuffer("positions", fPositionBuffer.get());
-		shadedBuffers.addBuffer("normals", fNormalBuffer.get());
+		shadedBuffers.addBuffer("positions", geometry.fPositionBuffer.get());
+		shadedBuffers.addBuffer("normals", geometry.fNormalBuffer.get());
 
-		setGeometryForRenderItem(*shadedItem, shadedBuffers, *fShadedIndexBuffer, &bounds);
-		setGeometryForRenderItem(*texturedItem, shadedBuffers, *fShadedIndexBuffer, &bounds);
+		setGeometryForRenderItem(*shadedItem, shadedBuffers, *geometry.fShadedIndexBuffer, &bounds);
+		setGeometryForRenderItem(*texturedItem, shadedBuffers, *geometry.fShadedIndexBuffer, &bounds);
 
 		// Point vertex buffer is fully sequential, use an empty index buffer to draw non-indexed.
 		if (vertexSelectionItem)
 			setGeometryForRenderItem(*vertexSelectionItem, wireBuffers, MIndexBuffer(MGeometry::kUnsignedInt32), &bounds);
 		if (edgeSelectionItem)
-			setGeometryForRenderItem(*edgeSelectionItem, wireBuffers, *fWireIndexBuffer, &bounds);
+			setGeometryForRenderItem(*edgeSelectionItem, wireBuffers, *geometry.fWireIndexBuffer, &bounds);
 		if (faceSelectionItem)
-			setGeometryForRenderItem(*faceSelectionItem, wireBuffers, *fShadedIndexBuffer, &bounds);
+			setGeometryForRenderItem(*faceSelectionItem, wireBuffers, *geometry.fShadedIndexBuffer, &bounds);
 	}
 
 	// Update active component items if required
@@ -1187,7 +1230,7 @@ void apiMeshSubSceneOverride::manageRenderItems(
 		MBoundingBox bounds = fMesh->boundingBox();
 
 		MVertexBufferArray vertexBuffer;
-		vertexBuffer.addBuffer("positions", fPositionBuffer.get());
+		vertexBuffer.addBuffer("positions", geometry.fPositionBuffer.get());
 
 		if (activeVertexItem)
 			setGeometryForRenderItem(*activeVertexItem, vertexBuffer, *fActiveVerticesIndexBuffer, &bounds);
@@ -1556,11 +1599,11 @@ void apiMeshSubSceneOverride::manageIsolateSelectRenderItems(
                 updateRenderItemShader(*viewSelectedTexturedItem, updateMaterial, surfaceShaderNode, instance, false);
 
 				MVertexBufferArray shadedBuffers;
-				shadedBuffers.addBuffer("positions", fPositionBuffer.get());
-				shadedBuffers.addBuffer("normals", fNormalBuffer.get());
+				shadedBuffers.addBuffer("positions", fGeometryBuffers->fPositionBuffer.get());
+				shadedBuffers.addBuffer("normals", fGeometryBuffers->fNormalBuffer.get());
 
 				MVertexBufferArray selectionBuffers;
-				selectionBuffers.addBuffer("positions", fPositionBuffer.get());
+				selectionBuffers.addBuffer("positions", fGeometryBuffers->fPositionBuffer.get());
 
 				std::unique_ptr<bool[]> faceStates(new bool[meshGeom->faceCount]);
 				for (int faceIdx = 0; faceIdx < meshGeom->faceCount; faceIdx++)
@@ -1651,269 +1694,386 @@ void apiMeshSubSceneOverride::manageIsolateSelectRenderItems(
 	}
 }
 
-void apiMeshSubSceneOverride::rebuildGeometryBuffers()
+namespace apiMeshSubSceneOverrideHelpers
 {
-	_OPENMAYA_DEPRECATION_PUSH_AND_DISABLE_WARNING
-	MHWRender::MRenderer* renderer = MHWRender::MRenderer::theRenderer();
-	_OPENMAYA_POP_WARNING
+	// Buffer sets by the address of the vertex array they were built from
+	typedef std::unordered_map<const void*, std::weak_ptr<GeometryBuffers>> GeometryBuffersMap;
+	static GeometryBuffersMap sGeometryBuffers;
 
-	if (sDrawAPI == MHWRender::kNone)
+	// Counters reported by apiMeshSubSceneStats
+	static unsigned long long sGeometryBuffersBuilt = 0;
+	static unsigned long long sGeometryBuffersReused = 0;
+	static double sGeometryBuffersBuildTime = 0.0;
+
+	GeometryBuffers::~GeometryBuffers()
 	{
-		if (renderer)
+		// Forget this set, unless a newer one took its place
+		GeometryBuffersMap::iterator it = sGeometryBuffers.find(fKey);
+		if (it != sGeometryBuffers.end() && it->second.expired())
 		{
-            sDrawAPI = renderer->drawAPI();
+			sGeometryBuffers.erase(it);
+		}
 
-            switch (sDrawAPI)
-            {
-            case MHWRender::kOpenGL:
-            case MHWRender::kOpenGLCoreProfile:
-            {
-                if (glewInit() != GLEW_OK)
-                {
-                    cerr << "Failed to initialize glew\n";
-                    return;
-                }
-            }
-            default:;
-            }
+		// Delete client buffers
+		if (sUseCustomUserBuffersForBoundingBox)
+		{
+			if (sDrawAPI == MHWRender::kOpenGL ||
+				sDrawAPI == MHWRender::kOpenGLCoreProfile)
+			{
+				if (fBoxPositionBufferId != 0)
+				{
+					glDeleteBuffers(1, &fBoxPositionBufferId);
+					fBoxPositionBufferId = 0;
+				}
+				if (fBoxIndexBufferId != 0)
+				{
+					glDeleteBuffers(1, &fBoxIndexBufferId);
+					fBoxIndexBufferId = 0;
+				}
+			}
+#ifdef _WINDOWS
+			else if (sDrawAPI == MHWRender::kDirectX11)
+			{
+				if (NULL != fBoxPositionBufferDX)
+				{
+					fBoxPositionBufferDX->Release();
+					fBoxPositionBufferDX = NULL;
+				}
+				if (NULL != fBoxIndexBufferDX)
+				{
+					fBoxIndexBufferDX->Release();
+					fBoxIndexBufferDX = NULL;
+				}
+			}
+#endif
 		}
 	}
-	
-	// Preamble
-	using namespace MHWRender;
-	apiMeshGeom* meshGeom = fMesh->meshGeomToUse();
-	if (!meshGeom)
-		return;
-	MBoundingBox bounds = fMesh->boundingBox();
 
-	// Clear old
-	deleteGeometryBuffers();
+	bool GeometryBuffers::builtFrom(const apiMeshGeom& geom) const
+	{
+		return fVertices.sharesWith(geom.vertices) &&
+			   fNormals.sharesWith(geom.normals) &&
+			   fFaceCounts.sharesWith(geom.face_counts) &&
+			   fFaceConnects.sharesWith(geom.face_connects);
+	}
 
-	// Compute mesh data size
-	unsigned int numTriangles = 0;
-	unsigned int totalVerts = 0;
-	for (int i=0; i<meshGeom->faceCount; i++)
+	std::shared_ptr<GeometryBuffers> GeometryBuffers::acquire(const apiMeshGeom& geom, const MBoundingBox& bounds)
 	{
-		int numVerts = meshGeom->face_counts[i];
-		if (numVerts > 2)
+		// The set holds on to the arrays it was built from, so while it
+		// is alive no other array can be allocated at the same address.
+		const void* key = &geom.vertices.read();
+		GeometryBuffersMap::iterator it = sGeometryBuffers.find(key);
+		if (it != sGeometryBuffers.end())
+		{
+			std::shared_ptr<GeometryBuffers> buffers = it->second.lock();
+			if (buffers && buffers->builtFrom(geom))
+			{
+				sGeometryBuffersReused++;
+				return buffers;
+			}
+		}
+
+		MTimer timer;
+		timer.beginTimer();
+		std::shared_ptr<GeometryBuffers> buffers = std::make_shared<GeometryBuffers>();
+		buffers->fKey = key;
+		if (!buffers->build(&geom, bounds))
 		{
-			numTriangles += numVerts - 2;
-			totalVerts += numVerts;
+			return nullptr;
 		}
+		timer.endTimer();
+		sGeometryBuffersBuildTime += timer.elapsedTime();
+		sGeometryBuffersBuilt++;
+
+		sGeometryBuffers[key] = buffers;
+		return buffers;
 	}
 
-    if (numTriangles == 0 || totalVerts == 0)
-        return;
+	bool GeometryBuffers::build(const apiMeshGeom* meshGeom, const MBoundingBox& bounds)
+	{
+		using namespace MHWRender;
+
+		// Compute mesh data size
+		unsigned int numTriangles = 0;
+		unsigned int totalVerts = 0;
+		for (int i=0; i<meshGeom->faceCount; i++)
+		{
+			int numVerts = meshGeom->face_counts[i];
+			if (numVerts > 2)
+			{
+				numTriangles += numVerts - 2;
+				totalVerts += numVerts;
+			}
+		}
 
-	// Acquire vertex buffer resources
-	const MVertexBufferDescriptor posDesc("", MGeometry::kPosition, MGeometry::kFloat, 3);
-	const MVertexBufferDescriptor normalDesc("", MGeometry::kNormal, MGeometry::kFloat, 3);
+		if (numTriangles == 0 || totalVerts == 0)
+			return false;
 
-	fPositionBuffer = std::make_unique<MVertexBuffer>(posDesc);
-	fNormalBuffer = std::make_unique<MVertexBuffer>(normalDesc);
-	fBoxPositionBuffer = std::make_unique<MVertexBuffer>(posDesc);
+		// Acquire vertex buffer resources
+		const MVertexBufferDescriptor posDesc("", MGeometry::kPosition, MGeometry::kFloat, 3);
+		const MVertexBufferDescriptor normalDesc("", MGeometry::kNormal, MGeometry::kFloat, 3);
 
-	// Generating a compact position buffer will reduce the data size transferred to the
-	// video card by leveraging the index buffer capabilities. It will also help with
-	// component selection since the vertex ID from the hit record will match one to one with
-	// the position in the vertices array.
-	float* positions = (float*)fPositionBuffer->acquire(meshGeom->vertices.length(), true);
-	float* normals = (float*)fNormalBuffer->acquire(meshGeom->vertices.length(), true);
+		fPositionBuffer = std::make_unique<MVertexBuffer>(posDesc);
+		fNormalBuffer = std::make_unique<MVertexBuffer>(normalDesc);
+		fBoxPositionBuffer = std::make_unique<MVertexBuffer>(posDesc);
 
-	float* boxPositions = NULL;
-	unsigned short* boxIndices = NULL;
-	if (sUseCustomUserBuffersForBoundingBox)
-	{
-		// Just for demo of custom user buffers make box custom
-		static float sBoxPositions[8*3];
-		static unsigned short sBoxIndices[24];
-		boxPositions = sBoxPositions;
-		boxIndices = sBoxIndices;
-	}
-	else
-	{
-		boxPositions = (float*)fBoxPositionBuffer->acquire(8, true);
-		boxIndices = (unsigned short*)fBoxIndexBuffer->acquire(24, true);
-	}
+		// Generating a compact position buffer will reduce the data size transferred to the
+		// video card by leveraging the index buffer capabilities. It will also help with
+		// component selection since the vertex ID from the hit record will match one to one with
+		// the position in the vertices array.
+		float* positions = (float*)fPositionBuffer->acquire(meshGeom->vertices.length(), true);
+		float* normals = (float*)fNormalBuffer->acquire(meshGeom->vertices.length(), true);
 
-	// Acquire index buffer resources
-	fWireIndexBuffer = std::make_unique<MIndexBuffer>(MGeometry::kUnsignedInt32);
-	fBoxIndexBuffer = std::make_unique<MIndexBuffer>(MGeometry::kUnsignedInt16);
-	fShadedIndexBuffer = std::make_unique<MIndexBuffer>(MGeometry::kUnsignedInt32);
+		float* boxPositions = NULL;
+		unsigned short* boxIndices = NULL;
+		if (sUseCustomUserBuffersForBoundingBox)
+		{
+			// Just for demo of custom user buffers make box custom
+			static float sBoxPositions[8*3];
+			static unsigned short sBoxIndices[24];
+			boxPositions = sBoxPositions;
+			boxIndices = sBoxIndices;
+		}
+		else
+		{
+			boxPositions = (float*)fBoxPositionBuffer->acquire(8, true);
+			boxIndices = (unsigned short*)fBoxIndexBuffer->acquire(24, true);
+		}
 
-	unsigned int* wireBuffer = (unsigned int*)fWireIndexBuffer->acquire(2 * totalVerts, true);
-	unsigned int* shadedBuffer = (unsigned int*)fShadedIndexBuffer->acquire(3 * numTriangles, true);
+		// Acquire index buffer resources
+		fWireIndexBuffer = std::make_unique<MIndexBuffer>(MGeometry::kUnsignedInt32);
+		fBoxIndexBuffer = std::make_unique<MIndexBuffer>(MGeometry::kUnsignedInt16);
+		fShadedIndexBuffer = std::make_unique<MIndexBuffer>(MGeometry::kUnsignedInt32);
 
-	// Sanity check
-	if (!positions || !boxPositions || !normals || !wireBuffer || !boxIndices || !shadedBuffer)
-	{
-		deleteGeometryBuffers();
-		return; // FAIL
-	}
+		unsigned int* wireBuffer = (unsigned int*)fWireIndexBuffer->acquire(2 * totalVerts, true);
+		unsigned int* shadedBuffer = (unsigned int*)fShadedIndexBuffer->acquire(3 * numTriangles, true);
 
-	// Fill vertex data for shaded/wireframe
-	int vid = 0;
-	int pid = 0;
-	int nid = 0;
-	for (unsigned int i=0; i<meshGeom->vertices.length(); i++)
-	{
-		MPoint position = meshGeom->vertices[i];
-		positions[pid++] = (float)position[0];
-		positions[pid++] = (float)position[1];
-		positions[pid++] = (float)position[2];
-
-		MVector normal = meshGeom->normals[i];
-		normals[nid++] = (float)normal[0];
-		normals[nid++] = (float)normal[1];
-		normals[nid++] = (float)normal[2];
-	}
-	fPositionBuffer->commit(positions); positions = NULL;
-	fNormalBuffer->commit(normals); normals = NULL;
-
-	// Fill vertex and index data for bounding box
-	MPoint bbmin = bounds.min();
-	MPoint bbmax = bounds.max();
-	boxPositions[0]  = (float)bbmin.x; boxPositions[1]  = (float)bbmin.y; boxPositions[2]  = (float)bbmin.z;
-	boxPositions[3]  = (float)bbmin.x; boxPositions[4]  = (float)bbmin.y; boxPositions[5]  = (float)bbmax.z;
-	boxPositions[6]  = (float)bbmax.x; boxPositions[7]  = (float)bbmin.y; boxPositions[8]  = (float)bbmax.z;
-	boxPositions[9]  = (float)bbmax.x; boxPositions[10] = (float)bbmin.y; boxPositions[11] = (float)bbmin.z;
-	boxPositions[12] = (float)bbmin.x; boxPositions[13] = (float)bbmax.y; boxPositions[14] = (float)bbmin.z;
-	boxPositions[15] = (float)bbmin.x; boxPositions[16] = (float)bbmax.y; boxPositions[17] = (float)bbmax.z;
-	boxPositions[18] = (float)bbmax.x; boxPositions[19] = (float)bbmax.y; boxPositions[20] = (float)bbmax.z;
-	boxPositions[21] = (float)bbmax.x; boxPositions[22] = (float)bbmax.y; boxPositions[23] = (float)bbmin.z;
-	boxIndices[0]  = 0; boxIndices[1]  = 1;
-	boxIndices[2]  = 1; boxIndices[3]  = 2;
-	boxIndices[4]  = 2; boxIndices[5]  = 3;
-	boxIndices[6]  = 3; boxIndices[7]  = 0;
-	boxIndices[8]  = 4; boxIndices[9]  = 5;
-	boxIndices[10] = 5; boxIndices[11] = 6;
-	boxIndices[12] = 6; boxIndices[13] = 7;
-	boxIndices[14] = 7; boxIndices[15] = 4;
-	boxIndices[16] = 0; boxIndices[17] = 4;
-	boxIndices[18] = 1; boxIndices[19] = 5;
-	boxIndices[20] = 2; boxIndices[21] = 6;
-	boxIndices[22] = 3; boxIndices[23] = 7;
-	if (sUseCustomUserBuffersForBoundingBox)
-	{
-		if (sDrawAPI == MHWRender::kOpenGL ||
-			sDrawAPI == MHWRender::kOpenGLCoreProfile)
-		{		
-			{
-				glGenBuffers(1, &fBoxPositionBufferId);
-				if (fBoxPositionBufferId != 0)
-				{
-					glBindBuffer(GL_ARRAY_BUFFER, fBoxPositionBufferId);
-					glBufferData(GL_ARRAY_BUFFER, 8*3*sizeof(float), boxPositions, GL_STATIC_DRAW);
-					glBindBuffer(GL_ARRAY_BUFFER, 0);
-					fBoxPositionBuffer->resourceHandle(&fBoxPositionBufferId, 8*3);
-				}
+		// Sanity check
+		if (!positions || !boxPositions || !normals || !wireBuffer || !boxIndices || !shadedBuffer)
+		{
+			return false; // FAIL
+		}
 
-				glGenBuffers(1, &fBoxIndexBufferId);
-				if (fBoxIndexBufferId != 0)
+		// Fill vertex data for shaded/wireframe
+		int vid = 0;
+		int pid = 0;
+		int nid = 0;
+		for (unsigned int i=0; i<meshGeom->vertices.length(); i++)
+		{
+			MPoint position = meshGeom->vertices[i];
+			positions[pid++] = (float)position[0];
+			positions[pid++] = (float)position[1];
+			positions[pid++] = (float)position[2];
+
+			MVector normal = meshGeom->normals[i];
+			normals[nid++] = (float)normal[0];
+			normals[nid++] = (float)normal[1];
+			normals[nid++] = (float)normal[2];
+		}
+		fPositionBuffer->commit(positions); positions = NULL;
+		fNormalBuffer->commit(normals); normals = NULL;
+
+		// Fill vertex and index data for bounding box
+		MPoint bbmin = bounds.min();
+		MPoint bbmax = bounds.max();
+		boxPositions[0]  = (float)bbmin.x; boxPositions[1]  = (float)bbmin.y; boxPositions[2]  = (float)bbmin.z;
+		boxPositions[3]  = (float)bbmin.x; boxPositions[4]  = (float)bbmin.y; boxPositions[5]  = (float)bbmax.z;
+		boxPositions[6]  = (float)bbmax.x; boxPositions[7]  = (float)bbmin.y; boxPositions[8]  = (float)bbmax.z;
+		boxPositions[9]  = (float)bbmax.x; boxPositions[10] = (float)bbmin.y; boxPositions[11] = (float)bbmin.z;
+		boxPositions[12] = (float)bbmin.x; boxPositions[13] = (float)bbmax.y; boxPositions[14] = (float)bbmin.z;
+		boxPositions[15] = (float)bbmin.x; boxPositions[16] = (float)bbmax.y; boxPositions[17] = (float)bbmax.z;
+		boxPositions[18] = (float)bbmax.x; boxPositions[19] = (float)bbmax.y; boxPositions[20] = (float)bbmax.z;
+		boxPositions[21] = (float)bbmax.x; boxPositions[22] = (float)bbmax.y; boxPositions[23] = (float)bbmin.z;
+		boxIndices[0]  = 0; boxIndices[1]  = 1;
+		boxIndices[2]  = 1; boxIndices[3]  = 2;
+		boxIndices[4]  = 2; boxIndices[5]  = 3;
+		boxIndices[6]  = 3; boxIndices[7]  = 0;
+		boxIndices[8]  = 4; boxIndices[9]  = 5;
+		boxIndices[10] = 5; boxIndices[11] = 6;
+		boxIndices[12] = 6; boxIndices[13] = 7;
+		boxIndices[14] = 7; boxIndices[15] = 4;
+		boxIndices[16] = 0; boxIndices[17] = 4;
+		boxIndices[18] = 1; boxIndices[19] = 5;
+		boxIndices[20] = 2; boxIndices[21] = 6;
+		boxIndices[22] = 3; boxIndices[23] = 7;
+		if (sUseCustomUserBuffersForBoundingBox)
+		{
+			if (sDrawAPI == MHWRender::kOpenGL ||
+				sDrawAPI == MHWRender::kOpenGLCoreProfile)
+			{		
 				{
-					glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, fBoxIndexBufferId);
-					glBufferData(GL_ELEMENT_ARRAY_BUFFER, 24*sizeof(unsigned short), boxIndices, GL_STATIC_DRAW);
-					glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-					fBoxIndexBuffer->resourceHandle(&fBoxIndexBufferId, 24);
+					glGenBuffers(1, &fBoxPositionBufferId);
+					if (fBoxPositionBufferId != 0)
+					{
+						glBindBuffer(GL_ARRAY_BUFFER, fBoxPositionBufferId);
+						glBufferData(GL_ARRAY_BUFFER, 8*3*sizeof(float), boxPositions, GL_STATIC_DRAW);
+						glBindBuffer(GL_ARRAY_BUFFER, 0);
+						fBoxPositionBuffer->resourceHandle(&fBoxPositionBufferId, 8*3);
+					}
+
+					glGenBuffers(1, &fBoxIndexBufferId);
+					if (fBoxIndexBufferId != 0)
+					{
+						glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, fBoxIndexBufferId);
+						glBufferData(GL_ELEMENT_ARRAY_BUFFER, 24*sizeof(unsigned short), boxIndices, GL_STATIC_DRAW);
+						glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+						fBoxIndexBuffer->resourceHandle(&fBoxIndexBufferId, 24);
+					}
 				}
 			}
-		}
-#ifdef _WINDOWS
-		else if (sDrawAPI == MHWRender::kDirectX11)
-		{
-			if (renderer)
+	#ifdef _WINDOWS
+			else if (sDrawAPI == MHWRender::kDirectX11)
 			{
-				ID3D11Device* pDevice = (ID3D11Device*)renderer->GPUDeviceHandle();
-
-				// Fill in a buffer description.
-				D3D11_BUFFER_DESC bufferDesc;
-				bufferDesc.Usage            = D3D11_USAGE_DEFAULT;
-				bufferDesc.ByteWidth        = sizeof(float) * 3 * 8;
-				bufferDesc.BindFlags        = D3D11_BIND_VERTEX_BUFFER;
-				bufferDesc.CPUAccessFlags   = 0;
-				bufferDesc.MiscFlags        = 0;
-
-				// Fill in the sub-resource data.
-				D3D11_SUBRESOURCE_DATA InitData;
-				InitData.pSysMem = boxPositions;
-				InitData.SysMemPitch = 0;
-				InitData.SysMemSlicePitch = 0;
-				
-				if (pDevice)
+				_OPENMAYA_DEPRECATION_PUSH_AND_DISABLE_WARNING
+				MHWRender::MRenderer* renderer = MHWRender::MRenderer::theRenderer();
+				_OPENMAYA_POP_WARNING
+
+				if (renderer)
 				{
-					pDevice->CreateBuffer( &bufferDesc, &InitData, &fBoxPositionBufferDX );
-					if (fBoxPositionBufferDX)
-						fBoxPositionBuffer->resourceHandle((void*)fBoxPositionBufferDX, 8*3);
-				}
+					ID3D11Device* pDevice = (ID3D11Device*)renderer->GPUDeviceHandle();
+
+					// Fill in a buffer description.
+					D3D11_BUFFER_DESC bufferDesc;
+					bufferDesc.Usage            = D3D11_USAGE_DEFAULT;
+					bufferDesc.ByteWidth        = sizeof(float) * 3 * 8;
+					bufferDesc.BindFlags        = D3D11_BIND_VERTEX_BUFFER;
+					bufferDesc.CPUAccessFlags   = 0;
+					bufferDesc.MiscFlags        = 0;
+
+					// Fill in the sub-resource data.
+					D3D11_SUBRESOURCE_DATA InitData;
+					InitData.pSysMem = boxPositions;
+					InitData.SysMemPitch = 0;
+					InitData.SysMemSlicePitch = 0;
+				
+					if (pDevice)
+					{
+						pDevice->CreateBuffer( &bufferDesc, &InitData, &fBoxPositionBufferDX );
+						if (fBoxPositionBufferDX)
+							fBoxPositionBuffer->resourceHandle((void*)fBoxPositionBufferDX, 8*3);
+					}
 
-				// Index buffer
-				bufferDesc.ByteWidth = sizeof(unsigned short) * 24;
-				bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-				InitData.pSysMem = boxIndices;
+					// Index buffer
+					bufferDesc.ByteWidth = sizeof(unsigned short) * 24;
+					bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+					InitData.pSysMem = boxIndices;
 
-				if (pDevice)
-				{
-					pDevice->CreateBuffer( &bufferDesc, &InitData, &fBoxIndexBufferDX);
-					if (fBoxIndexBufferDX)
-						fBoxIndexBuffer->resourceHandle((void*)fBoxIndexBufferDX, 24);
+					if (pDevice)
+					{
+						pDevice->CreateBuffer( &bufferDesc, &InitData, &fBoxIndexBufferDX);
+						if (fBoxIndexBufferDX)
+							fBoxIndexBuffer->resourceHandle((void*)fBoxIndexBufferDX, 24);
+					}
 				}
 			}
+	#endif
 		}
-#endif
-	}
-	else
-	{
-		fBoxPositionBuffer->commit(boxPositions);
-		fBoxIndexBuffer->commit(boxIndices);
-	}
-	boxPositions = NULL;
-	boxIndices = NULL;
-
-	// Fill index data for wireframe
-	vid = 0;
-	int first = 0;
-	unsigned int idx = 0;
-	for (int faceIdx=0; faceIdx<meshGeom->faceCount; faceIdx++)
-	{
-		// ignore degenerate faces
-		int numVerts = meshGeom->face_counts[faceIdx];
-		if (numVerts > 2)
+		else
+		{
+			fBoxPositionBuffer->commit(boxPositions);
+			fBoxIndexBuffer->commit(boxIndices);
+		}
+		boxPositions = NULL;
+		boxIndices = NULL;
+
+		// Fill index data for wireframe
+		vid = 0;
+		int first = 0;
+		unsigned int idx = 0;
+		for (int faceIdx=0; faceIdx<meshGeom->faceCount; faceIdx++)
 		{
-			first = vid;
-			for (int v=0; v<numVerts-1; v++)
+			// ignore degenerate faces
+			int numVerts = meshGeom->face_counts[faceIdx];
+			if (numVerts > 2)
 			{
+				first = vid;
+				for (int v=0; v<numVerts-1; v++)
+				{
+					wireBuffer[idx++] = meshGeom->face_connects[vid++];
+					wireBuffer[idx++] = meshGeom->face_connects[vid];
+				}
 				wireBuffer[idx++] = meshGeom->face_connects[vid++];
-				wireBuffer[idx++] = meshGeom->face_connects[vid];
+				wireBuffer[idx++] = meshGeom->face_connects[first];
+			}
+			else
+			{
+				vid += numVerts;
 			}
-			wireBuffer[idx++] = meshGeom->face_connects[vid++];
-			wireBuffer[idx++] = meshGeom->face_connects[first];
 		}
-		else
+		fWireIndexBuffer->commit(wireBuffer); wireBuffer = NULL;
+
+		// Fill index data for shaded
+		unsigned int base = 0;
+		idx = 0;
+		for (int faceIdx=0; faceIdx<meshGeom->faceCount; faceIdx++)
 		{
-			vid += numVerts;
+			// Ignore degenerate faces
+			int numVerts = meshGeom->face_counts[faceIdx];
+			if (numVerts > 2)
+			{
+				for (int v=1; v<numVerts-1; v++)
+				{
+					shadedBuffer[idx++] = meshGeom->face_connects[base];
+					shadedBuffer[idx++] = meshGeom->face_connects[base+v];
+					shadedBuffer[idx++] = meshGeom->face_connects[base+v+1];
+				}
+				base += numVerts;
+			}
 		}
+		fShadedIndexBuffer->commit(shadedBuffer); shadedBuffer = NULL;
+
+		// Keep the arrays the buffers were built from
+		fVertices = meshGeom->vertices;
+		fNormals = meshGeom->normals;
+		fFaceCounts = meshGeom->face_counts;
+		fFaceConnects = meshGeom->face_connects;
+
+		fBytes = meshGeom->vertices.length() * 2 * 3 * sizeof(float)	// positions, normals
+			+ 8 * 3 * sizeof(float) + 24 * sizeof(unsigned short)			// box
+			+ 2 * totalVerts * sizeof(unsigned int)							// wireframe
+			+ 3 * numTriangles * sizeof(unsigned int);						// shaded
+		return true;
 	}
-	fWireIndexBuffer->commit(wireBuffer); wireBuffer = NULL;
+}
+
+void apiMeshSubSceneOverride::rebuildGeometryBuffers()
+{
+	_OPENMAYA_DEPRECATION_PUSH_AND_DISABLE_WARNING
+	MHWRender::MRenderer* renderer = MHWRender::MRenderer::theRenderer();
+	_OPENMAYA_POP_WARNING
 
-	// Fill index data for shaded
-	unsigned int base = 0;
-	idx = 0;
-	for (int faceIdx=0; faceIdx<meshGeom->faceCount; faceIdx++)
+	if (sDrawAPI == MHWRender::kNone)
 	{
-		// Ignore degenerate faces
-		int numVerts = meshGeom->face_counts[faceIdx];
-		if (numVerts > 2)
+		if (renderer)
 		{
-			for (int v=1; v<numVerts-1; v++)
-			{
-				shadedBuffer[idx++] = meshGeom->face_connects[base];
-				shadedBuffer[idx++] = meshGeom->face_connects[base+v];
-				shadedBuffer[idx++] = meshGeom->face_connects[base+v+1];
-			}
-			base += numVerts;
+            sDrawAPI = renderer->drawAPI();
+
+            switch (sDrawAPI)
+            {
+            case MHWRender::kOpenGL:
+            case MHWRender::kOpenGLCoreProfile:
+            {
+                if (glewInit() != GLEW_OK)
+                {
+                    cerr << "Failed to initialize glew\n";
+                    return;
+                }
+            }
+            default:;
+            }
 		}
 	}
-	fShadedIndexBuffer->commit(shadedBuffer); shadedBuffer = NULL;
+	
+	apiMeshGeom* meshGeom = fMesh->meshGeomToUse();
+	if (!meshGeom)
+	{
+		deleteGeometryBuffers();
+		return;
+	}
+
+	// Reuse the buffers of any shape drawing the same geometry, including
+	// the ones this override already has if the geometry did not change.
+	fGeometryBuffers = GeometryBuffers::acquire(*meshGeom, fMesh->boundingBox());
 }
 
 void apiMeshSubSceneOverride::rebuildActiveComponentIndexBuffers()
@@ -2045,46 +2205,7 @@ void apiMeshSubSceneOverride::deleteBuffers()
 
 void apiMeshSubSceneOverride::deleteGeometryBuffers()
 {
-	fPositionBuffer.reset();
-	fNormalBuffer.reset();
-	fBoxPositionBuffer.reset();
-	fWireIndexBuffer.reset();
-	fBoxIndexBuffer.reset();
-	fShadedIndexBuffer.reset();
-
-	// Delete client buffers
-	if (sUseCustomUserBuffersForBoundingBox)
-	{
-		if (sDrawAPI == MHWRender::kOpenGL ||
-			sDrawAPI == MHWRender::kOpenGLCoreProfile)
-		{					
-			if (fBoxPositionBufferId != 0)
-			{
-				glDeleteBuffers(1, &fBoxPositionBufferId);
-				fBoxPositionBufferId = 0;
-			}
-			if (fBoxIndexBufferId != 0)
-			{
-				glDeleteBuffers(1, &fBoxIndexBufferId);
-				fBoxIndexBufferId = 0;
-			}
-		}
-#ifdef _WINDOWS
-		else if (sDrawAPI == MHWRender::kDirectX11)
-		{
-			if (NULL != fBoxPositionBufferDX)
-			{
-				fBoxPositionBufferDX->Release();
-				fBoxPositionBufferDX = NULL;
-			}
-			if (NULL != fBoxIndexBufferDX)
-			{
-				fBoxIndexBufferDX->Release();
-				fBoxIndexBufferDX = NULL;
-			}
-		}
-#endif
-	}
+	fGeometryBuffers.reset();
 }
 
 void apiMeshSubSceneOverride::deleteActiveComponentIndexBuffers()
@@ -2355,3 +2476,77 @@ static bool floatApproxEqual(float left, float right)
     return fabs(left - right) < 0.0001f;
 }
 
+/*
+	apiMeshSubSceneStats [-reset]
+
+	Prints how many geometry buffer sets the sub-scene overrides hold, how
+	many overrides draw with them, and their size against the size of one
+	set per override. Returns, in that order: sets, overrides, bytes,
+	bytes without sharing, sets built, sets reused and the time spent
+	building them since the last reset.
+*/
+void* apiMeshSubSceneStatsCmd::creator()
+{
+	return new apiMeshSubSceneStatsCmd;
+}
+
+MStatus apiMeshSubSceneStatsCmd::doIt( const MArgList& args )
+{
+	bool reset = false;
+	for ( unsigned int i=0; i<args.length(); i++ )
+	{
+		MString arg = args.asString( i );
+		if ( arg == "-r" || arg == "-reset" ) {
+			reset = true;
+		}
+		else {
+			displayError( "Usage: apiMeshSubSceneStats [-reset]" );
+			return MS::kInvalidParameter;
+		}
+	}
+
+	unsigned int numSets = 0;
+	unsigned int numUsers = 0;
+	double bytes = 0.0;
+	double unsharedBytes = 0.0;
+	for ( GeometryBuffersMap::const_iterator it = sGeometryBuffers.begin(); it != sGeometryBuffers.end(); ++it )
+	{
+		std::shared_ptr<GeometryBuffers> buffers = it->second.lock();
+		if ( !buffers )
+			continue;
+
+		// Not counting the reference just taken
+		unsigned int users = (unsigned int)buffers.use_count() - 1;
+		numSets++;
+		numUsers += users;
+		bytes += (double)buffers->fBytes;
+		unsharedBytes += (double)buffers->fBytes * users;
+	}
+
+	MString msg;
+	msg.format( "apiMesh sub-scene geometry: ^1s buffer sets for ^2s shapes, ^3s MB (^4s MB unshared)",
+				MString() + (int)numSets, MString() + (int)numUsers,
+				MString() + bytes / (1024.0 * 1024.0),
+				MString() + unsharedBytes / (1024.0 * 1024.0) );
+	MGlobal::displayInfo( msg );
+	msg.format( "  built ^1s sets in ^2s s, reused ^3s times",
+				MString() + (double)sGeometryBuffersBuilt,
+				MString() + sGeometryBuffersBuildTime,
+				MString() + (double)sGeometryBuffersReused );
+	MGlobal::displayInfo( msg );
+
+	appendToResult( (double)numSets );
+	appendToResult( (double)numUsers );
+	appendToResult( bytes );
+	appendToResult( unsharedBytes );
+	appendToResult( (double)sGeometryBuffersBuilt );
+	appendToResult( (double)sGeometryBuffersReused );
+	appendToResult( sGeometryBuffersBuildTime );
+
+	if ( reset ) {
+		sGeometryBuffersBuilt = 0;
+		sGeometryBuffersReused = 0;
+		sGeometryBuffersBuildTime = 0.0;
+	}
+	return MS::kSuccess;
+}
@@ -19,6 +19,7 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <maya/MPxSubSceneOverride.h>
+#include <maya/MPxCommand.h>
 #include <maya/MSharedPtr.h>
 #include <map>
 #include <set>
@@ -31,6 +32,7 @@ struct ID3D11Buffer;
 
 namespace apiMeshSubSceneOverrideHelpers {
 	class LinkLostUserData;
+	class GeometryBuffers;
 }
 
 // A multimap to store all view-selected face indices of each DAG instance
@@ -170,25 +172,15 @@ private:
 	MHWRender::MShaderInstance* fEdgeComponentShader = nullptr;
 	MHWRender::MShaderInstance* fFaceComponentShader = nullptr;
 
-    std::unique_ptr<MHWRender::MVertexBuffer>
-        fPositionBuffer,
-        fNormalBuffer,
-        fBoxPositionBuffer;
+	// Geometry buffers, shared with the overrides of other shapes drawing
+	// the same apiMeshGeom (see GeometryBuffers::acquire)
+	std::shared_ptr<apiMeshSubSceneOverrideHelpers::GeometryBuffers> fGeometryBuffers;
 
     std::unique_ptr<MHWRender::MIndexBuffer>
-        fWireIndexBuffer,
-        fBoxIndexBuffer,
-        fShadedIndexBuffer,
         fActiveVerticesIndexBuffer,
         fActiveEdgesIndexBuffer,
         fActiveFacesIndexBuffer;
 
-	// Client buffers
-	unsigned int fBoxPositionBufferId = 0;
-	unsigned int fBoxIndexBufferId = 0;
-	ID3D11Buffer* fBoxPositionBufferDX = nullptr;
-	ID3D11Buffer* fBoxIndexBufferDX = nullptr;
-
     float fThickLineWidth = -1.0f;
     unsigned int fNumInstances = 0;
     bool fIsInstanceMode = false;
@@ -207,3 +199,11 @@ private:
 
 	std::vector<MSharedPtr<apiMeshSubSceneOverrideHelpers::LinkLostUserData>> fLinkLostUserDatas;
 };
+
+// Reports how many geometry buffer sets the sub-scene overrides share
+class apiMeshSubSceneStatsCmd : public MPxCommand
+{
+public:
+	MStatus			doIt( const MArgList& args ) override;
+	static void*	creator();
+};
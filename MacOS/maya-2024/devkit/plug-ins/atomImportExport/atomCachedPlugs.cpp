@@ -16,6 +16,11 @@ or hard copy form.*/
 #include <maya/MPlugArray.h>
 #include <maya/MObjectArray.h>
 #include <maya/MDGContextGuard.h>
+#include <maya/MAnimControl.h>
+#include <maya/MProgressWindow.h>
+#include "atomImportExportStrings.h"
+
+#include <tbb/parallel_for.h>
 
 #include <fstream>
 
@@ -40,18 +45,26 @@ T atomCachedValues<T>::getValue(unsigned int item, unsigned int element)
 	return mValues[(item * mStride) + element];
 }
 /*
-	atomShortValues
+	atomBasePlugAndValues
 */
-atomShortValues::atomShortValues(MPlug &plug, unsigned int numItems) :atomBasePlugAndValues(plug)
+void atomBasePlugAndValues::reduceKeys(double startFrame, double tolerance)
 {
-	mCachedValues.resize(numItems,1);
+	std::vector<double> values;
+	getValues(values);
+	mReduced = values.size() > 0;
+	if(mReduced)
+		atomKeyReducer::reduce(values, startFrame, tolerance, isStepped(), mReducedKeys);
 }
-	
-void atomShortValues::setValue(MDGContext &context,unsigned int index)
+
+/*
+	atomShortValues
+*/
+atomShortValues::atomShortValues(MPlug &plug, unsigned int numItems) :atomBasePlugAndValues(plug), mSampler(NULL)
 {
-	MObject attribute = mPlug.attribute();
-	MDGContextGuard guard(context);
+	mCachedValues.resize(numItems,1);
 
+	//resolve how to read the plug once, rather than on every frame
+	MObject attribute = mPlug.attribute();
 	if ( attribute.hasFn( MFn::kNumericAttribute ) )
 	{
 		MFnNumericAttribute fnAttrib(attribute);
@@ -59,42 +72,50 @@ void atomShortValues::setValue(MDGContext &context,unsigned int index)
 		switch(fnAttrib.unitType())
 		{
 			case MFnNumericData::kBoolean:
-			{
-				bool value;
-				mPlug.getValue(value);
-				short ival = value == true ? 1 : 0;
-				mCachedValues.setValue(ival,index);
+				mSampler = sampleBool;
 				break;
-			}
 			case MFnNumericData::kByte:
 			case MFnNumericData::kChar:
-			{
-				char value;
-				mPlug.getValue(value);
-				short ival = (short) value;
-				mCachedValues.setValue(ival,index);
+				mSampler = sampleChar;
 				break;
-			}
 			case MFnNumericData::kShort:
-			{
-				short value;
-				mPlug.getValue(value);
-				mCachedValues.setValue(value,index);
+				mSampler = sampleShort;
 				break;
-			}
 			default:
 				break;
 		}
 	}
 	else if( attribute.hasFn( MFn::kEnumAttribute ) )
 	{
-		short value;
-		mPlug.getValue(value);
+		mSampler = sampleShort;
+	}
+}
+
+short atomShortValues::sampleBool(const MPlug &plug)
+{
+	return plug.asBool() == true ? 1 : 0;
+}
+
+short atomShortValues::sampleChar(const MPlug &plug)
+{
+	return (short) plug.asChar();
+}
+
+short atomShortValues::sampleShort(const MPlug &plug)
+{
+	return plug.asShort();
+}
+	
+void atomShortValues::sample(unsigned int index)
+{
+	if(mSampler)
+	{
+		short value = mSampler(mPlug);
 		mCachedValues.setValue(value,index);
 	}
 }
 
-void atomShortValues::writeToAtomFile(std::ofstream & clip)
+void atomShortValues::writeToAtomFile(std::ostream & clip)
 {
 	for(unsigned int i=0;i<mCachedValues.numItems();++i)
 	{
@@ -103,33 +124,39 @@ void atomShortValues::writeToAtomFile(std::ofstream & clip)
 	}
 }
 
+void atomShortValues::getValues(std::vector<double> &values)
+{
+	values.resize(mCachedValues.numItems());
+	for(unsigned int i=0;i<mCachedValues.numItems();++i)
+		values[i] = (double)mCachedValues.getValue(i);
+}
+
 
 /*
 	atomIntValues
 */
-atomIntValues::atomIntValues(MPlug &plug, unsigned int numItems) :atomBasePlugAndValues(plug)
+atomIntValues::atomIntValues(MPlug &plug, unsigned int numItems) :atomBasePlugAndValues(plug), mSupported(false)
 {
 	mCachedValues.resize(numItems,1);
-}
-	
-void atomIntValues::setValue(MDGContext &context,unsigned int index)
-{
-	MObject attribute = mPlug.attribute();
-	MDGContextGuard guard(context);
 
+	MObject attribute = mPlug.attribute();
 	if ( attribute.hasFn( MFn::kNumericAttribute ) )
 	{
 		MFnNumericAttribute fnAttrib(attribute);
-		if(fnAttrib.unitType()==MFnNumericData::kLong)
-		{
-			int value;
-			mPlug.getValue(value);
-			mCachedValues.setValue(value,index);
-		}
+		mSupported = fnAttrib.unitType()==MFnNumericData::kLong;
+	}
+}
+	
+void atomIntValues::sample(unsigned int index)
+{
+	if(mSupported)
+	{
+		int value = mPlug.asInt();
+		mCachedValues.setValue(value,index);
 	}
 }
 
-void atomIntValues::writeToAtomFile(std::ofstream & clip)
+void atomIntValues::writeToAtomFile(std::ostream & clip)
 {
 	for(unsigned int i=0;i<mCachedValues.numItems();++i)
 	{
@@ -138,40 +165,39 @@ void atomIntValues::writeToAtomFile(std::ofstream & clip)
 	}
 }
 
+void atomIntValues::getValues(std::vector<double> &values)
+{
+	values.resize(mCachedValues.numItems());
+	for(unsigned int i=0;i<mCachedValues.numItems();++i)
+		values[i] = (double)mCachedValues.getValue(i);
+}
+
 
 /*
 	atomFloatValues
 */
-atomFloatValues::atomFloatValues(MPlug &plug, unsigned int numItems,unsigned int stride) :atomBasePlugAndValues(plug)
+atomFloatValues::atomFloatValues(MPlug &plug, unsigned int numItems,unsigned int stride) :atomBasePlugAndValues(plug), mSupported(false)
 {
 	mCachedValues.resize(numItems,stride);
-}
-	
-void atomFloatValues::setValue(MDGContext &context,unsigned int index)
-{
-	MObject attribute = mPlug.attribute();
-	MDGContextGuard guard(context);
 
+	MObject attribute = mPlug.attribute();
 	if ( attribute.hasFn( MFn::kNumericAttribute ) )
 	{
 		MFnNumericAttribute fnAttrib(attribute);
-
-		switch(fnAttrib.unitType())
-		{
-			case MFnNumericData::kFloat:
-			{
-				float value;
-				mPlug.getValue(value);
-				mCachedValues.setValue(value,index);
-				break;
-			}
-			default:
-				break;
-		}
+		mSupported = fnAttrib.unitType()==MFnNumericData::kFloat;
+	}
+}
+	
+void atomFloatValues::sample(unsigned int index)
+{
+	if(mSupported)
+	{
+		float value = mPlug.asFloat();
+		mCachedValues.setValue(value,index);
 	}
 }
 
-void atomFloatValues::writeToAtomFile(std::ofstream & clip)
+void atomFloatValues::writeToAtomFile(std::ostream & clip)
 {
 	for(unsigned int i=0;i<mCachedValues.numItems();++i)
 	{
@@ -183,36 +209,32 @@ void atomFloatValues::writeToAtomFile(std::ofstream & clip)
 	}
 }
 
+void atomFloatValues::getValues(std::vector<double> &values)
+{
+	//only single valued floats are fitted
+	values.clear();
+	if(mCachedValues.stride() != 1)
+		return;
+	values.resize(mCachedValues.numItems());
+	for(unsigned int i=0;i<mCachedValues.numItems();++i)
+		values[i] = (double)mCachedValues.getValue(i);
+}
+
 
 /*
 	atomDoubleValues
 */
-atomDoubleValues::atomDoubleValues(MPlug &plug, unsigned int numItems,double scale) :atomBasePlugAndValues(plug), mScale(scale)
+atomDoubleValues::atomDoubleValues(MPlug &plug, unsigned int numItems,double scale) :atomBasePlugAndValues(plug), mScale(scale), mSupported(false)
 {
 	mCachedValues.resize(numItems,1);
-}
-	
-void atomDoubleValues::setValue(MDGContext &context,unsigned int index)
-{
-	MObject attribute = mPlug.attribute();
-	MDGContextGuard guard(context);
 
+	//angles and distances are converted with the export units, everything else is stored as is
+	MObject attribute = mPlug.attribute();
 	if ( attribute.hasFn( MFn::kNumericAttribute ) )
 	{
 		MFnNumericAttribute fnAttrib(attribute);
-
-		switch(fnAttrib.unitType())
-		{
-			case MFnNumericData::kDouble:
-			{
-				double value;
-				mPlug.getValue(value);
-				mCachedValues.setValue(value,index);
-				break;
-			}
-			default:
-				break;
-		}
+		mSupported = fnAttrib.unitType()==MFnNumericData::kDouble;
+		mScale = 1.0;
 	}
 	else if( attribute.hasFn( MFn::kUnitAttribute ) )
 	{
@@ -220,37 +242,29 @@ void atomDoubleValues::setValue(MDGContext &context,unsigned int index)
 		switch(fnAttrib.unitType())
 		{
 			case MFnUnitAttribute::kAngle:
-			{
-				double value;
-				mPlug.getValue(value);
-				value *= mScale;
- 				mCachedValues.setValue(value,index);
-				break;
-			}
 			case MFnUnitAttribute::kDistance:
-			{
-				double value;
-				mPlug.getValue(value);
-				value *= mScale;
-				mCachedValues.setValue(value,index);
+				mSupported = true;
 				break;
-			}
 			case MFnUnitAttribute::kTime:
-			{
-				double value;
-				mPlug.getValue(value);
-				mCachedValues.setValue(value,index);
+				mSupported = true;
+				mScale = 1.0;
 				break;
-			}
 			default:
-			{
 				break;
-			}
 		}
 	}
 }
+	
+void atomDoubleValues::sample(unsigned int index)
+{
+	if(mSupported)
+	{
+		double value = mPlug.asDouble() * mScale;
+		mCachedValues.setValue(value,index);
+	}
+}
 
-void atomDoubleValues::writeToAtomFile(std::ofstream & clip)
+void atomDoubleValues::writeToAtomFile(std::ostream & clip)
 {
 	for(unsigned int i=0;i<mCachedValues.numItems();++i)
 	{
@@ -259,6 +273,13 @@ void atomDoubleValues::writeToAtomFile(std::ofstream & clip)
 	}
 }
 
+void atomDoubleValues::getValues(std::vector<double> &values)
+{
+	values.resize(mCachedValues.numItems());
+	for(unsigned int i=0;i<mCachedValues.numItems();++i)
+		values[i] = (double)mCachedValues.getValue(i);
+}
+
 
 /*
 
@@ -448,16 +469,16 @@ MPlug& atomCachedPlugs::getPlug(unsigned int item)
 {
 	return mCachedPlugs[item]->getPlug();
 }
-void atomCachedPlugs::calculateValue(MDGContext &ctx,unsigned int item)
+void atomCachedPlugs::calculateValue(unsigned int item)
 {
 	for(unsigned int i = 0;i< mCachedPlugs.size(); ++i)
 	{
 		if(mCachedPlugs[i])
-			mCachedPlugs[i]->setValue(ctx,item);
+			mCachedPlugs[i]->sample(item);
 	}
 }
 
-void atomCachedPlugs::writeValues(std::ofstream &clip,unsigned int item)
+void atomCachedPlugs::writeValues(std::ostream &clip,unsigned int item)
 {
 	if(item< mCachedPlugs.size())
 	{
@@ -489,4 +510,104 @@ bool atomCachedPlugs::isAttrCached(const MString &attrName,const  MString &layer
 	return false;
 }
 
+//number of frames baked from startTime to endTime, both included. bakeValues() steps
+//through exactly these frames, so the value arrays sized with it are always filled.
+unsigned int atomCachedPlugs::numFrames(const MTime &startTime, const MTime &endTime)
+{
+	double dStart = startTime.value();
+	double dEnd = endTime.value() +  (.0000001); //little nudge in case of round off errors
+	double tickStep = MTime(1.0,startTime.unit()).value();
+	return ((unsigned int)((dEnd - dStart)/tickStep)) + 1;
+}
+
+bool atomCachedPlugs::bakeValues(std::vector<atomCachedPlugs *> &cachedPlugs, const MTime &startTime,
+		const MTime &endTime, bool stepTime, bool showProgress)
+{
+	if(endTime<startTime)
+		return false;
+
+	double dStart = startTime.value();
+	MTime::Unit unit = startTime.unit();
+	double tickStep = MTime(1.0,unit).value();
+	unsigned int frames = numFrames(startTime,endTime);
+
+	bool hasActiveProgress = false;
+	if (showProgress && MProgressWindow::reserve()) {
+		hasActiveProgress = true;
+		MProgressWindow::setInterruptable(true);
+		MProgressWindow::startProgress();
+		MProgressWindow::setProgressRange(0, frames);
+		MProgressWindow::setProgress(0);
+		MStatus stringStat;
+		MString msg = MStringResource::getString(kBakingProgress, stringStat);
+		if(stringStat == MS::kSuccess)
+			MProgressWindow::setTitle(msg);
+	}
+
+	//when stepping the time the evaluation manager evaluates each frame, in parallel when
+	//its mode allows, and the plugs are then read clean in the normal context. Otherwise
+	//every plug of every node is pulled through one context for the frame, the values
+	//themselves don't set a context of their own.
+	MTime currentTime = MAnimControl::currentTime();
+	bool computationFinished = true; //if no interrupt happens we will finish the computation
+	for(unsigned int count = 0; count < frames; ++count)
+	{
+		if(hasActiveProgress)
+			MProgressWindow::setProgress(count);
+		MTime time(dStart + count * tickStep,unit);
+		if(stepTime)
+		{
+			MAnimControl::setCurrentTime(time);
+			for(unsigned int z = 0; z< cachedPlugs.size(); ++z)
+			{
+				if(cachedPlugs[z])
+					cachedPlugs[z]->calculateValue(count);
+			}
+		}
+		else
+		{
+			MDGContext ctx(time);
+			MDGContextGuard guard(ctx);
+			for(unsigned int z = 0; z< cachedPlugs.size(); ++z)
+			{
+				if(cachedPlugs[z])
+					cachedPlugs[z]->calculateValue(count);
+			}
+		}
+
+		if  (hasActiveProgress && MProgressWindow::isCancelled())
+		{
+			computationFinished = false;
+			break;
+		}
+	}
+	if(stepTime)
+		MAnimControl::setCurrentTime(currentTime);
+	if(hasActiveProgress)
+		MProgressWindow::endProgress();
+	return computationFinished;
+}
+
+void atomCachedPlugs::reduceKeys(std::vector<atomCachedPlugs *> &cachedPlugs, const MTime &startTime, double tolerance)
+{
+	std::vector<atomBasePlugAndValues *> plugs;
+	for(unsigned int z = 0; z< cachedPlugs.size(); ++z)
+	{
+		if(cachedPlugs[z])
+		{
+			for(unsigned int i = 0;i< cachedPlugs[z]->mCachedPlugs.size(); ++i)
+			{
+				if(cachedPlugs[z]->mCachedPlugs[i])
+					plugs.push_back(cachedPlugs[z]->mCachedPlugs[i]);
+			}
+		}
+	}
 
+	double startFrame = startTime.value();
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, plugs.size()),
+		[&](const tbb::blocked_range<size_t> &range)
+		{
+			for(size_t i = range.begin(); i != range.end(); ++i)
+				plugs[i]->reduceKeys(startFrame, tolerance);
+		});
+}
@@ -23,6 +23,7 @@ or hard copy form.*/
 #include <maya/MString.h>
 #include <maya/MTime.h>
 #include "atomFileUtils.h"
+#include "atomKeyReducer.h"
 
 #include <iosfwd>
 
@@ -49,13 +50,25 @@ public:
 
 	virtual ~atomBasePlugAndValues(){};
 
-	virtual void setValue(MDGContext &context,unsigned int index) = 0;
-	virtual void writeToAtomFile(std::ofstream & clip) = 0;
+	// Read the plug in the current context and store it at index. The
+	// caller sets the context once for the whole frame.
+	virtual void sample(unsigned int index) = 0;
+	virtual void writeToAtomFile(std::ostream & clip) = 0;
 	MPlug& getPlug() {return mPlug;}
+
+	//fit keys to the baked values, doesn't touch Maya so plugs can be reduced in parallel
+	void reduceKeys(double startFrame, double tolerance);
+	bool hasReducedKeys() {return mReduced;}
+	const std::vector<atomReducedKey>& getReducedKeys() {return mReducedKeys;}
+	virtual bool isStepped() {return false;}
+	virtual unsigned int numValues() = 0;
 protected:
-	atomBasePlugAndValues(MPlug &plug):mPlug(plug){}; //virtual class
+	atomBasePlugAndValues(MPlug &plug):mPlug(plug), mReduced(false){}; //virtual class
+	virtual void getValues(std::vector<double> &values) = 0;
 
 	MPlug mPlug;
+	std::vector<atomReducedKey> mReducedKeys;
+	bool mReduced;
 
 
 };
@@ -64,42 +77,64 @@ class atomShortValues : public atomBasePlugAndValues
 {
 public:
 	atomShortValues(MPlug &plug, unsigned int numItems);
-	void setValue(MDGContext &context,unsigned int index) override;
-	void writeToAtomFile(std::ofstream & clip) override;
+	void sample(unsigned int index) override;
+	void writeToAtomFile(std::ostream & clip) override;
+	bool isStepped() override {return true;}
+	unsigned int numValues() override {return mCachedValues.numItems();}
+protected:
+	void getValues(std::vector<double> &values) override;
 private:
+	typedef short (*Sampler)(const MPlug &plug);
+	static short sampleBool(const MPlug &plug);
+	static short sampleChar(const MPlug &plug);
+	static short sampleShort(const MPlug &plug);
+
 	atomCachedValues<short> mCachedValues;
+	Sampler mSampler;
 };
 
 class atomIntValues : public atomBasePlugAndValues
 {
 public:
 	atomIntValues(MPlug &plug, unsigned int numItems);
-	void setValue(MDGContext &context,unsigned int index) override;
-	void writeToAtomFile(std::ofstream & clip) override;
+	void sample(unsigned int index) override;
+	void writeToAtomFile(std::ostream & clip) override;
+	bool isStepped() override {return true;}
+	unsigned int numValues() override {return mCachedValues.numItems();}
+protected:
+	void getValues(std::vector<double> &values) override;
 private:
 	atomCachedValues<int> mCachedValues;
+	bool mSupported;
 };
 
 class atomFloatValues : public atomBasePlugAndValues
 {
 public:
 	atomFloatValues(MPlug &plug, unsigned int numItems,unsigned int stride = 1);
-	void setValue(MDGContext &context,unsigned int index) override;
-	void writeToAtomFile(std::ofstream & clip) override;
+	void sample(unsigned int index) override;
+	void writeToAtomFile(std::ostream & clip) override;
+	unsigned int numValues() override {return mCachedValues.numItems();}
+protected:
+	void getValues(std::vector<double> &values) override;
 private:
 	atomCachedValues<float> mCachedValues;
+	bool mSupported;
 };
 
 class atomDoubleValues : public atomBasePlugAndValues
 {
 public:
 	atomDoubleValues(MPlug &plug, unsigned int numItems,double scale = 1.0);
-	void setValue(MDGContext &context,unsigned int index) override;
-	void writeToAtomFile(std::ofstream & clip) override;
-
+	void sample(unsigned int index) override;
+	void writeToAtomFile(std::ostream & clip) override;
+	unsigned int numValues() override {return mCachedValues.numItems();}
+protected:
+	void getValues(std::vector<double> &values) override;
 private:
 	atomCachedValues<double> mCachedValues;
 	double mScale;
+	bool mSupported;
 };
 
 
@@ -116,9 +151,22 @@ public:
 	bool hasCached(){return (mCachedPlugs.size() >0);}
 	unsigned int getNumPlugs(){ return (unsigned int)mCachedPlugs.size();}
 	MPlug& getPlug(unsigned int item);	
-	void calculateValue(MDGContext &ctx, unsigned int item);
-	void writeValues(std::ofstream &clip, unsigned int item);
+	void calculateValue(unsigned int item);
+	void writeValues(std::ostream &clip, unsigned int item);
+	atomBasePlugAndValues* getPlugAndValues(unsigned int item) {return mCachedPlugs[item];}
 	bool isAttrCached(const MString &attrName, const MString &layerName);
+
+	//bake all the cached plugs of all the nodes, one frame at a time from startTime to endTime.
+	//each frame is pulled through a single DG context, or when stepTime is set (the
+	//stepTime export option), by moving the current time so the evaluation manager can
+	//evaluate the frame first.
+	//returns false if the user cancelled the bake.
+	static bool bakeValues(std::vector<atomCachedPlugs *> &cachedPlugs, const MTime &startTime,
+		const MTime &endTime, bool stepTime, bool showProgress);
+	static unsigned int numFrames(const MTime &startTime, const MTime &endTime);
+
+	//fit keys to the baked values of all the plugs of all the nodes, in parallel across the plugs.
+	static void reduceKeys(std::vector<atomCachedPlugs *> &cachedPlugs, const MTime &startTime, double tolerance);
 private:
 	std::vector<atomBasePlugAndValues *> mCachedPlugs;
 	void getCachedPlugs(MString &nodeName,const MPlugArray &animatablePlugs,
@@ -37,6 +37,7 @@ or hard copy form.*/
 #include <maya/MDGModifier.h>
 
 #include <fstream>
+#include <sstream>
 #include <cstring>
 
 //-------------------------------------------------------------------------
@@ -2449,6 +2450,7 @@ atomWriter::atomWriter()
 //		Class constructor.
 //
 {
+	resetKeyReductionStats();
 }
 
 atomWriter::~atomWriter()
@@ -2619,8 +2621,6 @@ void atomWriter::writeCachedValues(std::ofstream &animFile,
 			//the long name flag there is only used to turn long name (or nice name) display on
 			if(attrStrings.size() == 0 || attrStrings.find(std::string(fnLeafAttr.shortName().asChar())) != constIter)
 			{
-				// Write out the plugs' cached statement
-				animFile <<kTwoSpace << "cached ";
 				// build up the full attribute name
 				MFnAttribute fnAttr (attrObj);
 				MString fullAttrName (fnLeafAttr.shortName());
@@ -2631,6 +2631,34 @@ void atomWriter::writeCachedValues(std::ofstream &animFile,
 					fullAttrName = fnAttr2.name() + "." + fullAttrName;
 					attrPlug = attrPlug.parent();
 				}
+
+				// If keys were fitted to the baked values write them as an anim curve instead
+				atomBasePlugAndValues *values = cachedPlugs->getPlugAndValues(i);
+				if(values && values->hasReducedKeys())
+				{
+					std::streampos start = animFile.tellp();
+					animFile << kTwoSpace << kAnim << kSpaceChar << fullAttrName.asChar() << " " << attrName.asChar() << " " << i << ";\n";
+					MFnAnimCurve fnCurve;
+					MFnAnimCurve::AnimCurveType type = fnCurve.timedAnimCurveTypeForPlug(plug);
+					writeAnimCurve(animFile, values->getReducedKeys(), type, values->isStepped());
+
+					//what the cached statement would have taken, for the report
+					std::ostringstream baked;
+					baked.precision(animFile.precision());
+					baked << kTwoSpace << "cached " << fullAttrName.asChar() << " " << attrName.asChar() << " " << i << ";\n";
+					baked << kTwoSpace << "{ ";
+					cachedPlugs->writeValues(baked,i);
+					baked << " }\n";
+
+					mReducedSamples += values->numValues();
+					mReducedKeys += (unsigned int)values->getReducedKeys().size();
+					mReducedBytes += (double)(animFile.tellp() - start);
+					mBakedBytes += (double)baked.str().size();
+					continue;
+				}
+
+				// Write out the plugs' cached statement
+				animFile <<kTwoSpace << "cached ";
 				animFile << fullAttrName.asChar() << " " << attrName.asChar() << " " << i << ";\n";
 				animFile <<kTwoSpace << "{ ";
 				cachedPlugs->writeValues(animFile,i);
@@ -2640,6 +2668,26 @@ void atomWriter::writeCachedValues(std::ofstream &animFile,
 	}
 }
 
+void atomWriter::resetKeyReductionStats()
+{
+	mReducedSamples = 0;
+	mReducedKeys = 0;
+	mBakedBytes = 0.0;
+	mReducedBytes = 0.0;
+}
+
+void atomWriter::reportKeyReduction()
+{
+	if(mReducedSamples == 0)
+		return;
+	MStatus stringStat;
+	MString msgFmt = MStringResource::getString(kKeyReductionReport, stringStat);
+	MString msg;
+	msg.format(msgFmt, MString() + (int)mReducedSamples, MString() + (int)mReducedKeys,
+		MString() + mReducedBytes, MString() + mBakedBytes);
+	MGlobal::displayInfo(msg);
+}
+
 void	
 atomWriter::writeNodeStart(std::ofstream& animFile,atomNodeNameReplacer::NodeType nodeType, MString &nodeName, unsigned int depth, unsigned int childCount)
 {
@@ -2996,6 +3044,95 @@ bool atomWriter::writeAnimCurve(std::ofstream &clip,
 	return true;
 }
 
+bool atomWriter::writeAnimCurve(std::ofstream &clip,
+								const std::vector<atomReducedKey> &keys,
+								MFnAnimCurve::AnimCurveType type,
+								bool stepped)
+//
+//	Description:
+//		Write out keys fitted to cached values in the same format as the
+//		anim curves above. The values are already in the export units.
+//		Smooth keys get fixed tangents matching their slopes, stepped keys
+//		hold their value until the next key.
+//
+{
+	if (!clip) {
+		return false;
+	}
+
+	clip << kTwoSpace<< kAnimData << kSpaceChar << kBraceLeftChar << std::endl;
+
+	clip << kFourSpace << kInputString << kSpaceChar <<
+			boolInputTypeAsWord(false) << kSemiColonChar << std::endl;
+
+	clip << kFourSpace << kOutputString << kSpaceChar <<
+			outputTypeAsWord(type) << kSemiColonChar << std::endl;
+
+	clip << kFourSpace << kWeightedString << kSpaceChar <<
+			0 << kSemiColonChar << std::endl;
+
+	clip << kFourSpace << kPreInfinityString << kSpaceChar <<
+			infinityTypeAsWord(MFnAnimCurve::kConstant) << 
+			kSemiColonChar << std::endl;
+
+	clip << kFourSpace << kPostInfinityString << kSpaceChar <<
+			infinityTypeAsWord(MFnAnimCurve::kConstant) << 
+			kSemiColonChar << std::endl;
+
+	clip << kFourSpace << kKeysString << kSpaceChar << kBraceLeftChar << std::endl;
+
+	//	Tangent angles are measured against seconds and internal units, the
+	//	slopes are per frame and in the export units.
+	//
+	double framesPerSecond = MTime(1.0, MTime::kSeconds).as(timeUnit);
+	double conversion = 1.0;
+	switch (type) {
+		case MFnAnimCurve::kAnimCurveTA:
+		case MFnAnimCurve::kAnimCurveUA:
+			conversion = MAngle(1.0).as(angularUnit);
+			break;
+		case MFnAnimCurve::kAnimCurveTL:
+		case MFnAnimCurve::kAnimCurveUL:
+			conversion = MDistance(1.0).as(linearUnit);
+			break;
+		default:
+			break;
+	}
+	double slopeScale = framesPerSecond / conversion;
+	for (size_t i = 0; i < keys.size(); i++) {
+		const atomReducedKey &key = keys[i];
+		clip << kFourSpace << kTwoSpace << key.time;
+
+		double animValue = key.value;
+		if (atomBase::isEquivalent(animValue,0.0)) animValue = 0.0;
+		clip << kSpaceChar << animValue;
+
+		if (stepped) {
+			clip << kSpaceChar << tangentTypeAsWord(MFnAnimCurve::kTangentLinear);
+			clip << kSpaceChar << tangentTypeAsWord(MFnAnimCurve::kTangentStep);
+			clip << kSpaceChar << 0 << kSpaceChar << 1 << kSpaceChar << 0;
+		}
+		else {
+			clip << kSpaceChar << tangentTypeAsWord(MFnAnimCurve::kTangentFixed);
+			clip << kSpaceChar << tangentTypeAsWord(MFnAnimCurve::kTangentFixed);
+			clip << kSpaceChar << (key.inSlope == key.outSlope ? 1 : 0);
+			clip << kSpaceChar << 1 << kSpaceChar << 0;
+
+			MAngle inAngle(atan(key.inSlope * slopeScale), MAngle::kRadians);
+			clip << kSpaceChar << inAngle.as(angularUnit) << kSpaceChar << 1.0;
+			MAngle outAngle(atan(key.outSlope * slopeScale), MAngle::kRadians);
+			clip << kSpaceChar << outAngle.as(angularUnit) << kSpaceChar << 1.0;
+		}
+
+		clip << kSemiColonChar << std::endl;
+	}
+	clip << kFourSpace << kBraceRightChar << std::endl;
+
+	clip << kTwoSpace << kBraceRightChar << std::endl;
+
+	return true;
+}
+
 void atomWriter::writeValue(std::ofstream & clip,MPlug &plug)
 {
 	MObject attribute = plug.attribute();
@@ -33,6 +33,7 @@ or hard copy form.*/
 #include <maya/MPlug.h>
 #include <maya/MFnAnimCurve.h>
 #include "atomNodeNameReplacer.h"
+#include "atomKeyReducer.h"
 
 #include <iosfwd>
 
@@ -106,6 +107,7 @@ protected:
 };
 
 class atomReader : public atomBase {
+	friend class atomBakeBenchmark;
 public:
 	atomReader();
 	~atomReader() override;
@@ -168,6 +170,7 @@ protected:
 };
 
 class atomWriter : public atomBase {
+	friend class atomBakeBenchmark;
 public:
 	atomWriter();
 	~atomWriter() override;
@@ -203,13 +206,25 @@ public:
 	void				writeNodeStart(std::ofstream&,atomNodeNameReplacer::NodeType nodeType, MString &name, unsigned int depth =0, unsigned int childCount =0);
 	void				writeNodeEnd(std::ofstream&);
 
+	//cached plugs with reduced keys are written as anim curves by writeCachedValues, these
+	//report how many samples and bytes that saved.
+	void				resetKeyReductionStats();
+	void				reportKeyReduction();
+
 protected:
 
 	bool	writeAnim(	std::ofstream&, const MAnimCurveClipboardItem&, const MString &layerName, const MString &nodeName);
 	bool 	writeAnimCurve(	std::ofstream&, const MObject *, 
 							MFnAnimCurve::AnimCurveType,
 							bool = false);
+	bool 	writeAnimCurve(	std::ofstream&, const std::vector<atomReducedKey> &keys,
+							MFnAnimCurve::AnimCurveType, bool stepped);
 	void	writeValue(std::ofstream & clip,MPlug &plug);
+
+	unsigned int	mReducedSamples;
+	unsigned int	mReducedKeys;
+	double			mBakedBytes;
+	double			mReducedBytes;
 };
 
 class atomUnitNames {
@@ -12,8 +12,11 @@ or hard copy form.*/
 //
 //
 
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 #include <vector>
 #include <maya/MGlobal.h>
 #include <maya/MString.h>
@@ -35,7 +38,10 @@ or hard copy form.*/
 #include <maya/MObjectArray.h>
 #include <maya/MProgressWindow.h>
 #include <maya/MAnimControl.h>
+#include <maya/MEvaluationManager.h>
 #include <maya/MDagModifier.h>
+#include <maya/MArgList.h>
+#include <maya/MTimer.h>
 
 #include <maya/MMessage.h>
 #include <maya/MSceneMessage.h>
@@ -630,6 +636,9 @@ MStatus atomExport::writer(	const MFileObject& file,
 	bool constraint = false;
 	bool sdk = false;
 	bool animLayers = true;
+	bool reduceKeys = false;
+	double reduceTolerance = 0.01;
+	bool stepTime = false;
 	MString templateName;
 	MString viewName;
 	MTime startTime = MAnimControl::animationStartTime();
@@ -654,6 +663,9 @@ MStatus atomExport::writer(	const MFileObject& file,
 		const MString flagRange("range");
 		const MString flagExportEdits("exportEdits");		
 		const MString flagCached("baked");		
+		const MString flagReduceKeys("reduceKeys");
+		const MString flagReduceTolerance("reduceTolerance");
+		const MString flagStepTime("stepTime");
 		
 		//	Start parsing.
 		//
@@ -746,6 +758,24 @@ MStatus atomExport::writer(	const MFileObject& file,
 					cached = (theOption[1].asInt()) ? true : false;
 				}
 			}
+			else if (	theOption[0] == 
+						flagReduceKeys && theOption.length() > 1) {
+				if (theOption[1].isInt()) {
+					reduceKeys = (theOption[1].asInt()) ? true : false;
+				}
+			}
+			else if (	theOption[0] == 
+						flagReduceTolerance && theOption.length() > 1) {
+				if (theOption[1].isDouble()) {
+					reduceTolerance = theOption[1].asDouble();
+				}
+			}
+			else if (	theOption[0] == 
+						flagStepTime && theOption.length() > 1) {
+				if (theOption[1].isInt()) {
+					stepTime = (theOption[1].asInt()) ? true : false;
+				}
+			}
 			else if (theOption[0] == flagSelected && theOption.length() > 1) {
 				includeChildren = (theOption[1] == optionChildrenToo) ? true : false;
 				if(theOption[1] == optionTemplate)
@@ -797,7 +827,8 @@ MStatus atomExport::writer(	const MFileObject& file,
 	}
 	status = exportSelected(animFile, copyFlags, attrStrings, includeChildren,
 							useSpecifiedRange, startTime, endTime, statics,
-							cached,sdk,constraint, animLayers, exportEditsFile,templateReader);
+							cached,sdk,constraint, animLayers, reduceKeys, reduceTolerance,
+							stepTime, exportEditsFile,templateReader);
 
 	animFile.flush();
 	animFile.close();
@@ -907,6 +938,9 @@ MStatus atomExport::exportSelected( std::ofstream &animFile,
 									bool sdk,
 									bool constraint,
 									bool layers,
+									bool reduceKeys,
+									double reduceTolerance,
+									bool stepTime,
 									const MString& exportEditsFile,
 									atomTemplateReader &templateReader)
 {
@@ -966,7 +1000,7 @@ MStatus atomExport::exportSelected( std::ofstream &animFile,
 	if(cached)
 	{
 		bool passed = setUpCache(sList,cachedPlugs,animLayers,sdk, constraint, layers, attrStrings,templateReader,startTime, endTime,
-			fWriter.getAngularUnit(), fWriter.getLinearUnit()); //this sets it up and runs the cache;
+			fWriter.getAngularUnit(), fWriter.getLinearUnit(), stepTime); //this sets it up and runs the cache;
 		if(passed == false) //failed for some reason, one reason is that the user canceled the computation
 		{
 			//first delete everything though
@@ -987,6 +1021,10 @@ MStatus atomExport::exportSelected( std::ofstream &animFile,
 			return (MS::kFailure);
 		}
 	}
+	//optionally fit keys to the baked values, the plugs that get keys are then written as anim curves
+	fWriter.resetKeyReductionStats();
+	if(cached && reduceKeys)
+		atomCachedPlugs::reduceKeys(cachedPlugs,startTime,reduceTolerance);
 
 	unsigned int numObjects = sList.length();
 
@@ -1160,6 +1198,9 @@ MStatus atomExport::exportSelected( std::ofstream &animFile,
 	if(hasActiveProgress)
 		MProgressWindow::endProgress();
 
+	if(cached && reduceKeys)
+		fWriter.reportKeyReduction();
+
 	if(haveAnyAnimatableStuff == false)
 	{
 		MString msg = MStringResource::getString(kAnimCurveNotFound, status);
@@ -1236,18 +1277,14 @@ atomExport::setUpCache(MSelectionList &sList, std::vector<atomCachedPlugs *> &ca
 						bool sdk, bool constraint, bool layers,
 						std::set<std::string> &attrStrings, atomTemplateReader &templateReader,
 						MTime &startTime, MTime &endTime, MAngle::Unit angularUnit,
-						MDistance::Unit	linearUnit)
+						MDistance::Unit	linearUnit, bool stepTime)
 {
 	if(endTime<startTime)
 		return false; //should never happen but just in case.
 	unsigned int numObjects = sList.length();
 	cachedPlugs.resize(numObjects);
 
-	double dStart = startTime.value();
-	double dEnd = endTime.value() +  (.0000001); //little nudge in case of round off errors
-	MTime::Unit unit = startTime.unit();
-	double tickStep = MTime(1.0,unit).value();
-	unsigned int numItems = ((unsigned int)((dEnd - dStart)/tickStep)) + 1;
+	unsigned int numItems = atomCachedPlugs::numFrames(startTime,endTime);
 	bool somethingIsCached = false; //if nothing get's cached no reason to run computation loop
 	for (unsigned int i = 0; i < numObjects; i++) 
 	{
@@ -1316,42 +1353,7 @@ atomExport::setUpCache(MSelectionList &sList, std::vector<atomCachedPlugs *> &ca
 	bool computationFinished = true; //if no interrupt happens we will finish the computation
 	if(somethingIsCached)
 	{
-		bool hasActiveProgress = false;
-		if (MProgressWindow::reserve()) {
-			hasActiveProgress = true;
-			MProgressWindow::setInterruptable(true);
-   			MProgressWindow::startProgress();
-    		MProgressWindow::setProgressRange(0, numObjects);
-			MProgressWindow::setProgress(0);
-			MStatus stringStat;
-			MString msg = MStringResource::getString(kBakingProgress, stringStat);
-			if(stringStat == MS::kSuccess)
-				MProgressWindow::setTitle(msg);
-		}
-
-		unsigned int count =0;
-		for(double tick = dStart; tick <= dEnd; tick += tickStep)
-		{
-			if(hasActiveProgress)
-				MProgressWindow::setProgress(count);
-			MTime time(tick,unit);
-			MDGContext ctx(time);
-			MDGContextGuard guard(ctx);
-			for(unsigned int z = 0; z< cachedPlugs.size(); ++z)
-			{
-				if(cachedPlugs[z])
-					cachedPlugs[z]->calculateValue(ctx,count);
-			}
-
-			if  (hasActiveProgress && MProgressWindow::isCancelled())
-			{
-				computationFinished = false;
-				break;
-			}
-			++count;
-		}
-		if(hasActiveProgress)
-			MProgressWindow::endProgress();
+		computationFinished = atomCachedPlugs::bakeValues(cachedPlugs,startTime,endTime,stepTime,true);
 	}
 	return computationFinished;
 
@@ -1432,6 +1434,211 @@ atomExport::setUpAnimLayers(MSelectionList &sList,atomAnimLayers &animLayers, st
 	return somethingIsAnimLayered;
 }
 
+void * atomBakeBenchmark::creator()
+{
+	return new atomBakeBenchmark();
+}
+
+double atomBakeBenchmark::reductionRoundTripError(atomBasePlugAndValues &values, const MObject &sourceCurve,
+	const MTime &startTime, unsigned int numFrames, double tolerance)
+{
+	MString tmpDir;
+	values.reduceKeys(startTime.value(), tolerance);
+	if (!values.hasReducedKeys() || !MGlobal::executeCommand("internalVar -userTmpDir", tmpDir))
+		return -1.0;
+	MString fileName = tmpDir + "atomBakeBenchmark.atom";
+
+	MFnAnimCurve fnSource(sourceCurve);
+	MFnAnimCurve::AnimCurveType type = fnSource.animCurveType();
+	atomWriter writer;
+	{
+		std::ofstream clip(fileName.asChar());
+		writer.writeAnimCurve(clip, values.getReducedKeys(), type, values.isStepped());
+	}
+
+	atomReader reader;
+	MAnimCurveClipboardItem item;
+	bool haveCurve = false;
+	{
+		std::ifstream clip(fileName.asChar());
+		std::string keyword;
+		clip >> keyword;	//animData, read by the caller of readAnimCurve on import
+		haveCurve = reader.readAnimCurve(clip, item);
+	}
+	remove(fileName.asChar());
+	if (!haveCurve)
+		return -1.0;
+
+	//compare in the units the tolerance is given in
+	double conversion = 1.0;
+	if (type == MFnAnimCurve::kAnimCurveTA)
+		conversion = MAngle(1.0).as(MAngle::uiUnit());
+	else if (type == MFnAnimCurve::kAnimCurveTL)
+		conversion = MDistance(1.0).as(MDistance::uiUnit());
+
+	MObject curve = item.animCurve();
+	MFnAnimCurve fnCurve(curve);
+	double error = 0.0;
+	for (unsigned int i = 0; i < numFrames; ++i)
+	{
+		MTime time = startTime + MTime((double)i, startTime.unit());
+		double expected = 0.0, actual = 0.0;
+		fnSource.evaluate(time, expected);
+		fnCurve.evaluate(time, actual);
+		error = std::max(error, fabs(actual - expected) * conversion);
+	}
+	MGlobal::deleteNode(curve);
+	return error;
+}
+
+MStatus atomBakeBenchmark::doIt( const MArgList& args )
+{
+	int numPlugs = 50000;
+	int numFrames = 1000;
+	for (unsigned int i = 0; i + 1 < args.length(); i += 2)
+	{
+		MString flag = args.asString(i);
+		if (flag == "-plugs" || flag == "-p")
+			numPlugs = args.asInt(i + 1);
+		else if (flag == "-frames" || flag == "-f")
+			numFrames = args.asInt(i + 1);
+	}
+	if (numPlugs < 1 || numFrames < 1)
+	{
+		displayError("atomBakeBenchmark: -plugs and -frames must be positive.");
+		return MS::kInvalidParameter;
+	}
+
+	MSelectionList timeList;
+	MObject timeNode;
+	if (timeList.add("time1") != MS::kSuccess || timeList.getDependNode(0, timeNode) != MS::kSuccess)
+	{
+		displayError("atomBakeBenchmark: could not find time1.");
+		return MS::kFailure;
+	}
+	MPlug outTime = MFnDependencyNode(timeNode).findPlug("outTime", true);
+
+	//one time driven curve per channel type, so every channel gets cached
+	static const char *channels[3][3] = {
+		{ "translateX", "translateY", "translateZ" },
+		{ "rotateX", "rotateY", "rotateZ" },
+		{ "scaleX", "scaleY", "scaleZ" } };
+	const MFnAnimCurve::AnimCurveType curveTypes[3] = {
+		MFnAnimCurve::kAnimCurveTL, MFnAnimCurve::kAnimCurveTA, MFnAnimCurve::kAnimCurveTU };
+
+	MDagModifier modifier;
+	MFnAnimCurve fnCurve;
+	MObject curves[3];
+	for (int c = 0; c < 3; ++c)
+		curves[c] = fnCurve.create(curveTypes[c], &modifier);
+	unsigned int numNodes = (unsigned int)(numPlugs + 8) / 9;
+	MObjectArray nodes;
+	for (unsigned int n = 0; n < numNodes; ++n)
+		nodes.append(modifier.createNode("transform"));
+	MStatus stat = modifier.doIt();
+	if (stat != MS::kSuccess)
+	{
+		displayError("atomBakeBenchmark: could not create the benchmark scene.");
+		return stat;
+	}
+
+	MTime startTime(0.0, MTime::uiUnit());
+	MTime endTime((double)(numFrames - 1), MTime::uiUnit());
+	for (int c = 0; c < 3; ++c)
+	{
+		fnCurve.setObject(curves[c]);
+		fnCurve.addKey(startTime, 1.0);
+		fnCurve.addKey(endTime, 10.0);
+		modifier.connect(outTime, fnCurve.findPlug("input", true));
+	}
+	int remaining = numPlugs;
+	for (unsigned int n = 0; n < numNodes; ++n)
+	{
+		MFnDependencyNode fnNode(nodes[n]);
+		for (int c = 0; c < 9 && remaining > 0; ++c, --remaining)
+		{
+			fnCurve.setObject(curves[c / 3]);
+			modifier.connect(fnCurve.findPlug("output", true), fnNode.findPlug(channels[c / 3][c % 3], true));
+		}
+	}
+	modifier.doIt();
+
+	unsigned int numItems = atomCachedPlugs::numFrames(startTime, endTime);
+	std::vector<atomCachedPlugs *> cachedPlugs(numNodes, (atomCachedPlugs *)NULL);
+	std::set<std::string> attrStrings;
+	atomTemplateReader templateReader;
+	unsigned int numCached = 0;
+	for (unsigned int n = 0; n < numNodes; ++n)
+	{
+		MObject node = nodes[n];
+		MFnDagNode fnNode(node);
+		MString name = fnNode.partialPathName();
+		MSelectionList localList;
+		localList.add(node);
+		MPlugArray animatablePlugs;
+		MAnimUtil::findAnimatablePlugs(localList, animatablePlugs);
+		cachedPlugs[n] = new atomCachedPlugs(name, node, animatablePlugs, true, false, false,
+			attrStrings, templateReader, numItems, MAngle::uiUnit(), MDistance::uiUnit());
+		numCached += cachedPlugs[n]->getNumPlugs();
+	}
+
+	double samples = (double)numCached * numItems;
+	MTimer timer;
+	timer.beginTimer();
+	atomCachedPlugs::bakeValues(cachedPlugs, startTime, endTime, false, false);
+	timer.endTimer();
+	double contextTime = timer.elapsedTime();
+
+	MString msg;
+	msg.format("atomBakeBenchmark: ^1s plugs, ^2s frames, DG context bake ^3s s (^4s samples/s)",
+		MString() + (int)numCached, MString() + (int)numItems, MString() + contextTime,
+		MString() + (contextTime > 0.0 ? samples / contextTime : 0.0));
+	MGlobal::displayInfo(msg);
+	appendToResult(contextTime);
+
+	if (MEvaluationManager::evaluationManagerActive(MDGContext::fsNormal))
+	{
+		timer.beginTimer();
+		atomCachedPlugs::bakeValues(cachedPlugs, startTime, endTime, true, false);
+		timer.endTimer();
+		double stepTime = timer.elapsedTime();
+
+		msg.format("atomBakeBenchmark: evaluation manager bake ^1s s (^2s samples/s)",
+			MString() + stepTime, MString() + (stepTime > 0.0 ? samples / stepTime : 0.0));
+		MGlobal::displayInfo(msg);
+		appendToResult(stepTime);
+	}
+
+	//the first node's rotateX is driven by the rotate curve. The key reducer works in ui
+	//units, so this catches tangents written in the wrong units.
+	const double tolerance = 0.01;
+	double roundTripError = -1.0;
+	MPlug rotatePlug = MFnDependencyNode(nodes[0]).findPlug("rotateX", true);
+	for (unsigned int i = 0; cachedPlugs[0] && i < cachedPlugs[0]->getNumPlugs(); ++i)
+	{
+		atomBasePlugAndValues *values = cachedPlugs[0]->getPlugAndValues(i);
+		if (values && values->getPlug() == rotatePlug)
+			roundTripError = reductionRoundTripError(*values, curves[1], startTime, numItems, tolerance);
+	}
+
+	for (unsigned int n = 0; n < numNodes; ++n)
+		delete cachedPlugs[n];
+	modifier.undoIt();
+
+	if (roundTripError >= 0.0)
+	{
+		msg.format("atomBakeBenchmark: reduced rotate curve round trip, largest error ^1s",
+			MString() + roundTripError);
+		MGlobal::displayInfo(msg);
+	}
+	if (roundTripError < 0.0 || roundTripError > tolerance * 1.01)
+	{
+		displayError("atomBakeBenchmark: the reduced rotate curve does not match after writing and reading it back.");
+		return MS::kFailure;
+	}
+	return MS::kSuccess;
+}
+
 MStatus initializePlugin(MObject obj)
 {
 	MStatus stat = MS::kFailure;
@@ -1462,6 +1669,15 @@ MStatus initializePlugin(MObject obj)
 										(char *)animExportDefaultOptions,
 										true);
 
+	if (stat != MS::kSuccess) {
+		return stat;
+	}
+
+	stat = plugIn.registerCommand("atomBakeBenchmark", atomBakeBenchmark::creator);
+	if (stat != MS::kSuccess) {
+		cerr << "Failed to register command : atomBakeBenchmark\n";
+		return stat;
+	}
 
 	MGlobal::sourceFile ( "atomLayerCommands.mel" ) ;
 
@@ -1481,6 +1697,12 @@ MStatus uninitializePlugin(MObject obj)
 
 	stat = plugIn.deregisterFileTranslator("atomExport");
 
+	if (stat != MS::kSuccess) {
+		return stat;
+	}
+
+	stat = plugIn.deregisterCommand("atomBakeBenchmark");
+
 	return stat;
 }
 
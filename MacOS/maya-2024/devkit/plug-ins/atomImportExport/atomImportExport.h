@@ -16,6 +16,7 @@ or hard copy form.*/
 
 #include <map>
 #include <maya/MPxFileTranslator.h>
+#include <maya/MPxCommand.h>
 #include <maya/MSelectionList.h>
 #include <maya/MFnDependencyNode.h>
 #include <maya/MTime.h>
@@ -112,6 +113,7 @@ private:
 										bool useSpecifiedTimes, MTime &startTime,
 										MTime &endTime,
 										bool statics, bool cached, bool sdk, bool constraint, bool layers,
+										bool reduceKeys, double reduceTolerance, bool stepTime,
 										const MString& exportEditsFile,
 										atomTemplateReader &reader);
 
@@ -129,7 +131,7 @@ private:
 									bool sdk, bool constraint, bool layers,
 									std::set<std::string> &attrStrings, atomTemplateReader &templateReader,
 									MTime &startTime, MTime &endTime,MAngle::Unit angularUnit,
-									MDistance::Unit	linearUnit);
+									MDistance::Unit	linearUnit, bool stepTime);
 
 	bool				setUpAnimLayers(MSelectionList &sList,atomAnimLayers &animLayers, 
 									std::vector<atomNodeWithAnimLayers *> &nodesWithAnimLayers,
@@ -139,5 +141,23 @@ private:
 	//MStatus				writeSetDrivenKeys(ofstream &animFile, MFnDependencyNode &fnNode,MString &name, bool &hasSetDrivenKey);
 	atomWriter			fWriter;
 };
+
+// Times baking cached plugs. Builds a scene of transforms whose channels are
+// driven by time driven anim curves, bakes them the same way atomExport does
+// and then removes the scene again. It also checks that a reduced rotate
+// curve written and read back matches its source curve.
+//
+//	atomBakeBenchmark [-plugs 50000] [-frames 1000]
+//
+class atomBakeBenchmark : public MPxCommand {
+public:
+	MStatus		doIt( const MArgList& args ) override;
+	static void *	creator ();
+private:
+	//largest difference, in ui units, between the source curve and the reduced keys of values
+	//after they went through atomWriter and atomReader. Negative if the round trip failed.
+	static double	reductionRoundTripError(atomBasePlugAndValues &values, const MObject &sourceCurve,
+						const MTime &startTime, unsigned int numFrames, double tolerance);
+};
 #endif
 
@@ -67,6 +67,8 @@ or hard copy form.*/
 
 #define kBakingProgress MStringResourceId(kPluginId, "kBakingATOM", "Baking")
 
+#define kKeyReductionReport MStringResourceId(kPluginId, "kKeyReductionReport", "Key reduction: ^1s baked values written as ^2s keys, ^3s bytes instead of ^4s.")
+
 
 
 
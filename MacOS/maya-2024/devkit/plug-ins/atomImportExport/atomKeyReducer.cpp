@@ -0,0 +1,116 @@
+/** Copyright 2012 Autodesk, Inc.  All rights reserved.
+Use of this software is subject to the terms of the Autodesk license
+agreement provided at the time of installation or download,  or
+which otherwise accompanies this software in either electronic
+or hard copy form.*/
+
+//
+//	File Name:	atomKeyReducer.cpp
+//
+//
+//		Fits keys to baked values so that they can be exported as anim
+//      curves instead of one value per frame.
+
+#include "atomKeyReducer.h"
+
+#include <math.h>
+
+double atomKeyReducer::slopeAt(const std::vector<double> &values, unsigned int index)
+{
+	unsigned int last = (unsigned int)values.size() - 1;
+	if(last == 0)
+		return 0.0;
+	if(index == 0)
+		return values[1] - values[0];
+	if(index == last)
+		return values[last] - values[last - 1];
+	return (values[index + 1] - values[index - 1]) * 0.5;
+}
+
+bool atomKeyReducer::segmentFits(const std::vector<double> &values, const std::vector<double> &slopes,
+		unsigned int first, unsigned int last, double tolerance)
+{
+	//cubic Hermite between the two keys, checked against every sample in between
+	double span = (double)(last - first);
+	double p0 = values[first];
+	double p1 = values[last];
+	double m0 = slopes[first] * span;
+	double m1 = slopes[last] * span;
+	for(unsigned int i = first + 1; i < last; ++i)
+	{
+		double s = (double)(i - first) / span;
+		double s2 = s * s;
+		double s3 = s2 * s;
+		double value = (2.0*s3 - 3.0*s2 + 1.0) * p0 + (s3 - 2.0*s2 + s) * m0 +
+			(-2.0*s3 + 3.0*s2) * p1 + (s3 - s2) * m1;
+		if(fabs(value - values[i]) > tolerance)
+			return false;
+	}
+	return true;
+}
+
+void atomKeyReducer::reduce(const std::vector<double> &values, double startFrame, double tolerance,
+		bool stepped, std::vector<atomReducedKey> &keys)
+{
+	keys.clear();
+	unsigned int numValues = (unsigned int)values.size();
+	if(numValues == 0)
+		return;
+
+	if(stepped)
+	{
+		for(unsigned int i = 0; i < numValues; ++i)
+		{
+			if(i == 0 || values[i] != values[i - 1])
+			{
+				atomReducedKey key = { startFrame + i, values[i], 0.0, 0.0 };
+				keys.push_back(key);
+			}
+		}
+		return;
+	}
+
+	std::vector<double> slopes(numValues);
+	for(unsigned int i = 0; i < numValues; ++i)
+		slopes[i] = slopeAt(values, i);
+
+	//greedy: from each key find the farthest sample the next key can go on, first by
+	//doubling the span and then by bisecting between the last fit and the first miss.
+	unsigned int first = 0;
+	unsigned int last = numValues - 1;
+	atomReducedKey key = { startFrame, values[0], slopes[0], slopes[0] };
+	keys.push_back(key);
+	while(first < last)
+	{
+		unsigned int fit = first + 1;
+		unsigned int miss = last + 1;
+		for(unsigned int span = 2; first + span <= last; span *= 2)
+		{
+			if(segmentFits(values, slopes, first, first + span, tolerance) == false)
+			{
+				miss = first + span;
+				break;
+			}
+			fit = first + span;
+		}
+		if(miss > last && fit < last && segmentFits(values, slopes, first, last, tolerance))
+			fit = last;
+		else
+		{
+			if(miss > last)
+				miss = last;
+			while(miss - fit > 1)
+			{
+				unsigned int mid = fit + (miss - fit) / 2;
+				if(segmentFits(values, slopes, first, mid, tolerance))
+					fit = mid;
+				else
+					miss = mid;
+			}
+		}
+
+		atomReducedKey next = { startFrame + fit, values[fit], slopes[fit], slopes[fit] };
+		keys.push_back(next);
+		first = fit;
+	}
+}
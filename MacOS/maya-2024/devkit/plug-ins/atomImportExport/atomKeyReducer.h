@@ -0,0 +1,43 @@
+/** Copyright 2012 Autodesk, Inc.  All rights reserved.
+Use of this software is subject to the terms of the Autodesk license
+agreement provided at the time of installation or download,  or
+which otherwise accompanies this software in either electronic
+or hard copy form.*/
+
+//
+//	File Name:	atomKeyReducer.h
+//
+//
+//		Fits keys to baked values so that they can be exported as anim
+//      curves instead of one value per frame.
+#ifndef __ATOM_KEY_REDUCER_H
+#define __ATOM_KEY_REDUCER_H
+
+#include <vector>
+
+//a fitted key, slopes are in value units per frame
+struct atomReducedKey
+{
+	double time;
+	double value;
+	double inSlope;
+	double outSlope;
+};
+
+class atomKeyReducer
+{
+public:
+	//fit keys to values sampled once per frame starting at startFrame. Keys are placed on
+	//samples and the Hermite segments between them stay within tolerance of every sample
+	//they span. When stepped is set the values are held until they change, which is
+	//what we use for integer, boolean and enum attributes.
+	static void reduce(const std::vector<double> &values, double startFrame, double tolerance,
+		bool stepped, std::vector<atomReducedKey> &keys);
+
+private:
+	static double slopeAt(const std::vector<double> &values, unsigned int index);
+	static bool segmentFits(const std::vector<double> &values, const std::vector<double> &slopes,
+		unsigned int first, unsigned int last, double tolerance);
+};
+
+#endif
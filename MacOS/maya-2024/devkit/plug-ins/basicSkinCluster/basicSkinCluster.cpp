@@ -15,6 +15,11 @@
 //  Description:
 //      Rudimentary implementation of a skin cluster.
 //
+//      The skinMode attribute selects linear blend, dual quaternion or a
+//      per-vertex mix of the two (driven by dqBlendWeights). The weights
+//      are flattened into a sparse cache that is only rebuilt when they
+//      change, and the points are deformed in a parallel loop.
+//
 //      Use this script to create a simple example.
 /*      
 loadPlugin basicSkinCluster;
@@ -56,7 +61,20 @@ skinCluster -e -maximumInfluences 3 basicSkinCluster1;	// forces computation of
 #include <maya/MPxSkinCluster.h> 
 #include <maya/MItGeometry.h>
 #include <maya/MPoint.h>
+#include <maya/MPointArray.h>
 #include <maya/MFnMatrixData.h>
+#include <maya/MFnEnumAttribute.h>
+#include <maya/MFnNumericAttribute.h>
+#include <maya/MTransformationMatrix.h>
+#include <maya/MEvaluationNode.h>
+#include <maya/MPlugArray.h>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <cmath>
+#include <unordered_map>
+#include <vector>
 
 
 class basicSkinCluster : public MPxSkinCluster
@@ -72,10 +90,55 @@ public:
                            const MMatrix& mat,
                            unsigned int multiIndex) override;
 
+    // Weight cache invalidation, for both DG and EM evaluation
+    //
+    MStatus setDependentsDirty(const MPlug& plug, MPlugArray& plugArray) override;
+    MStatus preEvaluation(const MDGContext& context, const MEvaluationNode& evaluationNode) override;
+
     static const MTypeId id;
+
+    // local node attributes
+    static  MObject skinMode;           // linear, dual quaternion or blended
+    static  MObject dqBlendWeights;     // per-vertex linear / dual quaternion mix
+
+    enum SkinMode {
+        kLinear = 0,
+        kDualQuaternion,
+        kBlended
+    };
+
+private:
+    // Sparse weights for one deformed geometry, stored in iteration order.
+    // The influences of point i are entries [offsets[i], offsets[i+1]).
+    // Rebuilt only when the weights change, so the skinning mode can be
+    // switched without any extra evaluation cost.
+    //
+    struct WeightCache {
+        bool                        dirty = true;
+        std::vector<unsigned int>   offsets;
+        std::vector<unsigned int>   influences;
+        std::vector<double>         weights;
+        std::vector<double>         blend;
+    };
+
+    // Per-influence data, converted once per evaluation.
+    //
+    struct Influence {
+        double  lbs[12];    // bindPreMatrix * matrix, as 4 rows of 3
+        double  scale[12];  // non-rigid part applied before the dual quaternion
+        double  real[4];    // rotation quaternion (w,x,y,z)
+        double  dual[4];    // translation dual part (w,x,y,z)
+    };
+
+    void    rebuildWeightCache(MDataBlock& block, MItGeometry& iter, WeightCache& cache);
+    void    invalidateWeightCaches();
+
+    std::unordered_map<unsigned int, WeightCache> fWeightCaches;
 };
 
 const MTypeId basicSkinCluster::id( 0x00080030 );
+MObject basicSkinCluster::skinMode;
+MObject basicSkinCluster::dqBlendWeights;
 
 
 void* basicSkinCluster::creator()
@@ -85,10 +148,190 @@ void* basicSkinCluster::creator()
 
 MStatus basicSkinCluster::initialize()
 {
+    MStatus status;
+
+    MFnEnumAttribute eAttr;
+    skinMode = eAttr.create( "skinMode", "skm", kLinear, &status );
+    eAttr.addField( "linear", kLinear );
+    eAttr.addField( "dualQuaternion", kDualQuaternion );
+    eAttr.addField( "blended", kBlended );
+    eAttr.setStorable( true );
+    eAttr.setKeyable( true );
+
+    MFnNumericAttribute nAttr;
+    dqBlendWeights = nAttr.create( "dqBlendWeights", "dqbw", MFnNumericData::kDouble, 0.0, &status );
+    nAttr.setArray( true );
+    nAttr.setUsesArrayDataBuilder( true );
+    nAttr.setStorable( true );
+    nAttr.setMin( 0.0 );
+    nAttr.setMax( 1.0 );
+
+    status = addAttribute( skinMode );
+    if (!status) { status.perror("addAttribute(skinMode)"); return status; }
+    status = addAttribute( dqBlendWeights );
+    if (!status) { status.perror("addAttribute(dqBlendWeights)"); return status; }
+
+    status = attributeAffects( skinMode, outputGeom );
+    if (!status) { status.perror("attributeAffects(skinMode)"); return status; }
+    status = attributeAffects( dqBlendWeights, outputGeom );
+    if (!status) { status.perror("attributeAffects(dqBlendWeights)"); return status; }
+
     return MStatus::kSuccess;
 }
 
 
+MStatus
+basicSkinCluster::setDependentsDirty( const MPlug& plug, MPlugArray& plugArray )
+{
+    const MObject attr = plug.attribute();
+    if ( attr == weightList || attr == weights || attr == dqBlendWeights ) {
+        invalidateWeightCaches();
+    }
+    return MPxSkinCluster::setDependentsDirty( plug, plugArray );
+}
+
+MStatus
+basicSkinCluster::preEvaluation( const MDGContext& context, const MEvaluationNode& evaluationNode )
+{
+    if ( context.isNormal() ) {
+        MStatus status;
+        if ( ( evaluationNode.dirtyPlugExists( weightList, &status ) && status ) ||
+             ( evaluationNode.dirtyPlugExists( weights, &status ) && status ) ||
+             ( evaluationNode.dirtyPlugExists( dqBlendWeights, &status ) && status ) )
+        {
+            invalidateWeightCaches();
+        }
+    }
+    return MStatus::kSuccess;
+}
+
+void
+basicSkinCluster::invalidateWeightCaches()
+{
+    for ( auto& entry : fWeightCaches ) {
+        entry.second.dirty = true;
+    }
+}
+
+
+void
+basicSkinCluster::rebuildWeightCache( MDataBlock& block,
+                                      MItGeometry& iter,
+                                      WeightCache& cache )
+//
+// Description:   Flattens the weightList and dqBlendWeights arrays into the
+//                sparse layout used by deform(). Only non-zero weights are
+//                kept.
+//
+{
+    cache.offsets.clear();
+    cache.influences.clear();
+    cache.weights.clear();
+    cache.blend.clear();
+
+    MArrayDataHandle weightListHandle = block.inputArrayValue( weightList );
+    MArrayDataHandle blendHandle = block.inputArrayValue( dqBlendWeights );
+    const bool hasBlend = blendHandle.elementCount() > 0;
+
+    cache.offsets.reserve( iter.count() + 1 );
+    cache.blend.reserve( iter.count() );
+    cache.offsets.push_back( 0 );
+
+    for ( iter.reset(); !iter.isDone(); iter.next() ) {
+        const unsigned int index = (unsigned int) iter.index();
+
+        if ( MS::kSuccess == weightListHandle.jumpToElement( index ) ) {
+            MArrayDataHandle weightsHandle = weightListHandle.inputValue().child( weights );
+            const unsigned int count = weightsHandle.elementCount();
+            for ( unsigned int i=0; i<count; ++i, weightsHandle.next() ) {
+                const double w = weightsHandle.inputValue().asDouble();
+                if ( w != 0.0 ) {
+                    cache.influences.push_back( weightsHandle.elementIndex() );
+                    cache.weights.push_back( w );
+                }
+            }
+        }
+        cache.offsets.push_back( (unsigned int) cache.influences.size() );
+
+        double b = 0.0;
+        if ( hasBlend && MS::kSuccess == blendHandle.jumpToElement( index ) ) {
+            b = blendHandle.inputValue().asDouble();
+        }
+        cache.blend.push_back( b );
+    }
+    iter.reset();
+
+    cache.dirty = false;
+}
+
+
+static void
+convertInfluence( const MMatrix& m, double lbs[12], double scale[12],
+                  double real[4], double dual[4] )
+//
+// Description:   Splits a skinning matrix into its rigid part, as a unit dual
+//                quaternion, and the remaining scale/shear, which is blended
+//                linearly ahead of the dual quaternion.
+//
+{
+    for ( int r=0; r<4; ++r ) {
+        for ( int c=0; c<3; ++c ) {
+            lbs[r*3 + c] = m[r][c];
+        }
+    }
+
+    MMatrix rigid = MTransformationMatrix( m ).asRotateMatrix();
+    rigid[3][0] = m[3][0];
+    rigid[3][1] = m[3][1];
+    rigid[3][2] = m[3][2];
+
+    const MMatrix nonRigid = m * rigid.inverse();
+    for ( int r=0; r<4; ++r ) {
+        for ( int c=0; c<3; ++c ) {
+            scale[r*3 + c] = nonRigid[r][c];
+        }
+    }
+
+    // Maya matrices transform row vectors, so the rotation used in the
+    // usual column-vector formulation is the transpose of 'rigid'.
+    double w, x, y, z;
+    const double trace = rigid[0][0] + rigid[1][1] + rigid[2][2];
+    if ( trace > 0.0 ) {
+        const double s = 0.5 / sqrt( trace + 1.0 );
+        w = 0.25 / s;
+        x = ( rigid[1][2] - rigid[2][1] ) * s;
+        y = ( rigid[2][0] - rigid[0][2] ) * s;
+        z = ( rigid[0][1] - rigid[1][0] ) * s;
+    } else if ( rigid[0][0] > rigid[1][1] && rigid[0][0] > rigid[2][2] ) {
+        const double s = 2.0 * sqrt( 1.0 + rigid[0][0] - rigid[1][1] - rigid[2][2] );
+        w = ( rigid[1][2] - rigid[2][1] ) / s;
+        x = 0.25 * s;
+        y = ( rigid[1][0] + rigid[0][1] ) / s;
+        z = ( rigid[2][0] + rigid[0][2] ) / s;
+    } else if ( rigid[1][1] > rigid[2][2] ) {
+        const double s = 2.0 * sqrt( 1.0 + rigid[1][1] - rigid[0][0] - rigid[2][2] );
+        w = ( rigid[2][0] - rigid[0][2] ) / s;
+        x = ( rigid[1][0] + rigid[0][1] ) / s;
+        y = 0.25 * s;
+        z = ( rigid[2][1] + rigid[1][2] ) / s;
+    } else {
+        const double s = 2.0 * sqrt( 1.0 + rigid[2][2] - rigid[0][0] - rigid[1][1] );
+        w = ( rigid[0][1] - rigid[1][0] ) / s;
+        x = ( rigid[2][0] + rigid[0][2] ) / s;
+        y = ( rigid[2][1] + rigid[1][2] ) / s;
+        z = 0.25 * s;
+    }
+    real[0] = w; real[1] = x; real[2] = y; real[3] = z;
+
+    // dual = 0.5 * (0, t) * real
+    const double tx = m[3][0], ty = m[3][1], tz = m[3][2];
+    dual[0] = -0.5 * (  tx*x + ty*y + tz*z );
+    dual[1] =  0.5 * (  tx*w + ty*z - tz*y );
+    dual[2] =  0.5 * ( -tx*z + ty*w + tz*x );
+    dual[3] =  0.5 * (  tx*y - ty*x + tz*w );
+}
+
+
 MStatus
 basicSkinCluster::deform( MDataBlock& block,
                       MItGeometry& iter,
@@ -97,7 +340,8 @@ basicSkinCluster::deform( MDataBlock& block,
 //
 // Method: deform
 //
-// Description:   Deforms the point with a simple smooth skinning algorithm
+// Description:   Deforms the point with linear blend, dual quaternion or
+//                blended skinning, depending on the skinMode attribute.
 //
 // Arguments:
 //   block      : the datablock of the node
@@ -125,8 +369,8 @@ basicSkinCluster::deform( MDataBlock& block,
 
 	MArrayDataHandle bindHandle = block.inputArrayValue( bindPreMatrix );
 	if ( bindHandle.elementCount() > 0 ) {
-		for (auto transform : transforms) {
-			transform = MFnMatrixData(bindHandle.inputValue().data()).matrix() * transform;
+		for ( int i=0; i<numTransforms; ++i ) {
+			transforms[i] = MFnMatrixData(bindHandle.inputValue().data()).matrix() * transforms[i];
 			bindHandle.next();
 		}
 	}
@@ -137,28 +381,125 @@ basicSkinCluster::deform( MDataBlock& block,
 		return MS::kSuccess;
 	}
 
-    // Iterate through each point in the geometry.
-    //
-    for ( ; !iter.isDone(); iter.next()) {
-        MPoint pt = iter.position();
-		MPoint skinned;
+	const short mode = block.inputValue( skinMode ).asShort();
+
+	// convert each influence once, not once per point
+	//
+	std::vector<Influence> influences( numTransforms );
+	for ( int i=0; i<numTransforms; ++i ) {
+		Influence& inf = influences[i];
+		convertInfluence( transforms[i], inf.lbs, inf.scale, inf.real, inf.dual );
+	}
+
+	WeightCache& cache = fWeightCaches[multiIndex];
+	if ( cache.dirty || cache.blend.size() != (size_t) iter.count() ) {
+		rebuildWeightCache( block, iter, cache );
+	}
 
-		// get the weights for this point
-		MArrayDataHandle weightsHandle = weightListHandle.inputValue().child( weights );
+	MPointArray points;
+	iter.allPositions( points );
+	const unsigned int numPoints = points.length();
 
-		// compute the skinning
-		for ( int i=0; i<numTransforms; ++i ) {
-			if ( MS::kSuccess == weightsHandle.jumpToElement( i ) ) {
-				skinned += ( pt * transforms[i] ) * weightsHandle.inputValue().asDouble();
+	const unsigned int* offsets = cache.offsets.data();
+	const unsigned int* infIndices = cache.influences.data();
+	const double* infWeights = cache.weights.data();
+	const double* blend = cache.blend.data();
+	const Influence* inf = influences.data();
+
+	tbb::parallel_for( tbb::blocked_range<unsigned int>( 0, numPoints, 1024 ),
+					   [&]( const tbb::blocked_range<unsigned int>& r )
+	{
+		for ( unsigned int p = r.begin(); p < r.end(); ++p ) {
+			const double px = points[p].x;
+			const double py = points[p].y;
+			const double pz = points[p].z;
+			const unsigned int first = offsets[p];
+			const unsigned int last = offsets[p+1];
+
+			// influences beyond the connected matrices are ignored, as before
+			double lbsOut[3] = { 0.0, 0.0, 0.0 };
+			if ( mode != kDualQuaternion ) {
+				double acc[12] = { 0.0 };
+				for ( unsigned int k = first; k < last; ++k ) {
+					if ( infIndices[k] >= (unsigned int) numTransforms ) continue;
+					const double* m = inf[ infIndices[k] ].lbs;
+					const double w = infWeights[k];
+					for ( int c=0; c<12; ++c ) acc[c] += w * m[c];
+				}
+				lbsOut[0] = px*acc[0] + py*acc[3] + pz*acc[6] + acc[9];
+				lbsOut[1] = px*acc[1] + py*acc[4] + pz*acc[7] + acc[10];
+				lbsOut[2] = px*acc[2] + py*acc[5] + pz*acc[8] + acc[11];
+			}
+
+			const double b = ( mode == kBlended ) ? blend[p] :
+							 ( mode == kDualQuaternion ) ? 1.0 : 0.0;
+			if ( b <= 0.0 ) {
+				points[p] = MPoint( lbsOut[0], lbsOut[1], lbsOut[2] );
+				continue;
+			}
+
+			double sc[12] = { 0.0 };
+			double q0[4] = { 0.0 };
+			double qe[4] = { 0.0 };
+			const double* pivot = nullptr;
+			for ( unsigned int k = first; k < last; ++k ) {
+				if ( infIndices[k] >= (unsigned int) numTransforms ) continue;
+				const Influence& in = inf[ infIndices[k] ];
+				double w = infWeights[k];
+				for ( int c=0; c<12; ++c ) sc[c] += w * in.scale[c];
+
+				// keep all rotations in the same hemisphere as the first one
+				if ( pivot == nullptr ) {
+					pivot = in.real;
+				} else if ( pivot[0]*in.real[0] + pivot[1]*in.real[1] +
+							pivot[2]*in.real[2] + pivot[3]*in.real[3] < 0.0 ) {
+					w = -w;
+				}
+				for ( int c=0; c<4; ++c ) {
+					q0[c] += w * in.real[c];
+					qe[c] += w * in.dual[c];
+				}
+			}
+
+			const double len = sqrt( q0[0]*q0[0] + q0[1]*q0[1] + q0[2]*q0[2] + q0[3]*q0[3] );
+			double dqOut[3] = { 0.0, 0.0, 0.0 };
+			if ( len > 0.0 ) {
+				const double inv = 1.0 / len;
+				for ( int c=0; c<4; ++c ) { q0[c] *= inv; qe[c] *= inv; }
+
+				const double vx = px*sc[0] + py*sc[3] + pz*sc[6] + sc[9];
+				const double vy = px*sc[1] + py*sc[4] + pz*sc[7] + sc[10];
+				const double vz = px*sc[2] + py*sc[5] + pz*sc[8] + sc[11];
+
+				// rotation: v + 2 * r x ( r x v + w v )
+				const double w = q0[0], x = q0[1], y = q0[2], z = q0[3];
+				const double cx = y*vz - z*vy + w*vx;
+				const double cy = z*vx - x*vz + w*vy;
+				const double cz = x*vy - y*vx + w*vz;
+				dqOut[0] = vx + 2.0 * ( y*cz - z*cy );
+				dqOut[1] = vy + 2.0 * ( z*cx - x*cz );
+				dqOut[2] = vz + 2.0 * ( x*cy - y*cx );
+
+				// translation: 2 * ( w d - dw r + r x d )
+				dqOut[0] += 2.0 * ( w*qe[1] - qe[0]*x + y*qe[3] - z*qe[2] );
+				dqOut[1] += 2.0 * ( w*qe[2] - qe[0]*y + z*qe[1] - x*qe[3] );
+				dqOut[2] += 2.0 * ( w*qe[3] - qe[0]*z + x*qe[2] - y*qe[1] );
+			}
+
+			if ( b >= 1.0 ) {
+				points[p] = MPoint( dqOut[0], dqOut[1], dqOut[2] );
+			} else {
+				const double a = 1.0 - b;
+				points[p] = MPoint( a*lbsOut[0] + b*dqOut[0],
+									a*lbsOut[1] + b*dqOut[1],
+									a*lbsOut[2] + b*dqOut[2] );
 			}
 		}
-        
-		// Set the final position.
-		iter.setPosition( skinned );
+	});
+
+	// Set the final positions.
+	iter.setAllPositions( points );
 
-		// advance the weight list handle
-		weightListHandle.next();
-    }
     return returnStatus;
 }
 
@@ -0,0 +1,1106 @@
+//-
+// ==========================================================================
+// Copyright 2009 Autodesk, Inc. All rights reserved.
+//
+// Use of this software is subject to the terms of the Autodesk
+// license agreement provided at the time of installation or download,
+// or which otherwise accompanies this software in either electronic
+// or hard copy form.
+// ==========================================================================
+//+
+
+//
+// Description:
+//	This plug-in provides a binary MPxCacheFormat, a sibling of the
+//	XmlGeometryCache example meant for caches too large for a text format.
+//
+//	File layout (all values little-endian):
+//
+//		header		64 bytes: magic, format version, start/end time, version
+//		chunks		one per cached time, each a sequence of records
+//		index		one entry per chunk: time, offset, size
+//		footer		index offset, chunk count, magic
+//
+//	Every record is a 64 byte header followed by its payload, and both
+//	start on 64 byte boundaries, so array payloads can be copied straight
+//	out of the file. On read the file is memory mapped and the footer
+//	index gives direct access to any time, so reading a frame is a single
+//	copy from the mapping into the output array.
+//
+//	With "binaryCacheCompression 1", array payloads are written through a
+//	fast byte-plane shuffle and run-length codec. Each array record is
+//	only stored compressed if that actually makes it smaller, so channels
+//	that do not compress well cost nothing extra to read.
+//
+//	Usage: load the plug-in, then select the "binaryMapped" format when
+//	creating a geometry cache.
+//
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#include <assert.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <maya/MFnPlugin.h>
+#include <maya/MGlobal.h>
+#include <maya/MString.h>
+#include <maya/MPxCacheFormat.h>
+#include <maya/MPxCommand.h>
+#include <maya/MArgList.h>
+#include <maya/MTime.h>
+#include <maya/MFloatVectorArray.h>
+#include <maya/MDoubleArray.h>
+#include <maya/MFloatArray.h>
+#include <maya/MIntArray.h>
+#include <maya/MVectorArray.h>
+
+using namespace std;
+
+#if defined(_WIN32)
+#define BINARY_CACHE_FSEEK _fseeki64
+#else
+#define BINARY_CACHE_FSEEK fseeko
+#endif
+
+// The arrays are copied to and from the file as raw memory
+static_assert( sizeof(MFloatVector) == 3 * sizeof(float), "MFloatVector is expected to be 3 packed floats" );
+static_assert( sizeof(MVector) == 3 * sizeof(double), "MVector is expected to be 3 packed doubles" );
+
+// ****************************************
+//
+//  File format
+//
+
+static const size_t		kAlignment = 64;
+static const char		kHeaderMagic[8] = { 'M','C','B','C','A','C','H','E' };
+static const char		kFooterMagic[8] = { 'M','C','B','I','N','D','E','X' };
+static const uint32_t	kFormatVersion = 1;
+
+enum RecordType
+{
+	kTimeRecord = 1,
+	kChannelRecord,
+	kInt32Record,
+	kDoubleArrayRecord,
+	kFloatArrayRecord,
+	kIntArrayRecord,
+	kDoubleVectorArrayRecord,
+	kFloatVectorArrayRecord
+};
+
+enum Codec
+{
+	kCodecNone = 0,
+	kCodecShuffleRLE
+};
+
+struct FileHeader
+{
+	char		magic[8];
+	uint32_t	formatVersion;
+	uint32_t	reserved;
+	double		startTime;		// in 6000 fps ticks
+	double		endTime;
+	char		version[32];
+};
+static_assert( sizeof(FileHeader) == kAlignment, "unexpected header size" );
+
+struct RecordHeader
+{
+	uint32_t	type;
+	uint32_t	codec;
+	uint64_t	count;			// array elements, or name length
+	uint64_t	rawSize;		// payload bytes once decoded
+	uint64_t	storedSize;		// payload bytes in the file
+	double		value;			// time or integer value of scalar records
+	uint8_t		reserved[24];
+};
+static_assert( sizeof(RecordHeader) == kAlignment, "unexpected record header size" );
+
+struct IndexEntry
+{
+	double		time;
+	uint64_t	offset;
+	uint64_t	size;
+};
+
+struct FileFooter
+{
+	uint64_t	indexOffset;
+	uint64_t	count;
+	char		magic[8];
+};
+
+static inline uint64_t alignUp( uint64_t value )
+{
+	return ( value + kAlignment - 1 ) & ~(uint64_t)( kAlignment - 1 );
+}
+
+static bool isLittleEndian()
+{
+	const uint16_t probe = 1;
+	return *(const uint8_t*)&probe == 1;
+}
+
+// ****************************************
+//
+//  Codec
+//
+//	Values are split into byte planes (all first bytes, then all second
+//	bytes, ...) which turns the slowly varying exponent and high mantissa
+//	bytes of simulation data into long runs, then run-length encoded:
+//	a control byte c < 128 is followed by c+1 literal bytes, c >= 128
+//	repeats the next byte c-125 times.
+//
+
+static void shuffleBytes( const uint8_t* src, uint8_t* dst, size_t count, size_t elementSize )
+{
+	for( size_t b = 0; b < elementSize; b++ ) {
+		uint8_t* plane = dst + b * count;
+		for( size_t i = 0; i < count; i++ ) {
+			plane[i] = src[i * elementSize + b];
+		}
+	}
+}
+
+static void unshuffleBytes( const uint8_t* src, uint8_t* dst, size_t count, size_t elementSize )
+{
+	for( size_t b = 0; b < elementSize; b++ ) {
+		const uint8_t* plane = src + b * count;
+		for( size_t i = 0; i < count; i++ ) {
+			dst[i * elementSize + b] = plane[i];
+		}
+	}
+}
+
+static void encodeRLE( const uint8_t* src, size_t size, vector<uint8_t>& out )
+{
+	out.clear();
+	out.reserve( size + size / 128 + 1 );
+	size_t i = 0;
+	while( i < size )
+	{
+		size_t run = 1;
+		while( i + run < size && run < 130 && src[i + run] == src[i] ) {
+			run++;
+		}
+		if( run >= 3 ) {
+			out.push_back( (uint8_t)( run + 125 ) );
+			out.push_back( src[i] );
+			i += run;
+			continue;
+		}
+
+		// Literals up to the next run of 3
+		size_t start = i;
+		while( i < size && i - start < 128 ) {
+			if( i + 2 < size && src[i] == src[i + 1] && src[i] == src[i + 2] ) {
+				break;
+			}
+			i++;
+		}
+		out.push_back( (uint8_t)( i - start - 1 ) );
+		out.insert( out.end(), src + start, src + i );
+	}
+}
+
+static bool decodeRLE( const uint8_t* src, size_t size, uint8_t* dst, size_t dstSize )
+{
+	size_t o = 0;
+	size_t i = 0;
+	while( i < size )
+	{
+		const uint8_t c = src[i++];
+		if( c < 128 ) {
+			const size_t n = (size_t)c + 1;
+			if( i + n > size || o + n > dstSize ) {
+				return false;
+			}
+			memcpy( dst + o, src + i, n );
+			i += n;
+			o += n;
+		} else {
+			const size_t n = (size_t)c - 125;
+			if( i >= size || o + n > dstSize ) {
+				return false;
+			}
+			memset( dst + o, src[i++], n );
+			o += n;
+		}
+	}
+	return o == dstSize;
+}
+
+// ****************************************
+//
+//  MappedFile
+//
+
+class MappedFile
+{
+public:
+	MappedFile() : fData( NULL ), fSize( 0 )
+#if defined(_WIN32)
+		, fFile( INVALID_HANDLE_VALUE ), fMapping( NULL )
+#endif
+	{}
+	~MappedFile() { close(); }
+
+	bool			open( const char* fileName );
+	void			close();
+	const uint8_t*	data() const { return fData; }
+	uint64_t		size() const { return fSize; }
+
+private:
+	const uint8_t*	fData;
+	uint64_t		fSize;
+#if defined(_WIN32)
+	HANDLE			fFile;
+	HANDLE			fMapping;
+#endif
+};
+
+bool MappedFile::open( const char* fileName )
+{
+	close();
+#if defined(_WIN32)
+	fFile = CreateFileA( fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( fFile == INVALID_HANDLE_VALUE ) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	if( !GetFileSizeEx( fFile, &size ) || size.QuadPart == 0 ) {
+		close();
+		return false;
+	}
+	fMapping = CreateFileMappingA( fFile, NULL, PAGE_READONLY, 0, 0, NULL );
+	if( fMapping ) {
+		fData = (const uint8_t*)MapViewOfFile( fMapping, FILE_MAP_READ, 0, 0, 0 );
+	}
+	if( !fData ) {
+		close();
+		return false;
+	}
+	fSize = (uint64_t)size.QuadPart;
+#else
+	int fd = ::open( fileName, O_RDONLY );
+	if( fd < 0 ) {
+		return false;
+	}
+	struct stat info;
+	if( fstat( fd, &info ) == 0 && info.st_size > 0 ) {
+		void* data = mmap( NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if( data != MAP_FAILED ) {
+			fData = (const uint8_t*)data;
+			fSize = (uint64_t)info.st_size;
+		}
+	}
+	::close( fd );
+	if( !fData ) {
+		return false;
+	}
+#endif
+	return true;
+}
+
+void MappedFile::close()
+{
+#if defined(_WIN32)
+	if( fData ) {
+		UnmapViewOfFile( fData );
+	}
+	if( fMapping ) {
+		CloseHandle( fMapping );
+	}
+	if( fFile != INVALID_HANDLE_VALUE ) {
+		CloseHandle( fFile );
+	}
+	fMapping = NULL;
+	fFile = INVALID_HANDLE_VALUE;
+#else
+	if( fData ) {
+		munmap( (void*)fData, (size_t)fSize );
+	}
+#endif
+	fData = NULL;
+	fSize = 0;
+}
+
+// ****************************************
+//
+//  BinaryCacheFormat
+//
+
+class BinaryCacheFormat : public MPxCacheFormat
+{
+public:
+	BinaryCacheFormat();
+	~BinaryCacheFormat() override;
+
+	static void*	creator();
+	static MString	translatorName();
+
+	static bool		compression() { return fCompression; }
+	static void		setCompression( bool compress ) { fCompression = compress; }
+
+	MStatus			isValid() override;
+
+    MStatus			open( const MString& fileName, FileAccessMode mode ) override;
+    void			close() override;
+
+    MStatus			readHeader() override;
+    MStatus			writeHeader( const MString& version, MTime& startTime, MTime& endTime ) override;
+
+    void			beginWriteChunk() override;
+    void			endWriteChunk() override;
+    MStatus			beginReadChunk() override;
+    void			endReadChunk() override;
+
+    MStatus			writeTime( MTime& time ) override;
+    MStatus			readTime( MTime& time ) override;
+    MStatus			findTime( MTime& time, MTime& foundTime ) override;
+    MStatus			readNextTime( MTime& foundTime ) override;
+
+    unsigned		readArraySize() override;
+
+    MStatus			writeDoubleArray( const MDoubleArray& ) override;
+    MStatus			readDoubleArray( MDoubleArray&, unsigned size ) override;
+    MStatus			writeFloatArray( const MFloatArray& ) override;
+    MStatus			readFloatArray( MFloatArray&, unsigned size ) override;
+    MStatus			writeIntArray( const MIntArray& ) override;
+    MStatus			readIntArray( MIntArray&, unsigned size ) override;
+    MStatus			writeDoubleVectorArray( const MVectorArray& array ) override;
+    MStatus			readDoubleVectorArray( MVectorArray&, unsigned arraySize ) override;
+    MStatus			writeFloatVectorArray( const MFloatVectorArray& array ) override;
+    MStatus			readFloatVectorArray( MFloatVectorArray& array, unsigned arraySize ) override;
+
+    MStatus			writeChannelName( const MString& name ) override;
+    MStatus			findChannelName( const MString& name ) override;
+    MStatus			readChannelName( MString& name ) override;
+
+    MStatus			writeInt32( int ) override;
+    int				readInt32() override;
+    MStatus			rewind() override;
+
+	MString			extension() override;
+
+protected:
+
+	static MString	fExtension;
+	static MString	fCacheFormatName;
+	static bool		fCompression;
+
+private:
+	// Writing
+	bool			writeBytes( const void* data, uint64_t size );
+	bool			writePadding();
+	bool			writeRecord( RecordType type, uint64_t count, const void* data,
+								 uint64_t size, size_t elementSize, double value = 0.0 );
+	bool			writeIndex();
+
+	// Reading
+	bool			readIndex();
+	bool			enterChunk( size_t chunk );
+	const RecordHeader*	peekRecord() const;
+	const RecordHeader*	nextRecord( const uint8_t*& payload );
+	const RecordHeader*	nextRecordOfType( RecordType type, const uint8_t*& payload );
+	bool			readArray( RecordType type, void* dst, uint64_t count, size_t elementSize );
+
+	MString			fFileName;
+	FileAccessMode	fMode;
+
+	FILE*			fOut;
+	uint64_t		fWriteOffset;
+	uint64_t		fChunkStart;
+	double			fChunkTime;
+	vector<uint8_t>	fScratch;
+	vector<uint8_t>	fEncoded;
+
+	MappedFile		fMap;
+	uint64_t		fDataEnd;		// first byte of the index
+	size_t			fCurrentChunk;	// kNoChunk before the first chunk
+	uint64_t		fCursor;
+	uint64_t		fChunkEnd;
+
+	vector<IndexEntry>	fIndex;		// chunks in file order
+	vector<size_t>	fByTime;		// fIndex entries sorted by time
+
+	static const size_t	kNoChunk = (size_t)-1;
+};
+
+MString BinaryCacheFormat::fExtension = "mcb";				// For files on disk
+MString BinaryCacheFormat::fCacheFormatName = "binaryMapped";	// For presentation in GUI
+bool BinaryCacheFormat::fCompression = false;
+
+inline MString BinaryCacheFormat::translatorName()
+{
+	return fCacheFormatName;
+}
+
+void* BinaryCacheFormat::creator()
+{
+	return new BinaryCacheFormat();
+}
+
+BinaryCacheFormat::BinaryCacheFormat()
+:	fMode( kRead )
+,	fOut( NULL )
+,	fWriteOffset( 0 )
+,	fChunkStart( 0 )
+,	fChunkTime( 0.0 )
+,	fDataEnd( 0 )
+,	fCurrentChunk( kNoChunk )
+,	fCursor( 0 )
+,	fChunkEnd( 0 )
+{
+}
+
+BinaryCacheFormat::~BinaryCacheFormat()
+{
+    close();
+}
+
+MStatus
+BinaryCacheFormat::open( const MString& fileName, FileAccessMode mode )
+{
+	close();
+
+	if( !isLittleEndian() ) {
+		return MS::kFailure;
+	}
+
+	fFileName = fileName;
+	fMode = mode;
+	bool rtn = true;
+
+	if( mode == kWrite ) {
+		fOut = fopen( fFileName.asChar(), "wb" );
+		rtn = ( fOut != NULL );
+		// Until writeHeader() is called the header is left empty
+		if( rtn ) {
+			FileHeader header;
+			memset( &header, 0, sizeof(header) );
+			rtn = writeBytes( &header, sizeof(header) );
+		}
+	}
+	else if( mode == kReadWrite ) {
+		// Read the existing index, then write new chunks over it
+		if( fMap.open( fFileName.asChar() ) && readHeader() ) {
+			fMap.close();
+			fOut = fopen( fFileName.asChar(), "r+b" );
+			rtn = ( fOut != NULL ) && BINARY_CACHE_FSEEK( fOut, (int64_t)fDataEnd, SEEK_SET ) == 0;
+			fWriteOffset = fDataEnd;
+		} else {
+			rtn = false;
+		}
+	}
+	else {
+		rtn = fMap.open( fFileName.asChar() ) && readHeader();
+	}
+
+	if( !rtn ) {
+		close();
+	}
+	return rtn ? MS::kSuccess : MS::kFailure ;
+}
+
+void BinaryCacheFormat::close()
+{
+	if( fOut ) {
+		writeIndex();
+		fclose( fOut );
+		fOut = NULL;
+	}
+	fMap.close();
+	fIndex.clear();
+	fByTime.clear();
+	fCurrentChunk = kNoChunk;
+	fCursor = fChunkEnd = fDataEnd = 0;
+	fWriteOffset = 0;
+}
+
+MStatus
+BinaryCacheFormat::isValid()
+{
+	bool rtn = ( fOut != NULL ) || ( fMap.data() != NULL );
+	return rtn ? MS::kSuccess : MS::kFailure ;
+}
+
+MStatus
+BinaryCacheFormat::readHeader()
+{
+	if( fMap.size() < sizeof(FileHeader) + sizeof(FileFooter) ) {
+		return MS::kFailure;
+	}
+	const FileHeader* header = (const FileHeader*)fMap.data();
+	if( memcmp( header->magic, kHeaderMagic, sizeof(kHeaderMagic) ) != 0 ||
+		header->formatVersion != kFormatVersion )
+	{
+		return MS::kFailure;
+	}
+
+	return readIndex() ? MS::kSuccess : MS::kFailure ;
+}
+
+MStatus
+BinaryCacheFormat::writeHeader( const MString& version, MTime& startTime, MTime& endTime )
+{
+	if( !fOut ) {
+		return MS::kFailure;
+	}
+
+	FileHeader header;
+	memset( &header, 0, sizeof(header) );
+	memcpy( header.magic, kHeaderMagic, sizeof(kHeaderMagic) );
+	header.formatVersion = kFormatVersion;
+	header.startTime = startTime.as( MTime::k6000FPS );
+	header.endTime = endTime.as( MTime::k6000FPS );
+	strncpy( header.version, version.asChar(), sizeof(header.version) - 1 );
+
+	// The header is always first in the file, whenever it gets written
+	if( BINARY_CACHE_FSEEK( fOut, 0, SEEK_SET ) != 0 ) {
+		return MS::kFailure;
+	}
+	bool rtn = fwrite( &header, sizeof(header), 1, fOut ) == 1;
+	rtn = rtn && BINARY_CACHE_FSEEK( fOut, (int64_t)fWriteOffset, SEEK_SET ) == 0;
+	return rtn ? MS::kSuccess : MS::kFailure ;
+}
+
+MStatus
+BinaryCacheFormat::rewind()
+{
+	if( !fMap.data() ) {
+		return MS::kFailure;
+	}
+	fCurrentChunk = kNoChunk;
+	fCursor = fChunkEnd = 0;
+	return MS::kSuccess;
+}
+
+MString
+BinaryCacheFormat::extension()
+{
+	return fExtension;
+}
+
+// ****************************************
+//
+//  Writing
+//
+
+bool BinaryCacheFormat::writeBytes( const void* data, uint64_t size )
+{
+	if( size == 0 ) {
+		return true;
+	}
+	if( fwrite( data, 1, (size_t)size, fOut ) != size ) {
+		return false;
+	}
+	fWriteOffset += size;
+	return true;
+}
+
+bool BinaryCacheFormat::writePadding()
+{
+	static const uint8_t zeros[kAlignment] = { 0 };
+	return writeBytes( zeros, alignUp( fWriteOffset ) - fWriteOffset );
+}
+
+bool BinaryCacheFormat::writeRecord( RecordType type, uint64_t count, const void* data,
+									 uint64_t size, size_t elementSize, double value )
+//
+// Write one record. When compression is on and elementSize is non-zero
+// the payload is shuffled and run-length encoded, and kept that way only
+// if it got at least an eighth smaller.
+//
+{
+	if( !fOut ) {
+		return false;
+	}
+
+	RecordHeader header;
+	memset( &header, 0, sizeof(header) );
+	header.type = type;
+	header.codec = kCodecNone;
+	header.count = count;
+	header.rawSize = size;
+	header.storedSize = size;
+	header.value = value;
+
+	const void* payload = data;
+	if( fCompression && elementSize > 0 && size >= kAlignment )
+	{
+		fScratch.resize( (size_t)size );
+		shuffleBytes( (const uint8_t*)data, &fScratch[0], (size_t)( size / elementSize ), elementSize );
+		encodeRLE( &fScratch[0], (size_t)size, fEncoded );
+		if( fEncoded.size() < size - size / 8 ) {
+			header.codec = kCodecShuffleRLE;
+			header.storedSize = fEncoded.size();
+			payload = &fEncoded[0];
+		}
+	}
+
+	return writePadding()
+		&& writeBytes( &header, sizeof(header) )
+		&& writeBytes( payload, header.storedSize );
+}
+
+bool BinaryCacheFormat::writeIndex()
+{
+	FileFooter footer;
+	memset( &footer, 0, sizeof(footer) );
+
+	bool rtn = writePadding();
+	footer.indexOffset = fWriteOffset;
+	footer.count = fIndex.size();
+	memcpy( footer.magic, kFooterMagic, sizeof(kFooterMagic) );
+
+	if( !fIndex.empty() ) {
+		rtn = rtn && writeBytes( &fIndex[0], fIndex.size() * sizeof(IndexEntry) );
+	}
+	return rtn && writeBytes( &footer, sizeof(footer) );
+}
+
+void BinaryCacheFormat::beginWriteChunk()
+{
+	if( fOut ) {
+		writePadding();
+		fChunkStart = fWriteOffset;
+		fChunkTime = 0.0;
+	}
+}
+
+void BinaryCacheFormat::endWriteChunk()
+{
+	if( fOut ) {
+		IndexEntry entry;
+		entry.time = fChunkTime;
+		entry.offset = fChunkStart;
+		entry.size = fWriteOffset - fChunkStart;
+		fIndex.push_back( entry );
+	}
+}
+
+MStatus
+BinaryCacheFormat::writeTime( MTime& time )
+{
+	fChunkTime = time.as( MTime::k6000FPS );
+	return writeRecord( kTimeRecord, 0, NULL, 0, 0, fChunkTime ) ? MS::kSuccess : MS::kFailure;
+}
+
+MStatus
+BinaryCacheFormat::writeChannelName( const MString& name )
+{
+	const unsigned length = name.length();
+	return writeRecord( kChannelRecord, length, name.asChar(), length, 0 ) ? MS::kSuccess : MS::kFailure;
+}
+
+MStatus BinaryCacheFormat::writeInt32( int i )
+{
+	return writeRecord( kInt32Record, 0, NULL, 0, 0, (double)i ) ? MS::kSuccess : MS::kFailure;
+}
+
+// The const operator[] of the scalar array classes returns a copy, so
+// the non-const one is used to get at their storage.
+//
+MStatus
+BinaryCacheFormat::writeDoubleArray( const MDoubleArray& array )
+{
+	const unsigned size = array.length();
+	const void* data = size ? &const_cast<MDoubleArray&>( array )[0] : NULL;
+	return writeRecord( kDoubleArrayRecord, size, data, (uint64_t)size * sizeof(double), sizeof(double) )
+		? MS::kSuccess : MS::kFailure;
+}
+
+MStatus
+BinaryCacheFormat::writeFloatArray( const MFloatArray& array )
+{
+	const unsigned size = array.length();
+	const void* data = size ? &const_cast<MFloatArray&>( array )[0] : NULL;
+	return writeRecord( kFloatArrayRecord, size, data, (uint64_t)size * sizeof(float), sizeof(float) )
+		? MS::kSuccess : MS::kFailure;
+}
+
+MStatus
+BinaryCacheFormat::writeIntArray( const MIntArray& array )
+{
+	const unsigned size = array.length();
+	const void* data = size ? &const_cast<MIntArray&>( array )[0] : NULL;
+	return writeRecord( kIntArrayRecord, size, data, (uint64_t)size * sizeof(int), sizeof(int) )
+		? MS::kSuccess : MS::kFailure;
+}
+
+MStatus
+BinaryCacheFormat::writeDoubleVectorArray( const MVectorArray& array )
+{
+	const unsigned size = array.length();
+	const void* data = size ? &array[0] : NULL;
+	return writeRecord( kDoubleVectorArrayRecord, size, data, (uint64_t)size * sizeof(MVector), sizeof(double) )
+		? MS::kSuccess : MS::kFailure;
+}
+
+MStatus
+BinaryCacheFormat::writeFloatVectorArray( const MFloatVectorArray& array )
+{
+	const unsigned size = array.length();
+	const void* data = size ? &array[0] : NULL;
+	return writeRecord( kFloatVectorArrayRecord, size, data, (uint64_t)size * sizeof(MFloatVector), sizeof(float) )
+		? MS::kSuccess : MS::kFailure;
+}
+
+// ****************************************
+//
+//  Reading
+//
+
+bool BinaryCacheFormat::readIndex()
+//
+// Load the footer index, checking that every chunk lies inside the data.
+//
+{
+	fIndex.clear();
+	fByTime.clear();
+
+	const uint64_t fileSize = fMap.size();
+	const FileFooter* footer = (const FileFooter*)( fMap.data() + fileSize - sizeof(FileFooter) );
+	if( memcmp( footer->magic, kFooterMagic, sizeof(kFooterMagic) ) != 0 ||
+		footer->indexOffset < sizeof(FileHeader) ||
+		footer->indexOffset > fileSize - sizeof(FileFooter) ||
+		footer->count > ( fileSize - sizeof(FileFooter) - footer->indexOffset ) / sizeof(IndexEntry) )
+	{
+		return false;
+	}
+
+	fDataEnd = footer->indexOffset;
+	fIndex.resize( (size_t)footer->count );
+	if( !fIndex.empty() ) {
+		memcpy( &fIndex[0], fMap.data() + footer->indexOffset, fIndex.size() * sizeof(IndexEntry) );
+	}
+	for( size_t i = 0; i < fIndex.size(); i++ ) {
+		if( fIndex[i].offset < sizeof(FileHeader) || fIndex[i].offset > fDataEnd ||
+			fIndex[i].size > fDataEnd - fIndex[i].offset )
+		{
+			fIndex.clear();
+			return false;
+		}
+	}
+
+	fByTime.resize( fIndex.size() );
+	for( size_t i = 0; i < fByTime.size(); i++ ) {
+		fByTime[i] = i;
+	}
+	stable_sort( fByTime.begin(), fByTime.end(),
+		[this]( size_t a, size_t b ) { return fIndex[a].time < fIndex[b].time; } );
+
+	fCurrentChunk = kNoChunk;
+	return true;
+}
+
+bool BinaryCacheFormat::enterChunk( size_t chunk )
+{
+	if( chunk >= fIndex.size() ) {
+		return false;
+	}
+	fCurrentChunk = chunk;
+	fCursor = fIndex[chunk].offset;
+	fChunkEnd = fIndex[chunk].offset + fIndex[chunk].size;
+	return true;
+}
+
+const RecordHeader* BinaryCacheFormat::peekRecord() const
+{
+	const uint64_t start = alignUp( fCursor );
+	if( fCurrentChunk == kNoChunk || start + sizeof(RecordHeader) > fChunkEnd ) {
+		return NULL;
+	}
+	const RecordHeader* header = (const RecordHeader*)( fMap.data() + start );
+	if( header->storedSize > fChunkEnd - start - sizeof(RecordHeader) ) {
+		return NULL;
+	}
+	return header;
+}
+
+const RecordHeader* BinaryCacheFormat::nextRecord( const uint8_t*& payload )
+{
+	const RecordHeader* header = peekRecord();
+	if( header ) {
+		payload = (const uint8_t*)( header + 1 );
+		fCursor = ( payload - fMap.data() ) + header->storedSize;
+	}
+	return header;
+}
+
+const RecordHeader* BinaryCacheFormat::nextRecordOfType( RecordType type, const uint8_t*& payload )
+//
+// Skip forward within the current chunk to the next record of the
+// given type.
+//
+{
+	const RecordHeader* header;
+	while( ( header = nextRecord( payload ) ) != NULL ) {
+		if( header->type == (uint32_t)type ) {
+			return header;
+		}
+	}
+	return NULL;
+}
+
+MStatus BinaryCacheFormat::beginReadChunk()
+{
+	const size_t next = ( fCurrentChunk == kNoChunk ) ? 0 : fCurrentChunk + 1;
+	return enterChunk( next ) ? MS::kSuccess : MS::kFailure;
+}
+
+void BinaryCacheFormat::endReadChunk()
+{
+	fCursor = fChunkEnd;
+}
+
+MStatus
+BinaryCacheFormat::readTime( MTime& time )
+{
+	const uint8_t* payload;
+	const RecordHeader* header = nextRecordOfType( kTimeRecord, payload );
+	if( !header ) {
+		return MS::kFailure;
+	}
+	time = MTime( header->value, MTime::k6000FPS );
+	return MS::kSuccess;
+}
+
+MStatus
+BinaryCacheFormat::readNextTime( MTime& foundTime )
+//
+// Read the time of the chunk following the current read position.
+//
+{
+	if( !beginReadChunk() ) {
+		return MS::kFailure;
+	}
+	return readTime( foundTime );
+}
+
+MStatus
+BinaryCacheFormat::findTime( MTime& time, MTime& foundTime )
+//
+// Find the chunk cached at exactly the given time and leave the read
+// position just past its time record.
+//
+{
+	const double seekTime = time.as( MTime::k6000FPS );
+	vector<size_t>::const_iterator it = lower_bound( fByTime.begin(), fByTime.end(), seekTime,
+		[this]( size_t entry, double t ) { return fIndex[entry].time < t; } );
+	if( it == fByTime.end() || fIndex[*it].time != seekTime )
+	{
+		// Time could not be found
+		//
+		return MS::kFailure;
+	}
+
+	if( !enterChunk( *it ) ) {
+		return MS::kFailure;
+	}
+	return readTime( foundTime );
+}
+
+MStatus
+BinaryCacheFormat::findChannelName( const MString& name )
+//
+//  Given that the right time has already been found, find the name
+//  of the channel we're trying to read.
+//
+{
+	const uint8_t* payload;
+	const RecordHeader* header;
+	const unsigned length = name.length();
+	while( ( header = nextRecordOfType( kChannelRecord, payload ) ) != NULL )
+	{
+		if( header->count == length && memcmp( payload, name.asChar(), length ) == 0 )
+		{
+			return MS::kSuccess;
+		}
+	}
+
+	return MS::kFailure;
+}
+
+MStatus
+BinaryCacheFormat::readChannelName( MString& name )
+//
+//  Read the next channel name in the current chunk. Returns false when
+//  there are no more channels, which callers use to stop scanning.
+//
+{
+	const uint8_t* payload;
+	const RecordHeader* header = nextRecordOfType( kChannelRecord, payload );
+	if( !header ) {
+		name.clear();
+		return MS::kFailure;
+	}
+	name = MString( (const char*)payload, (int)header->count );
+	return MS::kSuccess;
+}
+
+int
+BinaryCacheFormat::readInt32()
+{
+	const uint8_t* payload;
+	const RecordHeader* header = nextRecordOfType( kInt32Record, payload );
+	return header ? (int)header->value : 0;
+}
+
+unsigned
+BinaryCacheFormat::readArraySize()
+//
+// The size of the next array record, which stays unread.
+//
+{
+	const RecordHeader* header = peekRecord();
+	if( !header || header->type < kDoubleArrayRecord || header->type > kFloatVectorArrayRecord ) {
+		return 0;
+	}
+	return (unsigned)header->count;
+}
+
+bool BinaryCacheFormat::readArray( RecordType type, void* dst, uint64_t count, size_t elementSize )
+//
+// Copy (or decode) the next array record of the given type into dst,
+// which holds count elements of elementSize bytes.
+//
+{
+	const uint8_t* payload;
+	const RecordHeader* header = nextRecord( payload );
+	if( !header || header->type != (uint32_t)type || header->count != count ||
+		header->rawSize != count * elementSize )
+	{
+		return false;
+	}
+	if( count == 0 ) {
+		return true;
+	}
+
+	if( header->codec == kCodecNone ) {
+		memcpy( dst, payload, (size_t)header->rawSize );
+		return true;
+	}
+	if( header->codec == kCodecShuffleRLE ) {
+		const size_t scalarSize = ( type == kDoubleArrayRecord || type == kDoubleVectorArrayRecord ) ? sizeof(double)
+								: ( type == kIntArrayRecord ) ? sizeof(int) : sizeof(float);
+		fScratch.resize( (size_t)header->rawSize );
+		if( !decodeRLE( payload, (size_t)header->storedSize, &fScratch[0], fScratch.size() ) ) {
+			return false;
+		}
+		unshuffleBytes( &fScratch[0], (uint8_t*)dst, fScratch.size() / scalarSize, scalarSize );
+		return true;
+	}
+	return false;
+}
+
+MStatus
+BinaryCacheFormat::readDoubleArray( MDoubleArray& array, unsigned arraySize )
+{
+	array.setLength( arraySize );
+	void* data = arraySize ? &array[0] : NULL;
+	return readArray( kDoubleArrayRecord, data, arraySize, sizeof(double) ) ? MS::kSuccess : MS::kFailure;
+}
+
+MStatus
+BinaryCacheFormat::readFloatArray( MFloatArray& array, unsigned arraySize )
+{
+	array.setLength( arraySize );
+	void* data = arraySize ? &array[0] : NULL;
+	return readArray( kFloatArrayRecord, data, arraySize, sizeof(float) ) ? MS::kSuccess : MS::kFailure;
+}
+
+MStatus
+BinaryCacheFormat::readIntArray( MIntArray& array, unsigned arraySize )
+{
+	array.setLength( arraySize );
+	void* data = arraySize ? &array[0] : NULL;
+	return readArray( kIntArrayRecord, data, arraySize, sizeof(int) ) ? MS::kSuccess : MS::kFailure;
+}
+
+MStatus
+BinaryCacheFormat::readDoubleVectorArray( MVectorArray& array, unsigned arraySize )
+{
+	array.setLength( arraySize );
+	void* data = arraySize ? &array[0] : NULL;
+	return readArray( kDoubleVectorArrayRecord, data, arraySize, sizeof(MVector) ) ? MS::kSuccess : MS::kFailure;
+}
+
+MStatus
+BinaryCacheFormat::readFloatVectorArray( MFloatVectorArray& array, unsigned arraySize )
+{
+	array.setLength( arraySize );
+	void* data = arraySize ? &array[0] : NULL;
+	return readArray( kFloatVectorArrayRecord, data, arraySize, sizeof(MFloatVector) ) ? MS::kSuccess : MS::kFailure;
+}
+
+// ****************************************
+//
+// binaryCacheCompression [on]
+//
+// Sets whether array channels written from now on are compressed.
+// Returns the current setting.
+//
+class binaryCacheCompression : public MPxCommand
+{
+public:
+	MStatus		doIt( const MArgList& args ) override;
+	static void* creator() { return new binaryCacheCompression(); }
+};
+
+MStatus binaryCacheCompression::doIt( const MArgList& args )
+{
+	MStatus status;
+	if( args.length() > 0 ) {
+		bool compress = args.asBool( 0, &status );
+		if( !status ) {
+			displayError( "binaryCacheCompression: expected a boolean argument" );
+			return status;
+		}
+		BinaryCacheFormat::setCompression( compress );
+	}
+	setResult( BinaryCacheFormat::compression() );
+	return MS::kSuccess;
+}
+
+// ****************************************
+
+MStatus initializePlugin( MObject obj )
+{
+	MFnPlugin plugin( obj, PLUGIN_COMPANY, "1.0", "Any" );
+
+	plugin.registerCacheFormat(
+		BinaryCacheFormat::translatorName(),
+		BinaryCacheFormat::creator
+	);
+	plugin.registerCommand( "binaryCacheCompression", binaryCacheCompression::creator );
+
+	return MS::kSuccess;
+}
+
+
+MStatus uninitializePlugin( MObject obj )
+{
+	MFnPlugin plugin( obj );
+
+	plugin.deregisterCacheFormat( BinaryCacheFormat::translatorName() );
+	plugin.deregisterCommand( "binaryCacheCompression" );
+
+	return MS::kSuccess;
+}
@@ -18,6 +18,33 @@
 
 #include <maya/MPxCustomEvaluator.h>
 #include <maya/MCustomEvaluatorClusterNode.h>
+#include <maya/MGraphNodeIterator.h>
+#include <maya/MEvaluationNode.h>
+#include <maya/MObjectHandle.h>
+#include <maya/MPlugArray.h>
+#include <maya/MDataBlock.h>
+#include <maya/MDataHandle.h>
+#include <maya/MMatrix.h>
+#include <maya/MTime.h>
+#include <maya/MFnNumericAttribute.h>
+#include <maya/MFnUnitAttribute.h>
+#include <maya/MFnMatrixAttribute.h>
+#include <maya/MFnTypedAttribute.h>
+#include <maya/MAnimControl.h>
+#include <maya/MNodeMessage.h>
+#include <maya/MCallbackIdArray.h>
+#include <maya/MProfiler.h>
+#include <maya/MPxCommand.h>
+#include <maya/MSyntax.h>
+#include <maya/MArgDatabase.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 /*
 # The customer evaluator is used to skip the EM evaluation of the nodes 
@@ -50,8 +77,272 @@ cmds.evaluator(enable=True, name="evaluationPruningEvaluator")
 # anim curve node alone is sufficient to stop the animation
 cmds.currentTime(0)
 cmds.play(forward = True)
+
+# Instead of pruning, the evaluator can cache the results of the clusters
+# in "PruneSet". Each cluster's connected output values are stored under a
+# hash of the current time and its connected input values, so ping-pong
+# playback and scrubbing over frames already seen are served from the cache.
+# Editing an attribute of a cached node discards that cluster's results.
+cmds.evaluationPruningCache(enable=True, memoryBudget=256)
+cmds.play(forward = True)
+
+# Hit rates are reported as "cacheStats" events in the "Evaluation Pruning
+# Evaluator" profiler category; the totals can also be queried:
+cmds.evaluationPruningCache(stats=True)    # [hits, misses, entries, bytes]
+cmds.evaluationPruningCache(clear=True)
 */
 
+namespace
+{
+    int _profilerCategory = MProfiler::addCategory("Evaluation Pruning Evaluator", "Events from the EM evaluation pruning evaluator");
+
+    // to avoid pulling in boost for just hash_combine, lets have our own
+    inline void hash_combine(std::size_t& seed, std::size_t v)
+    {
+        seed ^= v + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+}
+
+///////////////////////////////////////////////////
+//
+// Result cache
+//
+// Keeps the output values of evaluated clusters, keyed by a hash of
+// their inputs, within a memory budget. The least recently used entries
+// are discarded first. Only numeric, unit and matrix plugs are cached;
+// clusters with connections of any other type are always evaluated.
+//
+///////////////////////////////////////////////////
+class clusterResultCache
+{
+public:
+    // How the value of a plug is stored in the cache
+    enum ValueKind
+    {
+        kUnsupported,
+        kBool, kChar, kShort, kInt, kFloat, kDouble,
+        k2Float, k3Float, k2Double, k3Double, k4Double,
+        k2Int, k3Int, kTime, kMatrix
+    };
+
+    static ValueKind    valueKind(const MPlug& plug);
+    static unsigned int valueSize(ValueKind kind);
+    static void         readValue(ValueKind kind, MDataHandle& handle, double* values);
+    static void         writeValue(ValueKind kind, MDataHandle& handle, const double* values);
+
+    struct Entry
+    {
+        std::size_t         layout;     // to rule out hash collisions
+        std::vector<double> inputs;
+        std::vector<double> outputs;
+        std::list<std::size_t>::iterator lru;
+    };
+
+    bool    find(std::size_t key, std::size_t layout, const std::vector<double>& inputs,
+                 size_t outputSize, std::vector<double>& outputs);
+    void    store(std::size_t key, std::size_t layout, const std::vector<double>& inputs,
+                  const std::vector<double>& outputs);
+    void    clear();
+
+    void    setBudget(size_t bytes);
+    size_t  budget() const { return fBudget; }
+    size_t  bytes() const { return fBytes; }
+    size_t  entries() const { return fEntries.size(); }
+
+    std::atomic<bool>           enabled{false};
+    std::atomic<unsigned int>   frameHits{0};
+    std::atomic<unsigned int>   frameMisses{0};
+    std::atomic<unsigned long long> totalHits{0};
+    std::atomic<unsigned long long> totalMisses{0};
+
+private:
+    static size_t entryBytes(const Entry& e)
+    {
+        return sizeof(Entry) + sizeof(std::size_t) + (e.inputs.size() + e.outputs.size()) * sizeof(double);
+    }
+    void    evict();
+
+    std::mutex                              fMutex;
+    std::unordered_map<std::size_t, Entry>  fEntries;
+    std::list<std::size_t>                  fLRU;       // most recently used first
+    size_t                                  fBudget = 256 * 1024 * 1024;
+    size_t                                  fBytes = 0;
+};
+
+clusterResultCache::ValueKind clusterResultCache::valueKind(const MPlug& plug)
+{
+    MObject attr = plug.attribute();
+    if (attr.hasFn(MFn::kNumericAttribute))
+    {
+        switch (MFnNumericAttribute(attr).unitType())
+        {
+        case MFnNumericData::kBoolean:  return kBool;
+        case MFnNumericData::kByte:
+        case MFnNumericData::kChar:     return kChar;
+        case MFnNumericData::kShort:    return kShort;
+        case MFnNumericData::kInt:      return kInt;
+        case MFnNumericData::kFloat:    return kFloat;
+        case MFnNumericData::kDouble:   return kDouble;
+        case MFnNumericData::k2Float:   return k2Float;
+        case MFnNumericData::k3Float:   return k3Float;
+        case MFnNumericData::k2Double:  return k2Double;
+        case MFnNumericData::k3Double:  return k3Double;
+        case MFnNumericData::k4Double:  return k4Double;
+        case MFnNumericData::k2Int:     return k2Int;
+        case MFnNumericData::k3Int:     return k3Int;
+        default:                        return kUnsupported;
+        }
+    }
+    if (attr.hasFn(MFn::kUnitAttribute))
+    {
+        // distances and angles are stored as doubles in internal units
+        return MFnUnitAttribute(attr).unitType() == MFnUnitAttribute::kTime ? kTime : kDouble;
+    }
+    if (attr.hasFn(MFn::kMatrixAttribute))
+    {
+        return kMatrix;
+    }
+    if (attr.hasFn(MFn::kTypedAttribute) && MFnTypedAttribute(attr).attrType() == MFnData::kMatrix)
+    {
+        return kMatrix;
+    }
+    return kUnsupported;
+}
+
+unsigned int clusterResultCache::valueSize(ValueKind kind)
+{
+    switch (kind)
+    {
+    case k2Float: case k2Double: case k2Int:    return 2;
+    case k3Float: case k3Double: case k3Int:    return 3;
+    case k4Double:                              return 4;
+    case kMatrix:                               return 16;
+    case kUnsupported:                          return 0;
+    default:                                    return 1;
+    }
+}
+
+void clusterResultCache::readValue(ValueKind kind, MDataHandle& handle, double* values)
+{
+    switch (kind)
+    {
+    case kBool:     values[0] = handle.asBool(); break;
+    case kChar:     values[0] = handle.asChar(); break;
+    case kShort:    values[0] = handle.asShort(); break;
+    case kInt:      values[0] = handle.asInt(); break;
+    case kFloat:    values[0] = handle.asFloat(); break;
+    case kDouble:   values[0] = handle.asDouble(); break;
+    case kTime:     values[0] = handle.asTime().as(MTime::k6000FPS); break;
+    case k2Float:   { const float2& v = handle.asFloat2(); values[0] = v[0]; values[1] = v[1]; break; }
+    case k3Float:   { const float3& v = handle.asFloat3(); values[0] = v[0]; values[1] = v[1]; values[2] = v[2]; break; }
+    case k2Double:  { const double2& v = handle.asDouble2(); values[0] = v[0]; values[1] = v[1]; break; }
+    case k3Double:  { const double3& v = handle.asDouble3(); values[0] = v[0]; values[1] = v[1]; values[2] = v[2]; break; }
+    case k4Double:  { const double4& v = handle.asDouble4(); for (int i = 0; i < 4; ++i) values[i] = v[i]; break; }
+    case k2Int:     { const int2& v = handle.asInt2(); values[0] = v[0]; values[1] = v[1]; break; }
+    case k3Int:     { const int3& v = handle.asInt3(); values[0] = v[0]; values[1] = v[1]; values[2] = v[2]; break; }
+    case kMatrix:   { const MMatrix& m = handle.asMatrix(); m.get((double(*)[4])values); break; }
+    default:        break;
+    }
+}
+
+void clusterResultCache::writeValue(ValueKind kind, MDataHandle& handle, const double* values)
+{
+    switch (kind)
+    {
+    case kBool:     handle.setBool(values[0] != 0.0); break;
+    case kChar:     handle.setChar((char)values[0]); break;
+    case kShort:    handle.setShort((short)values[0]); break;
+    case kInt:      handle.setInt((int)values[0]); break;
+    case kFloat:    handle.setFloat((float)values[0]); break;
+    case kDouble:   handle.setDouble(values[0]); break;
+    case kTime:     handle.setMTime(MTime(values[0], MTime::k6000FPS)); break;
+    case k2Float:   handle.set2Float((float)values[0], (float)values[1]); break;
+    case k3Float:   handle.set3Float((float)values[0], (float)values[1], (float)values[2]); break;
+    case k2Double:  handle.set2Double(values[0], values[1]); break;
+    case k3Double:  handle.set3Double(values[0], values[1], values[2]); break;
+    case k4Double:  handle.set4Double(values[0], values[1], values[2], values[3]); break;
+    case k2Int:     handle.set2Int((int)values[0], (int)values[1]); break;
+    case k3Int:     handle.set3Int((int)values[0], (int)values[1], (int)values[2]); break;
+    case kMatrix:   handle.setMMatrix(MMatrix((const double(*)[4])values)); break;
+    default:        break;
+    }
+    handle.setClean();
+}
+
+bool clusterResultCache::find(std::size_t key, std::size_t layout, const std::vector<double>& inputs,
+                              size_t outputSize, std::vector<double>& outputs)
+{
+    std::lock_guard<std::mutex> lock(fMutex);
+    auto it = fEntries.find(key);
+    if (it == fEntries.end() || it->second.layout != layout ||
+        it->second.outputs.size() != outputSize || it->second.inputs != inputs)
+    {
+        return false;
+    }
+    fLRU.splice(fLRU.begin(), fLRU, it->second.lru);
+    outputs = it->second.outputs;
+    return true;
+}
+
+void clusterResultCache::store(std::size_t key, std::size_t layout, const std::vector<double>& inputs,
+                               const std::vector<double>& outputs)
+{
+    std::lock_guard<std::mutex> lock(fMutex);
+    auto it = fEntries.find(key);
+    if (it != fEntries.end())
+    {
+        fBytes -= entryBytes(it->second);
+        fLRU.erase(it->second.lru);
+        fEntries.erase(it);
+    }
+
+    Entry entry;
+    entry.layout = layout;
+    entry.inputs = inputs;
+    entry.outputs = outputs;
+    if (entryBytes(entry) > fBudget)
+    {
+        return;
+    }
+    fLRU.push_front(key);
+    entry.lru = fLRU.begin();
+    fBytes += entryBytes(entry);
+    fEntries.emplace(key, std::move(entry));
+    evict();
+}
+
+void clusterResultCache::evict()
+{
+    while (fBytes > fBudget && !fLRU.empty())
+    {
+        auto it = fEntries.find(fLRU.back());
+        fBytes -= entryBytes(it->second);
+        fEntries.erase(it);
+        fLRU.pop_back();
+    }
+}
+
+void clusterResultCache::clear()
+{
+    std::lock_guard<std::mutex> lock(fMutex);
+    fEntries.clear();
+    fLRU.clear();
+    fBytes = 0;
+}
+
+void clusterResultCache::setBudget(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(fMutex);
+    fBudget = bytes;
+    evict();
+}
+
+namespace
+{
+    // Shared by the evaluator and the evaluationPruningCache command
+    clusterResultCache theResultCache;
+}
+
 ///////////////////////////////////////////////////
 //
 // Evaluator class declaration
@@ -67,10 +358,38 @@ public:
 	bool    wantPruneExecution() const override;
 	bool    pruneExecution(const MCustomEvaluatorClusterNode* cluster) override;
 
+	bool    clusterInitialize(const MCustomEvaluatorClusterNode* cluster) override;
 	void	clusterEvaluate(const MCustomEvaluatorClusterNode* cluster) override;
+	void    clusterTerminate(const MCustomEvaluatorClusterNode* cluster) override;
+
+	void    postEvaluate(const MEvaluationGraph* graph) override;
 
 	static MPxCustomEvaluator*	creator();
 
+private:
+	// Connected plugs of the nodes of one cluster, gathered at scheduling
+	struct CachedPlug
+	{
+		MPlug                           plug;
+		unsigned int                    node;   // index in 'nodes'
+		clusterResultCache::ValueKind   kind;
+	};
+	struct ClusterLayout
+	{
+		std::vector<MObject>        nodes;
+		std::vector<CachedPlug>     inputs;
+		std::vector<CachedPlug>     outputs;
+		unsigned int                inputSize = 0;
+		unsigned int                outputSize = 0;
+		std::size_t                 id = 0;
+		std::atomic<unsigned int>   generation{0};  // bumped when a node is edited
+		MCallbackIdArray            callbacks;
+	};
+
+	bool    evaluateCached(const MCustomEvaluatorClusterNode* cluster, ClusterLayout& layout);
+	static void attributeChanged(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* clientData);
+
+	std::unordered_map<const MCustomEvaluatorClusterNode*, std::unique_ptr<ClusterLayout>> fLayouts;
 };
 
 bool evaluationPruningEvaluator::markIfSupported(const MEvaluationNode* node)
@@ -109,18 +428,256 @@ bool evaluationPruningEvaluator::wantPruneExecution() const
 }
 
 // Should the evaluation of the input cluster node be pruned?
+// When the result cache is enabled the clusters are evaluated (or restored
+// from the cache) instead.
 bool evaluationPruningEvaluator::pruneExecution(const MCustomEvaluatorClusterNode* cluster)
 {
-	return true; 
+	return !theResultCache.enabled;
+}
+
+// Gather the connected plugs of the cluster nodes: destination plugs driven
+// from outside the cluster are the inputs hashed for the cache key, source
+// plugs the cached outputs. Destination plugs driven from inside the cluster
+// still hold the previous evaluation's values when the key is built, so they
+// are cached and restored along with the outputs instead.
+bool evaluationPruningEvaluator::clusterInitialize(const MCustomEvaluatorClusterNode* cluster)
+{
+	std::unique_ptr<ClusterLayout> layout(new ClusterLayout);
+	bool cacheable = true;
+
+	MStatus stat = MS::kSuccess;
+	MGraphNodeIterator iterator(cluster, &stat);
+	if (stat != MS::kSuccess)
+	{
+		return true;
+	}
+	while (!iterator.isDone())
+	{
+		iterator.next(&stat);
+
+		MEvaluationNode currEvalNode = iterator.currentEvaluationNode(&stat);
+		if (stat != MS::kSuccess) continue;
+		MObject node = currEvalNode.dependencyNode(&stat);
+		if (stat != MS::kSuccess) continue;
+
+		layout->nodes.push_back(node);
+		hash_combine(layout->id, MObjectHandle(node).hashCode());
+	}
+
+	std::unordered_map<unsigned int, std::vector<unsigned int>> nodesByHash;
+	for (unsigned int n = 0; n < layout->nodes.size(); ++n)
+	{
+		nodesByHash[MObjectHandle(layout->nodes[n]).hashCode()].push_back(n);
+	}
+	auto inCluster = [&](const MObject& node)
+	{
+		auto it = nodesByHash.find(MObjectHandle(node).hashCode());
+		if (it == nodesByHash.end()) return false;
+		for (unsigned int n : it->second)
+		{
+			if (layout->nodes[n] == node) return true;
+		}
+		return false;
+	};
+
+	for (unsigned int nodeIndex = 0; nodeIndex < layout->nodes.size(); ++nodeIndex)
+	{
+		MPlugArray connections;
+		MFnDependencyNode(layout->nodes[nodeIndex]).getConnections(connections);
+		for (unsigned int i = 0; i < connections.length(); ++i)
+		{
+			const MPlug& plug = connections[i];
+			CachedPlug cached = { plug, nodeIndex, clusterResultCache::valueKind(plug) };
+			if (cached.kind == clusterResultCache::kUnsupported)
+			{
+				// message connections carry no data, anything else can't be cached
+				if (!plug.attribute().hasFn(MFn::kMessageAttribute))
+				{
+					cacheable = false;
+				}
+				continue;
+			}
+			const unsigned int size = clusterResultCache::valueSize(cached.kind);
+			if (plug.isDestination())
+			{
+				if (inCluster(plug.source().node()))
+				{
+					layout->outputs.push_back(cached);
+					layout->outputSize += size;
+				}
+				else
+				{
+					layout->inputs.push_back(cached);
+					layout->inputSize += size;
+				}
+			}
+			if (plug.isSource())
+			{
+				layout->outputs.push_back(cached);
+				layout->outputSize += size;
+			}
+		}
+	}
+
+	if (cacheable && !layout->outputs.empty())
+	{
+		// Edits that don't go through a connection (keyframes, setAttr)
+		// change the results without changing the inputs, so drop the
+		// cluster's entries when that happens.
+		for (MObject& node : layout->nodes)
+		{
+			MCallbackId id = MNodeMessage::addAttributeChangedCallback(node, attributeChanged, layout.get(), &stat);
+			if (stat == MS::kSuccess)
+			{
+				layout->callbacks.append(id);
+			}
+		}
+		fLayouts[cluster] = std::move(layout);
+	}
+
+	return true;
+}
+
+void evaluationPruningEvaluator::attributeChanged(MNodeMessage::AttributeMessage msg, MPlug& /*plug*/, MPlug& /*otherPlug*/, void* clientData)
+{
+	if (msg & (MNodeMessage::kAttributeSet | MNodeMessage::kAttributeArrayAdded | MNodeMessage::kAttributeArrayRemoved))
+	{
+		++static_cast<ClusterLayout*>(clientData)->generation;
+	}
+}
+
+// Restore the cluster outputs from the cache, or evaluate the cluster and
+// store them. Returns false if the cluster has to be evaluated normally.
+bool evaluationPruningEvaluator::evaluateCached(const MCustomEvaluatorClusterNode* cluster, ClusterLayout& layout)
+{
+	MStatus stat;
+	MGraphNodeIterator iterator(cluster, &stat);
+	if (stat != MS::kSuccess)
+	{
+		return false;
+	}
+
+	std::vector<MDataBlock> datablocks;
+	datablocks.reserve(layout.nodes.size());
+	while (!iterator.isDone())
+	{
+		iterator.next(&stat);
+		MEvaluationNode currEvalNode = iterator.currentEvaluationNode(&stat);
+		if (stat != MS::kSuccess) return false;
+		datablocks.push_back(currEvalNode.datablock(&stat));
+		if (stat != MS::kSuccess) return false;
+	}
+	if (datablocks.size() != layout.nodes.size())
+	{
+		return false;
+	}
+
+	// Key on the time, the node edits and the values coming into the cluster
+	std::size_t key = layout.id;
+	hash_combine(key, std::hash<double>()(MAnimControl::currentTime().as(MTime::k6000FPS)));
+	hash_combine(key, layout.generation.load());
+
+	std::vector<double> inputs(layout.inputSize + 1);
+	inputs[layout.inputSize] = MAnimControl::currentTime().as(MTime::k6000FPS);
+	{
+		double* values = inputs.data();
+		for (const CachedPlug& in : layout.inputs)
+		{
+			MDataHandle handle = datablocks[in.node].inputValue(in.plug, &stat);
+			if (stat != MS::kSuccess) return false;
+			clusterResultCache::readValue(in.kind, handle, values);
+			values += clusterResultCache::valueSize(in.kind);
+		}
+	}
+	for (double v : inputs)
+	{
+		hash_combine(key, std::hash<double>()(v));
+	}
+
+	std::vector<double> outputs;
+	if (theResultCache.find(key, layout.id, inputs, layout.outputSize, outputs))
+	{
+		MProfilingScope profilingScope(_profilerCategory, MProfiler::kColorD_L2, "Restore cluster from cache");
+		const double* values = outputs.data();
+		for (const CachedPlug& out : layout.outputs)
+		{
+			MDataHandle handle = datablocks[out.node].outputValue(out.plug, &stat);
+			if (stat != MS::kSuccess) return false;
+			clusterResultCache::writeValue(out.kind, handle, values);
+			values += clusterResultCache::valueSize(out.kind);
+		}
+		++theResultCache.frameHits;
+		return true;
+	}
+
+	{
+		MProfilingScope profilingScope(_profilerCategory, MProfiler::kColorD_L1, "Evaluate and cache cluster");
+		cluster->evaluate(&stat);
+		if (stat != MS::kSuccess)
+		{
+			return true;
+		}
+
+		outputs.resize(layout.outputSize);
+		double* values = outputs.data();
+		for (const CachedPlug& out : layout.outputs)
+		{
+			MDataHandle handle = datablocks[out.node].inputValue(out.plug, &stat);
+			if (stat != MS::kSuccess) return true;
+			clusterResultCache::readValue(out.kind, handle, values);
+			values += clusterResultCache::valueSize(out.kind);
+		}
+		theResultCache.store(key, layout.id, inputs, outputs);
+	}
+	++theResultCache.frameMisses;
+	return true;
 }
 
 // To evlauate the cluster node. The method shouldn't be called if the evaluation is pruned.
 void evaluationPruningEvaluator::clusterEvaluate(const MCustomEvaluatorClusterNode* cluster)
 {
+	if (theResultCache.enabled)
+	{
+		auto it = fLayouts.find(cluster);
+		if (it != fLayouts.end() && evaluateCached(cluster, *it->second))
+		{
+			return;
+		}
+	}
+
 	MGlobal::displayInfo("evaluationPruningEvaluator::clusterEvaluate()");
 	cluster->evaluate();
 }
 
+void evaluationPruningEvaluator::clusterTerminate(const MCustomEvaluatorClusterNode* cluster)
+{
+	auto it = fLayouts.find(cluster);
+	if (it != fLayouts.end())
+	{
+		MMessage::removeCallbacks(it->second->callbacks);
+		fLayouts.erase(it);
+	}
+
+	// the cached layouts no longer match the graph
+	theResultCache.clear();
+}
+
+// Report the hit rate of the frame that was just evaluated
+void evaluationPruningEvaluator::postEvaluate(const MEvaluationGraph* /*graph*/)
+{
+	const unsigned int hits = theResultCache.frameHits.exchange(0);
+	const unsigned int misses = theResultCache.frameMisses.exchange(0);
+	theResultCache.totalHits += hits;
+	theResultCache.totalMisses += misses;
+
+	if ((hits + misses) > 0 && MProfiler::categoryRecording(_profilerCategory))
+	{
+		std::string stats = "hits " + std::to_string(hits) + ", misses " + std::to_string(misses) +
+			", " + std::to_string(theResultCache.bytes() / 1024) + " KB cached";
+		MProfiler::signalEvent(_profilerCategory, MProfiler::kColorD_L3, "cacheStats", stats.c_str());
+	}
+}
+
 MPxCustomEvaluator* evaluationPruningEvaluator::creator()
 {
 	return new evaluationPruningEvaluator();
@@ -128,6 +685,90 @@ MPxCustomEvaluator* evaluationPruningEvaluator::creator()
 
 evaluationPruningEvaluator::~evaluationPruningEvaluator()
 {
+	for (auto& entry : fLayouts)
+	{
+		MMessage::removeCallbacks(entry.second->callbacks);
+	}
+}
+
+///////////////////////////////////////////////////
+//
+// evaluationPruningCache [-enable bool] [-memoryBudget MB] [-clear] [-stats]
+//
+// Configures the result cache of the evaluator. -stats returns the
+// hits, misses, number of entries and bytes used since the last -clear.
+//
+///////////////////////////////////////////////////
+class evaluationPruningCacheCmd : public MPxCommand
+{
+public:
+	MStatus         doIt(const MArgList& args) override;
+	static void*    creator() { return new evaluationPruningCacheCmd(); }
+	static MSyntax  newSyntax();
+};
+
+namespace
+{
+	const char* kEnableFlag = "-e";
+	const char* kEnableFlagLong = "-enable";
+	const char* kBudgetFlag = "-mb";
+	const char* kBudgetFlagLong = "-memoryBudget";
+	const char* kClearFlag = "-c";
+	const char* kClearFlagLong = "-clear";
+	const char* kStatsFlag = "-s";
+	const char* kStatsFlagLong = "-stats";
+}
+
+MSyntax evaluationPruningCacheCmd::newSyntax()
+{
+	MSyntax syntax;
+	syntax.addFlag(kEnableFlag, kEnableFlagLong, MSyntax::kBoolean);
+	syntax.addFlag(kBudgetFlag, kBudgetFlagLong, MSyntax::kUnsigned);
+	syntax.addFlag(kClearFlag, kClearFlagLong);
+	syntax.addFlag(kStatsFlag, kStatsFlagLong);
+	return syntax;
+}
+
+MStatus evaluationPruningCacheCmd::doIt(const MArgList& args)
+{
+	MStatus status;
+	MArgDatabase argData(syntax(), args, &status);
+	if (!status)
+	{
+		return status;
+	}
+
+	if (argData.isFlagSet(kEnableFlag))
+	{
+		bool enable = false;
+		argData.getFlagArgument(kEnableFlag, 0, enable);
+		theResultCache.enabled = enable;
+		if (!enable)
+		{
+			theResultCache.clear();
+		}
+	}
+	if (argData.isFlagSet(kBudgetFlag))
+	{
+		unsigned int megabytes = 0;
+		argData.getFlagArgument(kBudgetFlag, 0, megabytes);
+		theResultCache.setBudget((size_t)megabytes * 1024 * 1024);
+	}
+	if (argData.isFlagSet(kClearFlag))
+	{
+		theResultCache.clear();
+		theResultCache.totalHits = 0;
+		theResultCache.totalMisses = 0;
+	}
+	if (argData.isFlagSet(kStatsFlag))
+	{
+		clearResult();
+		appendToResult((double)theResultCache.totalHits);
+		appendToResult((double)theResultCache.totalMisses);
+		appendToResult((int)theResultCache.entries());
+		appendToResult((double)theResultCache.bytes());
+	}
+	return MS::kSuccess;
 }
 
 MStatus initializePlugin( MObject obj )
@@ -145,6 +786,13 @@ MStatus initializePlugin( MObject obj )
 		return status;
 	}
 
+	status = plugin.registerCommand("evaluationPruningCache", evaluationPruningCacheCmd::creator, evaluationPruningCacheCmd::newSyntax);
+	if (!status)
+	{
+		status.perror("registerCommand");
+		return status;
+	}
+
 	return status;
 }
 
@@ -153,6 +801,13 @@ MStatus uninitializePlugin( MObject obj)
 	MStatus   status;
 	MFnPlugin plugin( obj );
 
+	status = plugin.deregisterCommand("evaluationPruningCache");
+	if (!status)
+	{
+		status.perror("deregisterCommand");
+		return status;
+	}
+
 	status =  plugin.deregisterEvaluator( "evaluationPruningEvaluator" );
 	if (!status)
     {
@@ -0,0 +1,239 @@
+//-
+// ==========================================================================
+// Copyright 2020 Autodesk, Inc. All rights reserved.
+//
+// Use of this software is subject to the terms of the Autodesk
+// license agreement provided at the time of installation or download,
+// or which otherwise accompanies this software in either electronic
+// or hard copy form.
+// ==========================================================================
+//+
+//
+// Region and mip level reading for the float image file readers.
+//
+// A reader only has to decode whole rows of a level (readRows). On top
+// of that, readRegion() returns any rectangle of any level, streaming
+// rows straight into the destination. When the reader provides a cache
+// key, decoded rows of partial reads are kept in bands of kBandRows rows
+// in a small LRU so that overlapping regions do not decode the file
+// again. Reads of a whole level bypass the cache: they are decoded once
+// into the caller's buffer and would only evict the bands of other
+// images.
+//
+// The cache lives in the plug-in that includes this header; readers
+// built into the same plug-in share it.
+//
+
+#ifndef FLOAT_IMAGE_REGION_READER_H
+#define FLOAT_IMAGE_REGION_READER_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstring>
+#include <cstdio>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+//
+// LRU of decoded row bands, keyed by file, level and band index
+//
+class DecodedTileCache
+{
+public:
+	typedef std::shared_ptr<const std::vector<float> > Tile;
+
+	explicit DecodedTileCache( size_t budgetBytes = 256 * 1024 * 1024 )
+	:	fBudget( budgetBytes ), fBytes( 0 ) {}
+
+	Tile find( const std::string& key )
+	{
+		std::lock_guard<std::mutex> lock( fMutex );
+		Map::iterator it = fMap.find( key );
+		if (it == fMap.end())
+			return Tile();
+		fLru.splice( fLru.begin(), fLru, it->second );
+		return it->second->second;
+	}
+
+	void insert( const std::string& key, const Tile& tile )
+	{
+		const size_t bytes = tile->size() * sizeof(float);
+		if (bytes > fBudget)
+			return;
+
+		std::lock_guard<std::mutex> lock( fMutex );
+		Map::iterator it = fMap.find( key );
+		if (it != fMap.end())
+		{
+			fBytes -= it->second->second->size() * sizeof(float);
+			fLru.erase( it->second );
+			fMap.erase( it );
+		}
+		while (fBytes + bytes > fBudget && !fLru.empty())
+		{
+			fBytes -= fLru.back().second->size() * sizeof(float);
+			fMap.erase( fLru.back().first );
+			fLru.pop_back();
+		}
+		fLru.push_front( Entry( key, tile ) );
+		fMap[key] = fLru.begin();
+		fBytes += bytes;
+	}
+
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock( fMutex );
+		fLru.clear();
+		fMap.clear();
+		fBytes = 0;
+	}
+
+	static DecodedTileCache& instance()
+	{
+		static DecodedTileCache cache;
+		return cache;
+	}
+
+private:
+	typedef std::pair<std::string, Tile> Entry;
+	typedef std::unordered_map<std::string, std::list<Entry>::iterator> Map;
+
+	std::mutex			fMutex;
+	std::list<Entry>	fLru;
+	Map					fMap;
+	size_t				fBudget;
+	size_t				fBytes;
+};
+
+class FloatImageRegionReader
+{
+public:
+	enum { kBandRows = 64 };
+
+	virtual ~FloatImageRegionReader() {}
+
+	virtual unsigned int	numLevels() const { return 1; }
+	virtual unsigned int	levelWidth( unsigned int level ) const = 0;
+	virtual unsigned int	levelHeight( unsigned int level ) const = 0;
+	virtual unsigned int	numChannels() const = 0;
+
+	// Decode rows [y, y+count) of a level, in file order, full width,
+	// into dst whose rows are rowStride floats apart.
+	virtual bool			readRows( unsigned int level, unsigned int y, unsigned int count,
+									  float* dst, size_t rowStride ) = 0;
+
+	// Identifies the decoded contents for the band cache. Readers that
+	// return an empty key (e.g. procedural ones) are not cached.
+	virtual std::string		cacheKey() const { return std::string(); }
+
+	//
+	// Read the region [x, x+width) x [y, y+height) of a level, y counted
+	// in file order, into dst (rows dstRowStride floats apart). With
+	// flip the last region row is written first, which is the bottom-up
+	// order MImage expects.
+	//
+	bool readRegion( unsigned int level, unsigned int x, unsigned int y,
+					 unsigned int width, unsigned int height,
+					 float* dst, size_t dstRowStride, bool flip )
+	{
+		if (level >= numLevels() || width == 0 || height == 0 ||
+			x + width > levelWidth( level ) || y + height > levelHeight( level ))
+		{
+			return false;
+		}
+
+		const unsigned int channels = numChannels();
+		const size_t levelRow = (size_t)levelWidth( level ) * channels;
+		const bool fullLevel = (x == 0 && y == 0 &&
+			width == levelWidth( level ) && height == levelHeight( level ));
+		const std::string key = fullLevel ? std::string() : cacheKey();
+
+		if (key.empty())
+		{
+			// Not cached: full-width regions decode in place, others go
+			// through one band of rows at a time.
+			if (x == 0 && width == levelWidth( level ) && !flip)
+				return readRows( level, y, height, dst, dstRowStride );
+
+			fBand.resize( levelRow * kBandRows );
+			for (unsigned int row = y; row < y + height; row += kBandRows)
+			{
+				const unsigned int count = std::min( (unsigned int)kBandRows, y + height - row );
+				if (!readRows( level, row, count, &fBand[0], levelRow ))
+					return false;
+				copyRows( &fBand[0], levelRow, row, count, x, width, y, height, dst, dstRowStride, flip );
+			}
+			return true;
+		}
+
+		DecodedTileCache& cache = DecodedTileCache::instance();
+		const unsigned int firstBand = y / kBandRows;
+		const unsigned int lastBand = (y + height - 1) / kBandRows;
+		for (unsigned int band = firstBand; band <= lastBand; band++)
+		{
+			const unsigned int bandY = band * kBandRows;
+			const unsigned int bandRows = std::min( (unsigned int)kBandRows, levelHeight( level ) - bandY );
+
+			char suffix[64];
+			snprintf( suffix, sizeof(suffix), "|%u|%u", level, band );
+			const std::string bandKey = key + suffix;
+
+			DecodedTileCache::Tile tile = cache.find( bandKey );
+			if (!tile)
+			{
+				std::shared_ptr<std::vector<float> > decoded =
+					std::make_shared<std::vector<float> >( levelRow * bandRows );
+				if (!readRows( level, bandY, bandRows, &(*decoded)[0], levelRow ))
+					return false;
+				cache.insert( bandKey, decoded );
+				tile = decoded;
+			}
+
+			// The part of this band inside the region
+			const unsigned int row = std::max( bandY, y );
+			const unsigned int count = std::min( bandY + bandRows, y + height ) - row;
+			copyRows( &(*tile)[(row - bandY) * levelRow], levelRow, row, count,
+					  x, width, y, height, dst, dstRowStride, flip );
+		}
+		return true;
+	}
+
+	// Key for a file on disk, changing whenever the file does
+	static std::string fileCacheKey( const char* path )
+	{
+		struct stat info;
+		if (stat( path, &info ) != 0)
+			return std::string();
+		char suffix[64];
+		snprintf( suffix, sizeof(suffix), "|%lld|%lld", (long long)info.st_size, (long long)info.st_mtime );
+		return std::string( path ) + suffix;
+	}
+
+private:
+	// Copy count decoded rows, the first being file row "row", into the
+	// region's place in dst.
+	void copyRows( const float* src, size_t srcRowStride, unsigned int row, unsigned int count,
+				   unsigned int x, unsigned int width, unsigned int y, unsigned int height,
+				   float* dst, size_t dstRowStride, bool flip ) const
+	{
+		const unsigned int channels = numChannels();
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const unsigned int regionRow = row + i - y;
+			const unsigned int dstRow = flip ? height - 1 - regionRow : regionRow;
+			memcpy( dst + dstRow * dstRowStride,
+					src + i * srcRowStride + (size_t)x * channels,
+					(size_t)width * channels * sizeof(float) );
+		}
+	}
+
+	std::vector<float>	fBand;
+};
+
+#endif
@@ -13,6 +13,8 @@
 #include <maya/MStatus.h>
 #include <maya/MDagPath.h>
 #include <maya/MFloatPointArray.h>
+#include <maya/MDoubleArray.h>
+#include <maya/MVectorArray.h>
 #include <maya/MObject.h>
 #include <maya/MPlugArray.h>
 #include <maya/MFnDependencyNode.h>
@@ -20,8 +22,18 @@
 #include <maya/MFnMesh.h>
 #include <maya/MHairSystem.h>
 #include <maya/MFnPlugin.h>
+#include <maya/MObjectHandle.h>
+#include <maya/MTimer.h>
 
 #include <math.h> 
+#include <float.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <vector>
+
+#include <tbb/parallel_for.h>
 
 #define	kPluginName		"hairCollisionSolver"
 
@@ -85,10 +97,12 @@
 // representation of your object pre-frame (e.g. an octree representation)
 // and then access this representation during the collision testing.
 //
-// For the purposes of our simple demo plug-in, our private data will
-// consist of a COLLISION_INFO which contains an array of COLLISION_OBJ
-// structures, each one holding the bounding box of the object in world
-// space.
+// In this plug-in the private data is a COLLISION_INFO per hairSystem,
+// holding a COLLISION_OBJ for each collision mesh: its world space
+// points at the previous and current frame, its triangles, and a
+// bounding volume hierarchy (BVH) over the triangles swept between the
+// two frames. The data is kept between frames so that when only the
+// points of an object move, the tree is refit rather than rebuilt.
 //
 // One issue with pre-processing the data involves managing the private
 // data. A collision object could be deleted or turned off during a
@@ -103,24 +117,197 @@
 // callback can get triggered 1000's of times per frame, for efficiency
 // you can pass back your private data as a pointer from your pre-frame
 // routine, and this pointer is then passed directly into your collide()
-// callback.
-// 
+// callback. Here the data lives in a table keyed by the hairSystem node
+// which is emptied when the plug-in is unloaded.
+//
+// collide() only reads the private data, and its statistics are atomic,
+// so follicles may be processed concurrently.
 //
 typedef struct {
-	int				numVerts;	// Number of vertices in object.
-	double			minx;		// Bounding box minimal extrema.
-	double			miny;		// Bounding box minimal extrema.
-	double			minz;		// Bounding box minimal extrema.
-	double			maxx;		// Bounding box maximal extrema.
-	double			maxy;		// Bounding box maximal extrema.
-	double			maxz;		// Bounding box maximal extrema.
+	float			bboxMin[3];	// Bounds of the swept triangles.
+	float			bboxMax[3];
+	int				first;		// Leaf: first triangle, inner: right child.
+	int				count;		// Leaf: number of triangles, inner: 0.
+} BVH_NODE ;
+
+typedef struct {
+	MObjectHandle		object;		// The collision mesh shape.
+	int					numVerts;	// Number of vertices in object.
+	unsigned int		topology;	// Hash of the face counts and vertex ids.
+	std::vector<float>	prevPoints;	// World space xyz at the previous frame.
+	std::vector<float>	points;		// World space xyz at this frame.
+	std::vector<int>	triangles;	// Three vertex ids per triangle, in tree order.
+	std::vector<BVH_NODE> nodes;	// Depth first, the left child follows its parent.
+	bool				rebuild;	// Topology changed, build rather than refit.
 } COLLISION_OBJ ;
 
 typedef struct {
-	int				numObjs;	// Number of collision objects.
-	COLLISION_OBJ	*objs;		// Array of per-object info.
+	MObjectHandle		hairSystem;
+	double				lastTime;	// Time of the last preFrame() call.
+	std::vector<COLLISION_OBJ> objs; // Per-object info.
+
+	// Statistics for the timing report, collide() updates them concurrently.
+	std::atomic<long long>	collideCalls;
+	std::atomic<long long>	collideNanoseconds;
+	std::atomic<long long>	contacts;
 } COLLISION_INFO ;
 
+static std::map<unsigned int, COLLISION_INFO *> collisionInfos;
+
+#define	EPSILON	0.0001
+#define	LEAF_SIZE 4
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Synopsis:
+//		void	buildTree( co ), refitTree( co )
+//
+// Description:
+//		Build the BVH over the triangles of `co', splitting at the median
+//	centroid along the longest axis, or recompute the node bounds of an
+//	existing tree after the points moved. Node bounds enclose each
+//	triangle at both the previous and the current frame so the tree can
+//	be used for the whole time step.
+//
+//////////////////////////////////////////////////////////////////////////
+
+
+static void	boundTriangles( COLLISION_OBJ *co, BVH_NODE &node )
+{
+	for ( int c = 0; c < 3; ++c ) {
+		node.bboxMin[c] =  FLT_MAX;
+		node.bboxMax[c] = -FLT_MAX;
+	}
+	for ( int t = node.first; t < node.first + node.count; ++t ) {
+		for ( int corner = 0; corner < 3; ++corner ) {
+			int v = co->triangles[t*3 + corner];
+			for ( int c = 0; c < 3; ++c ) {
+				float p0 = co->prevPoints[v*3 + c];
+				float p1 = co->points[v*3 + c];
+				node.bboxMin[c] = std::min( node.bboxMin[c], std::min( p0, p1 ) );
+				node.bboxMax[c] = std::max( node.bboxMax[c], std::max( p0, p1 ) );
+			}
+		}
+	}
+}
+
+static void	mergeChildren( COLLISION_OBJ *co, int index )
+{
+	BVH_NODE &node = co->nodes[index];
+	const BVH_NODE &left = co->nodes[index + 1];
+	const BVH_NODE &right = co->nodes[node.first];
+	for ( int c = 0; c < 3; ++c ) {
+		node.bboxMin[c] = std::min( left.bboxMin[c], right.bboxMin[c] );
+		node.bboxMax[c] = std::max( left.bboxMax[c], right.bboxMax[c] );
+	}
+}
+
+static int	buildNode( COLLISION_OBJ *co, std::vector<float> &centroids,
+				int first, int count )
+{
+	int index = (int) co->nodes.size();
+	co->nodes.push_back( BVH_NODE() );
+
+	if ( count <= LEAF_SIZE ) {
+		co->nodes[index].first = first;
+		co->nodes[index].count = count;
+		boundTriangles( co, co->nodes[index] );
+		return( index );
+	}
+
+	float cmin[3] = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+	float cmax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for ( int t = first; t < first + count; ++t ) {
+		for ( int c = 0; c < 3; ++c ) {
+			cmin[c] = std::min( cmin[c], centroids[t*3 + c] );
+			cmax[c] = std::max( cmax[c], centroids[t*3 + c] );
+		}
+	}
+	int axis = 0;
+	if ( cmax[1] - cmin[1] > cmax[axis] - cmin[axis] ) axis = 1;
+	if ( cmax[2] - cmin[2] > cmax[axis] - cmin[axis] ) axis = 2;
+
+	// Order the triangles around the median centroid, moving their vertex
+	// ids and centroids together.
+	//
+	int half = count / 2;
+	std::vector<int> order( count );
+	for ( int i = 0; i < count; ++i ) {
+		order[i] = first + i;
+	}
+	std::nth_element( order.begin(), order.begin() + half, order.end(),
+		[&centroids, axis]( int a, int b ) {
+			return centroids[a*3 + axis] < centroids[b*3 + axis];
+		} );
+	std::vector<int> triangles( count * 3 );
+	std::vector<float> sorted( count * 3 );
+	for ( int i = 0; i < count; ++i ) {
+		for ( int c = 0; c < 3; ++c ) {
+			triangles[i*3 + c] = co->triangles[order[i]*3 + c];
+			sorted[i*3 + c] = centroids[order[i]*3 + c];
+		}
+	}
+	std::copy( triangles.begin(), triangles.end(), co->triangles.begin() + first*3 );
+	std::copy( sorted.begin(), sorted.end(), centroids.begin() + first*3 );
+
+	buildNode( co, centroids, first, half );
+	int right = buildNode( co, centroids, first + half, count - half );
+	co->nodes[index].first = right;
+	co->nodes[index].count = 0;
+	mergeChildren( co, index );
+	return( index );
+}
+
+// FNV-1a hash of the mesh's face counts and face vertex ids, cheap next
+// to fetching the triangles and rebuilding the tree.
+//
+static unsigned int	topologyHash( const MIntArray &counts, const MIntArray &connects )
+{
+	unsigned int hash = 2166136261u;
+	const MIntArray *arrays[2] = { &counts, &connects };
+	for ( int a = 0; a < 2; ++a ) {
+		hash = ( hash ^ arrays[a]->length() ) * 16777619u;
+		for ( unsigned int i = 0; i < arrays[a]->length(); ++i ) {
+			hash = ( hash ^ (unsigned int) (*arrays[a])[i] ) * 16777619u;
+		}
+	}
+	return( hash );
+}
+
+static void	buildTree( COLLISION_OBJ *co )
+{
+	co->nodes.clear();
+	int numTris = (int) co->triangles.size() / 3;
+	if ( numTris == 0 ) {
+		return;
+	}
+	std::vector<float> centroids( numTris * 3, 0.0f );
+	for ( int t = 0; t < numTris; ++t ) {
+		for ( int corner = 0; corner < 3; ++corner ) {
+			int v = co->triangles[t*3 + corner];
+			for ( int c = 0; c < 3; ++c ) {
+				centroids[t*3 + c] += co->points[v*3 + c] / 3.0f;
+			}
+		}
+	}
+	co->nodes.reserve( 2 * numTris / LEAF_SIZE + 1 );
+	buildNode( co, centroids, 0, numTris );
+}
+
+static void	refitTree( COLLISION_OBJ *co )
+{
+	// Children always come after their parent, so walking the nodes
+	// backwards visits them bottom up.
+	//
+	for ( int i = (int) co->nodes.size() - 1; i >= 0; --i ) {
+		if ( co->nodes[i].count > 0 ) {
+			boundTriangles( co, co->nodes[i] );
+		} else {
+			mergeChildren( co, i );
+		}
+	}
+}
+
 //////////////////////////////////////////////////////////////////////////
 //
 // Synopsis:
@@ -166,60 +353,72 @@ bool		preFrame(
 {
 	MStatus status;
 
-	// If you need want to perform any preprocessing on your collision
-	// objects pre-frame, do it here. One option for storing the pre-
-	// processed data is on a typed attribute on the hairSystem node.
-	// That data could be fetched and updated here.
-	//
-	// In our example, we'll just compute a bounding box here and NOT use
-	// attribute storage. That is an exercise for the reader.
-	//
 	MFnDependencyNode fnHairSystem( hairSystem, &status );
 	CHECK_MSTATUS_AND_RETURN( status, false );
-	fprintf( stderr,
-			"preFrame: calling hairSystem node=`%s', time=%g\n",
-			fnHairSystem.name().asChar(), curTime );
 	MObjectArray	cols;
 	MIntArray		logIdxs;
 	CHECK_MSTATUS_AND_RETURN( MHairSystem::getCollisionObject( hairSystem,
 			cols, logIdxs ), false );
 	int nobj = cols.length();
 
-	// Allocate private data.
-	// This allows us to pre-process data on a pre-frame basis to avoid
-	// calculating it per hair inside the collide() call. As noted earlier
-	// we could allocate this in preFrame() and hang it off the hairSystem
-	// node via a dynamic attribute.
-	// Instead we'll allocate it here.
+	// Find the private data of this hair system, creating it on the first
+	// frame we see it.
 	//
-	COLLISION_INFO *collisionInfo = (COLLISION_INFO *) malloc(
-			sizeof( COLLISION_INFO ) );
-	collisionInfo->objs = (COLLISION_OBJ *) malloc(
-			nobj * sizeof( COLLISION_OBJ ) );
-	collisionInfo->numObjs = nobj;
-
-	// Create the private data that we'll make available to the collide
-	// method. The data should actually be stored in a way that it can
-	// be cleaned up (such as storing the pointer on the hairSystem node
-	// using a dynamic attribute). As it stands right now, there is a
-	// memory leak with this plug-in because the memory we're allocating
-	// for the private data is never cleaned up.
+	MObjectHandle hairHandle( hairSystem );
+	COLLISION_INFO *collisionInfo = NULL;
+	std::map<unsigned int, COLLISION_INFO *>::iterator found =
+			collisionInfos.find( hairHandle.hashCode() );
+	if ( found != collisionInfos.end() && found->second->hairSystem == hairHandle ) {
+		collisionInfo = found->second;
+	} else {
+		if ( found != collisionInfos.end() ) {
+			delete found->second;
+		}
+		collisionInfo = new COLLISION_INFO;
+		collisionInfo->hairSystem = hairHandle;
+		collisionInfo->lastTime = curTime;
+		collisionInfo->collideCalls = 0;
+		collisionInfo->collideNanoseconds = 0;
+		collisionInfo->contacts = 0;
+		collisionInfos[hairHandle.hashCode()] = collisionInfo;
+	}
+
+	// Report on the frame that just finished.
 	//
-	// Note that when using the dynamic attribute approach, it is still
-	// wise to set *privateData because this avoids the need to look up
-	// the plug inside the collide() routine which is a high-traffic
-	// method.
+	if ( collisionInfo->collideCalls > 0 ) {
+		fprintf( stderr,
+				"%s: hairSystem `%s', time %g: %lld collide calls, %.3f ms, %lld contacts\n",
+				kPluginName, fnHairSystem.name().asChar(), collisionInfo->lastTime,
+				(long long) collisionInfo->collideCalls,
+				collisionInfo->collideNanoseconds * 1.0e-6,
+				(long long) collisionInfo->contacts );
+	}
+	collisionInfo->collideCalls = 0;
+	collisionInfo->collideNanoseconds = 0;
+	collisionInfo->contacts = 0;
+
+	// If playback restarted (or went backwards) there is no motion to
+	// sweep over, so the previous points become the current ones.
 	//
-	*privateData = (void *) collisionInfo;
+	bool restarted = curTime <= collisionInfo->lastTime;
+	collisionInfo->lastTime = curTime;
+
+	MTimer timer;
+	timer.beginTimer();
 
-	// Loop through the collision objects and pre-process, storing the
-	// results in the collisionInfo structure.
+	// Gather the points and triangles of each collision object. This has
+	// to happen here since the API isn't thread safe; the trees are then
+	// built or refit in parallel.
 	//
+	collisionInfo->objs.resize( nobj );
 	int	   obj;
+	int	   numBuilt = 0;
+	int	   numTris = 0;
 	for ( obj = 0; obj < nobj; ++obj ) {
 		// Get the ith collision geometry we are connected to.
 		//
 		MObject colObj = cols[obj];
+		COLLISION_OBJ *co = &collisionInfo->objs[obj];
 
 		// Get the DAG path for the collision object so we can transform
 		// the vertices to world space.
@@ -242,86 +441,239 @@ bool		preFrame(
 		MFloatPointArray	verts;
 		status = fnMesh.getPoints( verts, MSpace::kWorld );
 		CHECK_MSTATUS_AND_RETURN( status, false );
-
-		// Compute the bounding box for the collision object.
-		// As this is a quick and dirty demo, we'll just support collisions
-		// between hair and the bbox.
-		//
-		double minx, miny, minz, maxx, maxy, maxz, x, y, z;
-		minx = maxx = verts[0].x;
-		miny = maxy = verts[0].y;
-		minz = maxz = verts[0].z;
 		int nv = verts.length();
-		int i;
-		for ( i = 1; i < nv; ++i ) {
-			x = verts[i].x;
-			y = verts[i].y;
-			z = verts[i].z;
-
-			if ( x < minx ) {
-				minx = x;
-			}
-			if ( y < miny ) {
-				miny = y;
-			}
-			if ( z < minz ) {
-				minz = z;
-			}
 
-			if ( x > maxx ) {
-				maxx = x;
-			}
-			if ( y > maxy ) {
-				maxy = y;
-			}
-			if ( z > maxz ) {
-				maxz = z;
+		// A different object, vertex count or connectivity means the
+		// triangles have to be fetched and the tree rebuilt. Otherwise
+		// only the points moved and the tree is refit.
+		//
+		MIntArray faceCounts, faceVerts;
+		status = fnMesh.getVertices( faceCounts, faceVerts );
+		CHECK_MSTATUS_AND_RETURN( status, false );
+		unsigned int topology = topologyHash( faceCounts, faceVerts );
+		co->rebuild = !( co->object == colObj ) || co->numVerts != nv ||
+			co->topology != topology;
+		if ( co->rebuild ) {
+			MIntArray triCounts, triVerts;
+			status = fnMesh.getTriangles( triCounts, triVerts );
+			CHECK_MSTATUS_AND_RETURN( status, false );
+			co->object = MObjectHandle( colObj );
+			co->numVerts = nv;
+			co->topology = topology;
+			co->triangles.resize( triVerts.length() );
+			for ( unsigned int i = 0; i < triVerts.length(); ++i ) {
+				co->triangles[i] = triVerts[i];
 			}
+			co->points.clear();
+			++numBuilt;
 		}
 
-		// Store this precomputed informantion into our private data
-		// structure.
-		//
-		collisionInfo->objs[obj].numVerts = nv;
-		collisionInfo->objs[obj].minx = minx;
-		collisionInfo->objs[obj].miny = miny;
-		collisionInfo->objs[obj].minz = minz;
-		collisionInfo->objs[obj].maxx = maxx;
-		collisionInfo->objs[obj].maxy = maxy;
-		collisionInfo->objs[obj].maxz = maxz;
-		fprintf( stderr, "Inside preFrameInit, bbox=%g %g %g %g %g %g\n",
-				minx,miny,minz,maxx,maxy,maxz);
+		co->prevPoints.swap( co->points );
+		co->points.resize( nv * 3 );
+		for ( int i = 0; i < nv; ++i ) {
+			co->points[i*3]     = verts[i].x;
+			co->points[i*3 + 1] = verts[i].y;
+			co->points[i*3 + 2] = verts[i].z;
+		}
+		if ( restarted || co->rebuild ) {
+			co->prevPoints = co->points;
+		}
+		numTris += (int) co->triangles.size() / 3;
 	}
 
+	tbb::parallel_for( tbb::blocked_range<int>( 0, nobj, 1 ),
+		[collisionInfo]( const tbb::blocked_range<int> &range ) {
+			for ( int i = range.begin(); i != range.end(); ++i ) {
+				COLLISION_OBJ *co = &collisionInfo->objs[i];
+				if ( co->rebuild ) {
+					buildTree( co );
+				} else {
+					refitTree( co );
+				}
+			}
+		} );
+
+	timer.endTimer();
+	fprintf( stderr,
+			"%s: hairSystem `%s', time %g: %d objects, %d triangles, "
+			"%d trees built, %d refit, %.3f ms\n",
+			kPluginName, fnHairSystem.name().asChar(), curTime, nobj, numTris,
+			numBuilt, nobj - numBuilt, timer.elapsedTime() * 1000.0 );
+
+	*privateData = (void *) collisionInfo;
+
 	return( true );
 }
 
 //////////////////////////////////////////////////////////////////////////
 //
 // Synopsis:
-//		bool	belowCollisionPlane( co, pnt )
+//		bool	sweptPointHit( co, start, end, radius, hit )
 //
 // Description:
-//		Test if `pnt' is directly below the collision plane of `co'.
+//		Continuous collision of a point moving from `start' to `end'
+//	against the triangles of `co'. The object's motion over the time
+//	step is taken out first: each triangle is treated as translating by
+//	the average motion of its corners, so the point is swept relative to
+//	the triangle at its current position. The point collides when its
+//	path crosses a triangle, or when it ends up closer than `radius' to
+//	one on the side it came from.
 //
 // Parameters:
 //		COLLISION_OBJ	*co	: (in)	The collision object to test against.
-//		MVector			&pnt: (in)	Point to test.
+//		MVector		&start	: (in)	Point at the previous time.
+//		MVector		&end	: (in)	Point at the current time.
+//		double		radius	: (in)	Hair radius at the point.
+//		SWEPT_HIT	&hit	: (out)	The earliest collision.
 //
 // Returns:
-//		bool	true		: The `pnt' is directly below the collision
-//							  plane specified by `co'.
-//		bool	false		: The `pnt' is not directly below the collis-
-//							  ion plane specified by `co'.
+//		bool	true		: A collision was found.
+//		bool	false		: The path is clear.
 //
 //////////////////////////////////////////////////////////////////////////
 
 
-bool	belowCollisionPlane( const COLLISION_OBJ *co, const MVector &pnt )
+typedef struct {
+	double			time;		// Fraction of the time step, 0..1.
+	MVector			where;		// Contact point on the current triangle.
+	MVector			normal;		// Facing the side the point came from.
+	MVector			objectVel;	// Motion of the triangle over the step.
+	MVector			relStart;	// Start of the path relative to the triangle.
+} SWEPT_HIT ;
+
+static inline MVector	pointAt( const std::vector<float> &pts, int v )
 {
-	return(    pnt.x > co->minx && pnt.x < co->maxx
-			                    && pnt.y < co->maxy
-			&& pnt.z > co->minz && pnt.z < co->maxz );
+	return MVector( pts[v*3], pts[v*3 + 1], pts[v*3 + 2] );
+}
+
+// Closest point on triangle abc to p, by Voronoi regions
+// (Ericson, Real-Time Collision Detection, 5.1.5)
+static MVector	closestPointOnTriangle( const MVector &p, const MVector &a,
+					const MVector &b, const MVector &c )
+{
+	MVector ab = b - a, ac = c - a, ap = p - a;
+	double d1 = ab * ap, d2 = ac * ap;
+	if ( d1 <= 0.0 && d2 <= 0.0 ) return a;
+	MVector bp = p - b;
+	double d3 = ab * bp, d4 = ac * bp;
+	if ( d3 >= 0.0 && d4 <= d3 ) return b;
+	double vc = d1*d4 - d3*d2;
+	if ( vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0 ) return a + ab * ( d1 / (d1 - d3) );
+	MVector cp = p - c;
+	double d5 = ab * cp, d6 = ac * cp;
+	if ( d6 >= 0.0 && d5 <= d6 ) return c;
+	double vb = d5*d2 - d1*d6;
+	if ( vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0 ) return a + ac * ( d2 / (d2 - d6) );
+	double va = d3*d6 - d5*d4;
+	if ( va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0 )
+		return b + (c - b) * ( (d4 - d3) / ((d4 - d3) + (d5 - d6)) );
+	double denom = va + vb + vc;
+	if ( denom == 0.0 ) return a;
+	return a + ab * ( vb / denom ) + ac * ( vc / denom );
+}
+
+static bool	sweptPointHit( const COLLISION_OBJ *co, const MVector &start,
+				const MVector &end, double radius, SWEPT_HIT &hit )
+{
+	if ( co->nodes.empty() ) {
+		return( false );
+	}
+
+	// Bounds of the path, grown by the radius. The tree bounds already
+	// cover the object's motion.
+	//
+	double qmin[3], qmax[3];
+	for ( int c = 0; c < 3; ++c ) {
+		qmin[c] = std::min( start[c], end[c] ) - radius;
+		qmax[c] = std::max( start[c], end[c] ) + radius;
+	}
+
+	bool found = false;
+	hit.time = DBL_MAX;
+
+	int stack[64];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while ( stackSize > 0 ) {
+		const BVH_NODE &node = co->nodes[ stack[--stackSize] ];
+		if (       qmax[0] < node.bboxMin[0] || qmin[0] > node.bboxMax[0]
+				|| qmax[1] < node.bboxMin[1] || qmin[1] > node.bboxMax[1]
+				|| qmax[2] < node.bboxMin[2] || qmin[2] > node.bboxMax[2] ) {
+			continue;
+		}
+		if ( node.count == 0 ) {
+			// Median splits keep the tree balanced, so the stack holds at
+			// most one pending node per level.
+			//
+			stack[stackSize++] = node.first;
+			stack[stackSize++] = (int) ( &node - &co->nodes[0] ) + 1;
+			continue;
+		}
+
+		for ( int t = node.first; t < node.first + node.count; ++t ) {
+			const int *tri = &co->triangles[t*3];
+			MVector a = pointAt( co->points, tri[0] );
+			MVector b = pointAt( co->points, tri[1] );
+			MVector c = pointAt( co->points, tri[2] );
+			MVector objectVel = ( ( a - pointAt( co->prevPoints, tri[0] ) )
+					+ ( b - pointAt( co->prevPoints, tri[1] ) )
+					+ ( c - pointAt( co->prevPoints, tri[2] ) ) ) / 3.0;
+
+			MVector normal = ( b - a ) ^ ( c - a );
+			double len = normal.length();
+			if ( len < EPSILON * EPSILON ) {
+				continue;	// degenerate triangle
+			}
+			normal /= len;
+
+			// Sweep relative to the triangle at its current position.
+			//
+			MVector relStart = start + objectVel;
+			MVector path = end - relStart;
+			double d0 = ( relStart - a ) * normal;
+			if ( d0 < 0.0 ) {
+				normal = -normal;
+				d0 = -d0;
+			}
+			double d1 = ( end - a ) * normal;
+
+			double time = DBL_MAX;
+			MVector where;
+			if ( d0 >= radius && d1 < radius ) {
+				// Time the path reaches `radius' from the plane, then check
+				// the touching point lies on the triangle.
+				//
+				double s = ( d0 - radius ) / ( d0 - d1 );
+				MVector p = relStart + path * s;
+				MVector onPlane = p - normal * ( ( p - a ) * normal );
+				MVector closest = closestPointOnTriangle( onPlane, a, b, c );
+				if ( ( closest - onPlane ).length() <= radius ) {
+					time = s;
+					where = closest;
+				}
+			}
+			if ( time == DBL_MAX ) {
+				// Resting contact or grazing an edge: the end point is within
+				// `radius' of the triangle.
+				//
+				MVector closest = closestPointOnTriangle( end, a, b, c );
+				if ( ( end - closest ).length() < radius && d1 >= -radius ) {
+					time = 1.0;
+					where = closest;
+				}
+			}
+
+			if ( time < hit.time ) {
+				hit.time = time;
+				hit.where = where;
+				hit.normal = normal;
+				hit.objectVel = objectVel;
+				hit.relStart = relStart;
+				found = true;
+			}
+		}
+	}
+	return( found );
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -399,8 +751,6 @@ bool	belowCollisionPlane( const COLLISION_OBJ *co, const MVector &pnt )
 //////////////////////////////////////////////////////////////////////////
 
 
-#define	EPSILON	0.0001
-
 bool	collide(
 				const MObject		hairSystem,
 				const int			follicleIndex,
@@ -430,222 +780,87 @@ bool	collide(
 	// after the object loop so that the data gets processed even if no
 	// collisions occur.
 	//
-	if ( ci->numObjs <= 0 || hairPositions.length() <= 0 ) {
+	if ( ci->objs.empty() || hairPositions.length() <= 0 ) {
 		return( true );
 	}
 
-	int		obj;
-	for ( obj = 0; obj < ci->numObjs; ++obj ) {
-		COLLISION_OBJ *co = &ci->objs[obj];
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	long long contacts = 0;
 
-		// For our plug-in example, we just collide the segments of the
-		// hair against the top of the bounding box for the geometry.
-		// In an implementation where you only care about hair falling
-		// downwards onto flat objects, this might be OK. However, in the
-		// most deluxe of implementation, you should do the following:
-		//
-		//		o  Determine the motion of each face of your collision
-		//		   object during the time range.
-		//		o  Step through the follicle, and consider each segment
-		//		   to be a moving cylinder where the start and end radii
-		//		   can differ. The radii come from `hairWidths' and the
-		//		   motion comes from the difference between `hairPositions'
-		//		   and `hairPositionsLast'.
-		//		o  Intersect each moving element (e.g. moving triangle
-		//		   if you have a mesh obect) with each hair segment
-		//		   e.g. moving cylinder). This intersection may occur
-		//		   at a point within the frame. (Remember that the
-		//		   hairPositions[] array holds the DESIRED location where
-		//		   the hair system wants the hair to go.
-		//		o  There can be multiple collisions along a hair segment.
-		//		   Use the first location found and the maximal velocity.
-		//
-		// If a collision is detected, the `hairPositions' array should be
-		// updated. `hairPositionsLast' may also be updated to provide a
-		// dampening effect only.
-		//
+	size_t	obj;
+	for ( obj = 0; obj < ci->objs.size(); ++obj ) {
+		const COLLISION_OBJ *co = &ci->objs[obj];
 
 		// Loop through the follicle, starting at the root and advancing
-		// toward the tip.
+		// toward the tip. Each segment is sampled at STEPS points along
+		// its length and each sample is swept continuously over the time
+		// step, from its previous position to where the solver wants it:
+		//
+		//		P = hairPositions		// Desired pos'n at cur frame.
+		//		L = hairPositionsLast	// Position at prev frame.
+		//		V = P - L				// Desired velocity of hair.
+		//
+		// The tip of the last segment is sampled as well. The hair width
+		// is the radius of the swept sample.
 		//
+		#define STEPS 4
 		int		numSegments = hairPositions.length() - 1;
 		int		seg;
 		for ( seg = 0; seg < numSegments; ++seg ) {
-			// Get the desired position of the segment (i.e. where the
-			// solver is trying to put the hair for the current frame)
-			// and the velocity required to get to that desired position.
+			// If `seg' lies between startIndex and endIndex
+			// we can move it. If its <= startIndex, the root is
+			// locked and if >= endIndex the tip is locked.
 			//
-			// Thus,
-			//		P = hairPositions		// Desired pos'n at cur frame.
-			//		L = hairPositionsLast	// Position at prev frame.
-			//		V = P - L				// Desired velocity of hair.
-			//
-			MVector pStart = hairPositions[seg];
-			MVector pEnd = hairPositions[seg + 1];
-
-			MVector vStart = pStart - hairPositionsLast[seg];
-			MVector vEnd = pEnd - hairPositionsLast[seg + 1];
-
-			// The proper way to time sample is to intersect the moving
-			// segment of width `hairWidths[seg] to hairWidths[seg + 1]'
-			// with the moving collision object. For the purposes of our
-			// demo plug-in, we will simply assume the collision object is
-			// static, the hair segment has zero width, and instead of
-			// intersecting continuously in time, we will sample discrete
-			// steps along the segment.
-			//
-			#define STEPS 4
+			if ( seg < startIndex || seg > endIndex ) {
+				continue;
+			}
+
+			int		numSteps = ( seg == numSegments - 1 ) ? STEPS + 1 : STEPS;
 			int		step;
-			for ( step = 0; step < STEPS; ++step ) {
-				// Compute the point for this step and its corresponding
-				// velocity. This is a "time swept" point:
-				//	p1 = desired position at current time
-				//	p0 = position at previous time to achieve desired pos
-				//
-				MVector pCur, pPrev, v;
+			for ( step = 0; step < numSteps; ++step ) {
 				double fracAlongSeg = step / ( (double) STEPS );
-				v = vStart * ( 1.0 - fracAlongSeg ) + vEnd * fracAlongSeg;
-				MVector p1 = pStart * ( 1.0 - fracAlongSeg )
-						+ pEnd * fracAlongSeg;
-				MVector p0 = p1 - v;
-
-				// See if BOTH endpoints are outside of the bounding box
-				// on the same side. If so, then the segment cannot
-				// intersect the bounding box. Note that we assume the
-				// bounding box is static.
-				//
-				if (       (p0.x < co->minx && p1.x < co->minx)
-						|| (p0.y < co->miny && p1.y < co->miny)
-						|| (p0.z < co->minz && p1.z < co->minz)
-						|| (p0.x > co->maxx && p1.x > co->maxx)
-						|| (p0.y > co->maxy && p1.y > co->maxy)
-						|| (p0.z > co->maxz && p1.z > co->maxz) ) {
+				MVector p1 = hairPositions[seg] * ( 1.0 - fracAlongSeg )
+						+ hairPositions[seg + 1] * fracAlongSeg;
+				MVector p0 = hairPositionsLast[seg] * ( 1.0 - fracAlongSeg )
+						+ hairPositionsLast[seg + 1] * fracAlongSeg;
+				double radius = 0.5 * ( hairWidths[seg] * ( 1.0 - fracAlongSeg )
+						+ hairWidths[seg + 1] * fracAlongSeg ) + EPSILON;
+
+				SWEPT_HIT hit;
+				if ( !sweptPointHit( co, p0, p1, radius, hit ) ) {
 					continue;
 				}
 
-				// For the purposes of this example plug-in, we'll assume
-				// the hair always moves downwards (due to gravity and
-				// thus in the negative Y direction). As such, we only
-				// need to test for collisions with the TOP of the
-				// bounding box. Expanding the example to all 6 sides is
-				// left as an exercise for the reader.
+				// Split the motion relative to the object at the contact
+				// into normal and tangential parts. The normal part is
+				// stopped and the tangential part slowed by friction,
+				// then the object's own motion is added back.
 				//
-				// Remember that p1 is the point at current time, and
-				// p0 is the point at the previous time. Since we assume
-				// the bounding box to be static, this simplifies things.
+				MVector relVel = p1 - hit.relStart;
+				MVector relVelAlongTangent = relVel
+						- ( relVel * hit.normal ) * hit.normal;
+				MVector newRelVel = relVelAlongTangent * ( 1.0 - friction );
+				MVector newVel = hit.objectVel + newRelVel;
+				MVector resolved = hit.where + hit.normal * radius
+						+ newRelVel * ( 1.0 - hit.time );
+				MVector deltaPos = resolved - p1;
+
+				// Move the closest segment endpoint by the amount the
+				// sample has to move. It looks more stable from a
+				// simulation standpoint than moving both.
 				//
-				MVector	where(-100000,-100000,-100000);	// Loc'n of collision
-				double  fracTime;	// Time at which collision happens 0..1
-
-				if ( fabs( v.y ) < EPSILON		// velocity is zero
-						&& fabs( p1.y - co->maxy ) < EPSILON ) {	// right on the bbox
-					// Velocity is zero and the desired location (p1) is
-					// right on top of the bounding box.
-					//
-					where = p1;
-					fracTime = 1.0;		// Collides right at end;
-				} else {
-					fracTime = ( co->maxy -  p0.y ) / v.y;
-					if ( fracTime >= 0.0 && fracTime <= 1.0 ) {
-						// Compute the collision of the swept point with the
-						// plane defined by the top of the bounding box.
-						//
-						where = p0 + v * fracTime;
-					}
-				}
+				int end = ( fracAlongSeg > 0.5 && seg + 1 <= endIndex ) ? seg + 1 : seg;
+				hairPositions[end] += deltaPos;
+				hairPositionsLast[end] = hairPositions[end] - newVel;
+				++contacts;
 
-				// If `seg' lies between startIndex and endIndex
-				// we can move it. If its <= startIndex, the root is
-				// locked and if >= endIndex the tip is locked.
+				// Once the segment collided go onto the next one, unless
+				// this was the tip sample.
 				//
-				if ( seg >= startIndex && seg <= endIndex ) {
-					// Since we are just colliding with the top of the
-					// bounding box, the normal where we hit is (0,1,0).
-					// For the object velocity, we SHOULD measure the
-					// relative motion of the object during the time
-					// interval, but for our example, we'll assume its
-					// not moving (0,0,0).
-					//
-					bool segCollides = false;
-					MVector normal(0.0,1.0,0.0);	// normal is always up
-					MVector objectVel(0.0,0.0,0.0);	// assume bbox is static
-
-					// If we get the this point, then the intersection
-					// point `where' is on the plane of the bounding box
-					// top. See if it lies within the actual bounds of the
-					// boxtop, and if so compute the position and velocity
-					// information and apply to the hair segment.
-					//
-					if ( where.x >= co->minx && where.x <= co->maxx
-							&& where.z >= co->minz && where.z <= co->maxz
-							&& fracTime >= 0.0 && fracTime <= 0.0 ) {
-						// We have a collision at `where' with the plane.
-						// Compute the new velocity for the hair at the
-						// point of collision.
-						//
-						MVector objVelAlongNormal = (objectVel * normal)
-								* normal;
-						MVector objVelAlongTangent = objectVel
-								- objVelAlongNormal;
-						MVector pntVelAlongTangent = v - ( v * normal )
-								* normal;
-						MVector reflectedPntVelAlongTangent
-								= pntVelAlongTangent * ( 1.0 - friction )
-								+ objVelAlongTangent * friction;
-						MVector newVel = objVelAlongNormal
-								+ reflectedPntVelAlongTangent;
-
-						// Update the hair position. It actually looks
-						// more stable from a simulation standpoint to
-						// just move the closest segment endpoint, but
-						// you are free to experiment. What we'll do in
-						// our example is move the closest segment end-
-						// point by the amount the collided point (where)
-						// has to move to have velocity `newVel' yet still
-						// pass through `where' at time `fracTime'.
-						//
-						if ( fracAlongSeg > 0.5 ) {
-							MVector	deltaPos = -newVel * fracTime;
-							hairPositionsLast[seg + 1] += deltaPos;
-							hairPositions[seg + 1] = hairPositionsLast[seg]
-									+ newVel;
-						} else {
-							MVector	deltaPos = newVel * fracTime;
-							hairPositionsLast[seg] += deltaPos;
-							hairPositions[seg] = hairPositionsLast[seg]
-									+ newVel;
-						}
-						segCollides = true;
-					}
-
-                    // Check for segment endpoints that may still be
-					// inside. Note that segments which started out being
-					// totally inside will never collide using the
-					// algorithm we use above, so we'll simply clamp them
-					// here. One might expect an inside-the-bounding-box
-					// test instead. However, this does not work if the
-					// collision object is a very thin object.
-					//
-					bool inside = false;
-                    if ( belowCollisionPlane( co, hairPositions[seg] ) ) {
-						hairPositions[seg].y = co->maxy + EPSILON;
-						hairPositionsLast[seg] = hairPositions[seg] - objectVel;
-						inside = true;
-                    }
-                    if ( belowCollisionPlane( co, hairPositions[seg+1] ) ) {
-						hairPositions[seg+1].y = co->maxy + EPSILON;
-						hairPositionsLast[seg+1] = hairPositions[seg+1] - objectVel;
-						inside = true;
-                    }
-
-					// If we collided, go onto the next segment.
-					//
-					if ( segCollides || inside ) {
-						goto nextSeg;
-					}
+				if ( step < STEPS ) {
+					break;
 				}
 			}
-nextSeg:;
     	}
 	}
 
@@ -656,6 +871,11 @@ nextSeg:;
 	// of reaching here once per hair per iteration.
 	//
 
+	ci->collideCalls += 1;
+	ci->contacts += contacts;
+	ci->collideNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - begin ).count();
+
 	return( true );
 }
 
@@ -713,5 +933,13 @@ MStatus uninitializePlugin( MObject obj )
 	CHECK_MSTATUS( MHairSystem::unregisterCollisionSolverCollide() );
 	CHECK_MSTATUS( MHairSystem::unregisterCollisionSolverPreFrame() );
 
+	// Free the private data of every hair system we collided.
+	//
+	std::map<unsigned int, COLLISION_INFO *>::iterator it;
+	for ( it = collisionInfos.begin(); it != collisionInfos.end(); ++it ) {
+		delete it->second;
+	}
+	collisionInfos.clear();
+
 	return( MS::kSuccess );
 }
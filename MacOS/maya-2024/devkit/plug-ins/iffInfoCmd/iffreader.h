@@ -39,10 +39,25 @@ public:
 	const byte *getPixelMap () const;
 	const float *getDepthMap () const;
 
+	// Bulk access, once readImage() has been called. Pixels are written
+	// as interleaved r,g,b[,a] rows, top to bottom, converted to the
+	// requested channel type (floats are normalized to 0-1). These only
+	// read the loaded image, so they can be called from several threads.
+	enum ChannelType { kUInt8, kUInt16, kFloat };
+	MStatus getPixels (int x, int y, int w, int h, ChannelType type,
+					   void *dst, bool alpha = true) const;
+	MStatus getPixelRow (int y, ChannelType type, void *dst, bool alpha = true) const;
+	// Depths as getDepth() returns them, 0 where there is nothing
+	MStatus getDepths (int x, int y, int w, int h, float *dst) const;
+
 protected:
+	bool inImage (int x, int y, int w, int h) const;
+
 	ILimage *fImage;
 	byte *fBuffer;
 	float *fZBuffer;
+	int fWidth, fHeight;		// of the loaded image
+	int fBytesPerChannel;
 };
 
 #endif
@@ -18,6 +18,16 @@
 // This command takes as arguments the names of an existing IFF file and the name of a PPM (portable pixmap)
 // file that it must create. The IFF image is read and written out in PPM format to the second file.
 // For example: "iffPpm sphere.iff sphere.ppm".
+//
+// With -depth the depth map is written instead of the colors. With -float
+// the output is a PFM (portable float map) holding the unquantized colors,
+// or the real depths with -depth.
+//
+// With -frames start end, every run of '#' in both file names is replaced
+// by the zero padded frame number and the whole sequence is converted,
+// several frames at a time. For example:
+// "iffPpm -frames 1 100 sphere.####.iff sphere.####.ppm".
+// The result is the number of frames converted.
 // 
 ////////////////////////////////////////////////////////////////////////
 
@@ -28,19 +38,27 @@
 #include <maya/MObject.h>
 #include <maya/MGlobal.h>
 #include <maya/MString.h>
+#include <maya/MStringArray.h>
 #include <maya/MPoint.h>
 #include <float.h>
 #include "iffreader.h"
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 
 #define IFFCHECKERR(stat, call) \
 if (!stat) { \
-	MString string = reader.errorString(); \
-    string += " in method "; \
-	string += #call; \
-    displayError (string); \
+	error = reader.errorString(); \
+	error += " in method "; \
+	error += #call; \
 	return MS::kFailure; \
 }
 
@@ -58,9 +76,16 @@ public:
     static      void* creator();
 
 private:
+	static MStatus convertImage (const MString &iffFile, const MString &outFile,
+								 bool depthOnly, bool floatOutput, MString &error);
+
 	MString     ppmFile;
 	MString     fileName;
 	bool        useDepth;
+	bool        useFloat;
+	bool        useFrames;
+	int         startFrame;
+	int         endFrame;
 };
 
 iffPpm::iffPpm()
@@ -91,28 +116,62 @@ MString itoa (int n)
 	return MString (buffer);
 }
 
-MStatus iffPpm::doIt( const MArgList& args )
+// Replace every run of '#' in a file name by the frame number, zero
+// padded to the length of the run.
+static MString frameName (const MString &pattern, int frame)
 {
-    MString componentName;
-	if (args.length () < 2 || args.length () > 3) {
-		displayError ("Syntax: iffPpm ifffile ppmfile [-depth]");
-		return MS::kFailure;
+	std::string name = pattern.asChar ();
+	std::string::size_type start;
+	while ((start = name.find ('#')) != std::string::npos) {
+		std::string::size_type end = name.find_first_not_of ('#', start);
+		if (end == std::string::npos)
+			end = name.size ();
+		char buffer [64];
+		sprintf (buffer, "%0*d", (int)(end - start), frame);
+		name.replace (start, end - start, buffer);
 	}
+	return MString (name.c_str ());
+}
+
+MStatus iffPpm::doIt( const MArgList& args )
+{
+	const char *syntax =
+		"Syntax: iffPpm [-depth] [-float] [-frames start end] ifffile ppmfile";
 
-	args.get (0, fileName);
-	args.get (1, ppmFile);
-	if (args.length () == 3)
+	useDepth = false;
+	useFloat = false;
+	useFrames = false;
+
+	MStringArray names;
+	for (unsigned int i = 0; i < args.length (); i++)
 	{
-		MString lastArg;
-		args.get (2, lastArg);
-		if (lastArg != MString ("-depth")) {
-			displayError ("Syntax: iffPpm ifffile ppmfile [-depth]");
-			return MS::kFailure;
+		MString arg;
+		args.get (i, arg);
+		if (arg == MString ("-depth"))
+			useDepth = true;
+		else if (arg == MString ("-float"))
+			useFloat = true;
+		else if (arg == MString ("-frames") && i + 2 < args.length ()) {
+			if (!args.get (++i, startFrame) || !args.get (++i, endFrame)) {
+				displayError (syntax);
+				return MS::kFailure;
+			}
+			useFrames = true;
 		}
-		useDepth = true;
+		else
+			names.append (arg);
+	}
+	if (names.length () != 2 || (useFrames && endFrame < startFrame)) {
+		displayError (syntax);
+		return MS::kFailure;
+	}
+	fileName = names [0];
+	ppmFile = names [1];
+
+	if (useFrames && (fileName.index ('#') < 0 || ppmFile.index ('#') < 0)) {
+		displayError ("With -frames both file names need a # frame number pattern");
+		return MS::kFailure;
 	}
-	else
-		useDepth = false;
 
     return redoIt();
 }
@@ -121,123 +180,211 @@ MStatus iffPpm::redoIt()
 {
     clearResult();
 
+	if (!useFrames) {
+		MString error;
+		MStatus stat = convertImage (fileName, ppmFile, useDepth, useFloat, error);
+		if (!stat)
+			displayError (error);
+		return stat;
+	}
+
+	// Convert the frames of the sequence in parallel, then report the
+	// failures in frame order.
+	const int frameCount = endFrame - startFrame + 1;
+	std::vector<MString> errors (frameCount);
+	tbb::parallel_for (tbb::blocked_range<int> (0, frameCount, 1),
+		[&] (const tbb::blocked_range<int> &range) {
+			for (int i = range.begin (); i != range.end (); i++) {
+				const int frame = startFrame + i;
+				convertImage (frameName (fileName, frame), frameName (ppmFile, frame),
+							  useDepth, useFloat, errors [i]);
+			}
+		});
+
+	int converted = 0;
+	for (int i = 0; i < frameCount; i++) {
+		if (errors [i].length () == 0)
+			converted++;
+		else
+			displayError (MString ("Frame ") + itoa (startFrame + i) + ": " + errors [i]);
+	}
+	setResult (converted);
+
+	return converted == frameCount ? MS::kSuccess : MS::kFailure;
+}
+
+// Image library calls are not known to be thread safe, so loading and
+// closing images is serialized; the conversion itself runs in parallel.
+static std::mutex ilMutex;
+
+// Rows formatted by one task
+static const int kRowsPerBlock = 64;
+
+MStatus iffPpm::convertImage (const MString &iffFile, const MString &outFile,
+							  bool depthOnly, bool floatOutput, MString &error)
+{
 	IFFimageReader reader;
 	MStatus stat;
 
-	stat = reader.open (fileName);
-	IFFCHECKERR (stat, open);
+	// Close the image under the lock however the conversion ends
+	struct LockedClose {
+		IFFimageReader &reader;
+		~LockedClose () {
+			std::lock_guard<std::mutex> lock (ilMutex);
+			reader.close ();
+		}
+	} lockedClose = { reader };
 
 	int imageWidth,imageHeight,bytesPerChannel;
-	stat = reader.getSize (imageWidth,imageHeight);
-	IFFCHECKERR (stat, getSize);
+	{
+		std::lock_guard<std::mutex> lock (ilMutex);
 
-	bytesPerChannel = reader.getBytesPerChannel ();
+		stat = reader.open (iffFile);
+		IFFCHECKERR (stat, open);
 
-	stat = reader.readImage ();
-	IFFCHECKERR (stat, readImage);
+		stat = reader.getSize (imageWidth,imageHeight);
+		IFFCHECKERR (stat, getSize);
 
-    std::ofstream out (ppmFile.asChar ());
+		bytesPerChannel = reader.getBytesPerChannel ();
+
+		stat = reader.readImage ();
+		IFFCHECKERR (stat, readImage);
+	}
+
+	if (depthOnly && !reader.hasDepthMap ()) {
+		error = "Image has no depth map";
+		return MS::kFailure;
+	}
+	if (!depthOnly && !reader.isRGB () && !reader.isGrayscale ()) {
+		error = "Image has no RGB data";
+		return MS::kFailure;
+	}
+
+	std::ofstream out (outFile.asChar (), std::ios::out | std::ios::binary);
 	if (!out.good ())
 	{
-		displayError ("Could not create output file");
+		error = "Could not create output file";
 		return MS::kFailure;
 	}
-	out << "P3" << std::endl << imageWidth << " " << imageHeight << std::endl;
-	if (useDepth) {
-		if (!reader.hasDepthMap ()) {
-			displayError ("Image has no depth map");
-			return MS::kFailure;
-		}
-
-		// Step 1: calculate the range of depth values in the data.
-		// We'll normalize against this range.
-		float minDepth=FLT_MAX, maxDepth=(-FLT_MAX);
-
-		const float *depthMap = reader.getDepthMap ();
-		for(int index=0; index<imageWidth*imageHeight; index++)
-		{
-			float depth=depthMap[index];
-			if (depth!=0.) // 0 values indicate nothing there
-			{
-				float realDepth= -1.0f/depth;
-				if (realDepth<minDepth)
-					minDepth=realDepth;
-				if (realDepth>maxDepth)
-					maxDepth=realDepth;
-			}
-		}
-
-		// Step 2: output data, normalizing to 0-255
-
-		out << "255" << std::endl;
-		float scaleFactor = (float) (255.0 / ((double)maxDepth - (double)minDepth));
-		float offset = minDepth * scaleFactor;
 
-		const float *entry = depthMap;
-
-		for(int y=0; y < imageHeight; y++)
-			for(int x=0; x < imageWidth; x++, entry++)
-			{
-				if (*entry == 0.)
-					out << "0 0 0" << std::endl;
-				else {
-					float realDepth = -scaleFactor / *entry - offset;
-					out << (int)realDepth << " " << (int)realDepth << " " <<
-						(int) realDepth << std::endl;
-				}
-			}
-	} else {
-		if (!reader.isRGB () && !reader.isGrayscale ()) {
-			displayError ("Image has no RGB data");
-			return MS::kFailure;
-		}
-		if (bytesPerChannel==1)
-			out << "255" << std::endl;
-		else
-			out << "65535" << std::endl;
-		const unsigned char *bitmap = reader.getPixelMap ();
-		const unsigned char *pixel = bitmap;
-		int bytesPerPixel = (bytesPerChannel == 1) ? 4 : 8;
-		for(int y=0; y < imageHeight; y++)
-			for(int x=0; x < imageWidth; x++, pixel += bytesPerPixel)
+	if (floatOutput) {
+		// PFM: a float per channel, rows from the bottom up. The negative
+		// scale marks little endian data.
+		const int channels = depthOnly ? 1 : 3;
+		const unsigned int one = 1;
+		const bool littleEndian = *(const unsigned char *)&one == 1;
+		out << (depthOnly ? "Pf" : "PF") << "\n" << imageWidth << " " << imageHeight << "\n"
+			<< (littleEndian ? "-1.0" : "1.0") << "\n";
+
+		std::vector<float> pixels ((size_t)imageWidth * imageHeight * channels);
+		tbb::parallel_for (tbb::blocked_range<int> (0, imageHeight, kRowsPerBlock),
+			[&] (const tbb::blocked_range<int> &range) {
+				const int rows = range.end () - range.begin ();
+				float *dst = &pixels [(size_t)range.begin () * imageWidth * channels];
+				if (depthOnly)
+					reader.getDepths (0, range.begin (), imageWidth, rows, dst);
+				else
+					reader.getPixels (0, range.begin (), imageWidth, rows,
+									  IFFimageReader::kFloat, dst, false);
+			});
+
+		const size_t rowFloats = (size_t)imageWidth * channels;
+		for (int y = imageHeight - 1; y >= 0; y--)
+			out.write ((const char *)&pixels [y * rowFloats], rowFloats * sizeof (float));
+	}
+	else {
+		// P3: rows are formatted into text blocks in parallel and the
+		// blocks written out in order.
+		const int blockCount = (imageHeight + kRowsPerBlock - 1) / kRowsPerBlock;
+		std::vector<std::string> blocks (blockCount);
+
+		out << "P3" << "\n" << imageWidth << " " << imageHeight << "\n";
+		if (depthOnly) {
+			// Step 1: calculate the range of depth values in the data.
+			// We'll normalize against this range.
+			float minDepth=FLT_MAX, maxDepth=(-FLT_MAX);
+
+			const float *depthMap = reader.getDepthMap ();
+			for(int index=0; index<imageWidth*imageHeight; index++)
 			{
-				// Note that if the image was greyscale then the ILload
-				// function will have expanded the grey into rgb now.
-				
-				//
-				if (bytesPerChannel==1)
+				float depth=depthMap[index];
+				if (depth!=0.) // 0 values indicate nothing there
 				{
-#if defined(_WIN32) || defined(__linux__)
-					// The actual internal storage on NT is BGRA
-					out << (int)pixel[2] << " " <<
-						(int)pixel[1] << " " <<
-						(int)pixel[0] << std::endl;
-#else
-					// The actual internal storage on IRIX is ABGR
-					out << (int)pixel[3] << " " <<
-						(int)pixel[2] << " " <<
-                        (int)pixel[1] << std::endl;
-#endif
-				}
-				else // 16 bit
-				{
-#if defined(_WIN32) || defined(__linux__)
-					out	<< ((int)pixel[4]<<8)+(int)pixel[5] << " " 
-						<< ((int)pixel[2]<<8)+(int)pixel[3] << " " 
-						<< ((int)pixel[0]<<8)+(int)pixel[1] << std::endl;
-#else
-					out	<< ((int)pixel[6]<<8)+(int)pixel[7] << " " 
-						<< ((int)pixel[4]<<8)+(int)pixel[5] << " " 
-						<< ((int)pixel[2]<<8)+(int)pixel[3] << std::endl;
-#endif
+					float realDepth= -1.0f/depth;
+					if (realDepth<minDepth)
+						minDepth=realDepth;
+					if (realDepth>maxDepth)
+						maxDepth=realDepth;
 				}
 			}
-	}
 
-	IFFCHECKERR (stat, getPixel);
+			// Step 2: output data, normalizing to 0-255
+
+			out << "255" << "\n";
+			float scaleFactor = (float) (255.0 / ((double)maxDepth - (double)minDepth));
+			float offset = minDepth * scaleFactor;
+
+			tbb::parallel_for (tbb::blocked_range<int> (0, blockCount, 1),
+				[&] (const tbb::blocked_range<int> &range) {
+					for (int block = range.begin (); block != range.end (); block++) {
+						const int firstRow = block * kRowsPerBlock;
+						const int lastRow = std::min (firstRow + kRowsPerBlock, imageHeight);
+						const float *entry = depthMap + (size_t)firstRow * imageWidth;
+						std::ostringstream text;
+						for (int y = firstRow; y < lastRow; y++)
+							for (int x = 0; x < imageWidth; x++, entry++)
+							{
+								if (*entry == 0.)
+									text << "0 0 0" << "\n";
+								else {
+									float realDepth = -scaleFactor / *entry - offset;
+									text << (int)realDepth << " " << (int)realDepth << " " <<
+										(int) realDepth << "\n";
+								}
+							}
+						blocks [block] = text.str ();
+					}
+				});
+		} else {
+			if (bytesPerChannel==1)
+				out << "255" << "\n";
+			else
+				out << "65535" << "\n";
+
+			// Note that if the image was greyscale then the ILload
+			// function will have expanded the grey into rgb now.
+			tbb::parallel_for (tbb::blocked_range<int> (0, blockCount, 1),
+				[&] (const tbb::blocked_range<int> &range) {
+					std::vector<unsigned short> row ((size_t)imageWidth * 3);
+					for (int block = range.begin (); block != range.end (); block++) {
+						const int firstRow = block * kRowsPerBlock;
+						const int lastRow = std::min (firstRow + kRowsPerBlock, imageHeight);
+						std::ostringstream text;
+						for (int y = firstRow; y < lastRow; y++) {
+							reader.getPixelRow (y, IFFimageReader::kUInt16, &row [0], false);
+							const unsigned short *pixel = &row [0];
+							for (int x = 0; x < imageWidth; x++, pixel += 3) {
+								if (bytesPerChannel == 1)
+									text << (pixel [0] >> 8) << " " << (pixel [1] >> 8) << " "
+										 << (pixel [2] >> 8) << "\n";
+								else
+									text << pixel [0] << " " << pixel [1] << " "
+										 << pixel [2] << "\n";
+							}
+						}
+						blocks [block] = text.str ();
+					}
+				});
+		}
 
-	stat = reader.close ();
-	IFFCHECKERR (stat, close);
+		for (int block = 0; block < blockCount; block++)
+			out << blocks [block];
+	}
+
+	if (!out.good ()) {
+		error = "Could not write output file";
+		return MS::kFailure;
+	}
 
     return MS::kSuccess;
 }
@@ -18,6 +18,8 @@ IFFimageReader::IFFimageReader ()
 	fImage = NULL;
 	fBuffer = NULL;
 	fZBuffer = NULL;
+	fWidth = fHeight = 0;
+	fBytesPerChannel = 0;
 }
 
 IFFimageReader::~IFFimageReader ()
@@ -74,6 +76,8 @@ MStatus IFFimageReader::close ()
 		delete [] fZBuffer;
 		fZBuffer = NULL;
 	}
+	fWidth = fHeight = 0;
+	fBytesPerChannel = 0;
 
 	return MS::kSuccess;
 }
@@ -160,6 +164,111 @@ MStatus IFFimageReader::readImage ()
 	if (ILload (fImage, fBuffer, fZBuffer))
 		return MS::kFailure;
 
+	// Remember the layout for the accessors
+	fWidth = width;
+	fHeight = height;
+	fBytesPerChannel = bpp;
+	return MS::kSuccess;
+}
+
+// Offsets of r, g, b and a within a stored pixel, in channels.
+// On IRIX pixels are stored as ABGR and on NT as BGRA. 16 bit channels
+// are stored high byte first.
+#if     defined(_WIN32) || defined(__linux__)
+static const int kChannelOffset [4] = { 2, 1, 0, 3 };
+#else
+static const int kChannelOffset [4] = { 3, 2, 1, 0 };
+#endif
+
+static inline unsigned char toUInt8 (unsigned int v, int bytes)
+{
+	return (unsigned char)(bytes == 2 ? v >> 8 : v);
+}
+
+static inline unsigned short toUInt16 (unsigned int v, int bytes)
+{
+	return (unsigned short)(bytes == 2 ? v : v * 257);
+}
+
+static inline float toFloat (unsigned int v, int bytes)
+{
+	return (float)v * (bytes == 2 ? 1.0f / 65535.0f : 1.0f / 255.0f);
+}
+
+template <int BYTES, class T, T (*CONVERT)(unsigned int, int)>
+static void copyPixels (const byte *src, int count, int channels, T *dst)
+{
+	for (int i = 0; i < count; i++, src += 4 * BYTES)
+	{
+		for (int c = 0; c < channels; c++)
+		{
+			const byte *p = src + kChannelOffset [c] * BYTES;
+			unsigned int v = (BYTES == 2) ? ((unsigned int)p [0] << 8) | p [1] : p [0];
+			*dst++ = CONVERT (v, BYTES);
+		}
+	}
+}
+
+bool IFFimageReader::inImage (int x, int y, int w, int h) const
+{
+	return x >= 0 && y >= 0 && w > 0 && h > 0 &&
+		   x + w <= fWidth && y + h <= fHeight;
+}
+
+MStatus IFFimageReader::getPixels (int x, int y, int w, int h, ChannelType type,
+								   void *dst, bool alpha) const
+{
+	if (NULL == fBuffer || NULL == dst || !inImage (x, y, w, h))
+		return MS::kFailure;
+
+	const int channels = alpha ? 4 : 3;
+	const int bytes = fBytesPerChannel;
+	const size_t srcRow = (size_t)fWidth * 4 * bytes;
+	for (int row = 0; row < h; row++)
+	{
+		const byte *src = fBuffer + (y + row) * srcRow + (size_t)x * 4 * bytes;
+		const size_t dstOffset = (size_t)row * w * channels;
+		switch (type)
+		{
+		case kUInt8:
+			if (bytes == 2)
+				copyPixels<2, unsigned char, toUInt8> (src, w, channels, (unsigned char *)dst + dstOffset);
+			else
+				copyPixels<1, unsigned char, toUInt8> (src, w, channels, (unsigned char *)dst + dstOffset);
+			break;
+		case kUInt16:
+			if (bytes == 2)
+				copyPixels<2, unsigned short, toUInt16> (src, w, channels, (unsigned short *)dst + dstOffset);
+			else
+				copyPixels<1, unsigned short, toUInt16> (src, w, channels, (unsigned short *)dst + dstOffset);
+			break;
+		case kFloat:
+			if (bytes == 2)
+				copyPixels<2, float, toFloat> (src, w, channels, (float *)dst + dstOffset);
+			else
+				copyPixels<1, float, toFloat> (src, w, channels, (float *)dst + dstOffset);
+			break;
+		}
+	}
+	return MS::kSuccess;
+}
+
+MStatus IFFimageReader::getPixelRow (int y, ChannelType type, void *dst, bool alpha) const
+{
+	return getPixels (0, y, fWidth, 1, type, dst, alpha);
+}
+
+MStatus IFFimageReader::getDepths (int x, int y, int w, int h, float *dst) const
+{
+	if (NULL == fZBuffer || NULL == dst || !inImage (x, y, w, h))
+		return MS::kFailure;
+
+	for (int row = 0; row < h; row++)
+	{
+		const float *src = fZBuffer + (size_t)(y + row) * fWidth + x;
+		for (int i = 0; i < w; i++)
+			*dst++ = (src [i] == 0.) ? 0.0f : -1.0f / src [i];
+	}
 	return MS::kSuccess;
 }
 
@@ -168,71 +277,28 @@ MStatus IFFimageReader::getPixel (int x, int y, int *r, int *g, int *b,
 {
 	if (NULL == fBuffer)
 		return MS::kFailure;
-	int width,height;
-	ILgetsize (fImage, &width, &height);
-	if (x >= width || y >= height || x < 0 || y < 0)
+
+	// Values in the image's own range, 0-255 or 0-65535
+	unsigned short pixel [4];
+	if (!getPixels (x, y, 1, 1, kUInt16, pixel))
 		return MS::kFailure;
-	if (ILgetbpp (fImage) == 2) {
-		int *ptr = (int *)&fBuffer [(y * width + x) * 4];
-		// On IRIX pixels are stored as ABGR and on NT as BGRA
-#if     defined(_WIN32) || defined(__linux__)
-		if (NULL != r)
-			*r = ptr [2];
-		if (NULL != g)
-			*g = ptr [1];
-		if (NULL != b)
-			*b = ptr [0];
-		if (NULL != a)
-			*a = ptr [3];
-#else
-		if (NULL != r)
-			*r = ptr [3];
-		if (NULL != g)
-			*g = ptr [2];
-		if (NULL != b)
-			*b = ptr [1];
-		if (NULL != a)
-			*a = ptr [0];
-#endif
-	} else {
-		byte *ptr = &fBuffer [(y * width + x) * 4];
-#if     defined(_WIN32) || defined(__linux__)
-		if (NULL != r)
-			*r = ptr [2];
-		if (NULL != g)
-			*g = ptr [1];
-		if (NULL != b)
-			*b = ptr [0];
-		if (NULL != a)
-			*a = ptr [3];
-#else
-		if (NULL != r)
-			*r = ptr [3];
-		if (NULL != g)
-			*g = ptr [2];
-		if (NULL != b)
-			*b = ptr [1];
-		if (NULL != a)
-			*a = ptr [0];
-#endif
-	}
+	const int shift = (fBytesPerChannel == 2) ? 0 : 8;
+	if (NULL != r)
+		*r = pixel [0] >> shift;
+	if (NULL != g)
+		*g = pixel [1] >> shift;
+	if (NULL != b)
+		*b = pixel [2] >> shift;
+	if (NULL != a)
+		*a = pixel [3] >> shift;
 	return MS::kSuccess;
 }
 
 MStatus IFFimageReader::getDepth (int x, int y, float *d)
 {
-	if (NULL == fZBuffer || NULL == d)
-		return MS::kFailure;
-	int width,height;
-	ILgetsize (fImage, &width, &height);
-	if (x >= width || y >= height || x < 0 || y < 0)
+	if (NULL == d)
 		return MS::kFailure;
-	float depth = fZBuffer [y * width + x];
-	if (depth == 0.)
-		*d = 0.;
-	else
-		*d = -1.0f/depth;
-	return MS::kSuccess;
+	return getDepths (x, y, 1, 1, d);
 }
 
 MString IFFimageReader::errorString ()
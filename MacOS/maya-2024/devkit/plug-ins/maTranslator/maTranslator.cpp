@@ -34,8 +34,23 @@
 //
 // To use this plug-in, load it and then invoke it through the Export All menu item.
 //
+// Passing the option "parallel=1" generates the 'addAttr' and 'setAttr'
+// commands, which make up most of a large file, for batches of nodes on
+// worker threads and merges them back in scene order, so the output is
+// the same as a serial write.  The API makes no promise that these calls
+// are thread safe (getSetAttrCmds() may run a plug-in data type's
+// writeASCII(), for instance), so this is only an option for scenes known
+// to be safe, and files are written serially by default.
+//
+// The plug-in also adds a command which times both ways of writing a
+// scene of generated nodes and checks that they produce the same file:
+//
+//   maTranslatorBenchmark [-nodes n]
+//
 ////////////////////////////////////////////////////////////////////////
 
+#include <maya/MArgList.h>
+#include <maya/MDagModifier.h>
 #include <maya/MDagPath.h>
 #include <maya/MDagPathArray.h>
 #include <maya/MFileIO.h>
@@ -51,15 +66,26 @@
 #include <maya/MObjectArray.h>
 #include <maya/MPlug.h>
 #include <maya/MPlugArray.h>
+#include <maya/MPxCommand.h>
 #include <maya/MPxFileTranslator.h>
 #include <maya/MString.h>
 #include <maya/MStringArray.h>
+#include <maya/MTimer.h>
 
 #include <ctype.h>
+#include <stdio.h>
 #include <time.h>
 
+#include <algorithm>
 #include <fstream>
 #include <ios>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 
 class maTranslator : public MPxFileTranslator
 {
@@ -92,40 +118,42 @@ public:
 
 protected:
 	void	getAddAttrCmds(const MObject& node, MStringArray& cmds);
+	void	getNodeAttrCmds(const MObject& node, std::string& cmds);
 	void	getSetAttrCmds(const MObject& node, MStringArray& cmds);
-	void	writeBrokenRefConnections(std::fstream& f);
-	void	writeConnections(std::fstream& f);
-	void	writeCreateNode(std::fstream& f, const MObject& node);
+	void	writeBrokenRefConnections(std::ostream& f);
+	void	writeConnections(std::ostream& f);
+	void	writeCreateNode(std::ostream& f, const MObject& node);
 
 	void	writeCreateNode(
-				std::fstream& f, const MDagPath& nodePath, const MDagPath& parentPath
+				std::ostream& f, const MDagPath& nodePath, const MDagPath& parentPath
 			);
 
-	void	writeDagNodes(std::fstream& f);
-	void	writeDefaultNodes(std::fstream& f);
-	void	writeFileInfo(std::fstream& f);
-	void	writeFooter(std::fstream& f, const MString& fileName);
-	void	writeHeader(std::fstream& f, const MString& fileName);
-	void	writeInstances(std::fstream& f);
-	void	writeLockNode(std::fstream& f, const MObject& node);
-	void	writeNodeAttrs(std::fstream& f, const MObject& node, bool isSelected);
-	void	writeNodeConnections(std::fstream& f, const MObject& node);
-	void	writeNonDagNodes(std::fstream& f);
+	void	writeDagNodes(std::ostream& f);
+	void	writeDefaultNodes(std::ostream& f);
+	void	writeFileInfo(std::ostream& f);
+	void	writeFooter(std::ostream& f, const MString& fileName);
+	void	writeHeader(std::ostream& f, const MString& fileName);
+	void	writeInstances(std::ostream& f);
+	void	writeLockNode(std::ostream& f, const MObject& node);
+	void	writeNodeAttrs(std::ostream& f, const MObject& node, bool isSelected);
+	void	writeNodeConnections(std::ostream& f, const MObject& node);
+	void	writeNonDagNodes(std::ostream& f);
 
 	void	writeParent(
-				std::fstream& f,
+				std::ostream& f,
 				const MDagPath& parent,
 				const MDagPath& child,
 				bool addIt
 			);
 
-	void	writePlugSizeHint(std::fstream& f, const MPlug& plug);
-	void	writeReferences(std::fstream& f);
-	void	writeReferenceNodes(std::fstream& f);
-	void	writeRefNodeParenting(std::fstream& f);
-	void	writeRequirements(std::fstream& f);
-	void	writeSelectNode(std::fstream& f, const MObject& node);
-	void	writeUnits(std::fstream& f);
+	void	writePlugSizeHint(std::ostream& f, const MPlug& plug);
+	void	writeQueuedNodeAttrs(std::ostream& f, const char* body, size_t bodySize);
+	void	writeReferences(std::ostream& f);
+	void	writeReferenceNodes(std::ostream& f);
+	void	writeRefNodeParenting(std::ostream& f);
+	void	writeRequirements(std::ostream& f);
+	void	writeSelectNode(std::ostream& f, const MObject& node);
+	void	writeUnits(std::ostream& f);
 
 	static MString	comment(const MString& text);
 	static MString	quote(const MString& text);
@@ -170,6 +198,21 @@ private:
 	unsigned int	fAttrFlag;
 	unsigned int	fCreateFlag;
 	unsigned int	fConnectionFlag;
+
+	//
+	// When writing in parallel, writeNodeAttrs() only queues the node
+	// along with the position in the output at which its commands belong.
+	// writeQueuedNodeAttrs() then generates them all and merges them in.
+	//
+	struct NodeAttrsEntry
+	{
+		MObject		node;
+		bool		isSelected;
+		size_t		position;
+	};
+
+	bool						fQueueNodeAttrs;
+	std::vector<NodeAttrsEntry>	fQueuedNodeAttrs;
 };
 
 //
@@ -202,6 +245,26 @@ inline MString maTranslator::translatorName()
 {	return fTranslatorName;	}
 
 
+//
+// Number of nodes whose attribute commands are generated together, and the
+// size of the buffer used for the output file.
+//
+static const size_t kNodeAttrsBatchSize = 64;
+static const size_t kOutputBufferSize = 1 << 20;
+
+
+//
+// A string buffer whose contents can be read in place, rather than
+// copied out with str().  Only ever written sequentially.
+//
+class maStringBuf : public std::stringbuf
+{
+public:
+	const char*	data() const	{ return pbase(); }
+	size_t		size() const	{ return (size_t)(pptr() - pbase()); }
+};
+
+
 void* maTranslator::creator()
 {
 	return new maTranslator();
@@ -263,7 +326,7 @@ MPxFileTranslator::MFileKind maTranslator::identifyFile(
 //
 MStatus maTranslator::writer(
 		const MFileObject& file,
-		const MString& /* options */,
+		const MString& options,
 		MPxFileTranslator::FileAccessMode mode
 )
 {
@@ -274,9 +337,31 @@ MStatus maTranslator::writer(
 	   	return MS::kNotImplemented;
 
 	//
-	// Let's see if we can open the output file.
+	// The only option is "parallel", which is off unless set to 1.
+	//
+	fQueueNodeAttrs = false;
+
+	MStringArray	optionList;
+	options.split(';', optionList);
+
+	for (unsigned int i = 0; i < optionList.length(); i++)
+	{
+		MStringArray	option;
+		optionList[i].split('=', option);
+
+		if ((option.length() == 2) && (option[0] == "parallel"))
+			fQueueNodeAttrs = (option[1].asInt() != 0);
+	}
+
+	//
+	// Let's see if we can open the output file.  The stream gets a large
+	// buffer since the file is written a line at a time.
 	//
-	std::fstream output(file.expandedFullName().asChar(), std::ios::out | std::ios::trunc);
+	std::vector<char>	outputBuffer(kOutputBufferSize);
+	std::fstream		output;
+
+	output.rdbuf()->pubsetbuf(&outputBuffer[0], outputBuffer.size());
+	output.open(file.expandedFullName().asChar(), std::ios::out | std::ios::trunc);
 
 	if (!output.good()) return MS::kNotFound;
 
@@ -322,17 +407,29 @@ MStatus maTranslator::writer(
 	//
 	// Write out the various sections of the file.
 	//
-	writeHeader(output, file.resolvedName());
-	writeFileInfo(output);
-	writeReferences(output);
-	writeRequirements(output);
-	writeUnits(output);
-	writeDagNodes(output);
-	writeNonDagNodes(output);
-	writeDefaultNodes(output);
-	writeReferenceNodes(output);
-	writeConnections(output);
-	writeFooter(output, file.resolvedName());
+	// When writing in parallel everything goes to memory first so that
+	// the queued attribute commands can be merged into it.
+	//
+	maStringBuf		bodyBuffer;
+	std::ostream	body(&bodyBuffer);
+	std::ostream&	f = fQueueNodeAttrs ? body : output;
+
+	fQueuedNodeAttrs.clear();
+
+	writeHeader(f, file.resolvedName());
+	writeFileInfo(f);
+	writeReferences(f);
+	writeRequirements(f);
+	writeUnits(f);
+	writeDagNodes(f);
+	writeNonDagNodes(f);
+	writeDefaultNodes(f);
+	writeReferenceNodes(f);
+	writeConnections(f);
+	writeFooter(f, file.resolvedName());
+
+	if (fQueueNodeAttrs)
+		writeQueuedNodeAttrs(output, bodyBuffer.data(), bodyBuffer.size());
 
 	output.close();
 
@@ -342,7 +439,7 @@ MStatus maTranslator::writer(
 }
 
 
-void maTranslator::writeHeader(std::fstream& f, const MString& fileName)
+void maTranslator::writeHeader(std::ostream& f, const MString& fileName)
 {
 	//
 	// Get the current time into the same format as used by Maya ASCII
@@ -370,7 +467,7 @@ void maTranslator::writeHeader(std::fstream& f, const MString& fileName)
 // Write out the "fileInfo" command for the freeform information associated
 // with the scene.
 //
-void maTranslator::writeFileInfo(std::fstream& f)
+void maTranslator::writeFileInfo(std::ostream& f)
 {
 	//
 	// There's no direct access to the scene's fileInfo from within the API,
@@ -386,7 +483,7 @@ void maTranslator::writeFileInfo(std::fstream& f)
 		for (i = 0; i < numEntries; i += 2)
 		{
 			f << "fileInfo " << quote(fileInfo[i]).asChar() << " "
-					<< quote(fileInfo[i+1]).asChar() << ";" << std::endl;
+					<< quote(fileInfo[i+1]).asChar() << ";\n";
 		}
 	}
 	else
@@ -398,7 +495,7 @@ void maTranslator::writeFileInfo(std::fstream& f)
 // Write out the "file" commands which specify the reference files used by
 // the scene.
 //
-void maTranslator::writeReferences(std::fstream& f)
+void maTranslator::writeReferences(std::ostream& f)
 {
 	MStringArray	files;
 
@@ -465,7 +562,7 @@ void maTranslator::writeReferences(std::fstream& f)
 		//
 		// Write out the reference command.
 		//
-		f << refCmd.asChar() << " \"" << fileName.asChar() << "\";" << std::endl;
+		f << refCmd.asChar() << " \"" << fileName.asChar() << "\";\n";
 	}
 }
 
@@ -474,12 +571,12 @@ void maTranslator::writeReferences(std::fstream& f)
 // Write out the "requires" lines which specify the plugins needed by the
 // scene.
 //
-void maTranslator::writeRequirements(std::fstream& f)
+void maTranslator::writeRequirements(std::ostream& f)
 {
 	//
 	// Every scene requires Maya itself.
 	//
-	f << "requires maya \"" << fFileVersion.asChar() << "\";" << std::endl;
+	f << "requires maya \"" << fFileVersion.asChar() << "\";\n";
 
 	//
 	// Write out requirements for each plugin.
@@ -494,7 +591,7 @@ void maTranslator::writeRequirements(std::fstream& f)
 		for (i = 0; i < numPlugins; i += 2)
 		{
 			f << "requires " << quote(pluginsUsed[i]).asChar() << " "
-					<< quote(pluginsUsed[i+1]).asChar() << ";" << std::endl;
+					<< quote(pluginsUsed[i+1]).asChar() << ";\n";
 		}
 	}
 	else
@@ -509,7 +606,7 @@ void maTranslator::writeRequirements(std::fstream& f)
 //
 // Write out the units of measurement currently being used by the scene.
 //
-void maTranslator::writeUnits(std::fstream& f)
+void maTranslator::writeUnits(std::ostream& f)
 {
 	MString	args = "";
 	MString	result;
@@ -540,12 +637,12 @@ void maTranslator::writeUnits(std::fstream& f)
 
 	if (args != "")
 	{
-		f << "currentUnit" << args.asChar() << ";" << std::endl;
+		f << "currentUnit" << args.asChar() << ";\n";
 	}
 }
 
 
-void maTranslator::writeDagNodes(std::fstream& f)
+void maTranslator::writeDagNodes(std::ostream& f)
 {
 	fParentingRequired.clear();
 
@@ -768,7 +865,7 @@ void maTranslator::writeDagNodes(std::fstream& f)
 // will put it under its remaining parents.  It will already have been put
 // under its first parent when it was created.
 //
-void maTranslator::writeInstances(std::fstream& f)
+void maTranslator::writeInstances(std::ostream& f)
 {
 	unsigned int numInstancedNodes = fInstanceChildren.length();
 	unsigned int i;
@@ -818,7 +915,7 @@ void maTranslator::writeInstances(std::fstream& f)
 // Write out a 'parent' command to parent one DAG node under another.
 //
 void maTranslator::writeParent(
-		std::fstream& f, const MDagPath& parent, const MDagPath& child, bool addIt
+		std::ostream& f, const MDagPath& parent, const MDagPath& child, bool addIt
 )
 {
 	f << "parent -s -nc -r ";
@@ -842,11 +939,11 @@ void maTranslator::writeParent(
 	if (parent.length() != 0)
 		f << " \"" << parent.partialPathName().asChar() << "\"";
 
-	f << ";" << std::endl;
+	f << ";\n";
 }
 
 
-void maTranslator::writeNonDagNodes(std::fstream& f)
+void maTranslator::writeNonDagNodes(std::ostream& f)
 {
 	MItDependencyNodes	nodeIter;
 
@@ -884,7 +981,7 @@ void maTranslator::writeNonDagNodes(std::fstream& f)
 }
 
 
-void maTranslator::writeDefaultNodes(std::fstream& f)
+void maTranslator::writeDefaultNodes(std::ostream& f)
 {
 	//
 	// For default nodes we don't write out a createNode statement, but we
@@ -908,23 +1005,30 @@ void maTranslator::writeDefaultNodes(std::fstream& f)
 // Write out the 'addAttr' and 'setAttr' commands for a node.
 //
 void maTranslator::writeNodeAttrs(
-		std::fstream& f, const MObject& node, bool isSelected
+		std::ostream& f, const MObject& node, bool isSelected
 )
 {
 	MFnDependencyNode	nodeFn(node);
 
 	if (nodeFn.canBeWritten())
 	{
-		MStringArray	addAttrCmds;
-		MStringArray	setAttrCmds;
+		if (fQueueNodeAttrs)
+		{
+			NodeAttrsEntry	entry;
+
+			entry.node = node;
+			entry.isSelected = isSelected;
+			entry.position = (size_t)(std::streamoff)f.tellp();
 
-		getAddAttrCmds(node, addAttrCmds);
-		getSetAttrCmds(node, setAttrCmds);
+			fQueuedNodeAttrs.push_back(entry);
+			return;
+		}
+
+		std::string	cmds;
 
-		unsigned int	numAddAttrCmds = addAttrCmds.length();
-		unsigned int	numSetAttrCmds = setAttrCmds.length();
+		getNodeAttrCmds(node, cmds);
 
-		if (numAddAttrCmds + numSetAttrCmds > 0)
+		if (!cmds.empty())
 		{
 			//
 			// If the node is not already selected, then issue a command to
@@ -932,19 +1036,87 @@ void maTranslator::writeNodeAttrs(
 			//
 			if (!isSelected) writeSelectNode(f, node);
 
-			unsigned int i;
+			f.write(cmds.data(), cmds.size());
+		}
+	}
+}
+
+
+//
+// Generate the commands for the nodes queued by writeNodeAttrs() and write
+// them out, interleaved with the rest of the file in 'body'.
+//
+void maTranslator::writeQueuedNodeAttrs(
+		std::ostream& f, const char* body, size_t bodySize
+)
+{
+	size_t	numNodes = fQueuedNodeAttrs.size();
+	size_t	numBatches = (numNodes + kNodeAttrsBatchSize - 1) / kNodeAttrsBatchSize;
 
-			for (i = 0; i < numAddAttrCmds; i++)
-				f << addAttrCmds[i].asChar() << std::endl;
+	//
+	// Each batch of nodes gets its own buffer, with 'cmdsEnd' marking where
+	// each node's commands end within it.  The batches are done on worker
+	// threads, which is why this is only done when asked for with the
+	// "parallel=1" option.
+	//
+	std::vector<std::string>	batchCmds(numBatches);
+	std::vector<size_t>			cmdsEnd(numNodes);
+
+	tbb::parallel_for(
+		tbb::blocked_range<size_t>(0, numBatches),
+		[&](const tbb::blocked_range<size_t>& range)
+		{
+			for (size_t b = range.begin(); b != range.end(); b++)
+			{
+				size_t	first = b * kNodeAttrsBatchSize;
+				size_t	last = std::min(numNodes, first + kNodeAttrsBatchSize);
+
+				for (size_t n = first; n < last; n++)
+				{
+					getNodeAttrCmds(fQueuedNodeAttrs[n].node, batchCmds[b]);
+					cmdsEnd[n] = batchCmds[b].size();
+				}
+			}
+		}
+	);
+
+	//
+	// Merge everything back in order.  The 'select' commands are written
+	// here rather than on the worker threads since writeSelectNode() may
+	// display a warning.
+	//
+	size_t	bodyPos = 0;
+
+	for (size_t n = 0; n < numNodes; n++)
+	{
+		const NodeAttrsEntry&	entry = fQueuedNodeAttrs[n];
+		size_t					b = n / kNodeAttrsBatchSize;
+		size_t					cmdsStart = (n % kNodeAttrsBatchSize) ? cmdsEnd[n-1] : 0;
+
+		f.write(body + bodyPos, entry.position - bodyPos);
+		bodyPos = entry.position;
+
+		if (cmdsEnd[n] > cmdsStart)
+		{
+			if (!entry.isSelected) writeSelectNode(f, entry.node);
 
-			for (i = 0; i < numSetAttrCmds; i++)
-				f << setAttrCmds[i].asChar() << std::endl;
+			f.write(batchCmds[b].data() + cmdsStart, cmdsEnd[n] - cmdsStart);
 		}
+
+		//
+		// Free each batch as soon as it has been written.
+		//
+		if ((n + 1) % kNodeAttrsBatchSize == 0 || n + 1 == numNodes)
+			std::string().swap(batchCmds[b]);
 	}
+
+	f.write(body + bodyPos, bodySize - bodyPos);
+
+	fQueuedNodeAttrs.clear();
 }
 
 
-void maTranslator::writeReferenceNodes(std::fstream& f)
+void maTranslator::writeReferenceNodes(std::ostream& f)
 {
 	//
 	// We don't write out createNode commands for reference nodes, but
@@ -1013,7 +1185,7 @@ void maTranslator::writeReferenceNodes(std::fstream& f)
 //
 // Write out all of the connections in the scene.
 //
-void maTranslator::writeConnections(std::fstream& f)
+void maTranslator::writeConnections(std::ostream& f)
 {
 	//
 	// If the scene has broken any connections which were made in referenced
@@ -1096,7 +1268,7 @@ void maTranslator::writeConnections(std::fstream& f)
 // Write the 'disconnectAttr' statements for those connections which were
 // made in referenced files, but broken in the main scene.
 //
-void maTranslator::writeBrokenRefConnections(std::fstream& f)
+void maTranslator::writeBrokenRefConnections(std::ostream& f)
 {
 	unsigned int	numBrokenConnections = fBrokenConnSrcs.length();
 	unsigned int	i;
@@ -1119,7 +1291,7 @@ void maTranslator::writeBrokenRefConnections(std::fstream& f)
 
 		if (!attrFn.indexMatters()) f << " -na";
 
-		f << ";" << std::endl;
+		f << ";\n";
 	}
 }
 
@@ -1128,7 +1300,7 @@ void maTranslator::writeBrokenRefConnections(std::fstream& f)
 // Write the 'connectAttr' commands for all of a node's incoming
 // connections.
 //
-void maTranslator::writeNodeConnections(std::fstream& f, const MObject& node)
+void maTranslator::writeNodeConnections(std::ostream& f, const MObject& node)
 {
 	MFnDependencyNode	nodeFn(node);
 	MPlugArray			plugs;
@@ -1229,7 +1401,7 @@ void maTranslator::writeNodeConnections(std::fstream& f, const MObject& node)
 
 			if (!attrFn.indexMatters()) f << " -na";
 
-			f << ";" << std::endl;
+			f << ";\n";
 		}
 	}
 }
@@ -1239,7 +1411,7 @@ void maTranslator::writeNodeConnections(std::fstream& f, const MObject& node)
 // Write out a 'createNode' command for a DAG node.
 //
 void maTranslator::writeCreateNode(
-		std::fstream& f, const MDagPath& nodePath, const MDagPath& parentPath
+		std::ostream& f, const MDagPath& nodePath, const MDagPath& parentPath
 )
 {
 	MObject		node(nodePath.node());
@@ -1264,14 +1436,14 @@ void maTranslator::writeCreateNode(
 	if (parentPath.length() > 0)
 		f << " -p \"" << parentPath.partialPathName().asChar() << "\"";
    
-	f << ";" << std::endl;
+	f << ";\n";
 }
 
 
 //
 // Write out a 'createNode' command for a non-DAG node.
 //
-void maTranslator::writeCreateNode(std::fstream& f, const MObject& node)
+void maTranslator::writeCreateNode(std::ostream& f, const MObject& node)
 {
 	MFnDependencyNode	nodeFn(node);
 
@@ -1285,14 +1457,14 @@ void maTranslator::writeCreateNode(std::fstream& f, const MObject& node)
 	//
 	if (nodeFn.isShared()) f << " -s";
 
-	f << " -n \"" << nodeFn.name().asChar() << "\";" << std::endl;
+	f << " -n \"" << nodeFn.name().asChar() << "\";\n";
 }
 
 
 //
 // Write out a "lockNode" command.
 //
-void maTranslator::writeLockNode(std::fstream& f, const MObject& node)
+void maTranslator::writeLockNode(std::ostream& f, const MObject& node)
 {
 	MFnDependencyNode	nodeFn(node);
 
@@ -1300,14 +1472,14 @@ void maTranslator::writeLockNode(std::fstream& f, const MObject& node)
 	// By default, nodes are not locked, so we only have to issue a
 	// "lockNode" command if the node is locked.
 	//
-	if (nodeFn.isLocked()) f << "lockNode;" << std::endl;
+	if (nodeFn.isLocked()) f << "lockNode;\n";
 }
 
 
 //
 // Write out a "select" command.
 //
-void maTranslator::writeSelectNode(std::fstream& f, const MObject& node)
+void maTranslator::writeSelectNode(std::ostream& f, const MObject& node)
 {
 	MStatus				status;
 	MFnDependencyNode	nodeFn(node);
@@ -1360,7 +1532,7 @@ void maTranslator::writeSelectNode(std::fstream& f, const MObject& node)
 // Deal with nodes whose parenting is between referenced and non-referenced
 // nodes.
 //
-void maTranslator::writeRefNodeParenting(std::fstream& f)
+void maTranslator::writeRefNodeParenting(std::ostream& f)
 {
 	unsigned int numNodes = fParentingRequired.length();
 	unsigned int i;
@@ -1433,7 +1605,7 @@ void maTranslator::writeRefNodeParenting(std::fstream& f)
 }
 
 
-void maTranslator::writeFooter(std::fstream& f, const MString& fileName)
+void maTranslator::writeFooter(std::ostream& f, const MString& fileName)
 {
 	f << comment(" End of ").asChar() << fileName.asChar() << std::endl;
 }
@@ -1506,6 +1678,35 @@ void maTranslator::getAddAttrCmds(const MObject& node, MStringArray& cmds)
 }
 
 
+//
+// Append a node's 'addAttr' and 'setAttr' commands to 'cmds', one per line.
+//
+void maTranslator::getNodeAttrCmds(const MObject& node, std::string& cmds)
+{
+	MStringArray	addAttrCmds;
+	MStringArray	setAttrCmds;
+
+	getAddAttrCmds(node, addAttrCmds);
+	getSetAttrCmds(node, setAttrCmds);
+
+	unsigned int	numAddAttrCmds = addAttrCmds.length();
+	unsigned int	numSetAttrCmds = setAttrCmds.length();
+	unsigned int	i;
+
+	for (i = 0; i < numAddAttrCmds; i++)
+	{
+		cmds += addAttrCmds[i].asChar();
+		cmds += '\n';
+	}
+
+	for (i = 0; i < numSetAttrCmds; i++)
+	{
+		cmds += setAttrCmds[i].asChar();
+		cmds += '\n';
+	}
+}
+
+
 void maTranslator::getSetAttrCmds(const MObject& node, MStringArray& cmds)
 {
 	//
@@ -1680,6 +1881,195 @@ MString maTranslator::quote(const MString& str)
 }
 
 
+// ****************************************
+
+//
+// Times the translator on a scene of generated nodes, writing it both
+// serially and in parallel.
+//
+class maTranslatorBenchmark : public MPxCommand
+{
+public:
+	MStatus			doIt(const MArgList& args) override;
+	static void*	creator();
+
+protected:
+	static MStatus	exportScene(const MString& fileName, bool parallel, double& seconds);
+	static bool		readBody(const MString& fileName, std::string& body);
+};
+
+
+void* maTranslatorBenchmark::creator()
+{
+	return new maTranslatorBenchmark();
+}
+
+
+MStatus maTranslatorBenchmark::exportScene(
+		const MString& fileName, bool parallel, double& seconds
+)
+{
+	MString	cmd = "file -force -options \"parallel=";
+	cmd += (parallel ? "1" : "0");
+	cmd += "\" -type \"" + maTranslator::translatorName() + "\" -exportAll \"";
+	cmd += fileName + "\"";
+
+	MTimer	timer;
+
+	timer.beginTimer();
+	MStatus	status = MGlobal::executeCommand(cmd);
+	timer.endTimer();
+
+	seconds = timer.elapsedTime();
+
+	return status;
+}
+
+
+//
+// Read a file written by the translator, skipping the header comments
+// since they hold the time it was written.
+//
+bool maTranslatorBenchmark::readBody(const MString& fileName, std::string& body)
+{
+	std::ifstream	input(fileName.asChar(), std::ios::in | std::ios::binary);
+
+	if (!input.good()) return false;
+
+	std::string	line;
+
+	for (int i = 0; i < 3; i++) std::getline(input, line);
+
+	body.assign(
+		std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()
+	);
+
+	return true;
+}
+
+
+//
+// maTranslatorBenchmark [-nodes n]
+//
+// Adds n nodes to the scene, half of them transforms and half of them
+// addDoubleLinear nodes, all with a few changed attribute values, then
+// exports the scene serially and in parallel and checks that both files
+// are the same.  The nodes are removed again afterwards.  Returns the
+// serial and parallel times in seconds.
+//
+MStatus maTranslatorBenchmark::doIt(const MArgList& args)
+{
+	int	numNodes = 200000;
+
+	for (unsigned int i = 0; i + 1 < args.length(); i += 2)
+	{
+		MString	flag = args.asString(i);
+
+		if ((flag == "-nodes") || (flag == "-n"))
+			numNodes = args.asInt(i + 1);
+	}
+
+	if (numNodes < 1)
+	{
+		displayError("maTranslatorBenchmark: -nodes must be positive.");
+		return MS::kInvalidParameter;
+	}
+
+	MString	tmpDir;
+
+	if (!MGlobal::executeCommand("internalVar -userTmpDir", tmpDir))
+		return MS::kFailure;
+
+	MDagModifier	dagMod;
+	MDGModifier		dgMod;
+	int				i;
+
+	for (i = 0; i < numNodes; i++)
+	{
+		double	value = (double)i;
+
+		if (i % 2 == 0)
+		{
+			MObject				node = dagMod.createNode("transform");
+			MFnDependencyNode	nodeFn(node);
+
+			dagMod.newPlugValueDouble(nodeFn.findPlug("translateX", true), value);
+			dagMod.newPlugValueDouble(nodeFn.findPlug("rotateY", true), value * 0.5);
+			dagMod.newPlugValueDouble(nodeFn.findPlug("scaleZ", true), 2.0);
+		}
+		else
+		{
+			MObject				node = dgMod.createNode("addDoubleLinear");
+			MFnDependencyNode	nodeFn(node);
+
+			dgMod.newPlugValueDouble(nodeFn.findPlug("input1", true), value);
+			dgMod.newPlugValueDouble(nodeFn.findPlug("input2", true), -value);
+		}
+	}
+
+	MStatus	status = dagMod.doIt();
+
+	if (status) status = dgMod.doIt();
+
+	//
+	// Both exports go to the same file, since its name is written into the
+	// file's header and footer.  The serial file is read back before the
+	// parallel export replaces it.
+	//
+	MString		fileName = tmpDir + "maTranslatorBenchmark.pma";
+	double		serialTime = 0.0;
+	double		parallelTime = 0.0;
+	std::string	serialBody;
+	std::string	parallelBody;
+	bool		same = false;
+
+	if (status) status = exportScene(fileName, false, serialTime);
+
+	if (status)
+	{
+		same = readBody(fileName, serialBody);
+		status = exportScene(fileName, true, parallelTime);
+	}
+
+	dgMod.undoIt();
+	dagMod.undoIt();
+
+	if (status)
+	{
+		same = same
+			&&	readBody(fileName, parallelBody)
+			&&	(serialBody == parallelBody);
+	}
+
+	remove(fileName.asChar());
+
+	if (!status)
+	{
+		displayError("maTranslatorBenchmark: could not export the scene.");
+		return status;
+	}
+
+	MString	msg;
+	msg.format(
+		"maTranslatorBenchmark: ^1s nodes, serial ^2s s, parallel ^3s s, ^4s bytes",
+		MString() + numNodes, MString() + serialTime, MString() + parallelTime,
+		MString() + (double)serialBody.size()
+	);
+	MGlobal::displayInfo(msg);
+
+	if (!same)
+	{
+		displayError("maTranslatorBenchmark: the serial and parallel files differ.");
+		return MS::kFailure;
+	}
+
+	appendToResult(serialTime);
+	appendToResult(parallelTime);
+
+	return MS::kSuccess;
+}
+
+
 // ****************************************
 
 MStatus initializePlugin(MObject obj)
@@ -1697,6 +2087,16 @@ MStatus initializePlugin(MObject obj)
 		false
 	);
 
+	MStatus	status = plugin.registerCommand(
+		"maTranslatorBenchmark", maTranslatorBenchmark::creator
+	);
+
+	if (!status)
+	{
+		status.perror("registerCommand");
+		return status;
+	}
+
 	return MS::kSuccess;
 }
 
@@ -1707,5 +2107,9 @@ MStatus uninitializePlugin(MObject obj)
 
 	plugin.deregisterFileTranslator(maTranslator::translatorName());
 
-	return MS::kSuccess;
+	MStatus	status = plugin.deregisterCommand("maTranslatorBenchmark");
+
+	if (!status) status.perror("deregisterCommand");
+
+	return status;
 }
@@ -35,6 +35,10 @@
 // itself is not animatable, but the effect of it through the chunkEnvelope
 // can be.
 //
+// Without a GPU the deform() method runs offsetCPU(), a multi-threaded
+// port of the offset.cl kernel that works on the same float3 buffers,
+// matrices and tables, so both paths produce the same results.
+//
 // To use this node:
 //	- create a plane or some other object
 //	- type: "deformer -type offset"
@@ -83,6 +87,7 @@
 #include <maya/MVector.h>
 #include <maya/MMatrix.h>
 #include <maya/MMatrixArray.h>
+#include <maya/MPointArray.h>
 
 #include <maya/MDagModifier.h>
 
@@ -94,8 +99,66 @@
 #include <maya/MViewport2Renderer.h>
 #include <maya/MFnMesh.h>
 #include <clew/clew.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <algorithm>
 #include <vector>
 
+// -----------------------------------------------------------------------------
+//
+// CPU implementation of the offset kernel in offset.cl. The arguments and
+// the arithmetic match the kernel one for one, including the use of single
+// precision, so its output can be compared directly with the GPU path.
+//
+// -----------------------------------------------------------------------------
+static void offsetCPU(
+	float* finalPos,							//float3
+	const float* initialPos,					//float3
+	const float* weights,
+	const unsigned int* affectMap,
+	const float (*matrices)[4],					//first matrix is offset matrix, second matrix is offset matrix inverse
+	const float* randomOffsetTable,
+	unsigned int randomOffsetTableSize,
+	float envelope,
+	float chunkWeight,
+	unsigned int affectCount)
+{
+	const float (*matrix)[4] = matrices;
+	const float (*matrixInverse)[4] = matrices + 4;
+
+	tbb::parallel_for(tbb::blocked_range<unsigned int>(0, affectCount, 4096),
+		[=](const tbb::blocked_range<unsigned int>& r)
+	{
+		// Plain loop over contiguous float3 data with no calls or branches
+		// on the identity map path, so the compiler can vectorize it.
+		for (unsigned int id = r.begin(); id < r.end(); ++id) {
+			const unsigned int positionId = (affectMap ? affectMap[id] : id);
+			const unsigned int positionOffset = positionId * 3;
+
+			const float x = initialPos[positionOffset];
+			const float y = initialPos[positionOffset+1];
+			const float z = initialPos[positionOffset+2];
+
+			// point *= matrix inverse
+			const float fx = x*matrixInverse[0][0] + y*matrixInverse[0][1] + z*matrixInverse[0][2] + matrixInverse[0][3];
+			float fy       = x*matrixInverse[1][0] + y*matrixInverse[1][1] + z*matrixInverse[1][2] + matrixInverse[1][3];
+			const float fz = x*matrixInverse[2][0] + y*matrixInverse[2][1] + z*matrixInverse[2][2] + matrixInverse[2][3];
+
+			float weight = weights ? weights[id] : 1.0f;
+			if (randomOffsetTableSize > 0) {
+				weight *= (1.0f + chunkWeight*randomOffsetTable[positionId%randomOffsetTableSize]);
+			}
+
+			fy += envelope*weight;
+
+			// point *= matrix
+			finalPos[positionOffset]   = fx*matrix[0][0] + fy*matrix[0][1] + fz*matrix[0][2] + matrix[0][3];
+			finalPos[positionOffset+1] = fx*matrix[1][0] + fy*matrix[1][1] + fz*matrix[1][2] + matrix[1][3];
+			finalPos[positionOffset+2] = fx*matrix[2][0] + fy*matrix[2][1] + fz*matrix[2][2] + matrix[2][3];
+		}
+	});
+}
+
 class offset : public MPxDeformerNode
 {
 public:
@@ -137,6 +200,10 @@ public:
 	static MString pluginPath;
 
 private:
+	// Scratch buffers for offsetCPU(), reused across evaluations
+	std::vector<float>			fPositions;
+	std::vector<float>			fWeights;
+	std::vector<unsigned int>	fAffectMap;
 };
 
 // local attributes
@@ -235,28 +302,59 @@ offset::deform( MDataBlock& block,
 	MDataHandle matData = block.inputValue(offsetMatrix, &returnStatus );
 	if (MS::kSuccess != returnStatus) return returnStatus;
 	MMatrix omat = matData.asMatrix();
-	MMatrix omatinv = omat.inverse();
 
-    bool useRandomOffset = (numChunks > 0 && chunkWeight > 0.0);
-	// iterate through each point in the geometry
-	//
-	for ( ; !iter.isDone(); iter.next()) {
-		MPoint pt = iter.position();
-		pt *= omatinv;
-		float weight = weightValue(block,multiIndex,iter.index());
-
-        if (useRandomOffset)
-            weight *= (1.0 + chunkWeight*randomOffsetTable[iter.index()%numChunks]);
-
-		// offset algorithm
-		//
-		pt.y = pt.y + env*weight;
-		//
-		// end of offset algorithm
-
-		pt *= omat;
-		iter.setPosition(pt);
+	// Same layout as the matrix buffer of the GPU deformer: the transposed
+	// offset matrix followed by its transposed inverse.
+	MMatrix omatT = omat.transpose();
+	MMatrix omatinvT = omat.inverse().transpose();
+	float matrices[8][4];
+	for (int r = 0; r < 4; ++r) {
+		for (int c = 0; c < 4; ++c) {
+			matrices[r][c] = (float)omatT[r][c];
+			matrices[r+4][c] = (float)omatinvT[r][c];
+		}
+	}
+
+	// Gather the affected points into a float3 buffer indexed by vertex id,
+	// with an affect map when only a subset of the geometry is deformed.
+	// Weights are read serially since weightValue() uses the datablock.
+	MPointArray points;
+	iter.allPositions(points);
+	const unsigned int affectCount = points.length();
+
+	fAffectMap.resize(affectCount);
+	fWeights.resize(affectCount);
+	bool identityMap = true;
+	unsigned int positionCount = 0;
+	unsigned int id = 0;
+	for (iter.reset(); !iter.isDone(); iter.next(), ++id) {
+		const unsigned int positionId = (unsigned int)iter.index();
+		fAffectMap[id] = positionId;
+		identityMap = identityMap && (positionId == id);
+		positionCount = std::max(positionCount, positionId + 1);
+		fWeights[id] = weightValue(block, multiIndex, positionId);
+	}
+
+	fPositions.resize(3 * (size_t)positionCount);
+	for (id = 0; id < affectCount; ++id) {
+		float* pos = &fPositions[3 * (size_t)fAffectMap[id]];
+		pos[0] = (float)points[id].x;
+		pos[1] = (float)points[id].y;
+		pos[2] = (float)points[id].z;
 	}
+
+	// The kernel deforms in place: each thread only touches its own vertices.
+	offsetCPU(fPositions.data(), fPositions.data(), fWeights.data(),
+			  identityMap ? nullptr : fAffectMap.data(), matrices,
+			  randomOffsetTable.length() ? &randomOffsetTable[0] : nullptr, randomOffsetTable.length(),
+			  env, chunkWeight, affectCount);
+
+	for (id = 0; id < affectCount; ++id) {
+		const float* pos = &fPositions[3 * (size_t)fAffectMap[id]];
+		points[id] = MPoint(pos[0], pos[1], pos[2]);
+	}
+	iter.setAllPositions(points);
+
 	return returnStatus;
 }
 
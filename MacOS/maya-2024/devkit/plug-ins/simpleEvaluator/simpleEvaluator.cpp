@@ -28,6 +28,13 @@
 #include <maya/MFnSet.h>
 #include <maya/MProfiler.h>
 #include <maya/MItDependencyNodes.h>
+#include <maya/MItDependencyGraph.h>
+#include <maya/MGraphNodeIterator.h>
+#include <maya/MEvaluationNode.h>
+#include <maya/MObjectHandle.h>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <string>
 
@@ -67,12 +74,31 @@ public:
 protected:
     void    buildPlugListWithControllerTag();
     void    buildHashValue();
+    void    clear();
 
 private:
-    std::size_t fOldHashValue;
-    std::size_t fCurrentHashValue;
-
-    MPlugArray  fControllerPlugs;
+    // Controller plugs, grouped by controller: the plugs of controller i
+    // are [fControllerPlugStart[i], fControllerPlugStart[i+1]).
+    MPlugArray                  fControllerPlugs;
+    std::vector<unsigned int>   fControllerPlugStart;
+
+    // Nodes downstream of each controller, by MObjectHandle hash code
+    std::vector<std::unordered_set<unsigned int>> fControllerDownstream;
+
+    // Pose hash of each controller on the previous and current frame
+    std::vector<std::size_t>    fOldHashValues;
+    std::vector<std::size_t>    fCurrentHashValues;
+    std::vector<char>           fControllerChanged;
+    bool                        fAnyControllerChanged = true;
+    bool                        fOldHashesValid = false;
+
+    // Controllers driving each cluster. Clusters which are not downstream
+    // of any controller are absent and evaluate whenever any controller
+    // changes, as the whole pose hash used to.
+    std::unordered_map<const MCustomEvaluatorClusterNode*, std::vector<unsigned int>> fClusterControllers;
+
+    std::atomic<unsigned int>   fEvaluatedClusters{0};
+    std::atomic<unsigned int>   fSkippedClusters{0};
 };
 
 ///////////////////////////////////////////////////
@@ -87,12 +113,18 @@ private:
 // we call buildPlugListWithControllerTag to build a 
 // list of plugs for translation, and rotation.
 // 
+// Each controller also gets the set of nodes downstream
+// of it, and every cluster is mapped to the controllers
+// that drive one of its nodes.
+// 
 // During preEvaluate(...) which is called per frame
-// we calculate a hash value based on the plug values of
-// the current frame. This value is compared with the 
-// previous frame's hash in clusterEvaluate(...) and
-// if the hash is different, we proceed with evaluation
-// otherwise we do nothing.
+// we calculate one hash value per controller based on
+// its plug values for the current frame, and compare it
+// with the previous frame's hash. In clusterEvaluate(...)
+// a cluster is only evaluated if one of the controllers
+// driving it has changed, otherwise we do nothing.
+// The number of evaluated and skipped clusters is sent
+// to the profiler after each frame.
 //
 // The setup is cleaned up in clusterTerminate(...), which
 // is only called when the scene's graph topology is
@@ -106,6 +138,11 @@ bool simpleEvaluator::markIfSupported(const MEvaluationNode* node)
 
 void simpleEvaluator::buildPlugListWithControllerTag()
 {
+    // rebuilt from scratch, so drop anything left from a previous scan
+    fControllerPlugs.clear();
+    fControllerPlugStart.clear();
+    fControllerDownstream.clear();
+
     MStatus stat;
     MItDependencyNodes dgIter(MFn::kControllerTag, &stat);
 
@@ -136,6 +173,24 @@ void simpleEvaluator::buildPlugListWithControllerTag()
 
                 MFnDependencyNode currControllerNode(controllerNode, &stat);
 
+                fControllerPlugStart.push_back(fControllerPlugs.length());
+
+                // everything the controller drives, including itself
+                std::unordered_set<unsigned int> downstream;
+                MItDependencyGraph graphIter(controllerNode, MFn::kInvalid,
+                                             MItDependencyGraph::kDownstream,
+                                             MItDependencyGraph::kBreadthFirst,
+                                             MItDependencyGraph::kNodeLevel, &stat);
+                if (stat == MS::kSuccess)
+                {
+                    for (; !graphIter.isDone(); graphIter.next())
+                    {
+                        downstream.insert(MObjectHandle(graphIter.currentItem()).hashCode());
+                    }
+                }
+                downstream.insert(MObjectHandle(controllerNode).hashCode());
+                fControllerDownstream.push_back(std::move(downstream));
+
                 for (unsigned int j = 0; j < 6; j++)
                 {
                     MPlug currPlug = currControllerNode.findPlug(values[j],  true,  &stat);
@@ -152,29 +207,57 @@ void simpleEvaluator::buildPlugListWithControllerTag()
             }
         }
     }
+    fControllerPlugStart.push_back(fControllerPlugs.length());
+
+    const size_t numControllers = fControllerDownstream.size();
+    fOldHashValues.assign(numControllers, 0);
+    fCurrentHashValues.assign(numControllers, 0);
+    fControllerChanged.assign(numControllers, 1);
+    fOldHashesValid = false;
 }
 
 void simpleEvaluator::buildHashValue()
 {
-    unsigned int length = fControllerPlugs.length();
     MStatus stat = MS::kSuccess;
+    const size_t numControllers = fControllerDownstream.size();
 
-    for (unsigned int i = 0; i < length; i++)
+    fAnyControllerChanged = !fOldHashesValid;
+    for (size_t c = 0; c < numControllers; c++)
     {
-        float value = 0;
-        stat = fControllerPlugs[i].getValue(value);
-
-        if (stat == MS::kSuccess)
+        std::size_t hashValue = 0;
+        for (unsigned int i = fControllerPlugStart[c]; i < fControllerPlugStart[c+1]; i++)
         {
-            hash_combine(fCurrentHashValue, value);
-        }
-        else
-        {
-            std::cerr << "NO VALUE: " << fControllerPlugs[i].name().asChar() << std::endl;
+            float value = 0;
+            stat = fControllerPlugs[i].getValue(value);
+
+            if (stat == MS::kSuccess)
+            {
+                hash_combine(hashValue, value);
+            }
+            else
+            {
+                std::cerr << "NO VALUE: " << fControllerPlugs[i].name().asChar() << std::endl;
+            }
         }
+
+        fCurrentHashValues[c] = hashValue;
+        fControllerChanged[c] = !fOldHashesValid || (hashValue != fOldHashValues[c]);
+        fAnyControllerChanged = fAnyControllerChanged || fControllerChanged[c];
     }
 }
 
+void simpleEvaluator::clear()
+{
+    fControllerPlugs.clear();
+    fControllerPlugStart.clear();
+    fControllerDownstream.clear();
+    fOldHashValues.clear();
+    fCurrentHashValues.clear();
+    fControllerChanged.clear();
+    fClusterControllers.clear();
+    fOldHashesValid = false;
+}
+
 // Is this evaluator capable of evaluating clusters in parallel?
 MCustomEvaluatorClusterNode::SchedulingType simpleEvaluator::schedulingType	(const MCustomEvaluatorClusterNode* cluster)
 {
@@ -189,8 +272,16 @@ void simpleEvaluator::preEvaluate(const MEvaluationGraph* graph)
 
 void simpleEvaluator::postEvaluate(const MEvaluationGraph* graph)
 {
-    fOldHashValue = fCurrentHashValue;
-    fCurrentHashValue = 0;
+    fOldHashValues.swap(fCurrentHashValues);
+    fOldHashesValid = true;
+
+    const unsigned int evaluated = fEvaluatedClusters.exchange(0);
+    const unsigned int skipped = fSkippedClusters.exchange(0);
+    if (MProfiler::categoryRecording(_profilerCategory))
+    {
+        std::string counts = "evaluated " + std::to_string(evaluated) + ", skipped " + std::to_string(skipped);
+        MProfiler::signalEvent(_profilerCategory, MProfiler::kColorD_L2, "clusterCounts", counts.c_str());
+    }
 }
 
 // called during scheduling
@@ -201,15 +292,72 @@ bool simpleEvaluator::clusterInitialize	(const MCustomEvaluatorClusterNode* clus
         buildPlugListWithControllerTag();
     }
 
+    // find the controllers driving any node of this cluster
+    std::vector<unsigned int> controllers;
+    MStatus stat = MS::kSuccess;
+    MGraphNodeIterator iterator(cluster, &stat);
+    if (stat == MS::kSuccess)
+    {
+        std::vector<char> found(fControllerDownstream.size(), 0);
+        while (!iterator.isDone())
+        {
+            iterator.next(&stat);
+
+            MEvaluationNode currEvalNode = iterator.currentEvaluationNode(&stat);
+            if (stat != MS::kSuccess) continue;
+            const unsigned int nodeHash = MObjectHandle(currEvalNode.dependencyNode()).hashCode();
+
+            for (size_t c = 0; c < fControllerDownstream.size(); c++)
+            {
+                if (!found[c] && fControllerDownstream[c].count(nodeHash))
+                {
+                    found[c] = 1;
+                    controllers.push_back((unsigned int)c);
+                }
+            }
+        }
+    }
+
+    if (controllers.empty())
+    {
+        fClusterControllers.erase(cluster);
+    }
+    else
+    {
+        fClusterControllers[cluster] = std::move(controllers);
+    }
+
     return true;
 }
 
 void simpleEvaluator::clusterEvaluate(const MCustomEvaluatorClusterNode* cluster)
 {
-    if (fOldHashValue != fCurrentHashValue)
+    // Only read shared state here, clusters may be evaluated in parallel.
+    bool changed = fAnyControllerChanged;
+    auto it = fClusterControllers.find(cluster);
+    if (it != fClusterControllers.end())
     {
-        // if the poses are different, call the cluster's evaluation
+        changed = false;
+        for (unsigned int c : it->second)
+        {
+            if (fControllerChanged[c])
+            {
+                changed = true;
+                break;
+            }
+        }
+    }
+
+    if (changed)
+    {
+        // if the poses of the driving controllers are different, call the cluster's evaluation
+        MProfilingScope profilingScope(_profilerCategory, MProfiler::kColorD_L1, "evaluateCluster");
         cluster->evaluate();
+        ++fEvaluatedClusters;
+    }
+    else
+    {
+        ++fSkippedClusters;
     }
 }
 
@@ -217,7 +365,7 @@ void simpleEvaluator::clusterTerminate(const MCustomEvaluatorClusterNode* cluste
 {
     if (fControllerPlugs.length() > 0)
     {
-        fControllerPlugs.clear();
+        clear();
     }
 }
 
@@ -87,6 +87,10 @@
 #include <maya/MDynSweptTriangle.h>
 #include <maya/MPlugArray.h>
 
+#include <vector>
+#include <tbb/parallel_for.h>
+#include <tbb/enumerable_thread_specific.h>
+
 
 MTypeId simpleFluidEmitter::id( 0x81020 );
 
@@ -344,6 +348,21 @@ simpleFluidEmitter::fluidEmitter(
 #define MIN(x,y) ((x)<(y)?(x):(y))
 #define MAX(x,y) ((x)>(y)?(x):(y))
 
+static inline double voxelRandom( unsigned long long seed, unsigned long long n )
+//
+//	Description:
+//
+//		Returns a random number in [0,1) that only depends on seed and n,
+//		the n'th value of the stream for the given seed.
+//
+{
+	unsigned long long z = seed + (n + 1) * 0x9E3779B97F4A7C15ull;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	z ^= z >> 31;
+	return (double)(z >> 11) * (1.0 / 9007199254740992.0);
+}
+
 void 
 simpleFluidEmitter::omniFluidEmitter(
 	MFnFluid& 		fluid,
@@ -506,9 +525,9 @@ simpleFluidEmitter::omniFluidEmitter(
 	//	number of samples in these cases.
 	//
 	//	If the "jitter" flag is enabled, we jitter each sample position,
-	//	using the rangen() function, which keeps track of independent 
-	//	random states for each fluid, to make sure that results are
-	//	repeatable for multiple simulation runs.
+	//	using per-voxel streams seeded from the randgen() function, which
+	//	keeps track of independent random states for each fluid, to make
+	//	sure that results are repeatable for multiple simulation runs.
 	//	
 
 	// basic sample count
@@ -534,75 +553,178 @@ simpleFluidEmitter::omniFluidEmitter(
 		numSamples = 1;
 	}
 
-	for( unsigned int p = 0; p < emitterPositions.length(); p++ )
+	//	world space position of a point (x,y,z) in fluid object space is
+	//	origin + x*axis[0] + y*axis[1] + z*axis[2].  Precompute that for
+	//	the low corner of every voxel row along each axis, so that a sample
+	//	position is three table lookups plus its offset inside the voxel.
+	//
+	MVector axis[3];
+	for( int a = 0; a < 3; a++ )
 	{
-		MPoint emitterWorldPos = emitterPositions[p];
+		axis[a] = MVector( fluidWorldMatrix[a][0], fluidWorldMatrix[a][1], fluidWorldMatrix[a][2] );
+	}
+	MVector origin( fluidWorldMatrix[3][0], fluidWorldMatrix[3][1], fluidWorldMatrix[3][2] );
+
+	std::vector<MVector> xCorner( res[0] ), yCorner( res[1] ), zCorner( res[2] );
+	for( unsigned int i = 0; i < res[0]; i++ )
+		xCorner[i] = axis[0] * (Ox + i*dx);
+	for( unsigned int j = 0; j < res[1]; j++ )
+		yCorner[j] = axis[1] * (Oy + j*dy);
+	for( unsigned int k = 0; k < res[2]; k++ )
+		zCorner[k] = axis[2] * (Oz + k*dz) + origin;
+	MVector voxelStep[3] = { axis[0] * dx, axis[1] * dy, axis[2] * dz };
+
+	//	only voxels overlapping the box around each emitter point that
+	//	contains its maxDist sphere, in fluid object space, can receive
+	//	anything.  The box half size along each axis is maxDist times the
+	//	length of the matching column of the world->object matrix.
+	//
+	MMatrix fluidInverse = fluidWorldMatrix.inverse();
+	double extent[3];
+	for( int a = 0; a < 3; a++ )
+	{
+		extent[a] = maxDist * sqrt( fluidInverse[0][a]*fluidInverse[0][a] +
+									fluidInverse[1][a]*fluidInverse[1][a] +
+									fluidInverse[2][a]*fluidInverse[2][a] );
+	}
 
-		//	loop through all voxels, looking for ones that lie at least
-		//	partially within the dropoff field around this emitter point
-		//
-		for( unsigned int i = 0; i < res[0]; i++ )
+	double origins[3] = { Ox, Oy, Oz };
+	double steps[3] = { dx, dy, dz };
+	unsigned int numPositions = emitterPositions.length();
+	std::vector<int> voxelRange( 6 * numPositions );
+	for( unsigned int p = 0; p < numPositions; p++ )
+	{
+		MPoint objectPos = MPoint( emitterPositions[p] ) * fluidInverse;
+		int *range = &voxelRange[6*p];
+		for( int a = 0; a < 3; a++ )
 		{
-			double x = Ox + i*dx;
-			
-			for( unsigned int j = 0; j < res[1]; j++ )
+			double lo = floor( (objectPos[a] - extent[a] - origins[a]) / steps[a] );
+			double hi = floor( (objectPos[a] + extent[a] - origins[a]) / steps[a] );
+			range[2*a] = (int)MAX( lo, 0.0 );
+			range[2*a+1] = (int)MIN( hi, (double)res[a] - 1.0 );
+		}
+	}
+
+	//	jittered samples draw from a random stream per emitter point, voxel
+	//	and sample, seeded once per frame from the fluid's random state, so
+	//	the result does not depend on how the voxels are split between
+	//	threads.
+	//
+	unsigned long long frameSeed = (unsigned long long)( randgen() * 4294967296.0 );
+
+	//	MFnFluid is not thread safe, so everything needed from it is fetched
+	//	here: the falloff grid, and the grid index of every voxel as the sum
+	//	of its x, y and z parts.
+	//
+	float *fArray = fluid.falloff();
+	std::vector<int> xIndex( res[0] ), yIndex( res[1] ), zIndex( res[2] );
+	int index0 = fluid.index( 0, 0, 0 );
+	for( unsigned int i = 0; i < res[0]; i++ )
+		xIndex[i] = fluid.index( (int)i, 0, 0 );
+	for( unsigned int j = 0; j < res[1]; j++ )
+		yIndex[j] = fluid.index( 0, (int)j, 0 ) - index0;
+	for( unsigned int k = 0; k < res[2]; k++ )
+		zIndex[k] = fluid.index( 0, 0, (int)k ) - index0;
+
+	//	the distances and emission amounts are computed in parallel over
+	//	slabs of voxels along x, and the emissions queued per thread.  Each
+	//	voxel belongs to one slab and within it the emitter points are
+	//	visited in order, so once the queues are applied below every voxel
+	//	has received the same emissions in the same order as a serial loop.
+	//
+	struct VoxelEmission
+	{
+		int		i, j, k;
+		float	amount;
+	};
+	tbb::enumerable_thread_specific< std::vector<VoxelEmission> > emissions;
+
+	tbb::parallel_for( tbb::blocked_range<int>( 0, (int)res[0] ),
+		[&]( const tbb::blocked_range<int> &slab )
+	{
+		std::vector<VoxelEmission> &queue = emissions.local();
+		for( unsigned int p = 0; p < numPositions; p++ )
+		{
+			const int *range = &voxelRange[6*p];
+			int iBegin = MAX( range[0], slab.begin() );
+			int iEnd = MIN( range[1], slab.end() - 1 );
+			if( iBegin > iEnd || range[2] > range[3] || range[4] > range[5] )
 			{
-				double y = Oy + j*dy;
-				
-				for( unsigned int k = 0; k < res[2]; k++ )
+				continue;
+			}
+
+			MVector emitterWorldPos = emitterPositions[p];
+
+			//	loop through the voxels in range, looking for ones that lie
+			//	at least partially within the dropoff field around this
+			//	emitter point
+			//
+			for( int i = iBegin; i <= iEnd; i++ )
+			{
+				double x = Ox + i*dx;
+
+				for( int j = range[2]; j <= range[3]; j++ )
 				{
-					double z = Oz + k*dz;
-	
-					int si;
-					for( si = 0; si < numSamples; si++ )
-					{
-						//	compute sample point (fluid object space)
-						//
-						double rx, ry, rz;
-						if( jitter )
-						{
-							rx = x + randgen()*dx;
-							ry = y + randgen()*dy;
-							rz = z + randgen()*dz;
-						}
-						else
-						{
-							rx = x + 0.5*dx;
-							ry = y + 0.5*dy;
-							rz = z + 0.5*dz;
-						}
+					double y = Oy + j*dy;
+					MVector xyCorner = xCorner[i] + yCorner[j];
 
-						//	compute distance from sample to emitter point
-						//	
-						MPoint point( rx, ry, rz );
-						point *= fluidWorldMatrix;
-						MVector diff = point - emitterWorldPos;
-						double distSquared = diff * diff;
-						double dist = diff.length();
-					
-						//	discard if outside min/max range
-						//
-						if( (dist < minDist) || (dist > maxDist) )
-						{
-							continue;
-						}
-						
-						//	drop off the emission rate according to the falloff
-						//	parameter, and divide to accound for multiple samples
-						//	in the voxel
-						//
-						double distDrop = dropoff * distSquared;
-						double newVal = theRate * exp( -distDrop ) / (double)numSamples;
+					for( int k = range[4]; k <= range[5]; k++ )
+					{
+						double z = Oz + k*dz;
+						MVector corner = xyCorner + zCorner[k];
+						unsigned long long stream =
+							(((unsigned long long)p * res[0] + i) * res[1] + j) * res[2] + k;
 
-						//	emit density/heat/fuel/color into the current voxel
-						//
-						if( newVal != 0 )
+						bool inRange = false;
+						for( int si = 0; si < numSamples; si++ )
 						{
-							fluid.emitIntoArrays( (float) newVal, i, j, k, (float)densityEmit, (float)heatEmit, (float)fuelEmit, doEmitColor, emitColor );
+							//	compute sample point offset inside the voxel
+							//
+							double fx, fy, fz;
+							if( jitter )
+							{
+								unsigned long long n = (stream * 8 + si) * 3;
+								fx = voxelRandom( frameSeed, n );
+								fy = voxelRandom( frameSeed, n + 1 );
+								fz = voxelRandom( frameSeed, n + 2 );
+							}
+							else
+							{
+								fx = fy = fz = 0.5;
+							}
+
+							//	compute distance from sample to emitter point
+							//
+							MVector point = corner + voxelStep[0]*fx + voxelStep[1]*fy + voxelStep[2]*fz;
+							MVector diff = point - emitterWorldPos;
+							double distSquared = diff * diff;
+							double dist = sqrt( distSquared );
+
+							//	discard if outside min/max range
+							//
+							if( (dist < minDist) || (dist > maxDist) )
+							{
+								continue;
+							}
+							inRange = true;
+
+							//	drop off the emission rate according to the falloff
+							//	parameter, and divide to accound for multiple samples
+							//	in the voxel
+							//
+							double distDrop = dropoff * distSquared;
+							double newVal = theRate * exp( -distDrop ) / (double)numSamples;
+
+							//	queue density/heat/fuel/color for the current voxel
+							//
+							if( newVal != 0 )
+							{
+								VoxelEmission emission = { i, j, k, (float) newVal };
+								queue.push_back( emission );
+							}
 						}
 
-						float *fArray = fluid.falloff();
-						if( fArray != NULL )
+						if( inRange && fArray != NULL )
 						{
 							MPoint midPoint( x+0.5*dx, y+0.5*dy, z+0.5*dz );
 							midPoint.x *= 0.2;
@@ -611,12 +733,25 @@ simpleFluidEmitter::omniFluidEmitter(
 
 							float fdist = (float) sqrt( midPoint.x*midPoint.x + midPoint.y*midPoint.y + midPoint.z*midPoint.z );
 							fdist /= sqrtf(3.0f);
-							fArray[fluid.index(i,j,k)] = 1.0f-fdist;
+							fArray[xIndex[i] + yIndex[j] + zIndex[k]] = 1.0f-fdist;
 						}
 					}
 				}
 			}
 		}
+	});
+
+	//	emit into the fluid on this thread
+	//
+	for( tbb::enumerable_thread_specific< std::vector<VoxelEmission> >::const_iterator
+			queue = emissions.begin(); queue != emissions.end(); ++queue )
+	{
+		for( size_t e = 0; e < queue->size(); e++ )
+		{
+			const VoxelEmission &emission = (*queue)[e];
+			fluid.emitIntoArrays( emission.amount, emission.i, emission.j, emission.k,
+				(float)densityEmit, (float)heatEmit, (float)fuelEmit, doEmitColor, emitColor );
+		}
 	}
 }
 
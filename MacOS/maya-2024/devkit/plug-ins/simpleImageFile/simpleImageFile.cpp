@@ -16,6 +16,11 @@
 //  image file will produce a procedurally generated colour 
 //  spectrum including values outside 0 to 1.
 //
+//  The image is generated a band of rows at a time through
+//  FloatImageRegionReader (see floatImageRegionReader.h), so regions
+//  can be produced on their own and glLoad() uploads the texture in
+//  bands rather than through a full-size temporary.
+//
 ///////////////////////////////////////////////////////////////////
 
 #include <maya/MPxImageFile.h>
@@ -26,9 +31,11 @@
 #include <maya/MIOStream.h>
 #include <maya/MGL.h>
 
+#include "floatImageRegionReader.h"
+
 MString kImagePluginName( "SimpleImageFile");
 
-class SimpleImageFile : public MPxImageFile
+class SimpleImageFile : public MPxImageFile, public FloatImageRegionReader
 {
 public:
                     SimpleImageFile();
@@ -38,8 +45,16 @@ public:
 	MStatus load( MImage& image, unsigned int idx) override;
 	MStatus glLoad( const MImageFileInfo& info, unsigned int imageNumber) override;
 
+	// FloatImageRegionReader. Procedural, so nothing is cached.
+	unsigned int	levelWidth( unsigned int ) const override { return 512; }
+	unsigned int	levelHeight( unsigned int ) const override { return 512; }
+	unsigned int	numChannels() const override { return 3; }
+	bool			readRows( unsigned int level, unsigned int y, unsigned int count,
+							  float* dst, size_t rowStride ) override;
+
 private:
-	void			populateTestImage( float* pixels, unsigned int w, unsigned int h);
+	void			populateTestImage( float* pixels, unsigned int w, unsigned int h,
+									   unsigned int y, unsigned int count, size_t rowStride);
 };
 
 //
@@ -90,26 +105,44 @@ MStatus SimpleImageFile::open( MString pathname, MImageFileInfo* info)
 
 //
 // DESCRIPTION:
-// Internal helper method to populate our procedural test image
+// Internal helper method to populate rows [y, y+count) of our
+// procedural test image, rows being rowStride floats apart.
 //
 ///////////////////////////////////////////////////////
-void SimpleImageFile::populateTestImage( float* pixels, unsigned int w, unsigned int h)
+void SimpleImageFile::populateTestImage( float* pixels, unsigned int w, unsigned int h,
+										 unsigned int y, unsigned int count, size_t rowStride)
 {
 	#define RAINBOW_SCALE 4.0f
-	unsigned int x, y;
-	for( y = 0; y < h; y++)
+	unsigned int x, row;
+	for( row = y; row < y + count; row++)
 	{
-		float g = RAINBOW_SCALE * y / (float)h;
+		float* rowPixels = pixels + (row - y) * rowStride;
+		float g = RAINBOW_SCALE * row / (float)h;
 		for( x = 0; x < w; x++)
 		{
 			float r = RAINBOW_SCALE * x / (float)w;
-			*pixels++ = r;
-			*pixels++ = g;
-			*pixels++ = RAINBOW_SCALE * 1.5f - r - g;
+			*rowPixels++ = r;
+			*rowPixels++ = g;
+			*rowPixels++ = RAINBOW_SCALE * 1.5f - r - g;
 		}
 	}
 }
 
+//
+// DESCRIPTION:
+// Generate rows of the image. Rows are produced in MImage order, so
+// regions are read without flipping.
+//
+///////////////////////////////////////////////////////
+bool SimpleImageFile::readRows( unsigned int level, unsigned int y, unsigned int count,
+								float* dst, size_t rowStride )
+{
+	if( level != 0)
+		return false;
+	populateTestImage( dst, levelWidth( 0), levelHeight( 0), y, count, rowStride);
+	return true;
+}
+
 
 //
 // DESCRIPTION:
@@ -127,8 +160,8 @@ MStatus SimpleImageFile::load( MImage& image, unsigned int)
 	// a pretty rainbow test image.
 	//
 	image.create( w, h, 3, MImage::kFloat);
-	populateTestImage( image.floatPixels(), w, h);
-	return MS::kSuccess;
+	return readRegion( 0, 0, 0, w, h, image.floatPixels(), (size_t)w * 3, false) ?
+		MS::kSuccess : MS::kFailure;
 }
 
 
@@ -141,14 +174,19 @@ MStatus SimpleImageFile::load( MImage& image, unsigned int)
 ///////////////////////////////////////////////////////
 MStatus SimpleImageFile::glLoad( const MImageFileInfo& info, unsigned int)
 {
-	// Create a floating point image
+	// Allocate a floating point texture
 	unsigned int w = info.width();
 	unsigned int h = info.height();
-	float* pixels = new float[ w * h * 3];
-	populateTestImage( pixels, w, h);
-	
-	// Now load it into OpenGL as a floating point image
-	::glTexImage2D( GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_FLOAT, pixels);
+	::glTexImage2D( GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_FLOAT, NULL);
+
+	// Now fill it a band of rows at a time
+	float* pixels = new float[ w * kBandRows * 3];
+	for( unsigned int y = 0; y < h; y += kBandRows)
+	{
+		unsigned int count = std::min( (unsigned int)kBandRows, h - y);
+		populateTestImage( pixels, w, h, y, count, (size_t)w * 3);
+		::glTexSubImage2D( GL_TEXTURE_2D, 0, 0, y, w, count, GL_RGB, GL_FLOAT, pixels);
+	}
 
 	delete[] pixels;
 	return MS::kSuccess;
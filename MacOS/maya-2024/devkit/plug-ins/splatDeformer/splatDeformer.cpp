@@ -16,6 +16,12 @@
 // 		Example implementation of a threaded deformer. This node
 //		deforms one mesh using another.
 //
+//		Closest points are found with a bounding volume hierarchy over the
+//		deforming mesh triangles. The hierarchy is only rebuilt when the
+//		topology changes and is refit otherwise, queries are issued in
+//		Morton order, and each vertex starts its search from the triangle
+//		it was closest to on the previous evaluation.
+//
 
 #include <maya/MIOStream.h>
 
@@ -25,17 +31,23 @@
 #include <maya/MDataBlock.h>
 #include <maya/MDataHandle.h>
 #include <maya/MPoint.h>
-#include <maya/MTimer.h>
 #include <maya/MFnMesh.h>
 #include <maya/MPointArray.h>
 #include <maya/MFnNumericAttribute.h>
 #include <maya/MFnTypedAttribute.h>
 #include <maya/MFnMeshData.h>
-#include <maya/MMeshIntersector.h>
+#include <maya/MIntArray.h>
+#include <maya/MProfiler.h>
 
 #include <maya/MThreadUtils.h>
 #include <tbb/blocked_range.h>
 #include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <map>
+#include <vector>
 
 // Macros
 //
@@ -45,6 +57,386 @@
 		return status;					\
 	}
 
+//======================================================================
+// Bounding volume hierarchy over the triangles of a mesh, used for
+// closest point queries. Nodes are stored depth first so that the left
+// child always directly follows its parent, which also means a reverse
+// walk over the nodes visits children before parents when refitting.
+//
+class TriangleBVH
+{
+public:
+	void	build(const float* points, unsigned int numPoints, const MIntArray& triangleVertices);
+	void	refit(const float* points, unsigned int numPoints);
+	bool	empty() const { return fNodes.empty(); }
+
+	// Returns the index of the closest triangle, or -1 if the hierarchy is
+	// empty. 'hint' is a triangle to seed the search with, or -1.
+	int		closestPoint(const double p[3], int hint, double result[3]) const;
+
+private:
+	struct Node
+	{
+		double	bmin[3];
+		double	bmax[3];
+		int		start;		// first triangle for leaves
+		int		count;		// number of triangles, 0 for inner nodes
+		int		right;		// right child for inner nodes
+	};
+
+	int		buildNode(int start, int count, std::vector<double>& centroids);
+	void	triangleBounds(int tri, double bmin[3], double bmax[3]) const;
+	double	closestOnTriangle(int tri, const double p[3], double result[3]) const;
+
+	std::vector<double>	fPoints;	// xyz triples
+	std::vector<int>	fTriangles;	// vertex triples, reordered by the build
+	std::vector<Node>	fNodes;
+
+	static const int kLeafSize = 4;
+};
+
+void TriangleBVH::build(const float* points, unsigned int numPoints, const MIntArray& triangleVertices)
+{
+	fPoints.assign(points, points + 3*numPoints);
+	fTriangles.resize(triangleVertices.length());
+	for(unsigned int i=0; i<triangleVertices.length(); ++i)
+		fTriangles[i] = triangleVertices[i];
+	fNodes.clear();
+
+	const int numTriangles = (int)(fTriangles.size() / 3);
+	if( numTriangles == 0 )
+		return;
+
+	std::vector<double> centroids(3*numTriangles);
+	for(int t=0; t<numTriangles; ++t)
+	{
+		for(int c=0; c<3; ++c)
+		{
+			centroids[3*t+c] = ( fPoints[3*fTriangles[3*t  ]+c] +
+								 fPoints[3*fTriangles[3*t+1]+c] +
+								 fPoints[3*fTriangles[3*t+2]+c] ) / 3.0;
+		}
+	}
+
+	fNodes.reserve(2*numTriangles/kLeafSize + 1);
+	buildNode(0, numTriangles, centroids);
+}
+
+int TriangleBVH::buildNode(int start, int count, std::vector<double>& centroids)
+{
+	const int index = (int)fNodes.size();
+	fNodes.push_back(Node());
+
+	double bmin[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+	double bmax[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+	double cmin[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+	double cmax[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+	for(int t=start; t<start+count; ++t)
+	{
+		double tmin[3], tmax[3];
+		triangleBounds(t, tmin, tmax);
+		for(int c=0; c<3; ++c)
+		{
+			bmin[c] = std::min(bmin[c], tmin[c]);
+			bmax[c] = std::max(bmax[c], tmax[c]);
+			cmin[c] = std::min(cmin[c], centroids[3*t+c]);
+			cmax[c] = std::max(cmax[c], centroids[3*t+c]);
+		}
+	}
+
+	Node node;
+	std::copy(bmin, bmin+3, node.bmin);
+	std::copy(bmax, bmax+3, node.bmax);
+	node.start = start;
+	node.count = count;
+	node.right = -1;
+
+	if( count > kLeafSize )
+	{
+		// Split at the centroid median of the widest axis. The triangles
+		// and their centroids are swapped together.
+		int axis = 0;
+		for(int c=1; c<3; ++c)
+			if( cmax[c]-cmin[c] > cmax[axis]-cmin[axis] ) axis = c;
+
+		std::vector<int> order(count);
+		for(int i=0; i<count; ++i) order[i] = start+i;
+		const int half = count/2;
+		std::nth_element(order.begin(), order.begin()+half, order.end(),
+						 [&](int a, int b) { return centroids[3*a+axis] < centroids[3*b+axis]; });
+
+		std::vector<int> tris(3*count);
+		std::vector<double> cents(3*count);
+		for(int i=0; i<count; ++i)
+		{
+			for(int c=0; c<3; ++c)
+			{
+				tris[3*i+c] = fTriangles[3*order[i]+c];
+				cents[3*i+c] = centroids[3*order[i]+c];
+			}
+		}
+		std::copy(tris.begin(), tris.end(), fTriangles.begin() + 3*start);
+		std::copy(cents.begin(), cents.end(), centroids.begin() + 3*start);
+
+		node.count = 0;
+		buildNode(start, half, centroids);
+		node.right = buildNode(start+half, count-half, centroids);
+	}
+
+	fNodes[index] = node;
+	return index;
+}
+
+void TriangleBVH::refit(const float* points, unsigned int numPoints)
+{
+	fPoints.assign(points, points + 3*numPoints);
+
+	for(int n=(int)fNodes.size()-1; n>=0; --n)
+	{
+		Node& node = fNodes[n];
+		if( node.count > 0 )
+		{
+			triangleBounds(node.start, node.bmin, node.bmax);
+			for(int t=node.start+1; t<node.start+node.count; ++t)
+			{
+				double tmin[3], tmax[3];
+				triangleBounds(t, tmin, tmax);
+				for(int c=0; c<3; ++c)
+				{
+					node.bmin[c] = std::min(node.bmin[c], tmin[c]);
+					node.bmax[c] = std::max(node.bmax[c], tmax[c]);
+				}
+			}
+		}
+		else
+		{
+			const Node& left = fNodes[n+1];
+			const Node& right = fNodes[node.right];
+			for(int c=0; c<3; ++c)
+			{
+				node.bmin[c] = std::min(left.bmin[c], right.bmin[c]);
+				node.bmax[c] = std::max(left.bmax[c], right.bmax[c]);
+			}
+		}
+	}
+}
+
+void TriangleBVH::triangleBounds(int tri, double bmin[3], double bmax[3]) const
+{
+	const double* a = &fPoints[3*fTriangles[3*tri  ]];
+	const double* b = &fPoints[3*fTriangles[3*tri+1]];
+	const double* c = &fPoints[3*fTriangles[3*tri+2]];
+	for(int i=0; i<3; ++i)
+	{
+		bmin[i] = std::min(a[i], std::min(b[i], c[i]));
+		bmax[i] = std::max(a[i], std::max(b[i], c[i]));
+	}
+}
+
+static inline double dot3(const double a[3], const double b[3])
+{
+	return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+// Closest point on a triangle, from Ericson's "Real-Time Collision
+// Detection". Returns the squared distance to 'p'.
+//
+double TriangleBVH::closestOnTriangle(int tri, const double p[3], double result[3]) const
+{
+	const double* a = &fPoints[3*fTriangles[3*tri  ]];
+	const double* b = &fPoints[3*fTriangles[3*tri+1]];
+	const double* c = &fPoints[3*fTriangles[3*tri+2]];
+
+	double ab[3], ac[3], ap[3];
+	for(int i=0; i<3; ++i) { ab[i] = b[i]-a[i]; ac[i] = c[i]-a[i]; ap[i] = p[i]-a[i]; }
+
+	double v = 0.0, w = 0.0;
+	const double d1 = dot3(ab, ap);
+	const double d2 = dot3(ac, ap);
+	if( d1 <= 0.0 && d2 <= 0.0 )
+	{
+		// vertex a
+	}
+	else
+	{
+		double bp[3];
+		for(int i=0; i<3; ++i) bp[i] = p[i]-b[i];
+		const double d3 = dot3(ab, bp);
+		const double d4 = dot3(ac, bp);
+		const double vc = d1*d4 - d3*d2;
+		if( d3 >= 0.0 && d4 <= d3 )
+		{
+			v = 1.0;
+		}
+		else if( vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0 )
+		{
+			v = d1 / (d1 - d3);
+		}
+		else
+		{
+			double cp[3];
+			for(int i=0; i<3; ++i) cp[i] = p[i]-c[i];
+			const double d5 = dot3(ab, cp);
+			const double d6 = dot3(ac, cp);
+			const double vb = d5*d2 - d1*d6;
+			const double va = d3*d6 - d5*d4;
+			if( d6 >= 0.0 && d5 <= d6 )
+			{
+				w = 1.0;
+			}
+			else if( vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0 )
+			{
+				w = d2 / (d2 - d6);
+			}
+			else if( va <= 0.0 && (d4-d3) >= 0.0 && (d5-d6) >= 0.0 )
+			{
+				w = (d4-d3) / ((d4-d3) + (d5-d6));
+				v = 1.0 - w;
+			}
+			else
+			{
+				const double denom = va + vb + vc;
+				if( denom > 0.0 )
+				{
+					v = vb / denom;
+					w = vc / denom;
+				}
+			}
+		}
+	}
+
+	double dist = 0.0;
+	for(int i=0; i<3; ++i)
+	{
+		result[i] = a[i] + v*ab[i] + w*ac[i];
+		const double d = p[i] - result[i];
+		dist += d*d;
+	}
+	return dist;
+}
+
+static inline double boxDistance(const double bmin[3], const double bmax[3], const double p[3])
+{
+	double dist = 0.0;
+	for(int i=0; i<3; ++i)
+	{
+		const double d = std::max(std::max(bmin[i] - p[i], 0.0), p[i] - bmax[i]);
+		dist += d*d;
+	}
+	return dist;
+}
+
+int TriangleBVH::closestPoint(const double p[3], int hint, double result[3]) const
+{
+	if( fNodes.empty() )
+		return -1;
+
+	int best = -1;
+	double bestDist = DBL_MAX;
+	if( hint >= 0 && hint < (int)(fTriangles.size()/3) )
+	{
+		bestDist = closestOnTriangle(hint, p, result);
+		best = hint;
+	}
+
+	int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+	while( top > 0 )
+	{
+		const Node& node = fNodes[stack[--top]];
+		if( boxDistance(node.bmin, node.bmax, p) >= bestDist )
+			continue;
+
+		if( node.count > 0 )
+		{
+			for(int t=node.start; t<node.start+node.count; ++t)
+			{
+				double candidate[3];
+				const double dist = closestOnTriangle(t, p, candidate);
+				if( dist < bestDist )
+				{
+					bestDist = dist;
+					best = t;
+					std::copy(candidate, candidate+3, result);
+				}
+			}
+		}
+		else
+		{
+			// Push the farther child first so the nearer one is visited next.
+			const int left = (int)(&node - &fNodes[0]) + 1;
+			const double dl = boxDistance(fNodes[left].bmin, fNodes[left].bmax, p);
+			const double dr = boxDistance(fNodes[node.right].bmin, fNodes[node.right].bmax, p);
+			if( dl < dr ) { stack[top++] = node.right; stack[top++] = left; }
+			else          { stack[top++] = left; stack[top++] = node.right; }
+		}
+	}
+	return best;
+}
+
+//======================================================================
+// Interleave the lower 10 bits of x, y and z into a 30 bit Morton code.
+//
+static inline unsigned int expandBits(unsigned int v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+static void mortonOrder(const MPointArray& points, std::vector<unsigned int>& order)
+{
+	const unsigned int n = points.length();
+	order.resize(n);
+	if( n == 0 )
+		return;
+
+	double bmin[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+	double bmax[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+	for(unsigned int i=0; i<n; ++i)
+	{
+		for(int c=0; c<3; ++c)
+		{
+			bmin[c] = std::min(bmin[c], points[i][c]);
+			bmax[c] = std::max(bmax[c], points[i][c]);
+		}
+	}
+	double scale[3];
+	for(int c=0; c<3; ++c)
+		scale[c] = (bmax[c] > bmin[c]) ? 1023.0 / (bmax[c] - bmin[c]) : 0.0;
+
+	std::vector<std::pair<unsigned int, unsigned int> > keys(n);
+	for(unsigned int i=0; i<n; ++i)
+	{
+		const unsigned int x = (unsigned int)((points[i].x - bmin[0]) * scale[0]);
+		const unsigned int y = (unsigned int)((points[i].y - bmin[1]) * scale[1]);
+		const unsigned int z = (unsigned int)((points[i].z - bmin[2]) * scale[2]);
+		keys[i].first = (expandBits(x) << 2) | (expandBits(y) << 1) | expandBits(z);
+		keys[i].second = i;
+	}
+	tbb::parallel_sort(keys.begin(), keys.end());
+	for(unsigned int i=0; i<n; ++i)
+		order[i] = keys[i].second;
+}
+
+// FNV-1a hash of a mesh's face counts and face vertex ids, so that faces
+// rewired without changing any count still rebuild the hierarchy.
+static unsigned int topologyHash(const MIntArray& counts, const MIntArray& connects)
+{
+	unsigned int hash = 2166136261u;
+	const MIntArray* arrays[2] = { &counts, &connects };
+	for(int a=0; a<2; ++a)
+	{
+		hash = (hash ^ arrays[a]->length()) * 16777619u;
+		for(unsigned int i=0; i<arrays[a]->length(); ++i)
+			hash = (hash ^ (unsigned int)(*arrays[a])[i]) * 16777619u;
+	}
+	return hash;
+}
+
 //======================================================================
 
 class splatDeformer : public MPxGeometryFilter
@@ -72,8 +464,22 @@ private:
 	// one child (as in DG evaluation) and the case of evaluating all children
 	// (as in EM evaluation).
 	MStatus computeOneOutput(unsigned int index, MDataBlock& data, MDataHandle& hInput);
+
+	// Acceleration structure for the deforming mesh, and the topology it
+	// was built for, so that it can be refit when only the points change.
+	TriangleBVH		fBVH;
+	int				fNumVertices = -1;
+	int				fNumPolygons = -1;
+	int				fNumFaceVertices = -1;
+	unsigned int	fTopology = 0;
+
+	// Closest triangle of each output point on the last evaluation, used
+	// to seed the next search.
+	std::map<unsigned int, std::vector<int> >	fLastTriangles;
 };
 
+static const int _profilerCategory = MProfiler::addCategory("splatDeformer", "Events from the splatDeformer closest point queries");
+
 //======================================================================
 
 MTypeId	splatDeformer::id( 0x8104D );
@@ -288,73 +694,107 @@ MStatus splatDeformer::computeOneOutput(unsigned int index, MDataBlock& data, MD
 
 	MItGeometry iter(outputData, lGroupId, false);
 
-	// create fast intersector structure
-	MMeshIntersector intersector;
-	intersector.create(dSurf);
-
 	// get all points at once. Faster to query, and also better for
 	// threading than using iterator
 	MPointArray verts;
 	iter.allPositions(verts);
 	unsigned int nPoints = verts.length();
 
+	// Build the closest point structure, or refit it if the deforming
+	// mesh topology has not changed since the last evaluation.
+	const float* deformPoints = fnDeformingMesh.getRawPoints(&status);
+	MCheckStatus(status, "ERROR getting deforming mesh points\n");
+	const int numVertices = fnDeformingMesh.numVertices();
+	const int numPolygons = fnDeformingMesh.numPolygons();
+	const int numFaceVertices = fnDeformingMesh.numFaceVertices();
+	MIntArray faceCounts, faceVertices;
+	fnDeformingMesh.getVertices(faceCounts, faceVertices);
+	const unsigned int topology = topologyHash(faceCounts, faceVertices);
+	if( fBVH.empty() || numVertices != fNumVertices ||
+		numPolygons != fNumPolygons || numFaceVertices != fNumFaceVertices ||
+		topology != fTopology )
+	{
+		MProfilingScope profilingScope(_profilerCategory, MProfiler::kColorE_L1, "Build BVH");
+		MIntArray triangleCounts, triangleVertices;
+		fnDeformingMesh.getTriangles(triangleCounts, triangleVertices);
+		fBVH.build(deformPoints, numVertices, triangleVertices);
+		fNumVertices = numVertices;
+		fNumPolygons = numPolygons;
+		fNumFaceVertices = numFaceVertices;
+		fTopology = topology;
+		fLastTriangles.clear();
+	}
+	else
+	{
+		MProfilingScope profilingScope(_profilerCategory, MProfiler::kColorE_L2, "Refit BVH");
+		fBVH.refit(deformPoints, numVertices);
+	}
+
+	std::vector<int>& lastTriangles = fLastTriangles[index];
+	if( lastTriangles.size() != nPoints )
+		lastTriangles.assign(nPoints, -1);
+
+	// Issue the queries in Morton order so that neighbouring queries walk
+	// the same parts of the hierarchy.
+	std::vector<unsigned int> order;
+	{
+		MProfilingScope profilingScope(_profilerCategory, MProfiler::kColorE_L3, "Sort queries");
+		mortonOrder(verts, order);
+	}
+
 	// use bool variable as lightweight object for failure check in loop below
 	volatile bool failed = false;
 
 	MDataHandle parallelEnabledData = data.inputValue(parallelEnabled, &status);
 	bool lParallelEnabled = (bool) parallelEnabledData.asBool();	
 
- 	MTimer timer; timer.beginTimer();
-	if( lParallelEnabled )
 	{
-		bool stop = false;
-		tbb::parallel_for( cancelable_range<unsigned int>(0,nPoints,nPoints/1000,stop),
-						   [&](const cancelable_range<unsigned int>& r)
+		MProfilingScope profilingScope(_profilerCategory, MProfiler::kColorD_L1,
+			lParallelEnabled ? "Closest point queries (parallel)" : "Closest point queries (serial)");
+
+		auto query = [&](unsigned int i) -> bool
+		{
+			double p[3] = { verts[i].x, verts[i].y, verts[i].z };
+			double result[3];
+			const int tri = fBVH.closestPoint(p, lastTriangles[i], result);
+			if( tri < 0 )
+				return false;
+			lastTriangles[i] = tri;
+			verts[i] = MPoint(result[0], result[1], result[2]);
+			return true;
+		};
+
+		if( lParallelEnabled )
 		{
-			// Iterate over subrange.  It is important that "<" be used for comparison,
-			// because the value of r.end() changes to r.begin() if r is cancelled.
-			for(unsigned int i = r.begin(); i < r.end(); ++i)
+			bool stop = false;
+			tbb::parallel_for( cancelable_range<unsigned int>(0,nPoints,std::max(nPoints/1000,1u),stop),
+							   [&](const cancelable_range<unsigned int>& r)
 			{
-				// mesh point object must be in loop-local scope to avoid race conditions
-				MPointOnMesh meshPoint;
-
-				// Do intersection. Need to use per-thread status value as
-				// MStatus has internal state and may trigger race conditions
-				// if set from multiple threads. Probably benign in this case,
-				// but worth being careful.
-				MStatus localStatus = intersector.getClosestPoint(verts[i], meshPoint);
-				if(localStatus != MStatus::kSuccess)
-				{
-					failed = true;
-					r.cancel();
-				}
-				else
+				// Iterate over subrange.  It is important that "<" be used for comparison,
+				// because the value of r.end() changes to r.begin() if r is cancelled.
+				for(unsigned int j = r.begin(); j < r.end(); ++j)
 				{
-					// default scheduling breaks traversal into large
-					// chunks, so low risk of false sharing here in array write.
-					verts[i] = meshPoint.getPoint();
+					if( !query(order[j]) )
+					{
+						failed = true;
+						r.cancel();
+					}
 				}
-			}
-		});
-	}
-	else
-	{
-		MPointOnMesh meshPoint;
-		for(unsigned int i=0; i<nPoints; ++i )
+			});
+		}
+		else
 		{
-			// Do intersection.
-			status = intersector.getClosestPoint(verts[i], meshPoint);
-			if(status != MStatus::kSuccess)
+			for(unsigned int j=0; j<nPoints; ++j )
 			{
-				failed = true;
-				break;
+				if( !query(order[j]) )
+				{
+					failed = true;
+					break;
+				}
 			}
-			verts[i] = meshPoint.getPoint();
 		}
 	}
 
- 	timer.endTimer(); printf("Runtime for %s loop %f\n", lParallelEnabled ? "parallel" : "serial", timer.elapsedTime() );
-
 	// write values back onto output using fast set method on iterator
 	iter.setAllPositions(verts);
 
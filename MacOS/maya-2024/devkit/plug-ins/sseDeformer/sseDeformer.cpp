@@ -18,6 +18,12 @@
 //		The weights are set using the set editor or the
 //		percent command.
 //
+//		When enableSSE is on, the points are staged into a reusable
+//		structure-of-arrays float buffer and processed in parallel
+//		chunks by the widest kernel the CPU supports (AVX-512, AVX2 or
+//		a plain loop). The sseDeformerBenchmark command reports the
+//		points/second of every kernel available on this machine.
+//
 
 #include <string.h>
 #include <float.h> // for FLT_MAX
@@ -53,6 +59,28 @@
 #include <maya/MFnTypedAttribute.h>
 #include <maya/MFnMeshData.h>
 #include <maya/MFloatVectorArray.h>
+#include <maya/MPxCommand.h>
+#include <maya/MArgList.h>
+#include <maya/MGlobal.h>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SSE_DEFORMER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SSE_DEFORMER_TARGET(isa)
+#else
+#define SSE_DEFORMER_TARGET(isa) __attribute__((target(isa)))
+#endif
+#else
+#define SSE_DEFORMER_X86 0
+#endif
 
 // Macros
 //
@@ -62,6 +90,287 @@
 		return status;					\
 	}
 
+//======================================================================
+//
+// Point kernels. Every kernel applies
+//
+//		v = env * cos(v) * sin(v) * tan(v)
+//
+// to a flat array of floats. The SIMD kernels evaluate sine and cosine
+// together with the single precision Cephes polynomials, so they only
+// match the scalar kernel to within float rounding.
+//
+enum SimdLevel
+{
+	kSimdScalar = 0,
+	kSimdAVX2,
+	kSimdAVX512,
+	kSimdLevelCount
+};
+
+typedef void (*PointKernel)(float* data, size_t count, float env);
+
+static const char* simdLevelName(SimdLevel level)
+{
+	switch(level) {
+		case kSimdAVX2:		return "AVX2";
+		case kSimdAVX512:	return "AVX-512";
+		default:			return "scalar";
+	}
+}
+
+static void kernelScalar(float* data, size_t count, float env)
+{
+	for(size_t i=0; i<count; i++) {
+		data[i] = env * (cosf(data[i]) * sinf(data[i]) * tanf(data[i]));
+	}
+}
+
+#if SSE_DEFORMER_X86
+
+// Range reduction constants and polynomial coefficients (Cephes sinf/cosf)
+#define SSE_DEFORMER_FOPI	1.27323954473516f	// 4 / PI
+#define SSE_DEFORMER_DP1	0.78515625f
+#define SSE_DEFORMER_DP2	2.4187564849853515625e-4f
+#define SSE_DEFORMER_DP3	3.77489497744594108e-8f
+#define SSE_DEFORMER_S0		-1.9515295891e-4f
+#define SSE_DEFORMER_S1		8.3321608736e-3f
+#define SSE_DEFORMER_S2		-1.6666654611e-1f
+#define SSE_DEFORMER_C0		2.443315711809948e-5f
+#define SSE_DEFORMER_C1		-1.388731625493765e-3f
+#define SSE_DEFORMER_C2		4.166664568298827e-2f
+
+SSE_DEFORMER_TARGET("avx2,fma")
+static inline __m256 kernelAVX2Value(__m256 x, __m256 env)
+{
+	const __m256i signMask = _mm256_set1_epi32(0x80000000);
+	__m256i xi = _mm256_castps_si256(x);
+	__m256i signSin = _mm256_and_si256(xi, signMask);
+	x = _mm256_castsi256_ps(_mm256_andnot_si256(signMask, xi));
+
+	// octant index, rounded up to an even value
+	__m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(SSE_DEFORMER_FOPI)));
+	j = _mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+	const __m256 y = _mm256_cvtepi32_ps(j);
+
+	signSin = _mm256_xor_si256(signSin, _mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(4)), 29));
+	const __m256i signCos = _mm256_slli_epi32(
+		_mm256_andnot_si256(_mm256_sub_epi32(j, _mm256_set1_epi32(2)), _mm256_set1_epi32(4)), 29);
+	const __m256 polyMask = _mm256_castsi256_ps(
+		_mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(2)), _mm256_setzero_si256()));
+
+	x = _mm256_fnmadd_ps(y, _mm256_set1_ps(SSE_DEFORMER_DP1), x);
+	x = _mm256_fnmadd_ps(y, _mm256_set1_ps(SSE_DEFORMER_DP2), x);
+	x = _mm256_fnmadd_ps(y, _mm256_set1_ps(SSE_DEFORMER_DP3), x);
+	const __m256 z = _mm256_mul_ps(x, x);
+
+	__m256 pc = _mm256_set1_ps(SSE_DEFORMER_C0);
+	pc = _mm256_fmadd_ps(pc, z, _mm256_set1_ps(SSE_DEFORMER_C1));
+	pc = _mm256_fmadd_ps(pc, z, _mm256_set1_ps(SSE_DEFORMER_C2));
+	pc = _mm256_mul_ps(pc, _mm256_mul_ps(z, z));
+	pc = _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), z, pc);
+	pc = _mm256_add_ps(pc, _mm256_set1_ps(1.0f));
+
+	__m256 ps = _mm256_set1_ps(SSE_DEFORMER_S0);
+	ps = _mm256_fmadd_ps(ps, z, _mm256_set1_ps(SSE_DEFORMER_S1));
+	ps = _mm256_fmadd_ps(ps, z, _mm256_set1_ps(SSE_DEFORMER_S2));
+	ps = _mm256_fmadd_ps(_mm256_mul_ps(ps, z), x, x);
+
+	__m256 s = _mm256_blendv_ps(pc, ps, polyMask);
+	__m256 c = _mm256_blendv_ps(ps, pc, polyMask);
+	s = _mm256_xor_ps(s, _mm256_castsi256_ps(signSin));
+	c = _mm256_xor_ps(c, _mm256_castsi256_ps(signCos));
+
+	const __m256 t = _mm256_div_ps(s, c);
+	return _mm256_mul_ps(env, _mm256_mul_ps(_mm256_mul_ps(c, s), t));
+}
+
+SSE_DEFORMER_TARGET("avx2,fma")
+static void kernelAVX2(float* data, size_t count, float env)
+{
+	const __m256 vEnv = _mm256_set1_ps(env);
+	size_t i = 0;
+	for(; i+8<=count; i+=8) {
+		_mm256_storeu_ps(data+i, kernelAVX2Value(_mm256_loadu_ps(data+i), vEnv));
+	}
+	kernelScalar(data+i, count-i, env);
+}
+
+SSE_DEFORMER_TARGET("avx512f")
+static inline __m512 kernelAVX512Value(__m512 x, __m512 env)
+{
+	const __m512i signMask = _mm512_set1_epi32(0x80000000);
+	__m512i xi = _mm512_castps_si512(x);
+	__m512i signSin = _mm512_and_si512(xi, signMask);
+	x = _mm512_castsi512_ps(_mm512_andnot_si512(signMask, xi));
+
+	// octant index, rounded up to an even value
+	__m512i j = _mm512_cvttps_epi32(_mm512_mul_ps(x, _mm512_set1_ps(SSE_DEFORMER_FOPI)));
+	j = _mm512_and_si512(_mm512_add_epi32(j, _mm512_set1_epi32(1)), _mm512_set1_epi32(~1));
+	const __m512 y = _mm512_cvtepi32_ps(j);
+
+	signSin = _mm512_xor_si512(signSin, _mm512_slli_epi32(_mm512_and_si512(j, _mm512_set1_epi32(4)), 29));
+	const __m512i signCos = _mm512_slli_epi32(
+		_mm512_andnot_si512(_mm512_sub_epi32(j, _mm512_set1_epi32(2)), _mm512_set1_epi32(4)), 29);
+	const __mmask16 polyMask = _mm512_cmpeq_epi32_mask(
+		_mm512_and_si512(j, _mm512_set1_epi32(2)), _mm512_setzero_si512());
+
+	x = _mm512_fnmadd_ps(y, _mm512_set1_ps(SSE_DEFORMER_DP1), x);
+	x = _mm512_fnmadd_ps(y, _mm512_set1_ps(SSE_DEFORMER_DP2), x);
+	x = _mm512_fnmadd_ps(y, _mm512_set1_ps(SSE_DEFORMER_DP3), x);
+	const __m512 z = _mm512_mul_ps(x, x);
+
+	__m512 pc = _mm512_set1_ps(SSE_DEFORMER_C0);
+	pc = _mm512_fmadd_ps(pc, z, _mm512_set1_ps(SSE_DEFORMER_C1));
+	pc = _mm512_fmadd_ps(pc, z, _mm512_set1_ps(SSE_DEFORMER_C2));
+	pc = _mm512_mul_ps(pc, _mm512_mul_ps(z, z));
+	pc = _mm512_fnmadd_ps(_mm512_set1_ps(0.5f), z, pc);
+	pc = _mm512_add_ps(pc, _mm512_set1_ps(1.0f));
+
+	__m512 ps = _mm512_set1_ps(SSE_DEFORMER_S0);
+	ps = _mm512_fmadd_ps(ps, z, _mm512_set1_ps(SSE_DEFORMER_S1));
+	ps = _mm512_fmadd_ps(ps, z, _mm512_set1_ps(SSE_DEFORMER_S2));
+	ps = _mm512_fmadd_ps(_mm512_mul_ps(ps, z), x, x);
+
+	__m512 s = _mm512_mask_blend_ps(polyMask, pc, ps);
+	__m512 c = _mm512_mask_blend_ps(polyMask, ps, pc);
+	s = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(s), signSin));
+	c = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(c), signCos));
+
+	const __m512 t = _mm512_div_ps(s, c);
+	return _mm512_mul_ps(env, _mm512_mul_ps(_mm512_mul_ps(c, s), t));
+}
+
+SSE_DEFORMER_TARGET("avx512f")
+static void kernelAVX512(float* data, size_t count, float env)
+{
+	const __m512 vEnv = _mm512_set1_ps(env);
+	size_t i = 0;
+	for(; i+16<=count; i+=16) {
+		_mm512_storeu_ps(data+i, kernelAVX512Value(_mm512_loadu_ps(data+i), vEnv));
+	}
+	if(i < count) {
+		// masked tail, so there is no scalar remainder loop
+		const __mmask16 tail = (__mmask16)((1u << (count-i)) - 1u);
+		const __m512 x = _mm512_maskz_loadu_ps(tail, data+i);
+		_mm512_mask_storeu_ps(data+i, tail, kernelAVX512Value(x, vEnv));
+	}
+}
+
+#endif // SSE_DEFORMER_X86
+
+// Returns whether the CPU and the OS both support the given level.
+//
+static bool simdLevelSupported(SimdLevel level)
+{
+	if(level == kSimdScalar) return true;
+#if SSE_DEFORMER_X86
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool fma = (info[2] & (1 << 12)) != 0;
+	if(!osxsave) return false;
+	const unsigned long long xcr0 = _xgetbv(0);
+	__cpuidex(info, 7, 0);
+	if(level == kSimdAVX2)
+		return fma && (info[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6;
+	if(level == kSimdAVX512)
+		return (info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6;
+#else
+	__builtin_cpu_init();
+	if(level == kSimdAVX2)
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	if(level == kSimdAVX512)
+		return __builtin_cpu_supports("avx512f");
+#endif
+#endif
+	return false;
+}
+
+static PointKernel simdKernel(SimdLevel level)
+{
+#if SSE_DEFORMER_X86
+	if(level == kSimdAVX512) return kernelAVX512;
+	if(level == kSimdAVX2) return kernelAVX2;
+#endif
+	return kernelScalar;
+}
+
+// Widest supported level, detected once.
+//
+static SimdLevel bestSimdLevel()
+{
+	static const SimdLevel level =
+		simdLevelSupported(kSimdAVX512) ? kSimdAVX512 :
+		simdLevelSupported(kSimdAVX2) ? kSimdAVX2 : kSimdScalar;
+	return level;
+}
+
+// Runs 'kernel' over 'count' floats in parallel chunks. Chunks are a
+// multiple of 64 floats so that no two threads write the same cache line.
+//
+static void runKernel(PointKernel kernel, float* data, size_t count, float env)
+{
+	const size_t chunk = 64;
+	const size_t numChunks = (count + chunk - 1) / chunk;
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, numChunks, 256),
+					  [&](const tbb::blocked_range<size_t>& r)
+	{
+		const size_t begin = r.begin() * chunk;
+		const size_t end = std::min(r.end() * chunk, count);
+		kernel(data + begin, end - begin, env);
+	});
+}
+
+//======================================================================
+//
+// Structure-of-arrays staging buffer, one 64 byte aligned plane per
+// coordinate. The storage only grows, so once it has been sized for a
+// mesh no further allocations happen on evaluation.
+//
+class SoAStaging
+{
+public:
+	void resize(size_t numPoints)
+	{
+		// round each plane up to a multiple of 16 floats to keep them aligned
+		fStride = (numPoints + 15) & ~size_t(15);
+		if(fStorage.size() < 3*fStride + 16) {
+			fStorage.resize(3*fStride + 16);
+		}
+		const size_t misalign = (reinterpret_cast<size_t>(fStorage.data()) / sizeof(float)) & 15;
+		fData = fStorage.data() + ((16 - misalign) & 15);
+	}
+
+	float* plane(int axis) { return fData + axis*fStride; }
+	float* data() { return fData; }
+	size_t stride() const { return fStride; }
+
+	void gather(const MFloatPointArray& pts)
+	{
+		const unsigned int n = pts.length();
+		float* px = plane(0); float* py = plane(1); float* pz = plane(2);
+		for(unsigned int i=0; i<n; i++) {
+			px[i] = pts[i].x; py[i] = pts[i].y; pz[i] = pts[i].z;
+		}
+	}
+
+	void scatter(MFloatPointArray& pts)
+	{
+		const unsigned int n = pts.length();
+		const float* px = plane(0); const float* py = plane(1); const float* pz = plane(2);
+		for(unsigned int i=0; i<n; i++) {
+			pts[i].x = px[i]; pts[i].y = py[i]; pts[i].z = pz[i];
+		}
+	}
+
+private:
+	std::vector<float>	fStorage;
+	float*				fData = nullptr;
+	size_t				fStride = 0;
+};
+
 //======================================================================
 
 class sseDeformer : public MPxGeometryFilter
@@ -88,6 +397,9 @@ private:
 	// one child (as in DG evaluation) and the case of evaluating all children
 	// (as in EM evaluation).
 	MStatus computeOneOutput(unsigned int index, MDataBlock& data, MDataHandle& hInput);
+
+	// Reused across evaluations to avoid per-compute allocations
+	SoAStaging	fStaging;
 };
 
 //======================================================================
@@ -250,17 +562,17 @@ MStatus sseDeformer::computeOneOutput(unsigned int index, MDataBlock& data, MDat
 	// to check for vectorization status messages with Intel compiler.
  	MTimer timer; timer.beginTimer();
 
+	const SimdLevel level = bestSimdLevel();
 	if(sseEnabled) {
 
-		// Innter loop will autovectorize. Around 3x faster than the
-		// loop below it. It would be faster if first element was
-		// guaranteed to be aligned on 16 byte boundary.
-		for(int i=0; i<nPoints; i++) {
-			float* ptPtr = &pts[i].x;
-			for(int j=0; j<4; j++) {
-				ptPtr[j] = env * (cosf(ptPtr[j]) * sinf(ptPtr[j]) * tanf(ptPtr[j]));
-			}
+		// Stage the x, y and z planes contiguously (dropping w) so the
+		// kernels see one flat float array, then process it in parallel.
+		fStaging.resize(nPoints);
+		fStaging.gather(pts);
+		for(int axis=0; axis<3; axis++) {
+			runKernel(simdKernel(level), fStaging.plane(axis), nPoints, env);
 		}
+		fStaging.scatter(pts);
 
 	} else {
 
@@ -276,9 +588,9 @@ MStatus sseDeformer::computeOneOutput(unsigned int index, MDataBlock& data, MDat
 
  	timer.endTimer(); 
 	if(sseEnabled) {
-		printf("SSE enabled, runtime %f\n", timer.elapsedTime());
+		printf("SIMD enabled (%s), runtime %f\n", simdLevelName(level), timer.elapsedTime());
 	} else {
-		printf("SSE disabled, runtime %f\n", timer.elapsedTime());
+		printf("SIMD disabled, runtime %f\n", timer.elapsedTime());
 	}
 
 	outMesh.setPoints(pts);
@@ -296,6 +608,75 @@ MStatus sseDeformer::computeOneOutput(unsigned int index, MDataBlock& data, MDat
 	return status;
 }
 
+//======================================================================
+//
+// sseDeformerBenchmark [numPoints] [iterations]
+//
+// Runs every point kernel supported on this machine over a synthetic
+// buffer and reports the throughput of each in points/second.
+//
+class sseDeformerBenchmark : public MPxCommand
+{
+public:
+	MStatus		doIt(const MArgList& args) override;
+	static void* creator() { return new sseDeformerBenchmark(); }
+};
+
+MStatus sseDeformerBenchmark::doIt(const MArgList& args)
+{
+	MStatus status;
+	int numPoints = 1000000;
+	int iterations = 10;
+	if(args.length() > 0) {
+		numPoints = args.asInt(0, &status);
+		MCheckStatus(status, "ERROR: numPoints must be an integer\n");
+	}
+	if(args.length() > 1) {
+		iterations = args.asInt(1, &status);
+		MCheckStatus(status, "ERROR: iterations must be an integer\n");
+	}
+	if(numPoints <= 0 || iterations <= 0) {
+		displayError("sseDeformerBenchmark: numPoints and iterations must be positive");
+		return MStatus::kInvalidParameter;
+	}
+
+	SoAStaging staging;
+	staging.resize(numPoints);
+	const size_t count = 3*staging.stride();
+
+	clearResult();
+	for(int l=kSimdScalar; l<kSimdLevelCount; l++) {
+		const SimdLevel level = (SimdLevel)l;
+		if(!simdLevelSupported(level)) {
+			continue;
+		}
+
+		double elapsed = 0.0;
+		for(int it=0; it<iterations; it++) {
+			// refill each pass so every kernel sees the same input
+			float* data = staging.data();
+			for(size_t i=0; i<count; i++) {
+				data[i] = (float)(i % 1000) * 0.001f;
+			}
+
+			MTimer timer; timer.beginTimer();
+			runKernel(simdKernel(level), data, count, 1.0f);
+			timer.endTimer();
+			elapsed += timer.elapsedTime();
+		}
+
+		const double pointsPerSecond = (elapsed > 0.0) ? (double)numPoints * iterations / elapsed : 0.0;
+		MString msg;
+		msg.format("sseDeformerBenchmark: ^1s kernel, ^2s points/second",
+				   MString(simdLevelName(level)), MString() + pointsPerSecond);
+		MGlobal::displayInfo(msg);
+		appendToResult(MString(simdLevelName(level)));
+		appendToResult(pointsPerSecond);
+	}
+
+	return MStatus::kSuccess;
+}
+
 //======================================================================
 //
 // standard initialization procedures
@@ -306,6 +687,9 @@ MStatus initializePlugin( MObject obj )
 	MFnPlugin plugin( obj, PLUGIN_COMPANY, "1.0", "Any");
 	result = plugin.registerNode( "sseDeformer", sseDeformer::id, sseDeformer::creator, 
 								  sseDeformer::initialize, MPxNode::kDeformerNode );
+	MCheckStatus(result, "ERROR registering sseDeformer\n");
+
+	result = plugin.registerCommand( "sseDeformerBenchmark", sseDeformerBenchmark::creator );
 
 	return result;
 }
@@ -316,6 +700,9 @@ MStatus uninitializePlugin( MObject obj)
 {
 	MStatus result;
 	MFnPlugin plugin( obj );
+	result = plugin.deregisterCommand( "sseDeformerBenchmark" );
+	MCheckStatus(result, "ERROR deregistering sseDeformerBenchmark\n");
+
 	result = plugin.deregisterNode( sseDeformer::id );
 	return result;
 }
@@ -18,6 +18,10 @@
 // In image reading menu dialogs of Maya, you can select *.* to see all images
 // and then retrieve a tiff extension file item to load the .tif file into Maya.
 //
+// Scan lines are decoded straight into bands of rows, see
+// floatImageRegionReader.h, so any region of the image can be read
+// through readRegion() and the decoded bands of partial reads are cached.
+//
 ///////////////////////////////////////////////////////////////////
 
 #include <maya/MPxImageFile.h>
@@ -33,11 +37,13 @@
 #include "tiff.h"
 #include "tiffio.h"
 
+#include "floatImageRegionReader.h"
+
 MString kImagePluginName( "TIFF Float Reader");
 
 #define _TIFF_SUCCESS	1
 
-class tiffFloatReader : public MPxImageFile
+class tiffFloatReader : public MPxImageFile, public FloatImageRegionReader
 {
 public:
 			tiffFloatReader();
@@ -47,12 +53,21 @@ public:
 	MStatus load( MImage& image, unsigned int idx) override;
 	MStatus close() override;
 
+	// FloatImageRegionReader, a single level
+	unsigned int	levelWidth( unsigned int ) const override { return fWidth; }
+	unsigned int	levelHeight( unsigned int ) const override { return fHeight; }
+	unsigned int	numChannels() const override { return fChannels; }
+	bool			readRows( unsigned int level, unsigned int y, unsigned int count,
+							  float* dst, size_t rowStride ) override;
+	std::string		cacheKey() const override { return fCacheKey; }
+
 protected:
 	unsigned int	fWidth;				// Width
 	unsigned int	fHeight;			// Height
 	unsigned int	fChannels;			// Number of channels
 
 	TIFF			*fInputFile;		// Tif interface
+	std::string		fCacheKey;			// Identifies the file for the band cache
 };
 
 //
@@ -162,6 +177,8 @@ MStatus tiffFloatReader::open( MString pathname, MImageFileInfo* info)
 	}
 #endif
 
+	fCacheKey = fileCacheKey( pathname.asChar() );
+
 	//printf("Opened tif file successfully: w=%d,h=%d, ch=%d\n",
 	//	fWidth, fHeight, fChannels );
 
@@ -192,9 +209,29 @@ MStatus tiffFloatReader::close()
 	if (fInputFile)
 		TIFFClose( fInputFile );
 	fInputFile = NULL;
+	fCacheKey.clear();
 	return MS::kSuccess;
 }
 
+//
+// DESCRIPTION:
+//		Decode scan lines, top-to-bottom as stored in the file, straight
+//		into dst.
+///////////////////////////////////////////////////////
+bool tiffFloatReader::readRows( unsigned int level, unsigned int y, unsigned int count,
+								float* dst, size_t rowStride )
+{
+	if (!fInputFile || level != 0)
+		return false;
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (TIFFReadScanline( fInputFile, dst + i * rowStride, y + i ) < 0)
+			return false;
+	}
+	return true;
+}
+
 //
 // DESCRIPTION:
 //		Load the image into system memory (MImage)
@@ -213,26 +250,12 @@ MStatus tiffFloatReader::load( MImage& image, unsigned int imageNumber)
 		return rval;
 	
 	// Maya expects images upside down
-	unsigned int row = 0;
 	bool flipVertically = true;
-	if (flipVertically)
-	{
-		outputBuffer += (fHeight-1) * (fWidth * fChannels);
-		for (row = 0; row < fHeight; row++)
-		{
-			TIFFReadScanline (fInputFile, outputBuffer, row);
-			outputBuffer -= (fWidth * fChannels);
-		}
-	}
-	else
+	if (readRegion( 0, 0, 0, fWidth, fHeight, outputBuffer,
+					(size_t)fWidth * fChannels, flipVertically ))
 	{
-		for (row = 0; row < fHeight; row++)
-		{
-			TIFFReadScanline (fInputFile, outputBuffer, row);
-			outputBuffer += (fWidth * fChannels);
-		}
+		rval = MS::kSuccess;
 	}
-	rval = MS::kSuccess;
 
 	return rval;
 }
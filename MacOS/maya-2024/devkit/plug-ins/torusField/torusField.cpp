@@ -26,12 +26,16 @@
 #include <math.h>
 
 #include "torusField.h"
+#include "torusFieldGrid.h"
 
 #include <maya/MTime.h>
 #include <maya/MVectorArray.h>
 #include <maya/MDoubleArray.h>
 #include <maya/MMatrix.h>
 #include <maya/MArrayDataBuilder.h>
+#include <maya/MArgList.h>
+#include <maya/MGlobal.h>
+#include <maya/MTimer.h>
 
 #include <maya/MFnDependencyNode.h>
 #include <maya/MFnTypedAttribute.h>
@@ -42,6 +46,10 @@
 #include <maya/MFnDoubleArrayData.h>
 #include <maya/MFnMatrixData.h>
 
+#include <algorithm>
+#include <random>
+#include <tbb/parallel_for.h>
+
 
 MObject torusField::aMinDistance;
 MObject torusField::aAttractDistance;
@@ -245,13 +253,9 @@ void torusField::applyNoMaxDist
 
 	// get field parameters.
 	//
-	double magValue = magnitudeValue( block );
-	// double attenValue = attenuationValue( block );
-	double minDist = minDistanceValue( block );
-	double attractDist = attractDistanceValue( block );
-	double repelDist = repelDistanceValue( block );
-	double dragMag = dragValue( block );
-	double swarmAmp = swarmAmplitudeValue( block );
+	torusFieldParams params;
+	std::vector<double> falloffTable;
+	getParams( block, params, falloffTable );
 
 	// get owner's data. posArray may have only one point which is the centroid
 	// (if this has owner) or field position(if without owner). Or it may have
@@ -261,350 +265,272 @@ void torusField::applyNoMaxDist
 	posArray.clear();
 	ownerPosition( block, posArray );
 
-	int fieldPosCount = posArray.length();
-	int receptorSize = points.length();
+	computeNoMaxDist( params, points, velocities, posArray, outputForce );
+}
 
-	// With this model,if max distance isn't set then we
-	// also don't attenuate, because 1 - dist/maxDist isn't
-	// meaningful. No max distance and no attenuation.
+
+void torusField::applyMaxDist
+	(
+		MDataBlock& block,				// get field param from this block
+		const MVectorArray &points,		// current position of Object
+		const MVectorArray &velocities,	// current velocity of Object
+		const MDoubleArray &/*masses*/,		// mass of Object
+		MVectorArray &outputForce		// output force
+	)
+//
+//	Descriptions:
+//		Compute output force in the case that the useMaxDistance is set.
+//
+{
+	// points and velocities should have the same length. If not return.
 	//
-	if (dragMag <= 0)
-	{
-		if (swarmAmp <= 0)
-		{
-			// No max dist, no attenuation, no drag, no swarm
-			//
-			for (int ptIndex = 0; ptIndex < receptorSize; ptIndex ++ )
-			{
-				MVector forceV(0.0,0.0,0.0);
-				const MVector &receptorPoint = points[ptIndex];
+	if( points.length() != velocities.length() )
+		return;
 
-				// Apply from every field position to every receptor position.
-				//
-				for(int i = fieldPosCount; --i>=0; )
-				{
-					MVector difference = (receptorPoint-posArray[i]);
+	// clear the output force array.
+	//
+	outputForce.clear();
 
-					double distance = difference.length();
-					if (distance < minDist) continue;
+	// get field parameters.
+	//
+	torusFieldParams params;
+	std::vector<double> falloffTable;
+	getParams( block, params, falloffTable );
 
-					if (distance <= repelDist)
-						forceV += difference * magValue;
-					else if (distance >= attractDist)
-						forceV += -difference * magValue;
-				}
-				outputForce.append( forceV );
-			}
-		}
-		else
-		{
-			// No max dist, no attenuation, no drag, yes swarm
-			//
-			for (int ptIndex = 0; ptIndex < receptorSize; ptIndex ++ )
-			{
-				MVector forceV(0.0,0.0,0.0);
-				const MVector &receptorPoint = points[ptIndex];
+	// get owner's data. posArray may have only one point which is the centroid
+	// (if this has owner) or field position(if without owner). Or it may have
+	// a list of points if with owner and applyPerVertex.
+	//
+	MVectorArray posArray;
+	posArray.clear();
+	ownerPosition( block, posArray );
 
-				// Apply from every field position to every receptor position.
-				//
-				double distance = 0.0;
-				int i;
-				for(i = fieldPosCount; --i>=0; )
-				{
-					MVector difference = (receptorPoint-posArray[i]);
-					distance = difference.length();
-					if (distance < minDist) continue;
+	computeMaxDist( params, points, velocities, posArray, outputForce );
+}
 
-					if (distance <= repelDist)
-						forceV += difference * magValue;
-					else if (distance >= attractDist)
-						forceV += -difference * magValue;
-				}
 
-				// Apply swarm only if the object is inside the zone
-				// the repulsion-attraction is pushing the object to.
-				//
-				if ( distance >= repelDist && distance <= attractDist)
-				{
-					double frequency = swarmFrequencyValue( block );
-					MVector phase( 0.0, 0.0, swarmPhaseValue(block) );
+void torusField::getParams
+	(
+		MDataBlock& block,
+		torusFieldParams &params,
+		std::vector<double> &falloffTable
+	)
+//
+//	Descriptions:
+//		Read the field parameters from the block. The falloff curve is
+//		sampled into falloffTable since it can not be evaluated from the
+//		worker threads.
+//
+{
+	params.magnitude = magnitudeValue( block );
+	params.attenuation = attenuationValue( block );
+	params.maxDistance = maxDistanceValue( block );
+	params.minDistance = minDistanceValue( block );
+	params.attractDistance = attractDistanceValue( block );
+	params.repelDistance = repelDistanceValue( block );
+	params.drag = dragValue( block );
+	params.swarmAmplitude = swarmAmplitudeValue( block );
+	params.swarmFrequency = 0.0;
+	params.swarmPhase = MVector( 0.0, 0.0, 0.0 );
+	if( params.swarmAmplitude > 0 )
+	{
+		params.swarmFrequency = swarmFrequencyValue( block );
+		params.swarmPhase.z = swarmPhaseValue( block );
+	}
 
-					// Add swarm in here
-					//
-					for(i = fieldPosCount; --i >= 0;)
-					{
-						MVector difference = receptorPoint - posArray[i];
-						difference = (difference + phase) * frequency;
-
-						double *noiseEffect = &difference.x;
-						if( (noiseEffect[0] < -2147483647.0) ||
-							(noiseEffect[0] >  2147483647.0) ||
-							(noiseEffect[1] < -2147483647.0) ||
-							(noiseEffect[1] >  2147483647.0) ||
-							(noiseEffect[2] < -2147483647.0) ||
-							(noiseEffect[2] >  2147483647.0) )
-							continue;
-
-						double noiseOut[4];
-						noiseFunction( noiseEffect, noiseOut );
-			 			MVector swarmForce( noiseOut[0] * swarmAmp,
-											noiseOut[1] * swarmAmp,
-											noiseOut[2] * swarmAmp );
-						forceV += swarmForce;
-					}
-				}
-				outputForce.append( forceV );
-			}
-		}
+	params.falloff = NULL;
+	if( params.maxDistance > 0.0 && !isFalloffCurveConstantOne() )
+	{
+		falloffTable.resize( kFalloffSamples + 1 );
+		for( int i = 0; i <= kFalloffSamples; i ++ )
+			falloffTable[i] = falloffCurve( (double)i / kFalloffSamples );
+		params.falloff = &falloffTable[0];
 	}
-	else
+}
+
+
+void torusField::computeNoMaxDist
+	(
+		const torusFieldParams &params,
+		const MVectorArray &points,		// current position of Object
+		const MVectorArray &velocities,	// current velocity of Object
+		const MVectorArray &posArray,	// owner positions
+		MVectorArray &outputForce		// output force
+	)
+//
+//	Descriptions:
+//		Without a max distance every owner further than attractDistance
+//		pulls the receptor in, so the force is unbounded in range. The
+//		pull of all owners is summed from their count and centroid, and
+//		only the owners within reach of the other thresholds are looked
+//		up in the grid to replace their share of it with the real force.
+//
+{
+	double magValue = params.magnitude;
+	double minDist = params.minDistance;
+	double attractDist = params.attractDistance;
+	double repelDist = params.repelDistance;
+	double dragMag = params.drag;
+	double swarmAmp = params.swarmAmplitude;
+
+	int fieldPosCount = posArray.length();
+	int receptorSize = points.length();
+
+	outputForce.setLength( receptorSize );
+	if( fieldPosCount == 0 )
 	{
-		if (swarmAmp <= 0)
-		{
-			// Yes drag, no swarm
-			//
-			for (int ptIndex = 0; ptIndex < receptorSize; ptIndex ++ )
-			{
-				const MVector& receptorPoint = points[ptIndex];
+		for (int ptIndex = 0; ptIndex < receptorSize; ptIndex ++ )
+			outputForce[ptIndex] = MVector( 0.0, 0.0, 0.0 );
+		return;
+	}
 
-				// Apply from every field position to every receptor position.
-				//
-				MVector forceV(0,0,0);
-				double distance = 0.0;
-				for(int i = fieldPosCount; --i>=0; )
-				{
-					MVector difference = (receptorPoint-posArray[i]);
-					distance = difference.length();
-					if (distance < minDist) continue;
+	// Owners further than nearDist can only attract.
+	//
+	double nearDist = minDist;
+	if( repelDist > nearDist ) nearDist = repelDist;
+	if( attractDist > nearDist ) nearDist = attractDist;
 
-					if (distance <= repelDist)
-						forceV += difference * magValue;
-					else if (distance >= attractDist)
-						forceV += -difference * magValue;
-				}
+	torusFieldGrid grid;
+	if( nearDist >= 0.0 )
+		grid.build( posArray, nearDist );
 
-				// Apply drag only if the object is inside the zone
-				// the repulsion-attraction is pushing the object to.
-				//
-				if ( distance >= repelDist && distance <= attractDist)
-				{
-					if (fieldPosCount > 0)
-					{
-						MVector dragForceV;
-						dragForceV = velocities[ptIndex] *
-												(-dragMag) * fieldPosCount;
-						forceV += dragForceV;
-					}
-				}
+	MVector ownerSum( 0.0, 0.0, 0.0 );
+	for( int i = 0; i < fieldPosCount; i ++ )
+		ownerSum += posArray[i];
 
-				outputForce.append( forceV );
-			}
-		}
-		else
+	// With this model,if max distance isn't set then we
+	// also don't attenuate, because 1 - dist/maxDist isn't
+	// meaningful. No max distance and no attenuation.
+	//
+	tbb::parallel_for( tbb::blocked_range<int>( 0, receptorSize, 256 ),
+		[&]( const tbb::blocked_range<int> &range )
+	{
+		for( int ptIndex = range.begin(); ptIndex != range.end(); ptIndex ++ )
 		{
-			// Yes drag, yes swarm
+			MVector forceV(0.0,0.0,0.0);
+			const MVector &receptorPoint = points[ptIndex];
+
+			// Apply from the owners close enough to repel or be ignored.
 			//
-			for (int ptIndex = 0; ptIndex < receptorSize; ptIndex ++ )
+			MVector nearSum( 0.0, 0.0, 0.0 );
+			int nearCount = 0;
+			if( nearDist >= 0.0 )
 			{
-				const MVector &receptorPoint = points[ptIndex];
-
-				// Apply from every field position to every receptor position.
-				//
-				MVector forceV(0,0,0);
-				double distance = 0.0;
-				int i;
-				for(i = fieldPosCount; --i>=0; )
+				grid.forEachNear( receptorPoint, nearDist, [&]( unsigned int i )
 				{
 					MVector difference = (receptorPoint-posArray[i]);
-					distance = difference.length();
-					if (distance < minDist) continue;
+					double distance = difference.length();
+					if (distance > nearDist) return;
+
+					nearSum += posArray[i];
+					nearCount ++;
+					if (distance < minDist) return;
 
 					if (distance <= repelDist)
 						forceV += difference * magValue;
 					else if (distance >= attractDist)
 						forceV += -difference * magValue;
+				});
+			}
+
+			// and attract from all the others at once.
+			//
+			int farCount = fieldPosCount - nearCount;
+			if( farCount > 0 )
+				forceV += -(receptorPoint * farCount - (ownerSum - nearSum)) * magValue;
+
+			// Apply drag and swarm only if the object is inside
+			// the zone the repulsion-attraction is pushing the object to.
+			// The zone test has always used the distance to the first
+			// owner, which was the last one the force loop visited.
+			//
+			double distance = (receptorPoint - posArray[0]).length();
+			if ( distance >= repelDist && distance <= attractDist)
+			{
+				if (dragMag > 0)
+				{
+					MVector dragForceV;
+					dragForceV = velocities[ptIndex] *
+											(-dragMag) * fieldPosCount;
+					forceV += dragForceV;
 				}
 
-				// Apply drag and swarm only if the object is inside
-				// the zone the repulsion-attraction is pushing the object to.
+				// Add swarm in here
 				//
-				if ( distance >= repelDist && distance <= attractDist)
+				if (swarmAmp > 0)
 				{
-					if (fieldPosCount > 0)
-					{
-						MVector dragForceV;
-						dragForceV = velocities[ptIndex] *
-												(-dragMag) * fieldPosCount;
-						forceV += dragForceV;
-					}
-
-					// Add swarm in here
-					//
-					double frequency = swarmFrequencyValue( block );
-					MVector phase( 0.0, 0.0, swarmPhaseValue(block) );
-
-					for(i = fieldPosCount; --i>=0; )
+					for(int i = fieldPosCount; --i >= 0;)
 					{
-						MVector difference = receptorPoint - posArray[i];
-						difference = (difference + phase) * frequency;
-
-						double *noiseEffect = &difference.x;
-						if( (noiseEffect[0] < -2147483647.0) ||
-							(noiseEffect[0] >  2147483647.0) ||
-							(noiseEffect[1] < -2147483647.0) ||
-							(noiseEffect[1] >  2147483647.0) ||
-							(noiseEffect[2] < -2147483647.0) ||
-							(noiseEffect[2] >  2147483647.0) )
-							continue;
-
-						double noiseOut[4];
-						noiseFunction( noiseEffect, noiseOut );
-						MVector swarmForce( noiseOut[0] * swarmAmp,
-											noiseOut[1] * swarmAmp,
-											noiseOut[2] * swarmAmp );
-						forceV += swarmForce;
+						MVector swarm;
+						if( swarmForce( params, receptorPoint - posArray[i], swarm ) )
+							forceV += swarm;
 					}
 				}
-				outputForce.append( forceV );
 			}
+			outputForce[ptIndex] = forceV;
 		}
-	}
+	});
 }
 
 
-void torusField::applyMaxDist
+void torusField::computeMaxDist
 	(
-		MDataBlock& block,				// get field param from this block
+		const torusFieldParams &params,
 		const MVectorArray &points,		// current position of Object
 		const MVectorArray &velocities,	// current velocity of Object
-		const MDoubleArray &/*masses*/,		// mass of Object
+		const MVectorArray &posArray,	// owner positions
 		MVectorArray &outputForce		// output force
 	)
 //
 //	Descriptions:
-//		Compute output force in the case that the useMaxDistance is set.
+//		With a max distance only the owners within it contribute, so
+//		each receptor only visits the grid cells around it.
 //
 {
-	// points and velocities should have the same length. If not return.
-	//
-	if( points.length() != velocities.length() )
-		return;
-
-	// clear the output force array.
-	//
-	outputForce.clear();
-
-	// get field parameters.
-	//
-	double magValue = magnitudeValue( block );
-	double attenValue = attenuationValue( block );
-	double maxDist = maxDistanceValue( block );
-	double minDist = minDistanceValue( block );
-	double attractDist = attractDistanceValue( block );
-	double repelDist = repelDistanceValue( block );
-	double dragMag = dragValue( block );
-	double swarmAmp = swarmAmplitudeValue( block );
-
-	// get owner's data. posArray may have only one point which is the centroid
-	// (if this has owner) or field position(if without owner). Or it may have
-	// a list of points if with owner and applyPerVertex.
-	//
-	MVectorArray posArray;
-	posArray.clear();
-	ownerPosition( block, posArray );
+	double magValue = params.magnitude;
+	double attenValue = params.attenuation;
+	double maxDist = params.maxDistance;
+	double minDist = params.minDistance;
+	double attractDist = params.attractDistance;
+	double repelDist = params.repelDistance;
+	double dragMag = params.drag;
+	double swarmAmp = params.swarmAmplitude;
 
 	int fieldPosCount = posArray.length();
 	int receptorSize = points.length();
 
-	if (attenValue > 0.0)
+	outputForce.setLength( receptorSize );
+
+	torusFieldGrid grid;
+	if( maxDist >= 0.0 )
+		grid.build( posArray, maxDist );
+
+	tbb::parallel_for( tbb::blocked_range<int>( 0, receptorSize, 256 ),
+		[&]( const tbb::blocked_range<int> &range )
 	{
-		// Max distance applies and so does attenuation.
-		//
-		for (int ptIndex = 0; ptIndex < receptorSize; ptIndex ++ )
+		for( int ptIndex = range.begin(); ptIndex != range.end(); ptIndex ++ )
 		{
 			const MVector &receptorPoint = points[ptIndex];
 
-			// Apply from every field position to every receptor position.
+			// Apply from every field position within max distance.
 			//
-			MVector forceV(0,0,0);
 			MVector sumForceV(0,0,0);
-			for(int i = fieldPosCount; --i>=0; )
+			grid.forEachNear( receptorPoint, maxDist, [&]( unsigned int i )
 			{
 				MVector difference = receptorPoint-posArray[i];
 				double distance  = difference.length();
-				if (distance <= maxDist && distance >= minDist )
+				if (distance < minDist || distance > maxDist) return;
+
+				MVector forceV(0,0,0);
+				if (attenValue > 0.0)
 				{
+					// Max distance applies and so does attenuation.
+					//
 					double force = magValue *
 									(pow((1.0-(distance/maxDist)),attenValue));
 					forceV = difference * force;
-
-					// Apply drag and swarm if the object is inside
-					// the zone the repulsion-attraction is pushing the
-					// object to, and if they are set.
-					//
-					if ( distance >= repelDist && distance <= attractDist)
-					{
-						if (fieldPosCount > 0 && dragMag > 0)
-						{
-							MVector dragForceV;
-							dragForceV = velocities[ptIndex] *
-											(-dragMag) * fieldPosCount;
-							forceV += dragForceV;
-						}
-
-						// Add swarm if swarm aplitude is set.
-						//
-						if (swarmAmp > 0)
-						{
-							double frequency = swarmFrequencyValue( block );
-							MVector phase( 0.0, 0.0, swarmPhaseValue(block) );
-
-							difference = receptorPoint - posArray[i];
-							difference = (difference + phase) * frequency;
-							double *noiseEffect = &difference.x;
-							if( (noiseEffect[0] < -2147483647.0) ||
-								(noiseEffect[0] >  2147483647.0) ||
-								(noiseEffect[1] < -2147483647.0) ||
-								(noiseEffect[1] >  2147483647.0) ||
-								(noiseEffect[2] < -2147483647.0) ||
-								(noiseEffect[2] >  2147483647.0) )
-								continue;
-
-							double noiseOut[4];
-							noiseFunction( noiseEffect, noiseOut );
-							MVector swarmForce( noiseOut[0] * swarmAmp,
-												noiseOut[1] * swarmAmp,
-												noiseOut[2] * swarmAmp );
-							forceV += swarmForce;
-						}
-					}
 				}
-				if (maxDist > 0.0) forceV *= falloffCurve(distance/maxDist);
-				sumForceV += forceV;					
-			}
-			outputForce.append( sumForceV );
-		}
-	}
-	else
-	{
-		// Max dist applies, but not attenuation.
-		//
-		for (int ptIndex = 0; ptIndex < receptorSize; ptIndex ++ )
-		{
-			const MVector & receptorPoint = points[ptIndex];
-
-			// Apply from every field position to every receptor position.
-			//
-			MVector forceV(0,0,0);
-			MVector sumForceV(0,0,0);
-			int i;
-			for(i = fieldPosCount; --i>=0; )
-			{
-				MVector difference = (receptorPoint-posArray[i]);
-				double distance = difference.length();
-				if (distance < minDist || distance > maxDist) continue;
-
-				if (distance <= repelDist)
+				else if (distance <= repelDist)
 					forceV = difference * magValue;
 				else if (distance >= attractDist)
 					forceV = -difference * magValue;
@@ -615,11 +541,11 @@ void torusField::applyMaxDist
 				//
 				if ( distance >= repelDist && distance <= attractDist)
 				{
-					if (fieldPosCount > 0 && dragMag > 0)
+					if (dragMag > 0)
 					{
 						MVector dragForceV;
 						dragForceV = velocities[ptIndex] *
-											(-dragMag) * fieldPosCount;
+										(-dragMag) * fieldPosCount;
 						forceV += dragForceV;
 					}
 
@@ -627,38 +553,70 @@ void torusField::applyMaxDist
 					//
 					if (swarmAmp > 0)
 					{
-						double frequency = swarmFrequencyValue( block );
-						MVector phase( 0.0, 0.0, swarmPhaseValue(block) );
-
-						for(i = fieldPosCount; --i >= 0;)
-						{
-							difference = receptorPoint - posArray[i];
-							difference = (difference + phase) * frequency;
-							double *noiseEffect = &difference.x;
-							if( (noiseEffect[0] < -2147483647.0) ||
-								(noiseEffect[0] >  2147483647.0) ||
-								(noiseEffect[1] < -2147483647.0) ||
-								(noiseEffect[1] >  2147483647.0) ||
-								(noiseEffect[2] < -2147483647.0) ||
-								(noiseEffect[2] >  2147483647.0) )
-								continue;
-
-							double noiseOut[4];
-							noiseFunction( noiseEffect, noiseOut );
-							MVector swarmForce( noiseOut[0] * swarmAmp,
-												noiseOut[1] * swarmAmp,
-												noiseOut[2] * swarmAmp );
-
-							forceV += swarmForce;
-						}
+						MVector swarm;
+						if( swarmForce( params, difference, swarm ) )
+							forceV += swarm;
 					}
 				}
-				if (maxDist > 0.0) forceV *= falloffCurve(distance/maxDist);
+				if (maxDist > 0.0) forceV *= falloffValue( params, distance/maxDist );
 				sumForceV += forceV;
-			}
-			outputForce.append( sumForceV );
+			});
+			outputForce[ptIndex] = sumForceV;
 		}
-	}
+	});
+}
+
+
+bool torusField::swarmForce
+	(
+		const torusFieldParams &params,
+		const MVector &difference,		// receptor position relative to owner
+		MVector &force
+	)
+//
+//	Descriptions:
+//		Noise force of one owner on a receptor. Returns false when the
+//		noise lookup is out of range.
+//
+{
+	MVector noiseInput = (difference + params.swarmPhase) * params.swarmFrequency;
+
+	double *noiseEffect = &noiseInput.x;
+	if( (noiseEffect[0] < -2147483647.0) ||
+		(noiseEffect[0] >  2147483647.0) ||
+		(noiseEffect[1] < -2147483647.0) ||
+		(noiseEffect[1] >  2147483647.0) ||
+		(noiseEffect[2] < -2147483647.0) ||
+		(noiseEffect[2] >  2147483647.0) )
+		return false;
+
+	double noiseOut[4];
+	noiseFunction( noiseEffect, noiseOut );
+	force = MVector( noiseOut[0] * params.swarmAmplitude,
+					 noiseOut[1] * params.swarmAmplitude,
+					 noiseOut[2] * params.swarmAmplitude );
+	return true;
+}
+
+
+double torusField::falloffValue( const torusFieldParams &params, double param )
+//
+//	Descriptions:
+//		Look up the sampled falloff curve.
+//
+{
+	if( params.falloff == NULL )
+		return( 1.0 );
+
+	double x = param * kFalloffSamples;
+	if( !(x > 0.0) )
+		return( params.falloff[0] );
+	if( x >= kFalloffSamples )
+		return( params.falloff[kFalloffSamples] );
+
+	int i = (int)x;
+	double t = x - i;
+	return( params.falloff[i] * (1.0 - t) + params.falloff[i + 1] * t );
 }
 
 
@@ -898,8 +856,14 @@ MStatus torusField::iconBitmap(GLubyte* bitmap)
 #define rand3c(x,y,z)	frand(89*(x)+97*(y)+101*(z))
 #define rand3d(x,y,z)	frand(103*(x)+107*(y)+109*(z))
 
-int		xlim[3][2];		// integer bound for point
-double	xarg[3];		// fractional part
+// lattice cell and position of a noise lookup. It lives on the caller's
+// stack so that receptors can be evaluated in parallel.
+//
+struct noiseLattice
+{
+	int		xlim[3][2];		// integer bound for point
+	double	xarg[3];		// fractional part
+};
 
 double frand( int s )   // get random number from seed
 {
@@ -918,8 +882,9 @@ double hermite( double p0, double p1, double r0, double r1, double t )
 	return(p0*(_2t3-_3t2+1) + p1*(-_2t3+_3t2) + r0*(t3-2.*t2+t) + r1*(t3-t2));
 }
 
-void interpolate( double f[4], int i, int n )
+void interpolate( const noiseLattice &lattice, double f[4], int i, int n )
 //
+//	lattice	point being looked up
 //	f[] returned tangent and value *
 //	i   location ?
 //	n   order
@@ -927,6 +892,9 @@ void interpolate( double f[4], int i, int n )
 {
 	double f0[4], f1[4] ;  //results for first and second halves
 
+	const int (&xlim)[3][2] = lattice.xlim;
+	const double (&xarg)[3] = lattice.xarg;
+
 	if( n == 0 )	// at 0, return lattice value
 	{
 		f[0] = rand3a( xlim[0][i&1], xlim[1][i>>1&1], xlim[2][i>>2] );
@@ -937,8 +905,8 @@ void interpolate( double f[4], int i, int n )
 	}
 
 	n--;
-	interpolate( f0, i, n );		// compute first half
-	interpolate( f1, i| 1<<n, n );	// compute second half
+	interpolate( lattice, f0, i, n );		// compute first half
+	interpolate( lattice, f1, i| 1<<n, n );	// compute second half
 
 	// use linear interpolation for slopes
 	//
@@ -957,6 +925,10 @@ void torusField::noiseFunction( double *inNoise, double *out )
 //		A noise function.
 //
 {
+	noiseLattice lattice;
+	int (&xlim)[3][2] = lattice.xlim;
+	double (&xarg)[3] = lattice.xarg;
+
 	xlim[0][0] = (int)floor( inNoise[0] );
 	xlim[0][1] = xlim[0][0] + 1;
 	xlim[1][0] = (int)floor( inNoise[1] );
@@ -968,7 +940,7 @@ void torusField::noiseFunction( double *inNoise, double *out )
 	xarg[1] = inNoise[1] - xlim[1][0];
 	xarg[2] = inNoise[2] - xlim[2][0];
 
-	interpolate( out, 0, 3 ) ;
+	interpolate( lattice, out, 0, 3 ) ;
 }
 
 #define TORUS_PI 3.14159265
@@ -1008,6 +980,187 @@ void torusField::draw( M3dView& view, const MDagPath& path, M3dView::DisplayStyl
 }
 
 
+//
+//	Benchmark
+//
+
+static void bruteForceNoMaxDist( const torusFieldParams &params,
+								 const MVectorArray &points,
+								 const MVectorArray &posArray,
+								 MVectorArray &outputForce )
+//
+//	Descriptions:
+//		The attract-repel force without drag or swarm, every receptor
+//		against every owner.
+//
+{
+	outputForce.setLength( points.length() );
+	for( unsigned int ptIndex = 0; ptIndex < points.length(); ptIndex ++ )
+	{
+		MVector forceV(0.0,0.0,0.0);
+		for( int i = posArray.length(); --i>=0; )
+		{
+			MVector difference = (points[ptIndex]-posArray[i]);
+			double distance = difference.length();
+			if (distance < params.minDistance) continue;
+
+			if (distance <= params.repelDistance)
+				forceV += difference * params.magnitude;
+			else if (distance >= params.attractDistance)
+				forceV += -difference * params.magnitude;
+		}
+		outputForce[ptIndex] = forceV;
+	}
+}
+
+static void bruteForceMaxDist( const torusFieldParams &params,
+							   const MVectorArray &points,
+							   const MVectorArray &posArray,
+							   MVectorArray &outputForce )
+{
+	outputForce.setLength( points.length() );
+	for( unsigned int ptIndex = 0; ptIndex < points.length(); ptIndex ++ )
+	{
+		MVector forceV(0.0,0.0,0.0);
+		for( int i = posArray.length(); --i>=0; )
+		{
+			MVector difference = (points[ptIndex]-posArray[i]);
+			double distance = difference.length();
+			if (distance < params.minDistance || distance > params.maxDistance) continue;
+
+			if (distance <= params.repelDistance)
+				forceV += difference * params.magnitude;
+			else if (distance >= params.attractDistance)
+				forceV += -difference * params.magnitude;
+		}
+		outputForce[ptIndex] = forceV;
+	}
+}
+
+static double maxDifference( const MVectorArray &a, const MVectorArray &b )
+{
+	double result = 0.0;
+	for( unsigned int i = 0; i < a.length() && i < b.length(); i ++ )
+	{
+		double d = (a[i] - b[i]).length() / (b[i].length() + 1.0);
+		if( d > result ) result = d;
+	}
+	return( result );
+}
+
+void *torusFieldBenchmark::creator()
+{
+	return new torusFieldBenchmark;
+}
+
+MStatus torusFieldBenchmark::doIt( const MArgList& args )
+//
+//	Descriptions:
+//		torusFieldBenchmark [-particles n]... [-bruteForceLimit n]
+//
+//		Runs both force loops with as many owners as receptors for
+//		every -particles count, which defaults to 1000, 10000 and
+//		100000. Owners and receptors are spread at the same density
+//		whatever their count. The plain loop is only timed up to
+//		-bruteForceLimit particles.
+//
+{
+	std::vector<int> counts;
+	int bruteForceLimit = 20000;
+	for( unsigned int i = 0; i + 1 < args.length(); i += 2 )
+	{
+		MString flag = args.asString( i );
+		if( flag == "-particles" || flag == "-p" )
+			counts.push_back( args.asInt( i + 1 ) );
+		else if( flag == "-bruteForceLimit" || flag == "-bf" )
+			bruteForceLimit = args.asInt( i + 1 );
+	}
+	if( counts.empty() )
+	{
+		counts.push_back( 1000 );
+		counts.push_back( 10000 );
+		counts.push_back( 100000 );
+	}
+
+	torusFieldParams params;
+	params.magnitude = 1.0;
+	params.attenuation = 0.0;
+	params.maxDistance = 1.0;
+	params.minDistance = 0.0;
+	params.attractDistance = 0.75;
+	params.repelDistance = 0.5;
+	params.drag = 0.0;
+	params.swarmAmplitude = 0.0;
+	params.swarmFrequency = 0.0;
+	params.swarmPhase = MVector( 0.0, 0.0, 0.0 );
+	params.falloff = NULL;
+
+	for( size_t c = 0; c < counts.size(); c ++ )
+	{
+		int count = counts[c];
+		if( count < 1 )
+		{
+			displayError( "torusFieldBenchmark: -particles must be positive." );
+			return MS::kInvalidParameter;
+		}
+
+		// about eight particles per unit cube.
+		//
+		double side = 0.5 * cbrt( (double)count );
+		std::mt19937 generator( 1234 );
+		std::uniform_real_distribution<double> coord( 0.0, side );
+		MVectorArray points( count ), velocities( count ), posArray( count );
+		for( int i = 0; i < count; i ++ )
+		{
+			points[i] = MVector( coord( generator ), coord( generator ), coord( generator ) );
+			velocities[i] = MVector( 0.0, 0.0, 0.0 );
+			posArray[i] = MVector( coord( generator ), coord( generator ), coord( generator ) );
+		}
+
+		MTimer timer;
+		MVectorArray noMaxForce, maxForce;
+		timer.beginTimer();
+		torusField::computeNoMaxDist( params, points, velocities, posArray, noMaxForce );
+		timer.endTimer();
+		double noMaxTime = timer.elapsedTime();
+
+		timer.beginTimer();
+		torusField::computeMaxDist( params, points, velocities, posArray, maxForce );
+		timer.endTimer();
+		double maxTime = timer.elapsedTime();
+
+		MString msg;
+		msg.format( "torusFieldBenchmark: ^1s particles, grid ^2s s without max distance, ^3s s with max distance",
+			MString() + count, MString() + noMaxTime, MString() + maxTime );
+		MGlobal::displayInfo( msg );
+		appendToResult( noMaxTime );
+		appendToResult( maxTime );
+
+		if( count > bruteForceLimit )
+			continue;
+
+		MVectorArray noMaxReference, maxReference;
+		timer.beginTimer();
+		bruteForceNoMaxDist( params, points, posArray, noMaxReference );
+		timer.endTimer();
+		double noMaxBruteTime = timer.elapsedTime();
+
+		timer.beginTimer();
+		bruteForceMaxDist( params, points, posArray, maxReference );
+		timer.endTimer();
+		double maxBruteTime = timer.elapsedTime();
+
+		msg.format( "torusFieldBenchmark: ^1s particles, all pairs ^2s s without max distance, ^3s s with max distance, largest relative difference ^4s",
+			MString() + count, MString() + noMaxBruteTime, MString() + maxBruteTime,
+			MString() + std::max( maxDifference( noMaxForce, noMaxReference ),
+								   maxDifference( maxForce, maxReference ) ) );
+		MGlobal::displayInfo( msg );
+	}
+
+	return MS::kSuccess;
+}
+
+
 MStatus initializePlugin(MObject obj)
 {
 	MStatus status;
@@ -1021,6 +1174,12 @@ MStatus initializePlugin(MObject obj)
 		return status;
 	}
 
+	status = plugin.registerCommand( "torusFieldBenchmark", torusFieldBenchmark::creator );
+	if (!status) {
+		cerr << "Failed to register command : torusFieldBenchmark\n";
+		return status;
+	}
+
 	return status;
 }
 
@@ -1029,6 +1188,12 @@ MStatus uninitializePlugin(MObject obj)
 	MStatus status;
 	MFnPlugin plugin(obj);
 
+	status = plugin.deregisterCommand( "torusFieldBenchmark" );
+	if (!status) {
+		cerr << "Failed to deregister command : torusFieldBenchmark\n";
+		return status;
+	}
+
 	status = plugin.deregisterNode( torusField::id );
 	if (!status) {
 		status.perror("deregisterNode");
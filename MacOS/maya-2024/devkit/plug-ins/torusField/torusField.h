@@ -25,9 +25,14 @@
 #include <maya/MDataBlock.h>
 #include <maya/MFnPlugin.h>
 #include <maya/MPxFieldNode.h>
+#include <maya/MPxCommand.h>
+#include <maya/MVectorArray.h>
+#include <maya/MDoubleArray.h>
 
 #include <maya/MGL.h>
 
+#include <vector>
+
 #define McheckErr(stat, msg)		\
 	if ( MS::kSuccess != stat )		\
 	{								\
@@ -35,6 +40,28 @@
 		return MS::kFailure;		\
 	}
 
+// field parameters read from the data block, so that the force loops
+// can run without touching it.
+//
+struct torusFieldParams
+{
+	double	magnitude;
+	double	attenuation;
+	double	maxDistance;
+	double	minDistance;
+	double	attractDistance;
+	double	repelDistance;
+	double	drag;
+	double	swarmAmplitude;
+	double	swarmFrequency;
+	MVector	swarmPhase;
+
+	// falloff curve sampled at kFalloffSamples+1 evenly spaced
+	// parameters over [0,1], NULL when the curve is constant one.
+	//
+	const double	*falloff;
+};
+
 class torusField: public MPxFieldNode
 {
 public:
@@ -101,6 +128,26 @@ public:
 	//
 	static MTypeId	id;
 
+	// number of intervals the falloff curve is sampled at.
+	//
+	static const int	kFalloffSamples = 1024;
+
+	// output force of the owner positions on the receptors. Owners are
+	// looked up through a torusFieldGrid and receptors are evaluated in
+	// parallel.
+	//
+	static void	computeNoMaxDist( const torusFieldParams &params,
+								  const MVectorArray &points,
+								  const MVectorArray &velocities,
+								  const MVectorArray &posArray,
+								  MVectorArray &outputForce );
+
+	static void	computeMaxDist( const torusFieldParams &params,
+								const MVectorArray &points,
+								const MVectorArray &velocities,
+								const MVectorArray &posArray,
+								MVectorArray &outputForce );
+
 private:
 
 	// methods to compute output force.
@@ -120,7 +167,13 @@ private:
 	void	ownerPosition( MDataBlock& block, MVectorArray &vArray );
 	MStatus	getWorldPosition( MVector &vector );
 	MStatus	getWorldPosition( MDataBlock& block, MVector &vector );
-	void	noiseFunction( double *inputNoise, double *out );
+	void	getParams( MDataBlock& block, torusFieldParams &params,
+					   std::vector<double> &falloffTable );
+
+	static void	noiseFunction( double *inputNoise, double *out );
+	static bool	swarmForce( const torusFieldParams &params,
+							const MVector &difference, MVector &force );
+	static double	falloffValue( const torusFieldParams &params, double param );
 
 	// methods to get attribute value.
 	//
@@ -319,3 +372,12 @@ inline MStatus torusField::ownerCentroidValue(MDataBlock& block,MVector &vector)
 	return( status );
 }
 
+// times the field's force loops on random particles against a plain
+// receptors x owners loop.
+//
+class torusFieldBenchmark : public MPxCommand
+{
+public:
+	MStatus		doIt( const MArgList& args ) override;
+	static void	*creator();
+};
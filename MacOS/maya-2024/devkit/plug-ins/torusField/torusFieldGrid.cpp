@@ -0,0 +1,66 @@
+//-
+// ==========================================================================
+// Copyright 2015 Autodesk, Inc.  All rights reserved.
+//
+// Use of this software is subject to the terms of the Autodesk
+// license agreement provided at the time of installation or download,
+// or which otherwise accompanies this software in either electronic
+// or hard copy form.
+// ==========================================================================
+//+
+
+#include "torusFieldGrid.h"
+
+torusFieldGrid::torusFieldGrid()
+:	fInvCellSize( 0.0 )
+,	fSingleCell( true )
+,	fNumPoints( 0 )
+,	fMask( 0 )
+{
+}
+
+void torusFieldGrid::build( const MVectorArray &points, double cellSize )
+//
+//	Descriptions:
+//		Counting sort of the points into hashed cells.
+//
+{
+	fNumPoints = points.length();
+	fCells.clear();
+	fBucketStart.clear();
+	fEntries.clear();
+
+	fInvCellSize = ( cellSize > 0.0 ) ? 1.0 / cellSize : 0.0;
+	fSingleCell = !( fInvCellSize > 0.0 && fInvCellSize < HUGE_VAL );
+	if( fSingleCell || fNumPoints == 0 )
+		return;
+
+	// about two buckets per point keeps the chains short.
+	//
+	unsigned int numBuckets = 1;
+	while( numBuckets < 2 * fNumPoints && numBuckets < 0x40000000u )
+		numBuckets <<= 1;
+	fMask = numBuckets - 1;
+
+	fCells.resize( 3 * fNumPoints );
+	std::vector<unsigned int> buckets( fNumPoints );
+	fBucketStart.assign( numBuckets + 1, 0 );
+	for( unsigned int i = 0; i < fNumPoints; i ++ )
+	{
+		const MVector &point = points[i];
+		int *cell = &fCells[3 * i];
+		cell[0] = cellCoord( point.x );
+		cell[1] = cellCoord( point.y );
+		cell[2] = cellCoord( point.z );
+		buckets[i] = hashCell( cell[0], cell[1], cell[2] ) & fMask;
+		fBucketStart[buckets[i] + 1] ++;
+	}
+
+	for( unsigned int b = 0; b < numBuckets; b ++ )
+		fBucketStart[b + 1] += fBucketStart[b];
+
+	std::vector<unsigned int> next( fBucketStart.begin(), fBucketStart.end() - 1 );
+	fEntries.resize( fNumPoints );
+	for( unsigned int i = 0; i < fNumPoints; i ++ )
+		fEntries[next[buckets[i]] ++] = i;
+}
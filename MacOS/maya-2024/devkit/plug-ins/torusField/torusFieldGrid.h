@@ -0,0 +1,143 @@
+//-
+// ==========================================================================
+// Copyright 2015 Autodesk, Inc.  All rights reserved.
+//
+// Use of this software is subject to the terms of the Autodesk
+// license agreement provided at the time of installation or download,
+// or which otherwise accompanies this software in either electronic
+// or hard copy form.
+// ==========================================================================
+//+
+
+//  Description
+//	A uniform grid over the owner positions of a torusField, hashed so
+//	that only occupied cells cost memory. It is rebuilt on every compute
+//	and lets each receptor visit the owners around it instead of all of
+//	them.
+//
+
+#ifndef _torusFieldGrid
+#define _torusFieldGrid
+
+#include <maya/MVector.h>
+#include <maya/MVectorArray.h>
+
+#include <math.h>
+#include <vector>
+
+class torusFieldGrid
+{
+public:
+	torusFieldGrid();
+
+	// bucket the points into cubic cells of the given size. A size
+	// that is not positive puts every point in the same cell, queries
+	// then visit all of them.
+	//
+	void	build( const MVectorArray &points, double cellSize );
+
+	// call visit( index ) for every point in the cells overlapped by
+	// the sphere of the given radius around center. Each point is
+	// visited at most once, but points outside the sphere may be
+	// visited too so callers still have to test the distance.
+	//
+	template<class Visitor>
+	void	forEachNear( const MVector &center, double radius,
+						 Visitor visit ) const;
+
+	unsigned int	length() const { return fNumPoints; }
+
+private:
+	int				cellCoord( double value ) const;
+	static unsigned int	hashCell( int x, int y, int z );
+
+	double			fInvCellSize;
+	bool			fSingleCell;
+	unsigned int	fNumPoints;
+	unsigned int	fMask;
+
+	// cell of every point, three ints per point.
+	//
+	std::vector<int>			fCells;
+
+	// points sorted by bucket, fBucketStart[b] is the first entry of
+	// bucket b and fBucketStart[b+1] one past its last.
+	//
+	std::vector<unsigned int>	fBucketStart;
+	std::vector<unsigned int>	fEntries;
+};
+
+inline int torusFieldGrid::cellCoord( double value ) const
+{
+	// clamp so that far away points still land in a valid cell, they
+	// share it with their neighbours and are filtered on distance.
+	//
+	const double limit = 1073741823.0;
+	double cell = floor( value * fInvCellSize );
+	if( !(cell > -limit) )
+		cell = -limit;
+	else if( cell > limit )
+		cell = limit;
+	return( (int)cell );
+}
+
+inline unsigned int torusFieldGrid::hashCell( int x, int y, int z )
+{
+	return( ((unsigned int)x * 73856093u) ^
+			((unsigned int)y * 19349663u) ^
+			((unsigned int)z * 83492791u) );
+}
+
+template<class Visitor>
+void torusFieldGrid::forEachNear( const MVector &center, double radius,
+								  Visitor visit ) const
+{
+	if( fNumPoints == 0 )
+		return;
+
+	int lo[3], hi[3];
+	double numCells = 1.0;
+	if( !fSingleCell && radius >= 0.0 )
+	{
+		for( int axis = 0; axis < 3; axis ++ )
+		{
+			lo[axis] = cellCoord( center[axis] - radius );
+			hi[axis] = cellCoord( center[axis] + radius );
+			numCells *= (double)hi[axis] - (double)lo[axis] + 1.0;
+		}
+	}
+
+	// a query covering more cells than there are points is cheaper
+	// as a plain scan.
+	//
+	if( fSingleCell || !(radius >= 0.0) || numCells > (double)fNumPoints )
+	{
+		for( unsigned int i = 0; i < fNumPoints; i ++ )
+			visit( i );
+		return;
+	}
+
+	for( int z = lo[2]; z <= hi[2]; z ++ )
+	{
+		for( int y = lo[1]; y <= hi[1]; y ++ )
+		{
+			for( int x = lo[0]; x <= hi[0]; x ++ )
+			{
+				unsigned int bucket = hashCell( x, y, z ) & fMask;
+				unsigned int end = fBucketStart[bucket + 1];
+				for( unsigned int e = fBucketStart[bucket]; e < end; e ++ )
+				{
+					// other cells can hash to the same bucket, only
+					// take the points that really are in this one.
+					//
+					unsigned int i = fEntries[e];
+					const int *cell = &fCells[3 * i];
+					if( cell[0] == x && cell[1] == y && cell[2] == z )
+						visit( i );
+				}
+			}
+		}
+	}
+}
+
+#endif
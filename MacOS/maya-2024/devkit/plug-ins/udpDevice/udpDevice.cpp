@@ -17,6 +17,13 @@
 // run the Python code and enter 3 numbers to update the
 // cube's translate. 
 //
+// Packets are received in batches and queued with their arrival time.
+// Every DG pull takes the most recent one and skips the others, so the
+// node keeps up with senders much faster than the refresh rate. The
+// receivedCount, droppedCount, coalescedCount and latency outputs show
+// how the stream is doing. The second Python script sends a stream at
+// 1 kHz over the loopback interface to try it locally.
+//
 
 /*
 
@@ -38,9 +45,22 @@ while True:
 		break
 clientSocket.close()
 
+# Python: loopback stream at 1 kHz, set serverName to 127.0.0.1 first
+import math, socket, time
+clientSocket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+start = time.time()
+while True:
+	t = time.time() - start
+	data = "%f %f %f" % (math.sin(t), math.cos(t), math.sin(3.0 * t))
+	clientSocket.sendto(data.encode(), ("127.0.0.1",7555))
+	time.sleep(0.001)
+
 */
 
 #ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -50,8 +70,13 @@ clientSocket.close()
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/select.h>
+#include <sys/uio.h>
 #endif
 
+#include <atomic>
+#include <chrono>
+
 #include <maya/MFnPlugin.h>
 #include <maya/MTypeId.h>
 
@@ -65,6 +90,86 @@ clientSocket.close()
 #include <maya/MFnNumericAttribute.h>
 #include <maya/MPxClientDeviceNode.h>
 
+// A translate received from the server and the time it arrived.
+struct udpSample
+{
+	double									translate[3];
+	std::chrono::steady_clock::time_point	received;
+};
+
+// Single producer, single consumer queue of samples. The device thread
+// pushes and compute() pops, neither of them locks or allocates. When
+// it is full push() fails and the sample goes to a udpLatestSample.
+class udpSampleRing
+{
+public:
+	static const unsigned int kCapacity = 4096;	// power of two
+
+				udpSampleRing() : fHead( 0 ), fTail( 0 ) {}
+
+	bool		push( const udpSample& sample )
+	{
+		unsigned int head = fHead.load( std::memory_order_relaxed );
+		if ( head - fTail.load( std::memory_order_acquire ) == kCapacity )
+			return false;
+		fSamples[head & (kCapacity - 1)] = sample;
+		fHead.store( head + 1, std::memory_order_release );
+		return true;
+	}
+
+	bool		pop( udpSample& sample )
+	{
+		unsigned int tail = fTail.load( std::memory_order_relaxed );
+		if ( tail == fHead.load( std::memory_order_acquire ) )
+			return false;
+		sample = fSamples[tail & (kCapacity - 1)];
+		fTail.store( tail + 1, std::memory_order_release );
+		return true;
+	}
+
+private:
+	udpSample					fSamples[kCapacity];
+	std::atomic<unsigned int>	fHead;
+	std::atomic<unsigned int>	fTail;
+};
+
+// Single producer, single consumer slot that always holds the newest
+// sample published to it. It is a triple buffer: the producer fills its
+// back slot and swaps it with the middle one, the consumer swaps the
+// middle slot with its front one when it holds something new.
+class udpLatestSample
+{
+public:
+				udpLatestSample() : fBack( 0 ), fMiddle( 1 ), fFront( 2 ) {}
+
+	// returns true when it replaced a sample that was never taken
+	bool		publish( const udpSample& sample )
+	{
+		fSlots[fBack] = sample;
+		unsigned int middle = fMiddle.exchange( fBack | kFresh, std::memory_order_acq_rel );
+		fBack = middle & ~kFresh;
+		return ( middle & kFresh ) != 0;
+	}
+
+	bool		take( udpSample& sample )
+	{
+		if ( ( fMiddle.load( std::memory_order_relaxed ) & kFresh ) == 0 )
+			return false;
+		unsigned int middle = fMiddle.exchange( fFront, std::memory_order_acq_rel );
+		fFront = middle & ~kFresh;
+		sample = fSlots[fFront];
+		return true;
+	}
+
+private:
+	static const unsigned int kFresh = 4;
+
+	udpSample					fSlots[3];
+	unsigned int				fBack;		// producer only
+	std::atomic<unsigned int>	fMiddle;
+	unsigned int				fFront;		// consumer only
+};
+
 class udpDeviceNode : public MPxClientDeviceNode
 {
 
@@ -87,9 +192,32 @@ public:
 	static MObject		outputTranslateY;
 	static MObject 		outputTranslateZ;
 
+	// stream statistics
+	static MObject		receivedCount;
+	static MObject		droppedCount;
+	static MObject		coalescedCount;
+	static MObject		latency;
+
 	static MTypeId		id;
 
 private:
+	void				pushSample( const char* text );
+	void				wakeCompute();
+	void				setStatistics( MDataBlock& block );
+
+	udpSampleRing		fSamples;
+	// newest sample that did not fit in fSamples
+	udpLatestSample		fOverflow;
+
+	// set while a wake up is queued with pushThreadData() and not yet
+	// taken by compute(), so that a burst of packets costs one DG pull
+	std::atomic<bool>	fWakePending;
+
+	std::atomic<int>	fReceived;
+	std::atomic<int>	fDropped;
+	std::atomic<int>	fKernelDropped;
+	int					fCoalesced;
+	double				fLatency;
 };
 
 MTypeId udpDeviceNode::id( 0x00081052 );
@@ -97,8 +225,18 @@ MObject udpDeviceNode::outputTranslate;
 MObject udpDeviceNode::outputTranslateX;
 MObject udpDeviceNode::outputTranslateY;
 MObject udpDeviceNode::outputTranslateZ;
+MObject udpDeviceNode::receivedCount;
+MObject udpDeviceNode::droppedCount;
+MObject udpDeviceNode::coalescedCount;
+MObject udpDeviceNode::latency;
 
 udpDeviceNode::udpDeviceNode() 
+	: fWakePending( false )
+	, fReceived( 0 )
+	, fDropped( 0 )
+	, fKernelDropped( 0 )
+	, fCoalesced( 0 )
+	, fLatency( 0.0 )
 {}
 
 udpDeviceNode::~udpDeviceNode()
@@ -110,10 +248,64 @@ void udpDeviceNode::postConstructor()
 {
 	MObjectArray attrArray;
 	attrArray.append( udpDeviceNode::outputTranslate );
+	attrArray.append( udpDeviceNode::receivedCount );
+	attrArray.append( udpDeviceNode::droppedCount );
+	attrArray.append( udpDeviceNode::coalescedCount );
+	attrArray.append( udpDeviceNode::latency );
 	setRefreshOutputAttributes( attrArray );
 
-	// we'll be reading one character line of size 1024
-	createMemoryPools( 1, 1024, sizeof(char));
+	// the samples go through fSamples, the thread data queue only
+	// carries wake ups so its buffers hold nothing
+	createMemoryPools( 2, 1, sizeof(char));
+}
+
+void udpDeviceNode::pushSample( const char* text )
+{
+	// three numbers separated by spaces, anything else gives zeros
+	udpSample sample;
+	sample.received = std::chrono::steady_clock::now();
+	const char* cursor = text;
+	int i = 0;
+	for ( i = 0; i < 3; i++ )
+	{
+		char* end = NULL;
+		sample.translate[i] = strtod( cursor, &end );
+		if ( end == cursor )
+			break;
+		cursor = end;
+	}
+	while ( *cursor == ' ' || *cursor == '\n' || *cursor == '\r' )
+		cursor++;
+	if ( i != 3 || *cursor != '\0' )
+	{
+		sample.translate[0] = 0.0; sample.translate[1] = 0.0; sample.translate[2] = 0.0;
+	}
+
+	// when the ring is full the sample still has to reach compute(), as
+	// it is newer than everything queued. Only a sample that is replaced
+	// in fOverflow before compute() sees it is really lost.
+	fReceived++;
+	if ( ! fSamples.push( sample ) && fOverflow.publish( sample ) )
+		fDropped++;
+}
+
+void udpDeviceNode::wakeCompute()
+{
+	if ( fWakePending.exchange( true ) )
+		return;
+
+	MCharBuffer buffer;
+	if ( ! acquireDataStorage(buffer) )
+	{
+		fWakePending = false;
+		return;
+	}
+
+	beginThreadLoop();
+	{
+		pushThreadData( buffer );
+	}
+	endThreadLoop();
 }
 
 void udpDeviceNode::threadHandler( const char* serverName, const char* deviceName )
@@ -124,9 +316,7 @@ void udpDeviceNode::threadHandler( const char* serverName, const char* deviceNam
 
 #ifdef __linux__
 	int sock;
-	int bytesRead;
-	socklen_t addressLength;
-	struct sockaddr_in serverAddress , clientAddress;
+	struct sockaddr_in serverAddress;
 	
 
 	serverAddress.sin_family = AF_INET;
@@ -134,8 +324,6 @@ void udpDeviceNode::threadHandler( const char* serverName, const char* deviceNam
 	serverAddress.sin_addr.s_addr = INADDR_ANY;
 	bzero(&(serverAddress.sin_zero),8);
 
-	addressLength = sizeof(struct sockaddr);
-
 	if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) == -1) 
 	{
 		return;
@@ -144,12 +332,41 @@ void udpDeviceNode::threadHandler( const char* serverName, const char* deviceNam
 	if (bind(sock,(struct sockaddr *)&serverAddress,
 		sizeof(struct sockaddr)) == -1)
 	{
+		close( sock );
 		return;
 	}
 
-	MStatus status;
-	MCharBuffer buffer;
-	char receiveBuffer[1025];
+	// room for bursts between thread wake ups, and the count of datagrams
+	// the kernel had to drop attached to every receive
+	int receiveBufferSize = 4 * 1024 * 1024;
+	setsockopt( sock, SOL_SOCKET, SO_RCVBUF, &receiveBufferSize, sizeof(receiveBufferSize) );
+	int overflowCount = 1;
+	setsockopt( sock, SOL_SOCKET, SO_RXQ_OVFL, &overflowCount, sizeof(overflowCount) );
+
+	// only take packets from the server, compare addresses rather than strings
+	struct in_addr serverAddr;
+	bool haveServer = ( serverName != NULL && inet_pton( AF_INET, serverName, &serverAddr ) == 1 );
+
+	// everything recvmmsg() needs is set up once, packets are received
+	// straight into these buffers
+	const int kBatchSize = 64;
+	const int kPacketSize = 1024;
+	static const size_t kControlSize = CMSG_SPACE(sizeof(unsigned int));
+	char receiveBuffers[kBatchSize][kPacketSize + 1];
+	char controlBuffers[kBatchSize][kControlSize];
+	struct iovec vectors[kBatchSize];
+	struct sockaddr_in clientAddresses[kBatchSize];
+	struct mmsghdr messages[kBatchSize];
+	memset( messages, 0, sizeof(messages) );
+	int m = 0;
+	for ( m = 0; m < kBatchSize; m++ )
+	{
+		vectors[m].iov_base = receiveBuffers[m];
+		vectors[m].iov_len = kPacketSize;
+		messages[m].msg_hdr.msg_iov = &vectors[m];
+		messages[m].msg_hdr.msg_iovlen = 1;
+		messages[m].msg_hdr.msg_name = &clientAddresses[m];
+	}
 
 	while ( !isDone() )
 	{
@@ -168,50 +385,48 @@ void udpDeviceNode::threadHandler( const char* serverName, const char* deviceNam
 		if ( ! FD_ISSET( sock, &read_set ) )
 			continue;
 
-		receiveBuffer[0] = 0;
-		bytesRead = recvfrom(sock,receiveBuffer,1024,0,
-		    (struct sockaddr *)&clientAddress, &addressLength);
-		    
-		const char *receivedFromServer = inet_ntoa(clientAddress.sin_addr);
-		unsigned short receivedFromPort = ntohs(clientAddress.sin_port);
-		
-		if ( NULL == receivedFromServer )
-			continue;
-		
-		printf("(%s , %d) connection : %s \n",receivedFromServer,receivedFromPort, receiveBuffer);
-
-		// Simple test to make sure we are getting data from the right server
-		// printf("%s %s\n",serverName, receivedFromServer);
-		if ( 0 != strcmp( serverName, receivedFromServer ) )
-			continue;
+		// drain the socket a batch at a time
+		bool received = false;
+		int count = kBatchSize;
+		while ( count == kBatchSize )
+		{
+			for ( m = 0; m < kBatchSize; m++ )
+			{
+				messages[m].msg_hdr.msg_namelen = sizeof(clientAddresses[m]);
+				messages[m].msg_hdr.msg_control = controlBuffers[m];
+				messages[m].msg_hdr.msg_controllen = kControlSize;
+			}
 
-		// Get the storage once we have data from the server
-		status = acquireDataStorage(buffer);
-		if ( ! status )
-			continue;
+			count = recvmmsg( sock, messages, kBatchSize, MSG_DONTWAIT, NULL );
+			if ( count <= 0 )
+				break;
 
-		beginThreadLoop();
-		{
-			receiveBuffer[bytesRead] = '\0';
-			double* doubleData = reinterpret_cast<double*>(buffer.ptr());
-			doubleData[0] = 0.0 ; doubleData[1] = 0.0; doubleData[2] = 0.0;
-			MStringArray sa;
-			MString s( receiveBuffer );
-			if ( s.split( ' ', sa ) )
+			for ( m = 0; m < count; m++ )
 			{
-				if ( sa.length() == 3 )
+				struct msghdr& header = messages[m].msg_hdr;
+				struct cmsghdr* control = CMSG_FIRSTHDR( &header );
+				for ( ; control != NULL; control = CMSG_NXTHDR( &header, control ) )
 				{
-					int i = 0;
-					for ( i = 0; i < 3; i++ )
+					if ( control->cmsg_level == SOL_SOCKET && control->cmsg_type == SO_RXQ_OVFL )
 					{
-						doubleData[i] = ( sa[i].isDouble() ? sa[i].asDouble() : 0.0 );
+						unsigned int dropped = 0;
+						memcpy( &dropped, CMSG_DATA(control), sizeof(dropped) );
+						fKernelDropped = (int)dropped;
 					}
-				}	
+				}
+
+				// Simple test to make sure we are getting data from the right server
+				if ( ! haveServer || clientAddresses[m].sin_addr.s_addr != serverAddr.s_addr )
+					continue;
+
+				receiveBuffers[m][messages[m].msg_len] = '\0';
+				pushSample( receiveBuffers[m] );
+				received = true;
 			}
-			pushThreadData( buffer );
 		}
-		endThreadLoop();
 
+		if ( received )
+			wakeCompute();
 	}
 	
 	// Close the socket
@@ -249,42 +464,106 @@ MStatus udpDeviceNode::initialize()
 	
 	ADD_ATTRIBUTE(outputTranslate);
 
+	receivedCount = numAttr.create("receivedCount", "rcc", MFnNumericData::kInt, 0, &status);
+	MCHECKERROR(status, "create receivedCount");
+	numAttr.setWritable( false );
+	numAttr.setStorable( false );
+	ADD_ATTRIBUTE(receivedCount);
+	droppedCount = numAttr.create("droppedCount", "drc", MFnNumericData::kInt, 0, &status);
+	MCHECKERROR(status, "create droppedCount");
+	numAttr.setWritable( false );
+	numAttr.setStorable( false );
+	ADD_ATTRIBUTE(droppedCount);
+	coalescedCount = numAttr.create("coalescedCount", "coc", MFnNumericData::kInt, 0, &status);
+	MCHECKERROR(status, "create coalescedCount");
+	numAttr.setWritable( false );
+	numAttr.setStorable( false );
+	ADD_ATTRIBUTE(coalescedCount);
+	latency = numAttr.create("latency", "lat", MFnNumericData::kDouble, 0.0, &status);
+	MCHECKERROR(status, "create latency");
+	numAttr.setWritable( false );
+	numAttr.setStorable( false );
+	ADD_ATTRIBUTE(latency);
+
 	ATTRIBUTE_AFFECTS( live, outputTranslate);
 	ATTRIBUTE_AFFECTS( frameRate, outputTranslate);
 	ATTRIBUTE_AFFECTS( serverName, outputTranslate);
 	ATTRIBUTE_AFFECTS( deviceName, outputTranslate);
+	ATTRIBUTE_AFFECTS( live, receivedCount);
+	ATTRIBUTE_AFFECTS( live, droppedCount);
+	ATTRIBUTE_AFFECTS( live, coalescedCount);
+	ATTRIBUTE_AFFECTS( live, latency);
 
 	return MS::kSuccess;
 }
 
+void udpDeviceNode::setStatistics( MDataBlock& block )
+{
+	// droppedCount is the samples that never reached compute(), including
+	// the datagrams the kernel dropped before we could receive them
+	block.outputValue( receivedCount ).setInt( fReceived );
+	block.outputValue( droppedCount ).setInt( fDropped + fKernelDropped );
+	block.outputValue( coalescedCount ).setInt( fCoalesced );
+	block.outputValue( latency ).setDouble( fLatency );
+	block.setClean( receivedCount );
+	block.setClean( droppedCount );
+	block.setClean( coalescedCount );
+	block.setClean( latency );
+}
+
 MStatus udpDeviceNode::compute( const MPlug& plug, MDataBlock& block )
 {
 	MStatus status;
 	if( plug == outputTranslate || plug == outputTranslateX ||
 		plug == outputTranslateY || plug == outputTranslateZ )
 	{
+		// take the wake up first so that samples arriving while we drain
+		// queue a new one
 		MCharBuffer buffer;
 		if ( popThreadData(buffer) )
 		{
-			double* doubleData = reinterpret_cast<double*>(buffer.ptr());
-
-			MDataHandle outputTranslateHandle = block.outputValue( outputTranslate, &status );
-			MCHECKERROR(status, "Error in block.outputValue for outputTranslate");
-
-			double3& outputTranslate = outputTranslateHandle.asDouble3();
-			outputTranslate[0] = doubleData[0];
-			outputTranslate[1] = doubleData[1];
-			outputTranslate[2] = doubleData[2];
-
-			block.setClean( plug );
-
 			releaseDataStorage(buffer);
-			return ( MS::kSuccess );
+			fWakePending = false;
 		}
-		else
+
+		// only the latest sample is used, the ones before it are coalesced
+		udpSample sample;
+		int numSamples = 0;
+		while ( fSamples.pop( sample ) )
+			numSamples++;
+		// the overflow sample may be older than what the ring queued
+		// after it, keep whichever arrived last
+		udpSample overflow;
+		if ( fOverflow.take( overflow ) )
 		{
-			return MS::kFailure;
+			if ( numSamples == 0 || overflow.received > sample.received )
+				sample = overflow;
+			numSamples++;
 		}
+		if ( numSamples == 0 )
+			return MS::kFailure;
+
+		fCoalesced += numSamples - 1;
+		fLatency = std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - sample.received ).count();
+
+		MDataHandle outputTranslateHandle = block.outputValue( outputTranslate, &status );
+		MCHECKERROR(status, "Error in block.outputValue for outputTranslate");
+
+		double3& outputTranslate = outputTranslateHandle.asDouble3();
+		outputTranslate[0] = sample.translate[0];
+		outputTranslate[1] = sample.translate[1];
+		outputTranslate[2] = sample.translate[2];
+
+		block.setClean( plug );
+		setStatistics( block );
+		return ( MS::kSuccess );
+	}
+	else if ( plug == receivedCount || plug == droppedCount ||
+			  plug == coalescedCount || plug == latency )
+	{
+		setStatistics( block );
+		return ( MS::kSuccess );
 	}
 
 	return ( MS::kUnknownParameter );